@@ -21,6 +21,14 @@
 #include <tools.h>
 #include <cstdint>
 #include <vector>
+#include <string>
+#include <iosfwd>
+
+namespace cpu_stats {
+    class mark;
+    class writer;
+    class selection;
+}
 
 namespace amdgpu_stats {
 
@@ -44,13 +52,60 @@ namespace amdgpu_stats {
         std::uint64_t
         ppt(std::uint32_t no);
 
+        static
+        bool
+        has_gpu_metrics(std::uint32_t no);
+
+        // pci address of the device of the hwmon device like
+        // 0000:03:00.0, stable across reboots in contrast to no
+        static
+        std::string
+        pci_address(std::uint32_t no);
+
+    };
+
+    // reader of the binary gpu_metrics table of an amdgpu device
+    class gpu_metrics {
+        tools::file_handle _fd;
+        std::vector<char> _buf;
+    public:
+        // decoded values of the table, NaN if not available
+        struct values {
+            std::uint8_t _format_rev;
+            std::uint8_t _content_rev;
+            // driver attached time stamp in ns
+            std::uint64_t _ts_ns;
+            double _power_w;
+            // energy accumulator in units of 2^-16 J (15.259 uJ)
+            bool _has_energy;
+            std::uint64_t _energy;
+            // mask of the valid bits of _energy, the accumulator
+            // of format 1.0 has only 32 bits
+            std::uint64_t _energy_mask;
+            double _gfx_mhz;
+            double _mem_mhz;
+            double _gfx_activity;
+            double _temp_edge;
+            double _temp_hotspot;
+            double _temp_mem;
+        };
+
+        static
+        std::string path(std::uint32_t hwmon_no);
+
+        gpu_metrics(std::uint32_t hwmon_no);
+        gpu_metrics(gpu_metrics&& r) = default;
+        gpu_metrics& operator=(gpu_metrics&& r) = default;
+        // true if the table exists
+        bool valid() const;
+        // read the table with one pread and decode it, returns false
+        // if the table could not be read or has an unknown format
+        bool read(values& v);
     };
 
     class shm_seg {
-        shm_seg(std::uint32_t id);
+        shm_seg(std::uint32_t id, const std::string& pci);
         ~shm_seg();
-        static
-        std::string name(std::uint32_t id);
     public:
         // powerstep of 2.5 W's
         static
@@ -60,22 +115,63 @@ namespace amdgpu_stats {
         // until we figure out
         static
         constexpr const double max_power=350;
+        // clock step of 100 MHz
+        static
+        constexpr const double clock_step=100;
+        static
+        constexpr const double inv_clock_step=1.0/clock_step;
+        static
+        constexpr const double max_clock=4000;
+        // activity step of 5 %
+        static
+        constexpr const double activity_step=5;
+        static
+        constexpr const double inv_activity_step=1.0/activity_step;
         enum {
-            POWER_ENTRIES=uint32_t(max_power/power_step)+1
+            POWER_ENTRIES=uint32_t(max_power/power_step)+1,
+            CLOCK_ENTRIES=uint32_t(max_clock/clock_step)+1,
+            ACTIVITY_ENTRIES=uint32_t(100/activity_step)+1
         };
     private:
-        // hwmon device id
+        // hwmon device id during the lifetime of the daemon
         std::uint32_t _id;
+        // pci address of the device
+        char _pci[16];
+        // revision of the gpu_metrics table, 0 if not used
+        std::uint8_t _format_rev;
+        std::uint8_t _content_rev;
         // power read last time
         double _power;
-        // (bad) estimation of time elapsed
-        std::uint64_t _elapsed_s;
+        // micro joules since start
+        std::uint64_t _uj_lo;
+        std::uint64_t _uj_hi;
+        // CLOCK_MONOTONIC nanoseconds covered by the energy
+        std::uint64_t _elapsed_ns;
         // array with ticks/power_range
         std::uint32_t _entries[POWER_ENTRIES];
+        // values from the last gpu_metrics read, NaN if not available
+        double _gfx_mhz;
+        double _mem_mhz;
+        double _gfx_activity;
+        double _temp_edge;
+        double _temp_hotspot;
+        double _temp_mem;
+        // arrays with ticks/gfx clock, memory clock and gfx activity
+        // range from gpu_metrics
+        std::uint32_t _gfx_entries[CLOCK_ENTRIES];
+        std::uint32_t _mem_entries[CLOCK_ENTRIES];
+        std::uint32_t _activity_entries[ACTIVITY_ENTRIES];
     public:
+        // prefix of the names of the segments
+        static
+        const char* const prefix;
+
+        static
+        std::string name(const std::string& pci);
+
         static
         shm_seg*
-        create(std::uint32_t pkg);
+        create(std::uint32_t id, const std::string& pci);
 
         static
         void
@@ -83,7 +179,7 @@ namespace amdgpu_stats {
 
         static
         const shm_seg*
-        open(std::uint32_t pkg);
+        open(const std::string& pci);
 
         static
         void
@@ -97,36 +193,122 @@ namespace amdgpu_stats {
         double
         idx_to_power(std::size_t p);
 
+        static
+        std::size_t
+        clock_to_idx(double mhz);
+
+        static
+        double
+        idx_to_clock(std::size_t i);
+
+        static
+        std::size_t
+        activity_to_idx(double pct);
+
+        static
+        double
+        idx_to_activity(std::size_t i);
+
+        // subtract the entries and the energy of r, used for the
+        // differences to a mark
+        shm_seg& operator-=(const shm_seg& r);
+
         const std::uint32_t& id() const;
+        const char* pci() const;
         shm_seg& power(const double& pwr);
         const double& power() const;
-        shm_seg& elapsed_s(const std::uint64_t& v);
-        const std::uint64_t& elapsed_s() const;
+        // add uj micro joules consumed during dt_ns nanoseconds
+        shm_seg& add_energy(std::uint64_t uj, std::uint64_t dt_ns);
+        const std::uint64_t& uj_lo() const;
+        const std::uint64_t& uj_hi() const;
+        // energy in joule from uj_lo and uj_hi
+        double joule() const;
+        const std::uint64_t& elapsed_ns() const;
         std::uint32_t* begin();
         std::uint32_t* end();
         const std::uint32_t* begin() const;
         const std::uint32_t* end() const;
+        // store the values of v and update the histograms of the
+        // gpu_metrics table
+        shm_seg& metrics(const gpu_metrics::values& v,
+                         std::uint32_t weight);
+        bool has_metrics() const;
+        const std::uint8_t& format_rev() const;
+        const std::uint8_t& content_rev() const;
+        const double& gfx_mhz() const;
+        const double& mem_mhz() const;
+        const double& gfx_activity() const;
+        const double& temp_edge() const;
+        const double& temp_hotspot() const;
+        const double& temp_mem() const;
+        const std::uint32_t* gfx_begin() const;
+        const std::uint32_t* mem_begin() const;
+        const std::uint32_t* activity_begin() const;
     };
 
     struct data {
         std::vector<const shm_seg*> _v;
+        // gpu_metrics readers of the segments in _v
+        std::vector<gpu_metrics> _vm;
+        struct priv_data {
+            // CLOCK_MONOTONIC time of the last read, 0 before the
+            // first read
+            std::uint64_t _ns;
+            // last value of the energy accumulator
+            std::uint64_t _energy;
+            bool _has_energy;
+            // remainder of the conversion of the accumulator into uJ
+            std::uint64_t _rem;
+            // values of the read of sample(), _s_power_w is NaN
+            // without a power reading
+            gpu_metrics::values _s_v;
+            bool _s_metrics;
+            double _s_power_w;
+            std::uint64_t _s_ns;
+        };
+        std::vector<priv_data> _vp;
         bool _create;
 
         static
         void
         to_stream(std::ostream& s, const shm_seg* p, bool short_output);
+        static
+        void
+        to_writer(cpu_stats::writer& w, const shm_seg* p);
     public:
-        data(bool create);
+        // the client opens the devices with the pci addresses in sel
+        // or all if sel is nullptr
+        data(bool create, const cpu_stats::selection* sel=nullptr);
         ~data();
         data(const data&) = delete;
         data&
         operator=(const data& r) = delete;
-        // update _v
+        // the segments
+        const std::vector<const shm_seg*>&
+        segments() const;
+        // the names of the segments
+        std::vector<std::string>
+        names() const;
+        // read gpu_metrics or the power, called before update outside
+        // of the update of the segments
         void
-        update(std::uint32_t tmo_sec, std::uint32_t weight);
+        sample();
+        // update _v from the last sample
+        void
+        update(std::uint32_t weight);
         // dump the data
         void
         to_stream(std::ostream& s, bool short_output=false);
+        // dump the differences to the data saved in mark m
+        void
+        to_stream(std::ostream& s, const cpu_stats::mark& m,
+                  bool short_output=false);
+        // write the data to w
+        void
+        to_writer(cpu_stats::writer& w);
+        // write the differences to the data saved in mark m to w
+        void
+        to_writer(cpu_stats::writer& w, const cpu_stats::mark& m);
     };
 }
 
@@ -154,20 +336,56 @@ amdgpu_stats::shm_seg::power()
     return _power;
 }
 
+inline
+const char*
+amdgpu_stats::shm_seg::pci()
+    const
+{
+    return _pci;
+}
+
 inline
 amdgpu_stats::shm_seg&
-amdgpu_stats::shm_seg::elapsed_s(const std::uint64_t& v)
+amdgpu_stats::shm_seg::add_energy(std::uint64_t uj, std::uint64_t dt_ns)
 {
-    _elapsed_s=v;
+    std::uint64_t ujl=_uj_lo + uj;
+    if (ujl < _uj_lo)
+        ++_uj_hi;
+    _uj_lo=ujl;
+    _elapsed_ns += dt_ns;
     return *this;
 }
 
 inline
 const std::uint64_t&
-amdgpu_stats::shm_seg::elapsed_s()
+amdgpu_stats::shm_seg::uj_lo()
     const
 {
-    return _elapsed_s;
+    return _uj_lo;
+}
+
+inline
+const std::uint64_t&
+amdgpu_stats::shm_seg::uj_hi()
+    const
+{
+    return _uj_hi;
+}
+
+inline
+double
+amdgpu_stats::shm_seg::joule()
+    const
+{
+    return (double(_uj_lo) + double(_uj_hi)*0x1p64)*1e-6;
+}
+
+inline
+const std::uint64_t&
+amdgpu_stats::shm_seg::elapsed_ns()
+    const
+{
+    return _elapsed_ns;
 }
 
 inline
@@ -200,5 +418,108 @@ amdgpu_stats::shm_seg::end()
     return _entries+POWER_ENTRIES;
 }
 
+inline
+const std::uint8_t&
+amdgpu_stats::shm_seg::format_rev()
+    const
+{
+    return _format_rev;
+}
+
+inline
+const std::uint8_t&
+amdgpu_stats::shm_seg::content_rev()
+    const
+{
+    return _content_rev;
+}
+
+inline
+bool
+amdgpu_stats::shm_seg::has_metrics()
+    const
+{
+    return _format_rev != 0;
+}
+
+inline
+const double&
+amdgpu_stats::shm_seg::gfx_mhz()
+    const
+{
+    return _gfx_mhz;
+}
+
+inline
+const double&
+amdgpu_stats::shm_seg::mem_mhz()
+    const
+{
+    return _mem_mhz;
+}
+
+inline
+const double&
+amdgpu_stats::shm_seg::gfx_activity()
+    const
+{
+    return _gfx_activity;
+}
+
+inline
+const double&
+amdgpu_stats::shm_seg::temp_edge()
+    const
+{
+    return _temp_edge;
+}
+
+inline
+const double&
+amdgpu_stats::shm_seg::temp_hotspot()
+    const
+{
+    return _temp_hotspot;
+}
+
+inline
+const double&
+amdgpu_stats::shm_seg::temp_mem()
+    const
+{
+    return _temp_mem;
+}
+
+inline
+const std::uint32_t*
+amdgpu_stats::shm_seg::gfx_begin()
+    const
+{
+    return _gfx_entries;
+}
+
+inline
+const std::uint32_t*
+amdgpu_stats::shm_seg::mem_begin()
+    const
+{
+    return _mem_entries;
+}
+
+inline
+const std::uint32_t*
+amdgpu_stats::shm_seg::activity_begin()
+    const
+{
+    return _activity_entries;
+}
+
+inline
+const std::vector<const amdgpu_stats::shm_seg*>&
+amdgpu_stats::data::segments()
+    const
+{
+    return _v;
+}
 
 #endif
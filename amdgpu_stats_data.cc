@@ -16,31 +16,55 @@
 //  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
 //
 #include "amdgpu_stats.h"
+#include "cpu-stats.h"
 #include <iostream>
 #include <iomanip>
 #include <cmath>
 #include <algorithm>
 #include <numeric>
+#include <cstring>
 #include <syslog.h>
 
-amdgpu_stats::data::data(bool create)
+amdgpu_stats::data::data(bool create, const cpu_stats::selection* sel)
     : _v(),
+      _vm(),
+      _vp(),
       _create(create)
 {
     try {
-        for (size_t i=0; hwmon::exists(i); ++i) {
-            if (!hwmon::is_amdgpu(i))
-                continue;
-            // some amdgpu devices do not export power1_input
-            if (!hwmon::has_ppt(i))
-                continue;
-            const shm_seg* p=nullptr;
-            if (_create) {
-                p=shm_seg::create(i);
-            } else {
-                p=shm_seg::open(i);
+        if (_create) {
+            for (size_t i=0; hwmon::exists(i); ++i) {
+                if (!hwmon::is_amdgpu(i))
+                    continue;
+                // some amdgpu devices do not export power1_input,
+                // these may provide the power using gpu_metrics
+                if (!hwmon::has_ppt(i) && !hwmon::has_gpu_metrics(i))
+                    continue;
+                std::string pci=hwmon::pci_address(i);
+                const shm_seg* p=shm_seg::create(i, pci);
+                _v.push_back(p);
+                _vm.emplace_back(i);
+                priv_data pd{};
+                pd._s_power_w=std::nan("");
+                _vp.push_back(pd);
+            }
+        } else {
+            // the segments are named by the pci address of the
+            // devices, the hwmon numbers may change between boots
+            std::string pf(shm_seg::prefix);
+            for (const auto& n : cpu_stats::segments(pf)) {
+                std::string pci=n.substr(pf.size());
+                if (sel != nullptr && !sel->gpu(pci))
+                    continue;
+                try {
+                    _v.push_back(shm_seg::open(pci));
+                }
+                catch (const std::runtime_error& e) {
+                    // listed in the index but not accessible, i.e. not
+                    // bound into a container
+                    continue;
+                }
             }
-            _v.push_back(p);
         }
     }
     catch (const std::runtime_error& e) {
@@ -68,16 +92,71 @@ amdgpu_stats::data::~data()
     }
 }
 
+void
+amdgpu_stats::data::sample()
+{
+    if (_create == false)
+        return;
+    for (std::size_t i=0; i<_v.size(); ++i) {
+        const shm_seg* p=_v[i];
+        priv_data& pd=_vp[i];
+        // prefer the gpu_metrics table: one read delivers power,
+        // clocks, activity and the energy accumulator
+        gpu_metrics::values& v=pd._s_v;
+        v._has_energy=false;
+        std::uint64_t ns_0=tools::monotonic_ns();
+        pd._s_metrics=_vm[i].read(v);
+        double p_in_w= pd._s_metrics ? v._power_w : std::nan("");
+        if (std::isnan(p_in_w) && hwmon::has_ppt(p->id()))
+            p_in_w=double(hwmon::ppt(p->id()))*1e-6;
+        std::uint64_t ns_1=tools::monotonic_ns();
+        pd._s_power_w=p_in_w;
+        pd._s_ns=(ns_0 + ns_1)/2;
+    }
+}
+
 void
 amdgpu_stats::data::
-update(std::uint32_t tmo_sec, std::uint32_t weight)
+update(std::uint32_t weight)
 {
     if (_create == false)
         return;
     for (std::size_t i=0; i<_v.size(); ++i) {
         shm_seg* p=const_cast<shm_seg*>(_v[i]);
-        std::uint64_t p_in_uw=hwmon::ppt(p->id());
-        double p_in_w = double(p_in_uw)*1e-6;
+        priv_data& pd=_vp[i];
+        const gpu_metrics::values& v=pd._s_v;
+        if (pd._s_metrics)
+            p->metrics(v, weight);
+        double p_in_w=pd._s_power_w;
+        if (std::isnan(p_in_w))
+            continue;
+        std::uint64_t ns_now=pd._s_ns;
+        std::uint64_t ns_last=pd._ns;
+        std::uint64_t e_last=pd._energy;
+        bool has_e_last=pd._has_energy;
+        pd._ns=ns_now;
+        pd._energy=v._energy;
+        pd._has_energy=v._has_energy;
+        // the first read only initializes the reference values
+        if (ns_last != 0 && ns_now > ns_last) {
+            std::uint64_t dt_ns=ns_now - ns_last;
+            std::uint64_t uj;
+            if (v._has_energy && has_e_last) {
+                // the accumulator counts in units of 2^-16 J,
+                // 1e6/2^16 == 15625/2^10, the remainder is carried
+                // to the next interval
+                std::uint64_t d=(v._energy - e_last) & v._energy_mask;
+                std::uint64_t t=d*15625 + pd._rem;
+                uj = t >> 10;
+                pd._rem = t & 1023;
+                // the average power over the measured interval
+                p_in_w = uj*1e-6/(dt_ns*1e-9);
+            } else {
+                // integrate the power over the measured interval
+                uj = std::uint64_t(std::rint(p_in_w*dt_ns*1e-3));
+            }
+            p->add_energy(uj, dt_ns);
+        }
         // std::cout << " p in w: " << p_in_w << '\n';
         size_t idx=shm_seg::power_to_idx(p_in_w);
         if ((idx>=shm_seg::POWER_ENTRIES-1) ||
@@ -88,11 +167,53 @@ update(std::uint32_t tmo_sec, std::uint32_t weight)
                    p_in_w);
         }
         // std::cout << " idx: " << idx << std::endl;
-        std::uint64_t s=p->elapsed_s() + tmo_sec;
         std::uint32_t* pi=p->begin() + idx;
         (*pi)+=weight;
         p->power(p_in_w);
-        p->elapsed_s(s);
+    }
+}
+
+namespace {
+
+    // print a histogram of the gpu_metrics table with the upper bound
+    // of every range, the percentage and the cumulative percentage,
+    // returns the average
+    template <typename _F>
+    double
+    histogram_to_stream(std::ostream& s, const char* title,
+                        const std::uint32_t* b, std::size_t n,
+                        _F idx_to_val, double step, bool print)
+    {
+        double sum_ti=std::accumulate(b, b+n, 0.0);
+        if (sum_ti == 0.0)
+            return std::nan("");
+        double avg=0.0;
+        for (std::size_t i=0; i<n; ++i)
+            avg += idx_to_val(i)*b[i];
+        avg = avg/sum_ti - step*0.5;
+        if (!print)
+            return avg;
+        s << title << '\n';
+        double spct=0.0;
+        for (std::size_t i=n; i-- > 0; ) {
+            if (b[i]==0)
+                continue;
+            double pct=b[i]*1e2/sum_ti;
+            spct += pct;
+            s << std::setw(7) << std::setprecision(0) << idx_to_val(i) << ' '
+              << std::setw(7) << std::setprecision(2) << pct << ' '
+              << std::setw(7) << std::setprecision(2) << spct << '\n';
+        }
+        return avg;
+    }
+
+    void
+    value_to_stream(std::ostream& s, const char* n, double v,
+                    const char* unit)
+    {
+        if (std::isnan(v))
+            return;
+        s << n << std::setprecision(0) << v << unit;
     }
 }
 
@@ -101,7 +222,7 @@ amdgpu_stats::data::
 to_stream(std::ostream& s, const shm_seg* p, bool short_output)
 {
     std::uint32_t vt[shm_seg::POWER_ENTRIES];
-    std::uint32_t id= p->id();
+    const char* pci= p->pci();
     std::copy(p->begin(), p->end(), std::begin(vt));
 
     // determine entries != 0
@@ -112,7 +233,7 @@ to_stream(std::ostream& s, const shm_seg* p, bool short_output)
     std::uint32_t max_ti=0;
     double sum_ti=0.0;
     double p_in_w=p->power();
-    std::uint64_t elapsed_s=p->elapsed_s();
+    double elapsed_s=p->elapsed_ns()*1e-9;
     for (std::size_t i=0; i<shm_seg::POWER_ENTRIES; ++i) {
         std::uint32_t ti=vt[i];
         if (vt[i]==0)
@@ -149,7 +270,7 @@ to_stream(std::ostream& s, const shm_seg* p, bool short_output)
         s << "========================";
     s << '\n';
     s << std::fixed << std::setprecision(0);
-    s << "amdgpu-hwmon " << id
+    s << "amdgpu " << pci
       << ", samples=" << std::scientific << std::setprecision(22) << sum_ti
       << std::fixed << '\n';
     for (std::uint32_t i=0; i<cols; ++i) {
@@ -179,20 +300,67 @@ to_stream(std::ostream& s, const shm_seg* p, bool short_output)
         }
         s << '\n';
     }
+    // the measured energy over the measured time, the histogram
+    // estimation only before the first interval
     avg = avg*1.0e-2 - (shm_seg::power_step*.5);
-    double ws=double(elapsed_s)*avg;
+    double ws=p->joule();
+    if (elapsed_s > 0.0)
+        avg = ws/elapsed_s;
     double kwh=ws/(1000*3600);
     ws = rint(ws);
     kwh= rint(kwh*1e3)*1e-3;
-    s << "average power: ~" << avg << " W, power over last interval: "
+    s << "average power: " << avg << " W, power over last interval: "
       << p_in_w << " W\n"
-      << "used energy:   ~"
-      << std::scientific << std::setprecision(15) << ws << " Ws, ~"
-      << std::setprecision(15) << kwh << " kWh"
+      << "used energy:   "
+      << std::scientific << std::setprecision(15) << ws << " Ws, "
+      << std::setprecision(15) << kwh << " kWh, time="
+      << std::fixed << std::setprecision(0) << elapsed_s << " s"
       << '\n';
     if (std::fabs(sum-100) > 0.005) {
         s << "invalid sum " << sum << std::endl;
     }
+    if (!p->has_metrics())
+        return;
+    s << "gpu_metrics v" << unsigned(p->format_rev()) << '.'
+      << unsigned(p->content_rev()) << '\n';
+    bool pr=!short_output;
+    double gfx_avg=histogram_to_stream(
+        s, "gfx clock/MHz       %   sum %",
+        p->gfx_begin(), shm_seg::CLOCK_ENTRIES,
+        shm_seg::idx_to_clock, shm_seg::clock_step, pr);
+    double mem_avg=histogram_to_stream(
+        s, "mem clock/MHz       %   sum %",
+        p->mem_begin(), shm_seg::CLOCK_ENTRIES,
+        shm_seg::idx_to_clock, shm_seg::clock_step, pr);
+    double act_avg=histogram_to_stream(
+        s, "gfx activity/%      %   sum %",
+        p->activity_begin(), shm_seg::ACTIVITY_ENTRIES,
+        shm_seg::idx_to_activity, shm_seg::activity_step, pr);
+    s << std::fixed;
+    value_to_stream(s, "average gfx clock: ~", gfx_avg, " MHz, ");
+    value_to_stream(s, "last: ", p->gfx_mhz(), " MHz");
+    s << '\n';
+    value_to_stream(s, "average memory clock: ~", mem_avg, " MHz, ");
+    value_to_stream(s, "last: ", p->mem_mhz(), " MHz");
+    s << '\n';
+    value_to_stream(s, "average gfx activity: ~", act_avg, " %, ");
+    value_to_stream(s, "last: ", p->gfx_activity(), " %");
+    s << '\n';
+    s << "temperatures:";
+    value_to_stream(s, " edge ", p->temp_edge(), " C");
+    value_to_stream(s, " hotspot ", p->temp_hotspot(), " C");
+    value_to_stream(s, " memory ", p->temp_mem(), " C");
+    s << '\n';
+}
+
+std::vector<std::string>
+amdgpu_stats::data::names()
+    const
+{
+    std::vector<std::string> r;
+    for (const auto* p : _v)
+        r.push_back(shm_seg::name(p->pci()));
+    return r;
 }
 
 void
@@ -202,3 +370,89 @@ amdgpu_stats::data::to_stream(std::ostream& s, bool short_output)
         to_stream(s, _v[i], short_output);
     }
 }
+
+void
+amdgpu_stats::data::
+to_stream(std::ostream& s, const cpu_stats::mark& m, bool short_output)
+{
+    for (std::size_t i=0; i<_v.size(); ++i) {
+        const shm_seg* p=_v[i];
+        std::string n=shm_seg::name(p->pci());
+        const void* pm=m.find(n, sizeof(shm_seg));
+        if (pm==nullptr)
+            continue;
+        alignas(shm_seg) char b[sizeof(shm_seg)];
+        m.read_live(b, p, sizeof(shm_seg));
+        shm_seg* d=reinterpret_cast<shm_seg*>(b);
+        (*d) -= *static_cast<const shm_seg*>(pm);
+        // nothing happened since the mark
+        if (std::all_of(d->begin(), d->end(),
+                        [](std::uint32_t v) { return v==0; }))
+            continue;
+        to_stream(s, d, short_output);
+    }
+}
+
+void
+amdgpu_stats::data::to_writer(cpu_stats::writer& w, const shm_seg* p)
+{
+    double power_w[shm_seg::POWER_ENTRIES];
+    double clock_mhz[shm_seg::CLOCK_ENTRIES];
+    double activity_pct[shm_seg::ACTIVITY_ENTRIES];
+    for (std::size_t i=0; i<shm_seg::POWER_ENTRIES; ++i)
+        power_w[i]=shm_seg::idx_to_power(i);
+    for (std::size_t i=0; i<shm_seg::CLOCK_ENTRIES; ++i)
+        clock_mhz[i]=shm_seg::idx_to_clock(i);
+    for (std::size_t i=0; i<shm_seg::ACTIVITY_ENTRIES; ++i)
+        activity_pct[i]=shm_seg::idx_to_activity(i);
+    double s=p->elapsed_ns()*1e-9;
+    w.begin("amdgpu", p->pci());
+    w.value("joule", p->joule());
+    w.value("elapsed_ns", p->elapsed_ns());
+    w.value("avg_power_w", s > 0.0 ? p->joule()/s : 0.0);
+    w.value("last_power_w", p->power());
+    w.values("power_w", power_w, shm_seg::POWER_ENTRIES);
+    w.values("entries", p->begin(), shm_seg::POWER_ENTRIES);
+    if (p->has_metrics()) {
+        w.value("format_rev", std::uint32_t(p->format_rev()));
+        w.value("content_rev", std::uint32_t(p->content_rev()));
+        w.value("last_gfx_mhz", p->gfx_mhz());
+        w.value("last_mem_mhz", p->mem_mhz());
+        w.value("last_gfx_activity_pct", p->gfx_activity());
+        w.value("last_temp_edge_c", p->temp_edge());
+        w.value("last_temp_hotspot_c", p->temp_hotspot());
+        w.value("last_temp_mem_c", p->temp_mem());
+        w.values("clock_mhz", clock_mhz, shm_seg::CLOCK_ENTRIES);
+        w.values("gfx_entries", p->gfx_begin(), shm_seg::CLOCK_ENTRIES);
+        w.values("mem_entries", p->mem_begin(), shm_seg::CLOCK_ENTRIES);
+        w.values("activity_pct", activity_pct, shm_seg::ACTIVITY_ENTRIES);
+        w.values("activity_entries", p->activity_begin(),
+                 shm_seg::ACTIVITY_ENTRIES);
+    }
+    w.end();
+}
+
+void
+amdgpu_stats::data::to_writer(cpu_stats::writer& w)
+{
+    for (std::size_t i=0; i<_v.size(); ++i)
+        to_writer(w, _v[i]);
+}
+
+void
+amdgpu_stats::data::
+to_writer(cpu_stats::writer& w, const cpu_stats::mark& m)
+{
+    for (std::size_t i=0; i<_v.size(); ++i) {
+        const shm_seg* p=_v[i];
+        std::string n=shm_seg::name(p->pci());
+        const void* pm=m.find(n, sizeof(shm_seg));
+        if (pm==nullptr)
+            continue;
+        alignas(shm_seg) char b[sizeof(shm_seg)];
+        m.read_live(b, p, sizeof(shm_seg));
+        shm_seg* d=reinterpret_cast<shm_seg*>(b);
+        (*d) -= *static_cast<const shm_seg*>(pm);
+        to_writer(w, d);
+    }
+}
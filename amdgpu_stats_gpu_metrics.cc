@@ -0,0 +1,194 @@
+//
+//  Copyright (C) 2020-2026  Axel Zeuner
+//
+//  This program is free software; you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation; either version 2 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program; if not, write to the Free Software
+//  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+//
+#include "amdgpu_stats.h"
+#include <cstring>
+#include <cstddef>
+#include <cmath>
+#include <fcntl.h>
+
+namespace {
+
+    // layouts of the gpu_metrics tables from the linux kernel
+    // (drivers/gpu/drm/amd/include/kgd_pp_interface.h), only the
+    // leading members used here are declared
+    struct metrics_table_header {
+        std::uint16_t structure_size;
+        std::uint8_t format_revision;
+        std::uint8_t content_revision;
+    };
+
+    // dGPUs, format 1 content 0
+    struct gpu_metrics_v1_0 {
+        metrics_table_header common_header;
+        std::uint64_t system_clock_counter;
+        std::uint16_t temperature_edge;
+        std::uint16_t temperature_hotspot;
+        std::uint16_t temperature_mem;
+        std::uint16_t temperature_vrgfx;
+        std::uint16_t temperature_vrsoc;
+        std::uint16_t temperature_vrmem;
+        std::uint16_t average_gfx_activity;
+        std::uint16_t average_umc_activity;
+        std::uint16_t average_mm_activity;
+        std::uint16_t average_socket_power;
+        std::uint32_t energy_accumulator;
+        std::uint16_t average_gfxclk_frequency;
+        std::uint16_t average_socclk_frequency;
+        std::uint16_t average_uclk_frequency;
+    };
+    static_assert(offsetof(gpu_metrics_v1_0, average_uclk_frequency)==44,
+                  "gpu_metrics_v1_0 layout");
+
+    // dGPUs, format 1 content 1 to 3
+    struct gpu_metrics_v1_1 {
+        metrics_table_header common_header;
+        std::uint16_t temperature_edge;
+        std::uint16_t temperature_hotspot;
+        std::uint16_t temperature_mem;
+        std::uint16_t temperature_vrgfx;
+        std::uint16_t temperature_vrsoc;
+        std::uint16_t temperature_vrmem;
+        std::uint16_t average_gfx_activity;
+        std::uint16_t average_umc_activity;
+        std::uint16_t average_mm_activity;
+        std::uint16_t average_socket_power;
+        std::uint64_t energy_accumulator;
+        std::uint64_t system_clock_counter;
+        std::uint16_t average_gfxclk_frequency;
+        std::uint16_t average_socclk_frequency;
+        std::uint16_t average_uclk_frequency;
+    };
+    static_assert(offsetof(gpu_metrics_v1_1, average_uclk_frequency)==44,
+                  "gpu_metrics_v1_1 layout");
+
+    // APUs, format 2, the powers are in mW and the temperatures in
+    // centi degree celsius
+    struct gpu_metrics_v2_0 {
+        metrics_table_header common_header;
+        std::uint64_t system_clock_counter;
+        std::uint16_t temperature_gfx;
+        std::uint16_t temperature_soc;
+        std::uint16_t temperature_core[8];
+        std::uint16_t temperature_l3[2];
+        std::uint16_t average_gfx_activity;
+        std::uint16_t average_mm_activity;
+        std::uint16_t average_socket_power;
+        std::uint16_t average_cpu_power;
+        std::uint16_t average_soc_power;
+        std::uint16_t average_gfx_power;
+        std::uint16_t average_core_power[8];
+        std::uint16_t average_gfxclk_frequency;
+        std::uint16_t average_socclk_frequency;
+        std::uint16_t average_uclk_frequency;
+    };
+    static_assert(offsetof(gpu_metrics_v2_0, average_uclk_frequency)==72,
+                  "gpu_metrics_v2_0 layout");
+
+    // 0xffff marks unsupported values
+    double
+    value(std::uint16_t v, double scale=1.0)
+    {
+        return v==0xffff ? std::nan("") : v*scale;
+    }
+
+    template <typename _T>
+    void
+    decode_v1(const char* b, amdgpu_stats::gpu_metrics::values& v)
+    {
+        _T m;
+        std::memcpy(&m, b, sizeof(m));
+        v._ts_ns=m.system_clock_counter;
+        v._power_w=value(m.average_socket_power);
+        v._has_energy=true;
+        v._energy=m.energy_accumulator;
+        v._energy_mask=sizeof(m.energy_accumulator) < sizeof(std::uint64_t) ?
+            std::uint64_t(0xffffffff) : ~std::uint64_t(0);
+        v._gfx_mhz=value(m.average_gfxclk_frequency);
+        v._mem_mhz=value(m.average_uclk_frequency);
+        v._gfx_activity=value(m.average_gfx_activity);
+        v._temp_edge=value(m.temperature_edge);
+        v._temp_hotspot=value(m.temperature_hotspot);
+        v._temp_mem=value(m.temperature_mem);
+    }
+
+    void
+    decode_v2(const char* b, amdgpu_stats::gpu_metrics::values& v)
+    {
+        gpu_metrics_v2_0 m;
+        std::memcpy(&m, b, sizeof(m));
+        v._ts_ns=m.system_clock_counter;
+        v._power_w=value(m.average_socket_power, 1e-3);
+        v._has_energy=false;
+        v._energy=0;
+        v._energy_mask=0;
+        v._gfx_mhz=value(m.average_gfxclk_frequency);
+        v._mem_mhz=value(m.average_uclk_frequency);
+        v._gfx_activity=value(m.average_gfx_activity);
+        v._temp_edge=value(m.temperature_gfx, 1e-2);
+        v._temp_hotspot=value(m.temperature_soc, 1e-2);
+        v._temp_mem=std::nan("");
+    }
+}
+
+std::string
+amdgpu_stats::gpu_metrics::path(std::uint32_t hwmon_no)
+{
+    return hwmon::path(hwmon_no) + "device/gpu_metrics";
+}
+
+amdgpu_stats::gpu_metrics::gpu_metrics(std::uint32_t hwmon_no)
+    : _fd(open(path(hwmon_no).c_str(), O_RDONLY|O_CLOEXEC)),
+      _buf(4096)
+{
+}
+
+bool
+amdgpu_stats::gpu_metrics::valid()
+    const
+{
+    return _fd() >= 0;
+}
+
+bool
+amdgpu_stats::gpu_metrics::read(values& v)
+{
+    if (_fd() < 0)
+        return false;
+    ssize_t rs=pread(_fd(), _buf.data(), _buf.size(), 0);
+    if (rs < ssize_t(sizeof(metrics_table_header)))
+        return false;
+    metrics_table_header h;
+    std::memcpy(&h, _buf.data(), sizeof(h));
+    std::size_t avail=std::min(std::size_t(rs), std::size_t(h.structure_size));
+    v._format_rev=h.format_revision;
+    v._content_rev=h.content_revision;
+    if (h.format_revision==1 && h.content_revision==0 &&
+        avail >= sizeof(gpu_metrics_v1_0)) {
+        decode_v1<gpu_metrics_v1_0>(_buf.data(), v);
+    } else if (h.format_revision==1 && h.content_revision >= 1 &&
+               h.content_revision <= 3 &&
+               avail >= sizeof(gpu_metrics_v1_1)) {
+        decode_v1<gpu_metrics_v1_1>(_buf.data(), v);
+    } else if (h.format_revision==2 &&
+               avail >= sizeof(gpu_metrics_v2_0)) {
+        decode_v2(_buf.data(), v);
+    } else {
+        return false;
+    }
+    return true;
+}
@@ -16,30 +16,29 @@
 //  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
 //
 #include "amdgpu_stats.h"
+#include "hwmon_stats.h"
 #include <sstream>
 #include <iostream>
+#include <climits>
+#include <cstdlib>
+#include <stdexcept>
 
 std::string
 amdgpu_stats::hwmon::path(std::uint32_t no)
 {
-    std::ostringstream s;
-    s << "/sys/class/hwmon/hwmon" << no << '/';
-    return s.str();
+    return hwmon_stats::hwmon::path(no);
 }
 
 bool
 amdgpu_stats::hwmon::exists(std::uint32_t no)
 {
-    std::string p=path(no);
-    return tools::file::exists(p);
+    return hwmon_stats::hwmon::exists(no);
 }
 
 bool
 amdgpu_stats::hwmon::is_amdgpu(std::uint32_t no)
 {
-    std::string p=path(no) + "name";
-    std::string n=tools::sys_fs::read<std::string>::from(p);
-    return n=="amdgpu\n";
+    return hwmon_stats::hwmon::name(no)=="amdgpu";
 }
 
 bool
@@ -55,3 +54,28 @@ amdgpu_stats::hwmon::ppt(std::uint32_t no)
     std::string p=path(no) + "power1_input";
     return tools::sys_fs::read<std::uint64_t>::from(p);
 }
+
+bool
+amdgpu_stats::hwmon::has_gpu_metrics(std::uint32_t no)
+{
+    std::string p=path(no) + "device/gpu_metrics";
+    return tools::file::exists(p);
+}
+
+std::string
+amdgpu_stats::hwmon::pci_address(std::uint32_t no)
+{
+    // device is a symbolic link to the pci device directory
+    std::string p=path(no) + "device";
+    char rp[PATH_MAX];
+    if (::realpath(p.c_str(), rp) == nullptr) {
+        std::ostringstream s;
+        s << "amdgpu_stats: could not resolve " << p;
+        throw std::runtime_error(s.str());
+    }
+    std::string r(rp);
+    std::string::size_type sl=r.rfind('/');
+    if (sl != std::string::npos)
+        r=r.substr(sl+1);
+    return r;
+}
@@ -20,39 +20,62 @@
 #include <sstream>
 #include <iomanip>
 #include <cmath>
+#include <cstring>
+#include <algorithm>
 
 constexpr const double amdgpu_stats::shm_seg::power_step;
 constexpr const double amdgpu_stats::shm_seg::inv_power_step;
 constexpr const double amdgpu_stats::shm_seg::max_power;
+constexpr const double amdgpu_stats::shm_seg::clock_step;
+constexpr const double amdgpu_stats::shm_seg::inv_clock_step;
+constexpr const double amdgpu_stats::shm_seg::max_clock;
+constexpr const double amdgpu_stats::shm_seg::activity_step;
+constexpr const double amdgpu_stats::shm_seg::inv_activity_step;
+
+const char* const amdgpu_stats::shm_seg::prefix="/cpu_stats_p_amdgpu_";
 
 std::string
-amdgpu_stats::shm_seg::name(std::uint32_t hwmon)
+amdgpu_stats::shm_seg::name(const std::string& pci)
 {
-    std::ostringstream s;
-    s << "/cpu_stats_p_amdgpu_" << std::setw(3) << std::setfill('0') << hwmon;
-    return s.str();
+    return std::string(prefix) + pci;
 }
 
-amdgpu_stats::shm_seg::shm_seg(std::uint32_t id)
+amdgpu_stats::shm_seg::shm_seg(std::uint32_t id, const std::string& pci)
     : _id(id),
+      _pci{0},
+      _format_rev(0),
+      _content_rev(0),
       _power(0.0),
-      _elapsed_s(0),
-      _entries{0}
+      _uj_lo(0),
+      _uj_hi(0),
+      _elapsed_ns(0),
+      _entries{0},
+      _gfx_mhz(std::nan("")),
+      _mem_mhz(std::nan("")),
+      _gfx_activity(std::nan("")),
+      _temp_edge(std::nan("")),
+      _temp_hotspot(std::nan("")),
+      _temp_mem(std::nan("")),
+      _gfx_entries{0},
+      _mem_entries{0},
+      _activity_entries{0}
 {
+    std::size_t n=std::min(pci.size(), sizeof(_pci)-1);
+    std::memcpy(_pci, pci.data(), n);
 }
 
 amdgpu_stats::shm_seg::~shm_seg()
 {
-    std::string fn=name(_id);
+    std::string fn=name(_pci);
     tools::shm::unlink(fn);
 }
 
 amdgpu_stats::shm_seg*
-amdgpu_stats::shm_seg::create(std::uint32_t hwmon)
+amdgpu_stats::shm_seg::create(std::uint32_t hwmon, const std::string& pci)
 {
-    std::string fn=name(hwmon);
+    std::string fn=name(pci);
     void* addr=tools::shm::create(fn, sizeof(shm_seg), 0644);
-    shm_seg* ret=new (addr) shm_seg(hwmon);
+    shm_seg* ret=new (addr) shm_seg(hwmon, pci);
     return ret;
 }
 
@@ -64,9 +87,9 @@ amdgpu_stats::shm_seg::close(shm_seg* p)
 }
 
 const amdgpu_stats::shm_seg*
-amdgpu_stats::shm_seg::open(std::uint32_t hwmon)
+amdgpu_stats::shm_seg::open(const std::string& pci)
 {
-    std::string fn=name(hwmon);
+    std::string fn=name(pci);
     void* addr=tools::shm::open_ro(fn, sizeof(shm_seg));
     const shm_seg* ret=reinterpret_cast<const shm_seg*>(addr);
     return ret;
@@ -93,3 +116,74 @@ amdgpu_stats::shm_seg::idx_to_power(std::size_t idx)
 {
     return (1+idx)*power_step;
 }
+
+std::size_t
+amdgpu_stats::shm_seg::clock_to_idx(double mhz)
+{
+    double c0=std::floor(mhz*inv_clock_step);
+    auto i=static_cast<std::size_t>(std::max(c0, 0.0));
+    i=std::min(i, std::size_t(CLOCK_ENTRIES)-1);
+    return i;
+}
+
+double
+amdgpu_stats::shm_seg::idx_to_clock(std::size_t idx)
+{
+    return (1+idx)*clock_step;
+}
+
+std::size_t
+amdgpu_stats::shm_seg::activity_to_idx(double pct)
+{
+    double a0=std::floor(pct*inv_activity_step);
+    auto i=static_cast<std::size_t>(std::max(a0, 0.0));
+    i=std::min(i, std::size_t(ACTIVITY_ENTRIES)-1);
+    return i;
+}
+
+double
+amdgpu_stats::shm_seg::idx_to_activity(std::size_t idx)
+{
+    return (1+idx)*activity_step;
+}
+
+amdgpu_stats::shm_seg&
+amdgpu_stats::shm_seg::operator-=(const shm_seg& r)
+{
+    std::uint64_t ujl=_uj_lo - r._uj_lo;
+    std::uint64_t borrow= _uj_lo < r._uj_lo ? 1 : 0;
+    _uj_hi = _uj_hi - r._uj_hi - borrow;
+    _uj_lo = ujl;
+    _elapsed_ns -= r._elapsed_ns;
+    for (std::size_t i=0; i<POWER_ENTRIES; ++i)
+        _entries[i] -= r._entries[i];
+    for (std::size_t i=0; i<CLOCK_ENTRIES; ++i) {
+        _gfx_entries[i] -= r._gfx_entries[i];
+        _mem_entries[i] -= r._mem_entries[i];
+    }
+    for (std::size_t i=0; i<ACTIVITY_ENTRIES; ++i)
+        _activity_entries[i] -= r._activity_entries[i];
+    return *this;
+}
+
+amdgpu_stats::shm_seg&
+amdgpu_stats::shm_seg::metrics(const gpu_metrics::values& v,
+                               std::uint32_t weight)
+{
+    _format_rev=v._format_rev;
+    _content_rev=v._content_rev;
+    _gfx_mhz=v._gfx_mhz;
+    _mem_mhz=v._mem_mhz;
+    _gfx_activity=v._gfx_activity;
+    _temp_edge=v._temp_edge;
+    _temp_hotspot=v._temp_hotspot;
+    _temp_mem=v._temp_mem;
+    // NaN values are not counted
+    if (!std::isnan(v._gfx_mhz))
+        _gfx_entries[clock_to_idx(v._gfx_mhz)] += weight;
+    if (!std::isnan(v._mem_mhz))
+        _mem_entries[clock_to_idx(v._mem_mhz)] += weight;
+    if (!std::isnan(v._gfx_activity))
+        _activity_entries[activity_to_idx(v._gfx_activity)] += weight;
+    return *this;
+}
@@ -19,6 +19,18 @@
 #include "cpufreq_stats.h"
 #include "rapl_stats.h"
 #include "amdgpu_stats.h"
+#include "hwmon_stats.h"
+#include "msr_stats.h"
+#include "cpuidle_stats.h"
+#include "thermal_stats.h"
+#include "uncore_stats.h"
+#include "throttle_stats.h"
+#include "psi_stats.h"
+#include "steal_stats.h"
+#include "irq_stats.h"
+#include "rollup_stats.h"
+#include "joint_stats.h"
+#include "topo_stats.h"
 #include <unistd.h>
 #include <sys/time.h>
 #include <time.h>
@@ -33,6 +45,9 @@
 #include <cstring>
 #include <sstream>
 #include <iostream>
+#include <memory>
+#include <cstdio>
+#include <algorithm>
 
 constexpr const std::uint32_t default_timeout_seconds=3;
 #define RUN_DIR "/run"
@@ -67,8 +82,102 @@ tools::file_handle write_pidfile()
     return lockfd;
 }
 
-int daemon_main(bool foreground, std::uint32_t timeout)
+// configuration of the daemon from the command line
+struct config {
+    bool _foreground;
+    std::uint32_t _timeout;
+    // directory of the rollup files, empty if disabled
+    std::string _rollup_dir;
+    // number of records per rollup resolution
+    std::uint32_t _retention[rollup_stats::LEVELS];
+    // hwmon devices and channels to monitor, empty if disabled
+    std::string _hwmon;
+    // template of the msr device files, empty if disabled
+    std::string _msr_path;
+    // true if -m was given, keeps the msrs enabled in virtual
+    // machines
+    bool _msr_path_set;
+    // margin below the rapl power limits counted as at the limit
+    double _limit_margin;
+    // cgroups with pressure files to monitor besides the system
+    std::string _psi_cgroups;
+};
+
+std::unique_ptr<rollup_stats::data>
+create_rollups(const config& cfg,
+               const rapl_stats::data& r_dta,
+               const amdgpu_stats::data& g_dta,
+               const cpufreq_stats::data* f_dta,
+               const topo_stats::data* o_dta)
+{
+    std::unique_ptr<rollup_stats::data> r;
+    if (cfg._rollup_dir.empty())
+        return r;
+    std::vector<rollup_stats::series> vs;
+    for (const auto* p : r_dta.segments()) {
+        std::ostringstream n;
+        n << p->label() << " power/W";
+        vs.emplace_back(n.str(), rapl_stats::shm_seg::max_power);
+    }
+    for (const auto* p : g_dta.segments()) {
+        std::ostringstream n;
+        n << "amdgpu " << p->pci() << " power/W";
+        vs.emplace_back(n.str(), amdgpu_stats::shm_seg::max_power);
+    }
+    if (f_dta != nullptr)
+        vs.emplace_back("cpu frequency/MHz", 7000.0);
+    if (o_dta != nullptr) {
+        for (const auto* p : o_dta->segments()) {
+            if (p->knd() != topo_stats::PACKAGE)
+                continue;
+            std::ostringstream n;
+            n << "package " << p->loc()._pkg << " frequency/MHz";
+            vs.emplace_back(n.str(), 7000.0);
+        }
+    }
+    try {
+        r=std::make_unique<rollup_stats::data>(cfg._rollup_dir,
+                                               cfg._retention, vs);
+    }
+    catch (const std::runtime_error& e) {
+        syslog(LOG_WARNING, "rollups disabled: %s", e.what());
+    }
+    return r;
+}
+
+void
+update_rollups(rollup_stats::data& u_dta, std::uint32_t weight,
+               const rapl_stats::data& r_dta,
+               const amdgpu_stats::data& g_dta,
+               const cpufreq_stats::data* f_dta,
+               const topo_stats::data* o_dta)
 {
+    u_dta.update(::time(nullptr));
+    std::size_t k=0;
+    for (const auto* p : r_dta.segments())
+        u_dta.sample(k++, p->power(), weight);
+    for (const auto* p : g_dta.segments())
+        u_dta.sample(k++, p->power(), weight);
+    if (f_dta == nullptr || f_dta->segments().empty())
+        return;
+    // the series contains the mean frequency of all cpus per tick
+    double f=0.0;
+    for (const auto* p : f_dta->segments())
+        f += p->last_f_khz();
+    u_dta.sample(k++, f*1e-3/f_dta->segments().size(), weight);
+    if (o_dta == nullptr)
+        return;
+    // the mean frequency of the cpus of each package
+    for (const auto* p : o_dta->segments()) {
+        if (p->knd() == topo_stats::PACKAGE)
+            u_dta.sample(k++, p->last_f_khz()*1e-3, weight);
+    }
+}
+
+int daemon_main(const config& cfg)
+{
+    bool foreground=cfg._foreground;
+    std::uint32_t timeout=cfg._timeout;
     try {
         openlog("cpu-stats-daemon",
                 LOG_PID | (foreground ? LOG_PERROR :0), LOG_DAEMON);
@@ -124,9 +233,50 @@ int daemon_main(bool foreground, std::uint32_t timeout)
         iv.it_value.tv_nsec=0;
         iv.it_value.tv_sec=timeout;
         timer_settime(timerid, 0, &iv, 0);
+        // the energy msrs are emulated or missing and the cpu
+        // frequencies are static or missing in virtual machines
+        std::string hv=steal_stats::hypervisor();
+        std::string msr_path=cfg._msr_path;
+        bool sample_freq=true;
+        if (!hv.empty()) {
+            if (!cfg._msr_path_set)
+                msr_path.clear();
+            // a fixed frequency reported by the hypervisor fills
+            // only one bin per cpu
+            sample_freq=cpufreq_stats::cpu::has_cur_freq(0) &&
+                !cpufreq_stats::cpu::static_cur_freq(10, 100);
+            syslog(LOG_INFO, "running on hypervisor %s, msrs %s, "
+                   "frequency sampling %s", hv.c_str(),
+                   msr_path.empty() ? "disabled" : "enabled",
+                   sample_freq ? "enabled" : "disabled");
+        }
         rapl_stats::data r_dta(true);
         amdgpu_stats::data g_dta(true);
-        cpufreq_stats::data f_dta(true);
+        hwmon_stats::data h_dta(true, hwmon_stats::allow_list(cfg._hwmon));
+        msr_stats::data m_dta(true, msr_path);
+        cpuidle_stats::data i_dta(true);
+        irq_stats::data q_dta(true);
+        psi_stats::data s_dta(true, cfg._psi_cgroups);
+        thermal_stats::data t_dta(true);
+        uncore_stats::data c_dta(true);
+        throttle_stats::data x_dta(true, r_dta, cfg._limit_margin);
+        steal_stats::data v_dta(true);
+        // the frequency segments and their aggregates exist only if
+        // the frequencies are sampled
+        std::unique_ptr<cpufreq_stats::data> f_dta;
+        std::unique_ptr<joint_stats::data> j_dta;
+        std::unique_ptr<topo_stats::data> o_dta;
+        if (sample_freq) {
+            f_dta=std::make_unique<cpufreq_stats::data>(true);
+            j_dta=std::make_unique<joint_stats::data>(true, r_dta);
+            o_dta=std::make_unique<topo_stats::data>(true, r_dta);
+        }
+        tools::proc_stat ps;
+        cpu_stats::state* st=cpu_stats::state::create(timeout);
+        // all segments exist now
+        cpu_stats::index::create();
+        std::unique_ptr<rollup_stats::data> u_dta=
+            create_rollups(cfg, r_dta, g_dta, f_dta.get(), o_dta.get());
 
         sigset_t s;
         sigfillset(&s);
@@ -142,9 +292,43 @@ int daemon_main(bool foreground, std::uint32_t timeout)
                 int tmr_or=timer_getoverrun(timerid);
                 if (tmr_or != -1) {
                     std::uint32_t weight=tmr_or+1;
-                    f_dta.update(weight);
-                    r_dta.update(weight*timeout, weight);
-                    g_dta.update(weight*timeout, weight);
+                    // all reads happen before the update, readers
+                    // wait only for the writes into the segments
+                    ps.read();
+                    if (f_dta)
+                        f_dta->sample();
+                    r_dta.sample();
+                    g_dta.sample();
+                    h_dta.sample();
+                    m_dta.sample();
+                    i_dta.sample();
+                    q_dta.sample();
+                    s_dta.sample();
+                    t_dta.sample();
+                    c_dta.sample();
+                    x_dta.sample();
+                    st->begin_update();
+                    if (f_dta)
+                        f_dta->update(weight, ps);
+                    v_dta.update(ps);
+                    r_dta.update(timeout);
+                    g_dta.update(weight);
+                    h_dta.update();
+                    m_dta.update();
+                    i_dta.update();
+                    q_dta.update();
+                    s_dta.update();
+                    t_dta.update();
+                    c_dta.update(weight);
+                    x_dta.update(r_dta);
+                    if (f_dta) {
+                        j_dta->update(weight, r_dta, *f_dta);
+                        o_dta->update(weight, r_dta, *f_dta);
+                    }
+                    st->end_update(weight);
+                    if (u_dta)
+                        update_rollups(*u_dta, weight, r_dta, g_dta,
+                                       f_dta.get(), o_dta.get());
                     if (weight > 1) {
                         syslog(LOG_WARNING,
                                "timer_getoverrun() returned %d", tmr_or);
@@ -166,6 +350,8 @@ int daemon_main(bool foreground, std::uint32_t timeout)
                 }
             }
         }
+        cpu_stats::index::remove();
+        cpu_stats::state::close(st);
         {
             std::stringstream s;
             r_dta.to_stream(s, false);
@@ -174,6 +360,22 @@ int daemon_main(bool foreground, std::uint32_t timeout)
                 syslog(LOG_INFO, "%s", l.c_str());
             }
         }
+        {
+            std::stringstream s;
+            x_dta.limits_to_stream(s);
+            std::string l;
+            while (std::getline(s, l).good()) {
+                syslog(LOG_INFO, "%s", l.c_str());
+            }
+        }
+        {
+            std::stringstream s;
+            c_dta.to_stream(s, false);
+            std::string l;
+            while (std::getline(s, l).good()) {
+                syslog(LOG_INFO, "%s", l.c_str());
+            }
+        }
         {
             std::stringstream s;
             g_dta.to_stream(s, false);
@@ -184,7 +386,81 @@ int daemon_main(bool foreground, std::uint32_t timeout)
         }
         {
             std::stringstream s;
-            f_dta.to_stream(s, false);
+            m_dta.to_stream(s, true);
+            std::string l;
+            while (std::getline(s, l).good()) {
+                syslog(LOG_INFO, "%s", l.c_str());
+            }
+        }
+        {
+            std::stringstream s;
+            t_dta.to_stream(s, true);
+            std::string l;
+            while (std::getline(s, l).good()) {
+                syslog(LOG_INFO, "%s", l.c_str());
+            }
+        }
+        {
+            std::stringstream s;
+            h_dta.to_stream(s, false);
+            std::string l;
+            while (std::getline(s, l).good()) {
+                syslog(LOG_INFO, "%s", l.c_str());
+            }
+        }
+        if (j_dta) {
+            std::stringstream s;
+            j_dta->to_stream(s, false);
+            std::string l;
+            while (std::getline(s, l).good()) {
+                syslog(LOG_INFO, "%s", l.c_str());
+            }
+        }
+        if (o_dta) {
+            std::stringstream s;
+            o_dta->to_stream(s, true);
+            std::string l;
+            while (std::getline(s, l).good()) {
+                syslog(LOG_INFO, "%s", l.c_str());
+            }
+        }
+        {
+            std::stringstream s;
+            i_dta.to_stream(s, true);
+            std::string l;
+            while (std::getline(s, l).good()) {
+                syslog(LOG_INFO, "%s", l.c_str());
+            }
+        }
+        {
+            std::stringstream s;
+            q_dta.to_stream(s, true);
+            std::string l;
+            while (std::getline(s, l).good()) {
+                syslog(LOG_INFO, "%s", l.c_str());
+            }
+        }
+        {
+            std::stringstream s;
+            s_dta.to_stream(s, true);
+            std::string l;
+            while (std::getline(s, l).good()) {
+                syslog(LOG_INFO, "%s", l.c_str());
+            }
+        }
+        if (f_dta)
+            f_dta->to_syslog(LOG_INFO, false);
+        {
+            std::stringstream s;
+            x_dta.to_stream(s, true);
+            std::string l;
+            while (std::getline(s, l).good()) {
+                syslog(LOG_INFO, "%s", l.c_str());
+            }
+        }
+        {
+            std::stringstream s;
+            v_dta.to_stream(s, true);
             std::string l;
             while (std::getline(s, l).good()) {
                 syslog(LOG_INFO, "%s", l.c_str());
@@ -202,11 +478,35 @@ int daemon_main(bool foreground, std::uint32_t timeout)
 void
 usage(const char* argv)
 {
-    std::cerr << argv << " [-f] [-t X] [-h]\n"
-              << "-f    stay in foreground\n"
-              << "-t X  sample every X seconds, 0<X<=60, default "
+    std::cerr << argv << " [-f] [-t X] [-d DIR] [-r M,H,D] [-w LIST]\n"
+              << "    [-m PATH] [-L PCT] [-P LIST] [-h]\n"
+              << "-f        stay in foreground\n"
+              << "-t X      sample every X seconds, 0<X<=60, default "
               << default_timeout_seconds<< "\n"
-              << "-h    print this information and exit\n";
+              << "-d DIR    directory of the rollup files, default "
+              << rollup_stats::default_dir << ", -d '' disables them\n"
+              << "-r M,H,D  number of minute, hour and day rollups "
+                 "kept, default "
+              << rollup_stats::default_retention[0] << ','
+              << rollup_stats::default_retention[1] << ','
+              << rollup_stats::default_retention[2] << "\n"
+              << "-w LIST   comma separated list of hwmon devices like\n"
+                 "          power_meter and channels like\n"
+                 "          amd_energy/energy1_input to monitor or all,\n"
+                 "          default none\n"
+              << "-m PATH   template of the msr device files for the\n"
+                 "          amd core energy, %u is replaced by the cpu,\n"
+                 "          %r by the register for tests, default\n"
+                 "          " << msr_stats::msr::default_path
+              << ", -m '' disables it, disabled in virtual\n"
+                 "          machines if not given\n"
+              << "-L PCT    margin in percent below the rapl power limits\n"
+                 "          counted as time at the limit, default "
+              << throttle_stats::default_margin*1e2 << "\n"
+              << "-P LIST   comma separated list of cgroups whose pressure\n"
+                 "          files are monitored besides the system, relative\n"
+                 "          to /sys/fs/cgroup if not absolute, default none\n"
+              << "-h        print this information and exit\n";
     std::exit(3);
 }
 
@@ -214,15 +514,50 @@ int main(int argc, char** argv)
 {
     char c;
     std::int32_t timeout=default_timeout_seconds;
-    bool foreground=false;
-    while ((c=getopt(argc, argv, "hft:")) != -1) {
+    config cfg;
+    cfg._foreground=false;
+    cfg._rollup_dir=rollup_stats::default_dir;
+    cfg._msr_path=msr_stats::msr::default_path;
+    cfg._msr_path_set=false;
+    cfg._limit_margin=throttle_stats::default_margin;
+    std::copy(std::begin(rollup_stats::default_retention),
+              std::end(rollup_stats::default_retention),
+              std::begin(cfg._retention));
+    while ((c=getopt(argc, argv, "hft:d:r:w:m:L:P:")) != -1) {
         switch (c) {
         case 'f':
-            foreground=true;
+            cfg._foreground=true;
             break;
         case 't':
             timeout=std::atoi(optarg);
             break;
+        case 'd':
+            cfg._rollup_dir=optarg;
+            break;
+        case 'r':
+            if (std::sscanf(optarg, "%u,%u,%u",
+                            &cfg._retention[0],
+                            &cfg._retention[1],
+                            &cfg._retention[2])!=3)
+                usage(argv[0]);
+            break;
+        case 'w':
+            cfg._hwmon=optarg;
+            break;
+        case 'm':
+            cfg._msr_path=optarg;
+            cfg._msr_path_set=true;
+            break;
+        case 'L': {
+            double m=std::atof(optarg);
+            if (!(m >= 0.0 && m < 100.0))
+                usage(argv[0]);
+            cfg._limit_margin=m*1e-2;
+            break;
+        }
+        case 'P':
+            cfg._psi_cgroups=optarg;
+            break;
         case 'h':
         default:
             usage(argv[0]);
@@ -237,5 +572,6 @@ int main(int argc, char** argv)
                   << std::endl;
         std::exit(3);
     }
-    return daemon_main(foreground, timeout);
+    cfg._timeout=timeout;
+    return daemon_main(cfg);
 }
@@ -0,0 +1,147 @@
+//
+//  Copyright (C) 2020-2026  Axel Zeuner
+//
+//  This program is free software; you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation; either version 2 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program; if not, write to the Free Software
+//  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+//
+#include "cpu-stats.h"
+#include <cstring>
+#include <algorithm>
+#include <stdexcept>
+#include <vector>
+
+struct cpu_stats::index::header {
+    char _magic[8];
+    std::uint32_t _version;
+    std::uint32_t _count;
+    // start time of the daemon
+    std::int64_t _start_s;
+};
+
+struct cpu_stats::index::entry {
+    // name of the segment
+    char _name[48];
+    // size of the segment
+    std::uint64_t _size;
+};
+
+namespace {
+    const char index_magic[8]="cpustix";
+    const std::uint32_t index_version=1;
+    const std::string mark_prefix="/cpu_stats_mark_";
+}
+
+std::string
+cpu_stats::index::name()
+{
+    return "/cpu_stats_index";
+}
+
+void
+cpu_stats::index::create()
+{
+    const state* st=state::open();
+    std::vector<std::string> names=tools::shm::list("/cpu_stats_");
+    std::vector<std::pair<std::string, std::size_t>> v;
+    for (const auto& n : names) {
+        if (n==state::name() || n==name() ||
+            n.compare(0, mark_prefix.length(), mark_prefix)==0)
+            continue;
+        if (n.length() >= sizeof(entry::_name))
+            continue;
+        v.emplace_back(n, tools::shm::size(n));
+    }
+    // the entries are sorted by name
+    std::size_t total=sizeof(header) + v.size()*sizeof(entry);
+    std::string fn=name();
+    tools::shm::unlink(fn);
+    char* addr=static_cast<char*>(tools::shm::create(fn, total, 0644));
+    header* h=reinterpret_cast<header*>(addr);
+    entry* pe=reinterpret_cast<entry*>(addr + sizeof(header));
+    for (std::size_t i=0; i<v.size(); ++i) {
+        std::strncpy(pe[i]._name, v[i].first.c_str(), sizeof(pe[i]._name));
+        pe[i]._size=v[i].second;
+    }
+    h->_version=index_version;
+    h->_count=v.size();
+    h->_start_s=st->start_s();
+    std::memcpy(h->_magic, index_magic, sizeof(h->_magic));
+    tools::shm::unmap(addr, total);
+    state::close(st);
+}
+
+void
+cpu_stats::index::remove()
+{
+    tools::shm::unlink(name());
+}
+
+cpu_stats::index::index()
+    : _h(nullptr), _size(0)
+{
+    std::string fn=name();
+    std::size_t s=tools::shm::size(fn);
+    if (s < sizeof(header)) {
+        std::string msg="could not open " + fn;
+        throw std::runtime_error(msg);
+    }
+    const void* addr=tools::shm::open_ro(fn, s);
+    const header* h=static_cast<const header*>(addr);
+    if (std::memcmp(h->_magic, index_magic, sizeof(h->_magic))!=0 ||
+        h->_version != index_version ||
+        sizeof(header) + h->_count*sizeof(entry) > s) {
+        tools::shm::unmap(const_cast<void*>(addr), s);
+        std::string msg="invalid index " + fn;
+        throw std::runtime_error(msg);
+    }
+    _h=h;
+    _size=s;
+}
+
+cpu_stats::index::~index()
+{
+    tools::shm::unmap(const_cast<header*>(_h), _size);
+}
+
+std::vector<std::string>
+cpu_stats::index::list(const std::string& prefix)
+    const
+{
+    std::vector<std::string> r;
+    const char* base=reinterpret_cast<const char*>(_h);
+    const entry* b=reinterpret_cast<const entry*>(base + sizeof(header));
+    const entry* e=b + _h->_count;
+    const entry* i=std::lower_bound(
+        b, e, prefix,
+        [](const entry& a, const std::string& n) {
+            return std::strncmp(a._name, n.c_str(), sizeof(a._name)) < 0;
+        });
+    for (; i != e; ++i) {
+        std::size_t l=strnlen(i->_name, sizeof(i->_name));
+        if (l < prefix.length() ||
+            prefix.compare(0, prefix.length(), i->_name,
+                           prefix.length()) != 0)
+            break;
+        r.emplace_back(i->_name, l);
+    }
+    return r;
+}
+
+std::vector<std::string>
+cpu_stats::segments(const std::string& prefix)
+{
+    // a restarted daemon creates a new index, never keep the old one
+    const index idx;
+    return idx.list(prefix);
+}
@@ -0,0 +1,343 @@
+//
+//  Copyright (C) 2020-2026  Axel Zeuner
+//
+//  This program is free software; you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation; either version 2 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program; if not, write to the Free Software
+//  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+//
+#include "cpu-stats.h"
+#include <cstring>
+#include <algorithm>
+#include <stdexcept>
+#include <vector>
+#include <time.h>
+
+struct cpu_stats::mark::header {
+    char _magic[8];
+    std::uint32_t _version;
+    std::uint32_t _count;
+    // start time of the daemon
+    std::int64_t _start_s;
+    // creation time of the mark
+    std::int64_t _created_s;
+    // ticks of the daemon at creation time
+    std::uint64_t _ticks;
+};
+
+struct cpu_stats::mark::source {
+    std::string _name;
+    const void* _p;
+    std::size_t _size;
+};
+
+struct cpu_stats::mark::entry {
+    // name of the segment
+    char _name[48];
+    // offset of the copy from the start of the mark
+    std::uint64_t _offset;
+    // size of the copy
+    std::uint64_t _size;
+};
+
+namespace {
+    const char mark_magic[8]="cpustmk";
+    const std::uint32_t mark_version=1;
+    const std::string mark_prefix="/cpu_stats_mark_";
+}
+
+std::string
+cpu_stats::mark::name(const std::string& mark_name)
+{
+    return mark_prefix + mark_name;
+}
+
+bool
+cpu_stats::mark::valid_name(const std::string& mark_name)
+{
+    if (mark_name.empty() || mark_name.length() > 64)
+        return false;
+    for (char c : mark_name) {
+        if (!((c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') ||
+              (c >= '0' && c <= '9') || c=='_' || c=='-' || c=='.'))
+            return false;
+    }
+    return true;
+}
+
+std::vector<std::string>
+cpu_stats::mark::all_sources()
+{
+    std::vector<std::string> r;
+    std::vector<std::string> names=tools::shm::list("/cpu_stats_");
+    for (const auto& n : names) {
+        if (n==state::name() || n==index::name() ||
+            n.compare(0, mark_prefix.length(), mark_prefix)==0)
+            continue;
+        r.push_back(n);
+    }
+    return r;
+}
+
+void
+cpu_stats::mark::map_sources(std::vector<source>& v,
+                             std::vector<std::string> names)
+{
+    // the entries of a mark are sorted by name
+    std::sort(names.begin(), names.end());
+    names.erase(std::unique(names.begin(), names.end()), names.end());
+    for (const auto& n : names) {
+        if (n.length() >= sizeof(entry::_name))
+            continue;
+        std::size_t s=tools::shm::size(n);
+        if (s==0)
+            continue;
+        const void* p=tools::shm::open_ro(n, s);
+        v.push_back(source{n, p, s});
+    }
+}
+
+void
+cpu_stats::mark::unmap_sources(std::vector<source>& v)
+{
+    for (std::size_t i=0; i<v.size(); ++i) {
+        tools::shm::unmap(const_cast<void*>(v[i]._p), v[i]._size);
+    }
+    v.clear();
+}
+
+std::size_t
+cpu_stats::mark::layout(const std::vector<source>& v,
+                        std::vector<std::size_t>& offs)
+{
+    // entries are sorted by name, the copies are 64 byte aligned
+    std::size_t hs=sizeof(header) + v.size()*sizeof(entry);
+    std::size_t total=(hs+63) & ~std::size_t(63);
+    offs.resize(v.size());
+    for (std::size_t i=0; i<v.size(); ++i) {
+        offs[i]=total;
+        total += (v[i]._size + 63) & ~std::size_t(63);
+    }
+    return total;
+}
+
+void
+cpu_stats::mark::copy(char* addr, const state* st,
+                      const std::vector<source>& v,
+                      const std::vector<std::size_t>& offs)
+{
+    header* h=reinterpret_cast<header*>(addr);
+    entry* pe=reinterpret_cast<entry*>(addr + sizeof(header));
+    for (std::size_t i=0; i<v.size(); ++i) {
+        std::strncpy(pe[i]._name, v[i]._name.c_str(),
+                     sizeof(pe[i]._name));
+        pe[i]._offset=offs[i];
+        pe[i]._size=v[i]._size;
+    }
+    // copy all segments between two updates of the daemon
+    std::uint64_t seq;
+    do {
+        if (!st->read_begin(seq))
+            throw std::runtime_error("the daemon did not finish an update");
+        for (std::size_t i=0; i<v.size(); ++i) {
+            std::memcpy(addr + offs[i], v[i]._p, v[i]._size);
+        }
+        h->_ticks=st->ticks();
+    } while (st->read_retry(seq));
+    h->_version=mark_version;
+    h->_count=v.size();
+    h->_start_s=st->start_s();
+    h->_created_s=::time(nullptr);
+    std::memcpy(h->_magic, mark_magic, sizeof(h->_magic));
+}
+
+void
+cpu_stats::mark::create(const std::string& mark_name)
+{
+    if (!valid_name(mark_name)) {
+        std::string msg="invalid mark name " + mark_name;
+        throw std::runtime_error(msg);
+    }
+    const state* st=state::open();
+    std::vector<source> v;
+    try {
+        map_sources(v, all_sources());
+        std::vector<std::size_t> offs;
+        std::size_t total=layout(v, offs);
+        // the mark is built under a temporary name and replaces an
+        // older mark atomically, '~' is not valid in mark names
+        std::string fn=name(mark_name);
+        std::string tn=fn + '~' + std::to_string(::getpid());
+        tools::shm::unlink(tn);
+        char* addr=static_cast<char*>(tools::shm::create(tn, total, 0644));
+        try {
+            copy(addr, st, v, offs);
+        }
+        catch (const std::runtime_error& e) {
+            tools::shm::unmap(addr, total);
+            tools::shm::unlink(tn);
+            throw;
+        }
+        tools::shm::unmap(addr, total);
+        if (!tools::shm::rename(tn, fn)) {
+            tools::shm::unlink(tn);
+            std::string msg="could not create mark " + mark_name;
+            throw std::runtime_error(msg);
+        }
+    }
+    catch (const std::runtime_error& e) {
+        unmap_sources(v);
+        state::close(st);
+        throw;
+    }
+    unmap_sources(v);
+    state::close(st);
+}
+
+void
+cpu_stats::mark::remove(const std::string& mark_name)
+{
+    if (!valid_name(mark_name)) {
+        std::string msg="invalid mark name " + mark_name;
+        throw std::runtime_error(msg);
+    }
+    tools::shm::unlink(name(mark_name));
+}
+
+cpu_stats::mark::mark(const std::string& mark_name)
+    : _h(nullptr), _size(0), _src(), _st(nullptr), _buf(), _live(nullptr)
+{
+    if (!valid_name(mark_name)) {
+        std::string msg="invalid mark name " + mark_name;
+        throw std::runtime_error(msg);
+    }
+    std::string fn=name(mark_name);
+    std::size_t s=tools::shm::size(fn);
+    if (s < sizeof(header)) {
+        std::string msg="could not open mark " + mark_name;
+        throw std::runtime_error(msg);
+    }
+    const void* addr=tools::shm::open_ro(fn, s);
+    const header* h=static_cast<const header*>(addr);
+    if (std::memcmp(h->_magic, mark_magic, sizeof(h->_magic))!=0 ||
+        h->_version != mark_version ||
+        sizeof(header) + h->_count*sizeof(entry) > s) {
+        tools::shm::unmap(const_cast<void*>(addr), s);
+        std::string msg="invalid mark " + mark_name;
+        throw std::runtime_error(msg);
+    }
+    _h=h;
+    _size=s;
+    try {
+        _live=state::open();
+    }
+    catch (const std::runtime_error& e) {
+        tools::shm::unmap(const_cast<header*>(_h), _size);
+        throw;
+    }
+}
+
+cpu_stats::mark::mark(const std::vector<std::string>& seg_names)
+    : _h(nullptr), _size(0), _src(), _st(nullptr), _buf(), _live(nullptr)
+{
+    _st=state::open();
+    _live=_st;
+    try {
+        map_sources(_src, seg_names);
+        refresh();
+    }
+    catch (const std::runtime_error& e) {
+        unmap_sources(_src);
+        state::close(_st);
+        throw;
+    }
+}
+
+cpu_stats::mark::~mark()
+{
+    if (_st != nullptr) {
+        unmap_sources(_src);
+        state::close(_st);
+    } else {
+        tools::shm::unmap(const_cast<header*>(_h), _size);
+        state::close(_live);
+    }
+}
+
+void
+cpu_stats::mark::refresh()
+{
+    if (_st == nullptr)
+        throw std::runtime_error("refresh of a named mark");
+    std::vector<std::size_t> offs;
+    std::size_t total=layout(_src, offs);
+    if (_size != total) {
+        _buf.resize(total/sizeof(_buf[0]));
+        _size=total;
+    }
+    char* addr=reinterpret_cast<char*>(_buf.data());
+    copy(addr, _st, _src, offs);
+    _h=reinterpret_cast<const header*>(addr);
+}
+
+const void*
+cpu_stats::mark::find(const std::string& seg_name, std::size_t s)
+    const
+{
+    const char* base=reinterpret_cast<const char*>(_h);
+    const entry* b=reinterpret_cast<const entry*>(base + sizeof(header));
+    const entry* e=b + _h->_count;
+    const entry* r=std::lower_bound(
+        b, e, seg_name,
+        [](const entry& a, const std::string& n) {
+            return std::strncmp(a._name, n.c_str(), sizeof(a._name)) < 0;
+        });
+    if (r==e ||
+        std::strncmp(r->_name, seg_name.c_str(), sizeof(r->_name))!=0 ||
+        r->_size != s ||
+        r->_offset + r->_size > _size)
+        return nullptr;
+    return base + r->_offset;
+}
+
+void
+cpu_stats::mark::read_live(void* b, const void* p, std::size_t s)
+    const
+{
+    std::uint64_t seq;
+    do {
+        if (!_live->read_begin(seq))
+            throw std::runtime_error("the daemon did not finish an update");
+        std::memcpy(b, p, s);
+    } while (_live->read_retry(seq));
+}
+
+std::int64_t
+cpu_stats::mark::start_s()
+    const
+{
+    return _h->_start_s;
+}
+
+std::int64_t
+cpu_stats::mark::created_s()
+    const
+{
+    return _h->_created_s;
+}
+
+std::uint64_t
+cpu_stats::mark::ticks()
+    const
+{
+    return _h->_ticks;
+}
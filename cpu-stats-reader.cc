@@ -0,0 +1,428 @@
+//
+//  Copyright (C) 2020-2026  Axel Zeuner
+//
+//  This program is free software; you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation; either version 2 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program; if not, write to the Free Software
+//  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+//
+#include "cpu-stats-reader.h"
+#include "cpu-stats.h"
+#include "cpufreq_stats.h"
+#include "rapl_stats.h"
+#include <cerrno>
+#include <cmath>
+#include <cstring>
+#include <memory>
+#include <new>
+#include <numeric>
+#include <stdexcept>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+// the segments of the daemon mapped by a reader
+struct cpustats_reader {
+    // the state of the daemon at the time of opening, unlinked by
+    // a stop or a restart of the daemon
+    tools::file_handle _st_fd;
+    const cpu_stats::state* _st;
+    std::unique_ptr<cpufreq_stats::data> _f;
+    std::unique_ptr<rapl_stats::data> _r;
+    // offsets of the copies in a snapshot
+    std::size_t _f_off;
+    std::size_t _r_off;
+    std::size_t _size;
+
+    cpustats_reader(bool all_cpus);
+    ~cpustats_reader();
+};
+
+namespace {
+
+    // header of a snapshot, followed by the 64 byte aligned copies
+    // of the cpufreq and the rapl segments
+    struct snap_header {
+        char _magic[8];
+        std::uint32_t _cpus;
+        std::uint32_t _zones;
+        std::uint64_t _ticks;
+        std::int64_t _start_s;
+    };
+
+    const char snap_magic[8]="cpustsn";
+
+    std::size_t
+    aligned(std::size_t s)
+    {
+        return (s + 63) & ~std::size_t(63);
+    }
+
+    // true if the daemon of r was stopped or restarted, the
+    // segments of r are not updated anymore
+    bool
+    stale(const cpustats_reader* r)
+    {
+        struct stat st;
+        return fstat(r->_st_fd(), &st)!=0 || st.st_nlink==0;
+    }
+
+    const snap_header*
+    header(const cpustats_reader* r, const void* snap)
+    {
+        const snap_header* h=static_cast<const snap_header*>(snap);
+        if (std::memcmp(h->_magic, snap_magic, sizeof(h->_magic))!=0 ||
+            h->_cpus != r->_f->segments().size() ||
+            h->_zones != r->_r->segments().size() ||
+            h->_start_s != r->_st->start_s())
+            return nullptr;
+        return h;
+    }
+
+    // the segment of cpu idx in snap or the mapped segment
+    const cpufreq_stats::shm_seg*
+    freq_seg(const cpustats_reader* r, const void* snap, std::uint32_t idx)
+    {
+        const auto& v=r->_f->segments();
+        if (idx >= v.size())
+            return nullptr;
+        if (snap==nullptr)
+            return v[idx];
+        if (header(r, snap)==nullptr)
+            return nullptr;
+        const char* b=static_cast<const char*>(snap) + r->_f_off +
+            idx*aligned(sizeof(cpufreq_stats::shm_seg));
+        return reinterpret_cast<const cpufreq_stats::shm_seg*>(b);
+    }
+
+    const rapl_stats::shm_seg*
+    power_seg(const cpustats_reader* r, const void* snap, std::uint32_t idx)
+    {
+        const auto& v=r->_r->segments();
+        if (idx >= v.size())
+            return nullptr;
+        if (snap==nullptr)
+            return v[idx];
+        if (header(r, snap)==nullptr)
+            return nullptr;
+        const char* b=static_cast<const char*>(snap) + r->_r_off +
+            idx*aligned(sizeof(rapl_stats::shm_seg));
+        return reinterpret_cast<const rapl_stats::shm_seg*>(b);
+    }
+}
+
+cpustats_reader::cpustats_reader(bool all_cpus)
+    : _st_fd(shm_open(cpu_stats::state::name().c_str(), O_RDONLY, 0)),
+      _st(cpu_stats::state::open()), _f(), _r(),
+      _f_off(0), _r_off(0), _size(0)
+{
+    try {
+        cpu_stats::selection sel;
+        if (!all_cpus && !sel.affinity())
+            throw std::runtime_error("no usable cpu");
+        _f=std::make_unique<cpufreq_stats::data>(
+            false, all_cpus ? nullptr : &sel);
+        _r=std::make_unique<rapl_stats::data>(false);
+    }
+    catch (...) {
+        cpu_stats::state::close(_st);
+        throw;
+    }
+    _f_off=aligned(sizeof(snap_header));
+    _r_off=_f_off +
+        _f->segments().size()*aligned(sizeof(cpufreq_stats::shm_seg));
+    _size=_r_off +
+        _r->segments().size()*aligned(sizeof(rapl_stats::shm_seg));
+}
+
+cpustats_reader::~cpustats_reader()
+{
+    cpu_stats::state::close(_st);
+}
+
+const char*
+cpustats_version(void)
+{
+    return cpu_stats::version;
+}
+
+std::uint32_t
+cpustats_api_version(void)
+{
+    return CPUSTATS_API_VERSION;
+}
+
+namespace {
+
+    cpustats_reader*
+    open(bool all_cpus)
+    {
+        try {
+            return new cpustats_reader(all_cpus);
+        }
+        catch (const std::bad_alloc& e) {
+            errno=ENOMEM;
+        }
+        catch (const std::exception& e) {
+            errno=ENOENT;
+        }
+        return nullptr;
+    }
+}
+
+cpustats_reader*
+cpustats_open(void)
+{
+    return open(true);
+}
+
+cpustats_reader*
+cpustats_open_usable(void)
+{
+    return open(false);
+}
+
+void
+cpustats_close(cpustats_reader* r)
+{
+    delete r;
+}
+
+std::uint32_t
+cpustats_cpus(const cpustats_reader* r)
+{
+    return r->_f->segments().size();
+}
+
+std::uint32_t
+cpustats_zones(const cpustats_reader* r)
+{
+    return r->_r->segments().size();
+}
+
+std::uint32_t
+cpustats_interval_s(const cpustats_reader* r)
+{
+    return r->_st->timeout();
+}
+
+std::int64_t
+cpustats_start_s(const cpustats_reader* r)
+{
+    return r->_st->start_s();
+}
+
+std::size_t
+cpustats_snapshot_size(const cpustats_reader* r)
+{
+    return r->_size;
+}
+
+int
+cpustats_snapshot(const cpustats_reader* r, void* buf, std::size_t size)
+{
+    if (size < r->_size || (reinterpret_cast<std::uintptr_t>(buf) & 63)) {
+        errno=EINVAL;
+        return -1;
+    }
+    if (stale(r)) {
+        errno=ESTALE;
+        return -1;
+    }
+    char* b=static_cast<char*>(buf);
+    snap_header* h=static_cast<snap_header*>(buf);
+    const auto& fv=r->_f->segments();
+    const auto& rv=r->_r->segments();
+    const std::size_t fs=aligned(sizeof(cpufreq_stats::shm_seg));
+    const std::size_t rs=aligned(sizeof(rapl_stats::shm_seg));
+    // copy all segments between two updates of the daemon
+    std::uint64_t seq;
+    do {
+        if (!r->_st->read_begin(seq))
+            return -1;
+        for (std::size_t i=0; i<fv.size(); ++i)
+            std::memcpy(b + r->_f_off + i*fs, fv[i],
+                        sizeof(cpufreq_stats::shm_seg));
+        for (std::size_t i=0; i<rv.size(); ++i)
+            std::memcpy(b + r->_r_off + i*rs, rv[i],
+                        sizeof(rapl_stats::shm_seg));
+        h->_ticks=r->_st->ticks();
+    } while (r->_st->read_retry(seq));
+    h->_cpus=fv.size();
+    h->_zones=rv.size();
+    h->_start_s=r->_st->start_s();
+    std::memcpy(h->_magic, snap_magic, sizeof(h->_magic));
+    return 0;
+}
+
+std::uint64_t
+cpustats_snapshot_ticks(const void* snap)
+{
+    return static_cast<const snap_header*>(snap)->_ticks;
+}
+
+int
+cpustats_freq(const cpustats_reader* r, const void* snap, std::uint32_t idx,
+              cpustats_freq_view* v)
+{
+    const cpufreq_stats::shm_seg* p=freq_seg(r, snap, idx);
+    if (p==nullptr) {
+        errno=EINVAL;
+        return -1;
+    }
+    v->cpu=p->cpu();
+    v->entries_count=cpufreq_stats::shm_seg::FREQ_ENTRIES;
+    v->min_f_khz=p->min_f_khz();
+    v->max_f_khz=p->max_f_khz();
+    v->last_f_khz=p->last_f_khz();
+    v->transitions=p->transitions();
+    v->entries=p->begin();
+    v->busy_entries=p->busy_begin();
+    v->busy_scale=cpufreq_stats::shm_seg::busy_scale;
+    return 0;
+}
+
+int
+cpustats_power(const cpustats_reader* r, const void* snap, std::uint32_t zone,
+               cpustats_power_view* v)
+{
+    const rapl_stats::shm_seg* p=power_seg(r, snap, zone);
+    if (p==nullptr) {
+        errno=EINVAL;
+        return -1;
+    }
+    v->pkg=p->pkg();
+    v->sub=p->sub();
+    std::strncpy(v->name, p->zone_name(), sizeof(v->name)-1);
+    v->name[sizeof(v->name)-1]=0;
+    v->entries_count=rapl_stats::shm_seg::POWER_ENTRIES;
+    v->joule=p->joule();
+    v->last_power_w=p->power();
+    v->entries=p->begin();
+    return 0;
+}
+
+double
+cpustats_freq_bin_khz(std::uint32_t i)
+{
+    return cpufreq_stats::shm_seg::idx_to_freq(i);
+}
+
+double
+cpustats_power_bin_w(std::uint32_t i)
+{
+    return rapl_stats::shm_seg::idx_to_power(i);
+}
+
+namespace {
+
+    // sums of the samples and of the samples times the frequencies
+    // of the entries in b minus the entries in a
+    template <typename _T>
+    void
+    sum_freq(double& s, double& sf, const _T* b, const _T* a)
+    {
+        for (std::size_t i=0; i<cpufreq_stats::shm_seg::FREQ_ENTRIES; ++i) {
+            double ni=double(b[i] - (a ? a[i] : 0));
+            s += ni;
+            sf += ni*cpufreq_stats::shm_seg::idx_to_freq(i);
+        }
+    }
+
+    // weighted mean of the frequencies of cpu idx or of all cpus
+    // for CPUSTATS_ALL_CPUS between older and newer, busy weighted
+    // if busy is true
+    double
+    avg_freq(const cpustats_reader* r, const void* older, const void* newer,
+             std::uint32_t idx, bool busy)
+    {
+        std::uint32_t b=idx, e=idx+1;
+        if (idx==CPUSTATS_ALL_CPUS) {
+            b=0;
+            e=r->_f->segments().size();
+        }
+        double s=0.0, sf=0.0;
+        for (std::uint32_t i=b; i<e; ++i) {
+            const cpufreq_stats::shm_seg* pn=freq_seg(r, newer, i);
+            const cpufreq_stats::shm_seg* po=
+                older ? freq_seg(r, older, i) : nullptr;
+            if (pn==nullptr || (older && po==nullptr))
+                return NAN;
+            if (busy)
+                sum_freq(s, sf, pn->busy_begin(),
+                         po ? po->busy_begin() : nullptr);
+            else
+                sum_freq(s, sf, pn->begin(), po ? po->begin() : nullptr);
+        }
+        return s > 0.0 ? sf/s : NAN;
+    }
+}
+
+double
+cpustats_avg_freq_khz(const cpustats_reader* r, const void* older,
+                      const void* newer, std::uint32_t idx)
+{
+    return avg_freq(r, older, newer, idx, false);
+}
+
+double
+cpustats_busy_freq_khz(const cpustats_reader* r, const void* older,
+                       const void* newer, std::uint32_t idx)
+{
+    return avg_freq(r, older, newer, idx, true);
+}
+
+double
+cpustats_avg_power_w(const cpustats_reader* r, const void* older,
+                     const void* newer, std::uint32_t zone)
+{
+    const rapl_stats::shm_seg* pn=power_seg(r, newer, zone);
+    if (pn==nullptr)
+        return NAN;
+    // the entries are the measured milliseconds, like in the
+    // output of cpu-stats
+    double j=pn->joule();
+    std::uint64_t ms=std::accumulate(pn->begin(), pn->end(), std::uint64_t(0));
+    if (older != nullptr) {
+        const rapl_stats::shm_seg* po=power_seg(r, older, zone);
+        if (po==nullptr)
+            return NAN;
+        j -= po->joule();
+        ms -= std::accumulate(po->begin(), po->end(), std::uint64_t(0));
+    }
+    double s=ms*1e-3;
+    return s > 0.0 ? j/s : NAN;
+}
+
+std::uint32_t
+cpustats_updates(const cpustats_reader* r)
+{
+    return r->_st->updates();
+}
+
+int
+cpustats_wait_update(const cpustats_reader* r, std::uint32_t updates,
+                     std::uint32_t timeout_ms)
+{
+    if (stale(r)) {
+        errno=ESTALE;
+        return -1;
+    }
+    if (r->_st->wait_update(updates, timeout_ms))
+        return 1;
+    // a stopped daemon does not update the old state anymore
+    if (stale(r)) {
+        errno=ESTALE;
+        return -1;
+    }
+    return 0;
+}
@@ -0,0 +1,281 @@
+//
+//  Copyright (C) 2020-2026  Axel Zeuner
+//
+//  This program is free software; you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation; either version 2 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program; if not, write to the Free Software
+//  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+//
+#if !defined (__CPU_STATS_READER_H__)
+#define __CPU_STATS_READER_H__ 1
+
+// stable reader interface of libcpustats.so for programs consuming
+// the power and frequency data of cpu-stats-daemon in process. The
+// C functions and structures only change compatibly, a new
+// CPUSTATS_API_VERSION adds functions with the symbol version
+// CPUSTATS_<version>, the C++ class is an inline wrapper around
+// them.
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define CPUSTATS_API_VERSION 2
+
+// the cpu index of the sums over all cpus of a reader
+#define CPUSTATS_ALL_CPUS UINT32_MAX
+
+#if defined (__cplusplus)
+extern "C" {
+#endif
+
+    typedef struct cpustats_reader cpustats_reader;
+
+    // zero copy view of the frequency histogram of one cpu, either
+    // over the mapped segment of the daemon or over a snapshot
+    struct cpustats_freq_view {
+        uint32_t cpu;
+        uint32_t entries_count;
+        double min_f_khz;
+        double max_f_khz;
+        double last_f_khz;
+        uint64_t transitions;
+        // ticks of the daemon per frequency, entries[i] counts the
+        // ticks at cpustats_freq_bin_khz(i)
+        const uint32_t* entries;
+        // ticks weighted by the busy fraction of the cpu in units
+        // of 1/busy_scale
+        const uint64_t* busy_entries;
+        double busy_scale;
+    };
+
+    // zero copy view of the power histogram of one rapl zone
+    struct cpustats_power_view {
+        // number of the top level zone, not the package id
+        uint32_t pkg;
+        // UINT32_MAX for the package zone itself
+        uint32_t sub;
+        char name[16];
+        uint32_t entries_count;
+        // energy since the start of the daemon
+        double joule;
+        double last_power_w;
+        // measured time per power range, entries[i] holds the
+        // milliseconds with a power below cpustats_power_bin_w(i)
+        const uint64_t* entries;
+    };
+
+    // version of the library, i.e. "0.5"
+    const char* cpustats_version(void);
+    // the CPUSTATS_API_VERSION of the library
+    uint32_t cpustats_api_version(void);
+
+    // map the segments of the running daemon, returns NULL and sets
+    // errno if the daemon is not running. cpustats_open maps all
+    // cpus, cpustats_open_usable (version 2) only the cpus usable by
+    // the process, i.e. the cpuset of a container
+    cpustats_reader* cpustats_open(void);
+    cpustats_reader* cpustats_open_usable(void);
+    void cpustats_close(cpustats_reader* r);
+
+    // discovery
+    uint32_t cpustats_cpus(const cpustats_reader* r);
+    uint32_t cpustats_zones(const cpustats_reader* r);
+    // sampling interval of the daemon in seconds
+    uint32_t cpustats_interval_s(const cpustats_reader* r);
+    // start of the daemon in seconds since the epoch
+    int64_t cpustats_start_s(const cpustats_reader* r);
+
+    // size of the buffers for cpustats_snapshot
+    size_t cpustats_snapshot_size(const cpustats_reader* r);
+    // consistent copy of all frequency and power data between two
+    // updates of the daemon into buf, which must be 64 byte aligned,
+    // returns 0 or -1 and sets errno, EAGAIN if the daemon did not
+    // finish an update, ESTALE if the daemon was stopped or restarted,
+    // close the reader and open a new one then
+    int cpustats_snapshot(const cpustats_reader* r, void* buf, size_t size);
+    // ticks of the daemon at the time of the snapshot
+    uint64_t cpustats_snapshot_ticks(const void* snap);
+
+    // views of cpu idx and zone idx of the snapshot snap or of the
+    // live data if snap is NULL, returns 0 or -1 and sets errno
+    int cpustats_freq(const cpustats_reader* r, const void* snap,
+                      uint32_t idx, struct cpustats_freq_view* v);
+    int cpustats_power(const cpustats_reader* r, const void* snap,
+                       uint32_t zone, struct cpustats_power_view* v);
+
+    // representative values of the histogram entries
+    double cpustats_freq_bin_khz(uint32_t i);
+    double cpustats_power_bin_w(uint32_t i);
+
+    // derived values: the average frequency of cpu idx, of all cpus
+    // of the reader for CPUSTATS_ALL_CPUS, and the
+    // average power of zone, the energy over the measured time,
+    // between the snapshots older and newer,
+    // since the start of the daemon if older is NULL and up to now if
+    // newer is NULL, NAN if there was no sample in between
+    double cpustats_avg_freq_khz(const cpustats_reader* r,
+                                 const void* older, const void* newer,
+                                 uint32_t idx);
+    double cpustats_busy_freq_khz(const cpustats_reader* r,
+                                  const void* older, const void* newer,
+                                  uint32_t idx);
+    double cpustats_avg_power_w(const cpustats_reader* r,
+                                const void* older, const void* newer,
+                                uint32_t zone);
+
+    // number of finished updates of the daemon
+    uint32_t cpustats_updates(const cpustats_reader* r);
+    // wait at most timeout_ms milliseconds until the number of
+    // finished updates differs from updates, returns 1 after an
+    // update, 0 on timeout and -1 with errno ESTALE if the daemon was
+    // stopped or restarted
+    int cpustats_wait_update(const cpustats_reader* r, uint32_t updates,
+                             uint32_t timeout_ms);
+
+#if defined (__cplusplus)
+}
+
+#include <cerrno>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+namespace cpu_stats {
+
+    // C++ interface of libcpustats.so
+    class reader {
+        cpustats_reader* _r;
+
+        static
+        void
+        check(int r, const char* what)
+        {
+            if (r != 0) {
+                std::string msg=what;
+                msg += ": ";
+                msg += std::strerror(errno);
+                throw std::runtime_error(msg);
+            }
+        }
+    public:
+        using freq_view = cpustats_freq_view;
+        using power_view = cpustats_power_view;
+
+        // a snapshot in a 64 byte aligned buffer
+        class snapshot {
+            struct alignas(64) line { char _b[64]; };
+            std::vector<line> _b;
+        public:
+            explicit snapshot(const reader& r)
+                : _b((cpustats_snapshot_size(r._r)+63)/64)
+            {
+                r.take(*this);
+            }
+            void* data() { return _b.data(); }
+            const void* data() const { return _b.data(); }
+            std::size_t size() const { return _b.size()*sizeof(line); }
+            std::uint64_t ticks() const
+            {
+                return cpustats_snapshot_ticks(data());
+            }
+        };
+
+        // all cpus or the cpus usable by the process
+        explicit
+        reader(bool usable_cpus=false)
+            : _r(usable_cpus ? cpustats_open_usable() : cpustats_open())
+        {
+            if (_r == nullptr)
+                check(-1, "could not open the data of cpu-stats-daemon");
+        }
+        ~reader()
+        {
+            cpustats_close(_r);
+        }
+        reader(const reader&) = delete;
+        reader&
+        operator=(const reader&) = delete;
+
+        std::uint32_t cpus() const { return cpustats_cpus(_r); }
+        std::uint32_t zones() const { return cpustats_zones(_r); }
+        std::uint32_t interval_s() const { return cpustats_interval_s(_r); }
+        std::int64_t start_s() const { return cpustats_start_s(_r); }
+
+        // refresh the snapshot s
+        void
+        take(snapshot& s) const
+        {
+            check(cpustats_snapshot(_r, s.data(), s.size()), "snapshot");
+        }
+
+        freq_view
+        freq(std::uint32_t idx, const snapshot* s=nullptr) const
+        {
+            freq_view v;
+            check(cpustats_freq(_r, s ? s->data() : nullptr, idx, &v),
+                  "frequency view");
+            return v;
+        }
+
+        power_view
+        power(std::uint32_t zone, const snapshot* s=nullptr) const
+        {
+            power_view v;
+            check(cpustats_power(_r, s ? s->data() : nullptr, zone, &v),
+                  "power view");
+            return v;
+        }
+
+        double
+        avg_freq_khz(std::uint32_t idx, const snapshot* older,
+                     const snapshot& newer) const
+        {
+            return cpustats_avg_freq_khz(
+                _r, older ? older->data() : nullptr, newer.data(), idx);
+        }
+
+        double
+        busy_freq_khz(std::uint32_t idx, const snapshot* older,
+                      const snapshot& newer) const
+        {
+            return cpustats_busy_freq_khz(
+                _r, older ? older->data() : nullptr, newer.data(), idx);
+        }
+
+        double
+        avg_power_w(std::uint32_t zone, const snapshot* older,
+                    const snapshot& newer) const
+        {
+            return cpustats_avg_power_w(
+                _r, older ? older->data() : nullptr, newer.data(), zone);
+        }
+
+        std::uint32_t updates() const { return cpustats_updates(_r); }
+
+        bool
+        wait_update(std::uint32_t updates, std::uint32_t timeout_ms) const
+        {
+            int r=cpustats_wait_update(_r, updates, timeout_ms);
+            if (r < 0)
+                check(r, "wait for update");
+            return r != 0;
+        }
+    };
+}
+
+#endif
+
+// Local variables:
+// mode: c++
+// end:
+#endif
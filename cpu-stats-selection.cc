@@ -0,0 +1,271 @@
+//
+//  Copyright (C) 2020-2026  Axel Zeuner
+//
+//  This program is free software; you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation; either version 2 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program; if not, write to the Free Software
+//  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+//
+#include "cpu-stats.h"
+#include <algorithm>
+#include <cerrno>
+#include <cstdlib>
+#include <fstream>
+#include <sstream>
+#include <sched.h>
+#include <unistd.h>
+
+namespace {
+
+    // the cpus in the affinity mask of the process
+    std::vector<bool>
+    affinity_cpus()
+    {
+        std::vector<bool> r;
+        for (int n=1024; n <= (1<<20); n*=2) {
+            cpu_set_t* cs=CPU_ALLOC(n);
+            std::size_t sz=CPU_ALLOC_SIZE(n);
+            CPU_ZERO_S(sz, cs);
+            if (sched_getaffinity(0, sz, cs)==0) {
+                for (int i=0; i<n; ++i) {
+                    if (CPU_ISSET_S(i, sz, cs)) {
+                        r.resize(i+1, false);
+                        r[i]=true;
+                    }
+                }
+                CPU_FREE(cs);
+                break;
+            }
+            CPU_FREE(cs);
+            if (errno != EINVAL)
+                break;
+        }
+        return r;
+    }
+
+    std::string
+    first_line(const std::string& fn)
+    {
+        std::ifstream f(fn.c_str());
+        std::string l;
+        std::getline(f, l);
+        return l;
+    }
+
+    // the effective cpus of the cpuset of the cgroup of the process,
+    // of the nearest ancestor with a cpuset
+    std::string
+    cgroup_cpus()
+    {
+        std::ifstream f("/proc/self/cgroup");
+        std::string l, base, file, path;
+        while (std::getline(f, l)) {
+            // hierarchy-ID:controller-list:cgroup-path
+            std::size_t c0=l.find(':');
+            std::size_t c1= c0==std::string::npos ?
+                std::string::npos : l.find(':', c0+1);
+            if (c1==std::string::npos)
+                continue;
+            std::string ctrl=l.substr(c0+1, c1-c0-1);
+            if (l.compare(0, c0, "0")==0 && ctrl.empty()) {
+                // cgroup v2, unless cgroup v1 provides a cpuset
+                if (base.empty()) {
+                    base="/sys/fs/cgroup";
+                    file="cpuset.cpus.effective";
+                    path=l.substr(c1+1);
+                }
+            } else {
+                std::istringstream cs(ctrl);
+                std::string ci;
+                while (std::getline(cs, ci, ',')) {
+                    if (ci=="cpuset") {
+                        base="/sys/fs/cgroup/cpuset";
+                        file="cpuset.effective_cpus";
+                        path=l.substr(c1+1);
+                    }
+                }
+            }
+        }
+        if (base.empty())
+            return std::string();
+        while (true) {
+            std::string dn=base + path;
+            if (dn.back() != '/')
+                dn += '/';
+            std::string v=first_line(dn + file);
+            if (!v.empty())
+                return v;
+            if (path.empty() || path=="/")
+                break;
+            std::size_t s=path.rfind('/');
+            path= s==0 || s==std::string::npos ?
+                std::string("/") : path.substr(0, s);
+        }
+        return std::string();
+    }
+}
+
+cpu_stats::selection::selection()
+    : _cpus(), _pkgs(), _gpus()
+{
+}
+
+bool
+cpu_stats::selection::parse(const std::string& s, ranges& r)
+{
+    r.clear();
+    const char* p=s.c_str();
+    while (*p != 0) {
+        char* e;
+        if (*p < '0' || *p > '9')
+            return false;
+        unsigned long lo=std::strtoul(p, &e, 10);
+        unsigned long hi=lo;
+        if (*e == '-') {
+            p=e+1;
+            if (*p < '0' || *p > '9')
+                return false;
+            hi=std::strtoul(p, &e, 10);
+        }
+        if (hi < lo)
+            return false;
+        r.emplace_back(lo, hi);
+        if (*e == ',')
+            ++e;
+        else if (*e != 0)
+            return false;
+        p=e;
+    }
+    return !r.empty();
+}
+
+bool
+cpu_stats::selection::contains(const ranges& r, std::uint32_t v)
+{
+    if (r.empty())
+        return true;
+    return std::any_of(r.begin(), r.end(),
+                       [v](const std::pair<std::uint32_t,
+                                           std::uint32_t>& i) {
+                           return v >= i.first && v <= i.second;
+                       });
+}
+
+bool
+cpu_stats::selection::cpus(const std::string& s)
+{
+    return parse(s, _cpus);
+}
+
+bool
+cpu_stats::selection::pkgs(const std::string& s)
+{
+    return parse(s, _pkgs);
+}
+
+bool
+cpu_stats::selection::gpus(const std::string& s)
+{
+    _gpus.clear();
+    for (std::size_t b=0; b<s.size(); ) {
+        std::size_t e=s.find(',', b);
+        if (e == std::string::npos)
+            e=s.size();
+        if (e > b)
+            _gpus.emplace_back(s.substr(b, e-b));
+        b=e+1;
+    }
+    return !_gpus.empty();
+}
+
+bool
+cpu_stats::selection::cpu(std::uint32_t c)
+    const
+{
+    return contains(_cpus, c);
+}
+
+bool
+cpu_stats::selection::pkg(std::uint32_t p)
+    const
+{
+    return contains(_pkgs, p);
+}
+
+bool
+cpu_stats::selection::gpu(const std::string& pci)
+    const
+{
+    if (_gpus.empty())
+        return true;
+    return std::find(_gpus.begin(), _gpus.end(), pci) != _gpus.end();
+}
+
+bool
+cpu_stats::selection::affinity()
+{
+    std::vector<bool> a=affinity_cpus();
+    if (a.empty())
+        return true;
+    ranges cg;
+    bool has_cg=parse(cgroup_cpus(), cg);
+    for (std::size_t i=0; i<a.size(); ++i) {
+        a[i] = a[i] && contains(_cpus, i) && (!has_cg || contains(cg, i));
+    }
+    ranges r;
+    for (std::size_t i=0; i<a.size(); ++i) {
+        if (!a[i])
+            continue;
+        if (!r.empty() && r.back().second+1==i)
+            r.back().second=i;
+        else
+            r.emplace_back(i, i);
+    }
+    if (r.empty())
+        return false;
+    // no restriction if the process may use all configured cpus
+    long n=sysconf(_SC_NPROCESSORS_CONF);
+    if (_cpus.empty() && r.size()==1 && r[0].first==0 &&
+        n > 0 && r[0].second+1 >= std::uint32_t(n))
+        return true;
+    _cpus.swap(r);
+    return true;
+}
+
+bool
+cpu_stats::selection::restricted()
+    const
+{
+    return !_cpus.empty();
+}
+
+bool
+cpu_stats::selection::pkgs_restricted()
+    const
+{
+    return !_pkgs.empty();
+}
+
+std::string
+cpu_stats::selection::cpu_list()
+    const
+{
+    std::ostringstream s;
+    for (std::size_t i=0; i<_cpus.size(); ++i) {
+        if (i)
+            s << ',';
+        s << _cpus[i].first;
+        if (_cpus[i].second != _cpus[i].first)
+            s << '-' << _cpus[i].second;
+    }
+    return s.str();
+}
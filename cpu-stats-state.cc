@@ -0,0 +1,162 @@
+//
+//  Copyright (C) 2020-2026  Axel Zeuner
+//
+//  This program is free software; you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation; either version 2 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program; if not, write to the Free Software
+//  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+//
+#include "cpu-stats.h"
+#include <climits>
+#include <cerrno>
+#include <time.h>
+#include <sched.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+
+std::string
+cpu_stats::state::name()
+{
+    return "/cpu_stats_state";
+}
+
+cpu_stats::state::state(std::uint32_t timeout)
+    : _seq(0),
+      _start_s(::time(nullptr)),
+      _timeout(timeout),
+      _ticks(0),
+      _updates(0)
+{
+}
+
+cpu_stats::state::~state()
+{
+    tools::shm::unlink(name());
+}
+
+cpu_stats::state*
+cpu_stats::state::create(std::uint32_t timeout)
+{
+    std::string fn=name();
+    void* addr=tools::shm::create(fn, sizeof(state), 0644);
+    state* ret=new (addr) state(timeout);
+    return ret;
+}
+
+void
+cpu_stats::state::close(state* p)
+{
+    p->~state();
+    tools::shm::unmap(p, sizeof(state));
+}
+
+const cpu_stats::state*
+cpu_stats::state::open()
+{
+    std::string fn=name();
+    void* addr=tools::shm::open_ro(fn, sizeof(state));
+    const state* ret=reinterpret_cast<const state*>(addr);
+    return ret;
+}
+
+void
+cpu_stats::state::close(const state* p)
+{
+    void* ap=const_cast<state*>(p);
+    tools::shm::unmap(ap, sizeof(state));
+}
+
+void
+cpu_stats::state::begin_update()
+{
+    _seq.fetch_add(1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+}
+
+void
+cpu_stats::state::end_update(std::uint32_t weight)
+{
+    _ticks += weight;
+    _seq.fetch_add(1, std::memory_order_release);
+    _updates.fetch_add(1, std::memory_order_release);
+    // the segment is shared between processes, no FUTEX_PRIVATE_FLAG
+    ::syscall(SYS_futex, &_updates, FUTEX_WAKE, INT_MAX,
+              nullptr, nullptr, 0);
+}
+
+bool
+cpu_stats::state::read_begin(std::uint64_t& seq)
+    const
+{
+    struct timespec t0, t1;
+    ::clock_gettime(CLOCK_MONOTONIC, &t0);
+    while (((seq=_seq.load(std::memory_order_acquire)) & 1) != 0) {
+        ::clock_gettime(CLOCK_MONOTONIC, &t1);
+        std::int64_t ms=(t1.tv_sec - t0.tv_sec)*1000 +
+            (t1.tv_nsec - t0.tv_nsec)/1000000;
+        if (ms >= max_update_ms) {
+            errno=EAGAIN;
+            return false;
+        }
+        sched_yield();
+    }
+    return true;
+}
+
+bool
+cpu_stats::state::read_retry(std::uint64_t seq)
+    const
+{
+    std::atomic_thread_fence(std::memory_order_acquire);
+    return _seq.load(std::memory_order_relaxed) != seq;
+}
+
+std::uint32_t
+cpu_stats::state::updates()
+    const
+{
+    return _updates.load(std::memory_order_acquire);
+}
+
+bool
+cpu_stats::state::wait_update(std::uint32_t updates,
+                              std::uint32_t timeout_ms)
+    const
+{
+    struct timespec now, end;
+    ::clock_gettime(CLOCK_MONOTONIC, &now);
+    end.tv_sec = now.tv_sec + timeout_ms/1000;
+    end.tv_nsec = now.tv_nsec + (timeout_ms%1000)*1000000L;
+    if (end.tv_nsec >= 1000000000L) {
+        end.tv_nsec -= 1000000000L;
+        ++end.tv_sec;
+    }
+    while (_updates.load(std::memory_order_acquire) == updates) {
+        ::clock_gettime(CLOCK_MONOTONIC, &now);
+        struct timespec rel;
+        rel.tv_sec = end.tv_sec - now.tv_sec;
+        rel.tv_nsec = end.tv_nsec - now.tv_nsec;
+        if (rel.tv_nsec < 0) {
+            rel.tv_nsec += 1000000000L;
+            --rel.tv_sec;
+        }
+        if (rel.tv_sec < 0)
+            return false;
+        // FUTEX_WAIT returns immediately if _updates != updates
+        long r=::syscall(SYS_futex, &_updates, FUTEX_WAIT, updates,
+                         &rel, nullptr, 0);
+        if (r == -1 && errno == ETIMEDOUT)
+            return false;
+    }
+    return true;
+}
@@ -0,0 +1,400 @@
+//
+//  Copyright (C) 2020-2026  Axel Zeuner
+//
+//  This program is free software; you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation; either version 2 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program; if not, write to the Free Software
+//  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+//
+#include "cpu-stats.h"
+#include <charconv>
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <cerrno>
+#include <stdexcept>
+#include <unistd.h>
+
+namespace {
+    // header of the binary format, followed by the records:
+    // tag (1 byte), length of the name (1 byte), name, payload
+    struct bin_header {
+        char _magic[8];
+        std::uint32_t _version;
+        // 0x01020304 in the byte order of the writer
+        std::uint32_t _byte_order;
+        // number of objects
+        std::uint32_t _objects;
+        std::uint32_t _reserved;
+    };
+
+    const char bin_magic[8]="cpustbn";
+}
+
+bool
+cpu_stats::writer::parse(const std::string& n, format& f)
+{
+    if (n=="json")
+        f=JSON;
+    else if (n=="csv")
+        f=CSV;
+    else if (n=="bin")
+        f=BIN;
+    else
+        return false;
+    return true;
+}
+
+cpu_stats::writer::writer(format f, std::size_t reserve)
+    : _fmt(f), _b(reserve), _n(0), _objects(0), _prefix()
+{
+    switch (_fmt) {
+    case JSON:
+        put("{\"version\":");
+        put_u64(version);
+        put(",\"objects\":[");
+        break;
+    case CSV:
+        put("kind,id,name,index,value\n");
+        break;
+    case BIN: {
+        bin_header h{};
+        std::memcpy(h._magic, bin_magic, sizeof(h._magic));
+        h._version=version;
+        h._byte_order=0x01020304;
+        put_raw(h);
+        break;
+    }
+    }
+}
+
+char*
+cpu_stats::writer::reserve(std::size_t n)
+{
+    if (_n + n > _b.size())
+        _b.resize(std::max(_b.size()*2, _n + n));
+    return _b.data() + _n;
+}
+
+void
+cpu_stats::writer::put(const char* p, std::size_t n)
+{
+    std::memcpy(reserve(n), p, n);
+    _n += n;
+}
+
+void
+cpu_stats::writer::put(const std::string& str)
+{
+    put(str.data(), str.size());
+}
+
+void
+cpu_stats::writer::put(char c)
+{
+    *reserve(1)=c;
+    ++_n;
+}
+
+template <typename _T>
+void
+cpu_stats::writer::put_raw(const _T& v)
+{
+    put(reinterpret_cast<const char*>(&v), sizeof(v));
+}
+
+void
+cpu_stats::writer::put_u64(std::uint64_t v)
+{
+    char* b=reserve(24);
+    _n += std::to_chars(b, b+24, v).ptr - b;
+}
+
+void
+cpu_stats::writer::put_i64(std::int64_t v)
+{
+    char* b=reserve(24);
+    _n += std::to_chars(b, b+24, v).ptr - b;
+}
+
+void
+cpu_stats::writer::put_f64(double v)
+{
+    if (!std::isfinite(v)) {
+        if (_fmt==JSON)
+            put("null", 4);
+        return;
+    }
+    // shortest representation which reads back exactly
+    char* b=reserve(32);
+    _n += std::to_chars(b, b+32, v).ptr - b;
+}
+
+void
+cpu_stats::writer::put_str(const char* p, std::size_t n)
+{
+    if (_fmt==BIN) {
+        put_raw(std::uint32_t(n));
+        put(p, n);
+        return;
+    }
+    if (_fmt==CSV &&
+        std::none_of(p, p+n, [](char c) {
+                return c==',' || c=='"' || c=='\n';
+            })) {
+        put(p, n);
+        return;
+    }
+    put('"');
+    for (std::size_t i=0; i<n; ++i) {
+        char c=p[i];
+        if (_fmt==CSV) {
+            if (c=='"')
+                put('"');
+            put(c);
+        } else if (c=='"' || c=='\\') {
+            put('\\');
+            put(c);
+        } else if (static_cast<unsigned char>(c) < 0x20) {
+            static const char hex[]="0123456789abcdef";
+            char e[6]={'\\', 'u', '0', '0', hex[(c>>4)&0xf], hex[c&0xf]};
+            put(e, sizeof(e));
+        } else {
+            put(c);
+        }
+    }
+    put('"');
+}
+
+void
+cpu_stats::writer::begin(const char* kind, const std::string& id)
+{
+    switch (_fmt) {
+    case JSON:
+        if (_objects)
+            put(',');
+        put("\n{\"kind\":");
+        put_str(kind, std::strlen(kind));
+        put(",\"id\":");
+        put_str(id.data(), id.size());
+        break;
+    case CSV:
+    {
+        // kind and id are repeated in every line
+        std::size_t n0=_n;
+        put_str(kind, std::strlen(kind));
+        put(',');
+        put_str(id.data(), id.size());
+        put(',');
+        _prefix.assign(_b.data() + n0, _n - n0);
+        _n=n0;
+        break;
+    }
+    case BIN:
+        put(char(OBJECT));
+        put(char(std::strlen(kind)));
+        put(kind, std::strlen(kind));
+        put_str(id.data(), id.size());
+        break;
+    }
+    ++_objects;
+}
+
+void
+cpu_stats::writer::begin(const char* kind, std::uint32_t id)
+{
+    char b[16];
+    char* e=std::to_chars(b, b+sizeof(b), id).ptr;
+    begin(kind, std::string(b, e));
+}
+
+void
+cpu_stats::writer::end()
+{
+    switch (_fmt) {
+    case JSON:
+        put('}');
+        break;
+    case CSV:
+        break;
+    case BIN:
+        put(char(END));
+        put(char(0));
+        break;
+    }
+}
+
+void
+cpu_stats::writer::field(tag t, const char* name, std::size_t idx)
+{
+    std::size_t l=std::strlen(name);
+    switch (_fmt) {
+    case JSON:
+        put(",\"", 2);
+        put(name, l);
+        put("\":", 2);
+        break;
+    case CSV:
+        put(_prefix);
+        put(name, l);
+        put(',');
+        if (idx != ~std::size_t(0))
+            put_u64(idx);
+        put(',');
+        break;
+    case BIN:
+        put(char(t));
+        put(char(l));
+        put(name, l);
+        break;
+    }
+}
+
+void
+cpu_stats::writer::value(const char* name, std::uint64_t v)
+{
+    field(U64, name);
+    if (_fmt==BIN)
+        put_raw(v);
+    else
+        put_u64(v);
+    if (_fmt==CSV)
+        put('\n');
+}
+
+void
+cpu_stats::writer::value(const char* name, std::uint32_t v)
+{
+    value(name, std::uint64_t(v));
+}
+
+void
+cpu_stats::writer::value(const char* name, std::int64_t v)
+{
+    field(I64, name);
+    if (_fmt==BIN)
+        put_raw(v);
+    else
+        put_i64(v);
+    if (_fmt==CSV)
+        put('\n');
+}
+
+void
+cpu_stats::writer::value(const char* name, double v)
+{
+    field(F64, name);
+    if (_fmt==BIN)
+        put_raw(v);
+    else
+        put_f64(v);
+    if (_fmt==CSV)
+        put('\n');
+}
+
+void
+cpu_stats::writer::value(const char* name, const char* v)
+{
+    field(STR, name);
+    put_str(v, std::strlen(v));
+    if (_fmt==CSV)
+        put('\n');
+}
+
+template <typename _T>
+void
+cpu_stats::writer::array(tag t, const char* name, const _T* b, std::size_t n)
+{
+    switch (_fmt) {
+    case JSON:
+        field(t, name);
+        put('[');
+        for (std::size_t i=0; i<n; ++i) {
+            if (i)
+                put(',');
+            if constexpr (std::is_floating_point_v<_T>)
+                put_f64(b[i]);
+            else
+                put_u64(b[i]);
+        }
+        put(']');
+        break;
+    case CSV:
+        // one line per element
+        for (std::size_t i=0; i<n; ++i) {
+            field(t, name, i);
+            if constexpr (std::is_floating_point_v<_T>)
+                put_f64(b[i]);
+            else
+                put_u64(b[i]);
+            put('\n');
+        }
+        break;
+    case BIN:
+        field(t, name);
+        put_raw(std::uint32_t(n));
+        put(reinterpret_cast<const char*>(b), n*sizeof(_T));
+        break;
+    }
+}
+
+void
+cpu_stats::writer::values(const char* name, const std::uint32_t* b,
+                          std::size_t n)
+{
+    array(U32_ARRAY, name, b, n);
+}
+
+void
+cpu_stats::writer::values(const char* name, const std::uint64_t* b,
+                          std::size_t n)
+{
+    array(U64_ARRAY, name, b, n);
+}
+
+void
+cpu_stats::writer::values(const char* name, const double* b,
+                          std::size_t n)
+{
+    array(F64_ARRAY, name, b, n);
+}
+
+void
+cpu_stats::writer::flush(int fd)
+{
+    switch (_fmt) {
+    case JSON:
+        put("\n]}\n");
+        break;
+    case CSV:
+        break;
+    case BIN:
+        reinterpret_cast<bin_header*>(_b.data())->_objects=_objects;
+        break;
+    }
+    const char* p=_b.data();
+    std::size_t n=_n;
+    // one write() unless interrupted or written to a full pipe
+    while (n != 0) {
+        ssize_t r=::write(fd, p, n);
+        if (r < 0) {
+            if (errno==EINTR)
+                continue;
+            std::string msg="write failed: ";
+            msg += std::strerror(errno);
+            throw std::runtime_error(msg);
+        }
+        p += r;
+        n -= r;
+    }
+    _n=0;
+}
@@ -19,8 +19,29 @@
 #include "cpufreq_stats.h"
 #include "rapl_stats.h"
 #include "amdgpu_stats.h"
+#include "hwmon_stats.h"
+#include "msr_stats.h"
+#include "cpuidle_stats.h"
+#include "thermal_stats.h"
+#include "uncore_stats.h"
+#include "throttle_stats.h"
+#include "psi_stats.h"
+#include "steal_stats.h"
+#include "irq_stats.h"
+#include "rollup_stats.h"
+#include "joint_stats.h"
+#include "topo_stats.h"
 #include <iostream>
 #include <string_view>
+#include <memory>
+#include <ctime>
+#include <algorithm>
+#include <functional>
+#include <sstream>
+#include <iomanip>
+#include <cerrno>
+#include <unistd.h>
+#include <sys/ioctl.h>
 
 
 namespace {
@@ -28,14 +49,252 @@ namespace {
     usage(const std::string_view& argv0)
     {
 	std::cerr << argv0
-		  << " [-v|--version] [-s|--short] [-l|--long] \n"
+		  << " [-v|--version] [-s|--short] [-l|--long] [-p] [-f] [-j] [-T]\n"
+		  << "       [-i] [-P] [--cpu LIST] [--pkg LIST] [--gpu LIST] [--all-cpus]\n"
+		  << "       [--watch[=INTERVAL]] [--format=json|csv|bin]\n"
 		  << "-s|--short     requests short output\n"
 		  << "-l|--long      requests long output\n"
-		  << "-p|--power     requests power output only\n"
+		  << "-p|--power     requests power and temperature output only\n"
 		  << "-f|--frequency requests frequency output only\n"
+		  << "-j|--joint     requests the joint frequency x power\n"
+		  << "               histograms of the packages only\n"
+		  << "-T|--topology  requests the frequencies summed up per\n"
+		  << "               package, die, numa node, core type and core\n"
+		  << "               only\n"
+		  << "-i|--idle      requests the idle state residencies and\n"
+		  << "               interrupt rates only\n"
+		  << "-P|--pressure  requests the pressure stall information only\n"
+		  << "--cpu LIST     restricts the per cpu output to the cpus\n"
+		  << "               in LIST, i.e. --cpu 0-15,64\n"
+		  << "--all-cpus     requests the output of all cpus instead of\n"
+		  << "               the cpus usable by this process, i.e. the\n"
+		  << "               cpuset of a container\n"
+		  << "--pkg LIST     restricts the per package output to the\n"
+		  << "               packages in LIST\n"
+		  << "--gpu LIST     restricts the gpu output to the comma\n"
+		  << "               separated pci addresses in LIST, i.e.\n"
+		  << "               --gpu 0000:03:00.0\n"
+		  << "--mark NAME    saves the current data as mark NAME\n"
+		  << "--unmark NAME  removes the mark NAME\n"
+		  << "--since NAME   requests the differences to mark NAME\n"
+		  << "--history RES[,RANGE]\n"
+		  << "               requests the rollups with resolution RES\n"
+		  << "               (1m, 1h or 1d) of the last RANGE, i.e.\n"
+		  << "               --history 1h,24h\n"
+		  << "--watch[=INTERVAL]\n"
+		  << "               redraws the output after every INTERVAL,\n"
+		  << "               i.e. --watch=5s, with the differences to\n"
+		  << "               the last output, the default INTERVAL is\n"
+		  << "               the sampling interval of the daemon\n"
+		  << "--format=json|csv|bin\n"
+		  << "               requests the raw histograms, totals, last\n"
+		  << "               values and derived values as json, csv\n"
+		  << "               or in the binary format\n"
+		  << "--rollup-dir DIR\n"
+		  << "               directory of the rollups, default "
+		  << rollup_stats::default_dir << "\n"
 		  << "-v|--version   displays version informantion\n";
 	std::exit(3);
     }
+
+    // parses durations like 90s, 15m, 24h, 7d, returns 0 on errors
+    std::uint32_t
+    duration_s(const std::string_view& d)
+    {
+        std::uint32_t v=0;
+        std::size_t i=0;
+        for (; i<d.length() && d[i]>='0' && d[i]<='9'; ++i)
+            v = v*10 + (d[i]-'0');
+        if (i==0 || i+1 < d.length())
+            return 0;
+        char u= i < d.length() ? d[i] : 's';
+        switch (u) {
+        case 's': return v;
+        case 'm': return v*60;
+        case 'h': return v*3600;
+        case 'd': return v*86400;
+        default: return 0;
+        }
+    }
+
+    // an output block, dumps the data as text to s or writes it to
+    // w, the differences to m if m is not nullptr
+    struct block {
+        std::function<void(std::ostream&, const cpu_stats::mark*)> _text;
+        std::function<void(cpu_stats::writer&, const cpu_stats::mark*)> _rec;
+        // the segments of the block, the sources of the differences
+        // in --watch
+        std::vector<std::string> _segs;
+    };
+
+    template <typename _D>
+    void
+    data_to_stream(std::ostream& s, _D& dta, const cpu_stats::mark* m,
+                   bool short_output)
+    {
+        if (m)
+            dta.to_stream(s, *m, short_output);
+        else
+            dta.to_stream(s, short_output);
+    }
+
+    template <typename _D>
+    void
+    data_to_writer(cpu_stats::writer& w, _D& dta, const cpu_stats::mark* m)
+    {
+        if (m)
+            dta.to_writer(w, *m);
+        else
+            dta.to_writer(w);
+    }
+
+    template <typename _D>
+    block
+    make_block(const std::shared_ptr<_D>& dta, bool short_output)
+    {
+        return block{
+            [dta, short_output](std::ostream& s, const cpu_stats::mark* m) {
+                data_to_stream(s, *dta, m, short_output);
+            },
+            [dta](cpu_stats::writer& w, const cpu_stats::mark* m) {
+                data_to_writer(w, *dta, m);
+            },
+            dta->names()
+        };
+    }
+
+    // terminal output of --watch, redraws only the lines changed
+    // since the last frame
+    class screen {
+        std::vector<std::string> _lines;
+        bool _tty;
+        struct winsize _ws;
+
+        static
+        void
+        write_all(const std::string& o)
+        {
+            const char* p=o.data();
+            std::size_t n=o.size();
+            while (n != 0) {
+                ssize_t r=::write(STDOUT_FILENO, p, n);
+                if (r < 0) {
+                    if (errno==EINTR)
+                        continue;
+                    return;
+                }
+                p += r;
+                n -= r;
+            }
+        }
+    public:
+        screen()
+            : _lines(), _tty(::isatty(STDOUT_FILENO)), _ws()
+        {
+        }
+
+        void
+        draw(const std::string& frame)
+        {
+            if (!_tty) {
+                // pipes and files receive complete frames
+                write_all(frame + '\n');
+                return;
+            }
+            struct winsize ws{};
+            if (::ioctl(STDOUT_FILENO, TIOCGWINSZ, &ws) != 0 ||
+                ws.ws_row == 0 || ws.ws_col == 0) {
+                ws.ws_row=24;
+                ws.ws_col=80;
+            }
+            std::string o;
+            if (ws.ws_row != _ws.ws_row || ws.ws_col != _ws.ws_col) {
+                // new terminal size: clear and redraw everything
+                _lines.clear();
+                o += "\x1b[H\x1b[2J";
+                _ws=ws;
+            }
+            std::vector<std::string> lines;
+            std::istringstream is(frame);
+            std::string l;
+            while (lines.size() < ws.ws_row && std::getline(is, l)) {
+                // long lines would wrap and move the following ones
+                if (l.size() > ws.ws_col)
+                    l.resize(ws.ws_col);
+                lines.push_back(std::move(l));
+            }
+            for (std::size_t i=0; i<lines.size(); ++i) {
+                if (i < _lines.size() && _lines[i]==lines[i])
+                    continue;
+                o += "\x1b[" + std::to_string(i+1) + ";1H";
+                o += lines[i];
+                o += "\x1b[K";
+            }
+            if (lines.size() < _lines.size()) {
+                o += "\x1b[" + std::to_string(lines.size()+1) + ";1H";
+                o += "\x1b[J";
+            }
+            write_all(o);
+            _lines.swap(lines);
+        }
+    };
+
+    // the --watch loop, wakes up with the updates of the daemon and
+    // renders the differences to the last frame and the totals
+    int
+    watch(const std::vector<block>& blocks, std::uint32_t interval_s)
+    {
+        try {
+            const cpu_stats::state* st=cpu_stats::state::open();
+            std::uint32_t timeout=st->timeout();
+            std::int64_t start_s=st->start_s();
+            cpu_stats::state::close(st);
+            std::vector<std::string> segs;
+            for (const auto& b : blocks)
+                segs.insert(segs.end(), b._segs.begin(), b._segs.end());
+            cpu_stats::mark last(segs);
+            // a tick of the daemon lasts timeout seconds
+            std::uint64_t ticks=(interval_s + timeout - 1)/timeout;
+            std::uint32_t wait_ms=(3*timeout+1)*1000;
+            screen scr;
+            st=cpu_stats::state::open();
+            std::unique_ptr<const cpu_stats::state,
+                            void (*)(const cpu_stats::state*)>
+                stp(st, cpu_stats::state::close);
+            while (true) {
+                std::uint32_t u=st->updates();
+                while (st->ticks() < last.ticks() + ticks) {
+                    if (!st->wait_update(u, wait_ms) ||
+                        st->start_s() != start_s) {
+                        std::cerr << "no updates from the daemon\n";
+                        return 3;
+                    }
+                    u=st->updates();
+                }
+                std::uint64_t dt=st->ticks()-last.ticks();
+                std::ostringstream os;
+                std::time_t now=std::time(nullptr);
+                struct tm tm;
+                ::localtime_r(&now, &tm);
+                os << std::put_time(&tm, "%F %T")
+                   << ", last " << dt*timeout << " seconds:\n";
+                for (const auto& b : blocks)
+                    b._text(os, &last);
+                last.refresh();
+                os << "since the start of the daemon "
+                   << now - start_s << " seconds ago:\n";
+                for (const auto& b : blocks)
+                    b._text(os, nullptr);
+                scr.draw(os.str());
+            }
+        }
+        catch (const std::runtime_error& e) {
+            std::cerr << e.what() << '\n';
+            std::cerr << "Is the daemon running?\n";
+            return 3;
+        }
+        return 0;
+    }
 }
 
 int main(int argc, char** argv)
@@ -43,6 +302,18 @@ int main(int argc, char** argv)
     bool short_output=true;
     bool power_only=false;
     bool frequency_only=false;
+    bool joint_only=false;
+    bool topology_only=false;
+    bool idle_only=false;
+    bool pressure_only=false;
+    std::string mark_name, unmark_name, since_name;
+    std::uint32_t history_res=0, history_range=0;
+    std::string rollup_dir=rollup_stats::default_dir;
+    cpu_stats::selection sel;
+    bool all_cpus=false;
+    std::uint32_t watch_s=0;
+    bool formatted=false;
+    cpu_stats::writer::format fmt=cpu_stats::writer::JSON;
     for (int argi = 1; argi < argc; ++argi) {
         std::string_view ag(argv[argi]);
         if (ag=="-v" || ag=="--version") {
@@ -56,41 +327,284 @@ int main(int argc, char** argv)
             power_only=true;
         } else if (ag=="-f" || ag=="--frequency") {
 	    frequency_only=true;
+        } else if (ag=="-j" || ag=="--joint") {
+	    joint_only=true;
+        } else if (ag=="-T" || ag=="--topology") {
+	    topology_only=true;
+        } else if (ag=="-i" || ag=="--idle") {
+	    idle_only=true;
+        } else if (ag=="-P" || ag=="--pressure") {
+	    pressure_only=true;
+        } else if ((ag=="--mark" || ag=="--unmark" || ag=="--since") &&
+                   argi+1 < argc) {
+            std::string n(argv[++argi]);
+            if (!cpu_stats::mark::valid_name(n))
+                usage(argv[0]);
+            if (ag=="--mark")
+                mark_name=n;
+            else if (ag=="--unmark")
+                unmark_name=n;
+            else
+                since_name=n;
+        } else if (ag=="--history" && argi+1 < argc) {
+            std::string_view h(argv[++argi]);
+            std::size_t c=h.find(',');
+            history_res=duration_s(h.substr(0, c));
+            if (c != std::string_view::npos) {
+                history_range=duration_s(h.substr(c+1));
+                if (history_range==0)
+                    usage(argv[0]);
+            }
+            if (std::find(std::begin(rollup_stats::resolution_s),
+                          std::end(rollup_stats::resolution_s),
+                          history_res)==std::end(rollup_stats::resolution_s))
+                usage(argv[0]);
+        } else if (ag=="--watch") {
+            // the sampling interval of the daemon
+            watch_s=1;
+        } else if (ag.compare(0, 8, "--watch=")==0) {
+            watch_s=duration_s(ag.substr(8));
+            if (watch_s==0)
+                usage(argv[0]);
+        } else if (ag.compare(0, 9, "--format=")==0) {
+            if (!cpu_stats::writer::parse(std::string(ag.substr(9)), fmt))
+                usage(argv[0]);
+            formatted=true;
+        } else if (ag=="--rollup-dir" && argi+1 < argc) {
+            rollup_dir=argv[++argi];
+        } else if (ag=="--cpu" && argi+1 < argc) {
+            if (!sel.cpus(argv[++argi]))
+                usage(argv[0]);
+        } else if (ag=="--all-cpus") {
+            all_cpus=true;
+        } else if (ag=="--pkg" && argi+1 < argc) {
+            if (!sel.pkgs(argv[++argi]))
+                usage(argv[0]);
+        } else if (ag=="--gpu" && argi+1 < argc) {
+            if (!sel.gpus(argv[++argi]))
+                usage(argv[0]);
         } else {
 	    usage(argv[0]);
         }
     }
-    bool output_power=(power_only==false && frequency_only==false) ||
-	(power_only==true);
-    bool output_frequency=(power_only==false && frequency_only==false) ||
-	(frequency_only==true);
-    if (output_power) {
-	try {
-	    rapl_stats::data dta(false);
-	    dta.to_stream(std::cout, short_output);
-	}
-	catch (const std::runtime_error& e) {
-	    std::cerr << e.what() << '\n';
-	    std::cerr << "Is the daemon running?\n";
-	}
+    if (watch_s != 0 && (!since_name.empty() || formatted))
+        usage(argv[0]);
+    // the cpus of the cpuset and the affinity mask of this process
+    if (!all_cpus && !sel.affinity()) {
+        std::cerr << "no cpu of the selection is usable by this process\n";
+        return 3;
+    }
+    if (!mark_name.empty() || !unmark_name.empty()) {
+        try {
+            if (!unmark_name.empty())
+                cpu_stats::mark::remove(unmark_name);
+            if (!mark_name.empty())
+                cpu_stats::mark::create(mark_name);
+        }
+        catch (const std::runtime_error& e) {
+            std::cerr << e.what() << '\n';
+            std::cerr << "Is the daemon running?\n";
+            return 3;
+        }
+        return 0;
+    }
+    if (history_res != 0) {
+        try {
+            rollup_stats::data::to_stream(std::cout, rollup_dir,
+                                          history_res, history_range,
+                                          short_output);
+        }
+        catch (const std::runtime_error& e) {
+            std::cerr << e.what() << '\n';
+            return 3;
+        }
+        return 0;
+    }
+    std::unique_ptr<cpu_stats::mark> since;
+    if (!since_name.empty()) {
+        try {
+            since=std::make_unique<cpu_stats::mark>(since_name);
+            const cpu_stats::state* st=cpu_stats::state::open();
+            std::int64_t start_s=st->start_s();
+            cpu_stats::state::close(st);
+            if (start_s != since->start_s()) {
+                std::cerr << "mark " << since_name
+                          << " was created by another instance of "
+                             "the daemon\n";
+                return 3;
+            }
+        }
+        catch (const std::runtime_error& e) {
+            std::cerr << e.what() << '\n';
+            return 3;
+        }
+        if (!formatted)
+            std::cout << "differences to mark " << since_name
+                      << " created "
+                      << std::time(nullptr) - since->created_s()
+                      << " seconds ago\n";
+    }
+    bool all=power_only==false && frequency_only==false &&
+	joint_only==false && topology_only==false && idle_only==false &&
+	pressure_only==false;
+    bool output_power=all || (power_only==true);
+    bool output_frequency=all || (frequency_only==true);
+    bool output_joint=all || (joint_only==true);
+    bool output_topology=all || (topology_only==true);
+    bool output_idle=all || (idle_only==true);
+    bool output_pressure=all || (pressure_only==true);
+    // the data objects of the blocks keep their segments mapped
+    // for --watch
+    std::vector<block> blocks;
+    auto add=[&blocks](const std::function<block()>& f) {
 	try {
-	    amdgpu_stats::data dta(false);
-	    dta.to_stream(std::cout, short_output);
+	    blocks.push_back(f());
 	}
 	catch (const std::runtime_error& e) {
 	    std::cerr << e.what() << '\n';
 	    std::cerr << "Is the daemon running?\n";
 	}
+    };
+    if (output_power) {
+	add([&sel, short_output]() {
+	    auto dta=std::make_shared<rapl_stats::data>(false, &sel);
+	    // the time at the power limits follows the power
+	    auto t_dta=std::make_shared<throttle_stats::data>(
+		false, *dta, throttle_stats::default_margin, &sel);
+	    auto text=[dta, t_dta, short_output](std::ostream& s,
+						  const cpu_stats::mark* m) {
+		data_to_stream(s, *dta, m, short_output);
+		if (m)
+		    t_dta->limits_to_stream(s, *m);
+		else
+		    t_dta->limits_to_stream(s);
+	    };
+	    auto rec=[dta, t_dta](cpu_stats::writer& w,
+				  const cpu_stats::mark* m) {
+		data_to_writer(w, *dta, m);
+		if (m)
+		    t_dta->limits_to_writer(w, *m);
+		else
+		    t_dta->limits_to_writer(w);
+	    };
+	    std::vector<std::string> segs=dta->names();
+	    for (const auto& n : t_dta->limit_names())
+		segs.push_back(n);
+	    return block{text, rec, segs};
+	});
+	// the uncore frequencies follow the power of the packages
+	add([&sel, short_output]() {
+	    return make_block(
+		std::make_shared<uncore_stats::data>(false, &sel),
+		short_output);
+	});
+	add([&sel, short_output]() {
+	    return make_block(
+		std::make_shared<amdgpu_stats::data>(false, &sel),
+		short_output);
+	});
+	add([&sel, short_output]() {
+	    return make_block(
+		std::make_shared<msr_stats::data>(false, std::string(), &sel),
+		short_output);
+	});
+	add([short_output]() {
+	    return make_block(std::make_shared<hwmon_stats::data>(false),
+			      short_output);
+	});
+	add([short_output]() {
+	    return make_block(std::make_shared<thermal_stats::data>(false),
+			      short_output);
+	});
+    }
+    if (output_joint) {
+	add([&sel, short_output]() {
+	    rapl_stats::data r_dta(false, &sel);
+	    return make_block(
+		std::make_shared<joint_stats::data>(false, r_dta),
+		short_output);
+	});
     }
     if (output_frequency) {
+	add([&sel, short_output, watch_s]() {
+	    auto dta=std::make_shared<cpufreq_stats::data>(false, &sel);
+	    block b=make_block(dta, short_output);
+	    b._text=[dta, short_output, watch_s](std::ostream& s,
+						 const cpu_stats::mark* m) {
+		// the current frequencies are only interesting while
+		// watching
+		if (watch_s != 0 && m != nullptr)
+		    dta->heat_map_to_stream(s);
+		if (&s != &std::cout) {
+		    data_to_stream(s, *dta, m, short_output);
+		    return;
+		}
+		// the chunks rendered in parallel go directly to stdout
+		std::cout.flush();
+		if (m)
+		    dta->to_fd(STDOUT_FILENO, *m, short_output);
+		else
+		    dta->to_fd(STDOUT_FILENO, short_output);
+	    };
+	    return b;
+	});
+	// the time throttled follows the frequencies
+	add([&sel, short_output]() {
+	    rapl_stats::data r_dta(false, &sel);
+	    auto dta=std::make_shared<throttle_stats::data>(
+		false, r_dta, throttle_stats::default_margin, &sel);
+	    return make_block(dta, short_output);
+	});
+	// the steal time replaces the frequencies in virtual machines
+	add([&sel, short_output]() {
+	    return make_block(
+		std::make_shared<steal_stats::data>(false, &sel),
+		short_output);
+	});
+    }
+    if (output_topology) {
+	add([&sel, short_output]() {
+	    rapl_stats::data r_dta(false);
+	    return make_block(
+		std::make_shared<topo_stats::data>(false, r_dta, &sel),
+		short_output);
+	});
+    }
+    if (output_idle) {
+	add([&sel, short_output]() {
+	    return make_block(
+		std::make_shared<cpuidle_stats::data>(false, &sel),
+		short_output);
+	});
+	// interrupts keep the cpus from entering deep idle states
+	add([&sel, short_output]() {
+	    return make_block(
+		std::make_shared<irq_stats::data>(false, &sel),
+		short_output);
+	});
+    }
+    if (output_pressure) {
+	add([short_output]() {
+	    return make_block(std::make_shared<psi_stats::data>(false),
+			      short_output);
+	});
+    }
+    if (watch_s != 0)
+	return watch(blocks, watch_s);
+    if (formatted) {
 	try {
-	    cpufreq_stats::data dta(false);
-	    dta.to_stream(std::cout, short_output);
+	    cpu_stats::writer w(fmt);
+	    for (const auto& b : blocks)
+		b._rec(w, since.get());
+	    w.flush(STDOUT_FILENO);
 	}
 	catch (const std::runtime_error& e) {
 	    std::cerr << e.what() << '\n';
-	    std::cerr << "Is the daemon running?\n";
+	    return 3;
 	}
+	return 0;
     }
+    for (const auto& b : blocks)
+	b._text(std::cout, since.get());
     return 0;
 }
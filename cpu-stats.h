@@ -18,10 +18,358 @@
 #if !defined (__CPU_STATS_H__)
 #define __CPU_STATS_H__ 1
 
+#include <tools.h>
+#include <cstdint>
+#include <atomic>
+#include <string>
+#include <vector>
+#include <utility>
+#include <type_traits>
+
 namespace cpu_stats {
 
     extern const char* version;
 
+    // shared memory segment with the state of the daemon, the
+    // sequence counter is odd while the daemon updates the other
+    // segments
+    class state {
+        state(std::uint32_t timeout);
+        ~state();
+        // sequence counter
+        std::atomic<std::uint64_t> _seq;
+        // start time of the daemon, seconds since the epoch
+        std::int64_t _start_s;
+        // sampling interval in seconds
+        std::uint32_t _timeout;
+        // number of ticks since start
+        std::uint64_t _ticks;
+        // number of finished updates, the clients wait on this
+        // futex for the next update
+        std::atomic<std::uint32_t> _updates;
+    public:
+        static
+        std::string name();
+
+        static
+        state*
+        create(std::uint32_t timeout);
+
+        static
+        void
+        close(state* p);
+
+        static
+        const state*
+        open();
+
+        static
+        void
+        close(const state* p);
+
+        // called by the daemon before and after an update of the
+        // other segments
+        void
+        begin_update();
+        void
+        end_update(std::uint32_t weight);
+
+        // the longest wait for the end of an update in read_begin
+        static
+        constexpr const std::uint32_t max_update_ms=500;
+        // wait until no update is in progress and store the sequence
+        // counter in seq, returns false and sets errno to EAGAIN if
+        // the update does not finish within max_update_ms, i.e. if
+        // the daemon was killed during an update
+        bool
+        read_begin(std::uint64_t& seq) const;
+        // true if an update happened since read_begin returned seq
+        bool
+        read_retry(std::uint64_t seq) const;
+
+        // number of finished updates
+        std::uint32_t
+        updates() const;
+        // wait at most timeout_ms milliseconds until the number of
+        // finished updates differs from updates, returns false on
+        // timeout
+        bool
+        wait_update(std::uint32_t updates, std::uint32_t timeout_ms) const;
+
+        const std::int64_t& start_s() const;
+        const std::uint32_t& timeout() const;
+        const std::uint64_t& ticks() const;
+    };
+
+    // named mark, a snapshot of all shared memory segments of the
+    // daemon, stored in a shared memory segment itself
+    class mark {
+        struct header;
+        struct entry;
+        struct source;
+        const header* _h;
+        std::size_t _size;
+        // only used by snapshots in process memory: the mapped
+        // segments of the daemon, the state and the copy
+        std::vector<source> _src;
+        const state* _st;
+        std::vector<std::aligned_storage<64, 64>::type> _buf;
+        // the state of the daemon for the copies of the live
+        // segments, _st for snapshots
+        const state* _live;
+        static
+        std::string
+        name(const std::string& mark_name);
+        // the names of all segments of the daemon except the state,
+        // the index and the marks
+        static
+        std::vector<std::string>
+        all_sources();
+        // maps the segments names
+        static
+        void
+        map_sources(std::vector<source>& v, std::vector<std::string> names);
+        static
+        void
+        unmap_sources(std::vector<source>& v);
+        // the size of the mark and the offsets of the copies
+        static
+        std::size_t
+        layout(const std::vector<source>& v, std::vector<std::size_t>& offs);
+        // fill the header and the entries and copy all segments
+        // between two updates of the daemon
+        static
+        void
+        copy(char* addr, const state* st, const std::vector<source>& v,
+             const std::vector<std::size_t>& offs);
+    public:
+        // checks if the name of a mark is acceptable
+        static
+        bool
+        valid_name(const std::string& mark_name);
+        // create a snapshot of all segments named mark_name,
+        // replacing an existing mark with the same name
+        static
+        void
+        create(const std::string& mark_name);
+        // remove the mark mark_name
+        static
+        void
+        remove(const std::string& mark_name);
+
+        // open the mark mark_name read only
+        mark(const std::string& mark_name);
+        // create an anonymous snapshot of the segments seg_names in
+        // process memory, the segments stay mapped for refresh
+        explicit
+        mark(const std::vector<std::string>& seg_names);
+        ~mark();
+        mark(const mark&) = delete;
+        mark&
+        operator=(const mark&) = delete;
+
+        // returns the copy of segment seg_name if the mark contains
+        // a segment with this name and size
+        const void*
+        find(const std::string& seg_name, std::size_t s) const;
+        // copy the live segment p of size s into b between two
+        // updates of the daemon like the copies in the mark, the
+        // base of the differences to the mark
+        void
+        read_live(void* b, const void* p, std::size_t s) const;
+        // start time of the daemon when the mark was created
+        std::int64_t
+        start_s() const;
+        // creation time of the mark
+        std::int64_t
+        created_s() const;
+        // ticks of the daemon when the mark was created
+        std::uint64_t
+        ticks() const;
+        // copy the current contents of the segments into an
+        // anonymous snapshot
+        void
+        refresh();
+    };
+
+    // directory of the segments of the daemon, created once after
+    // all collectors are set up, the clients find their segments
+    // here instead of probing sysfs or /dev/shm
+    class index {
+        struct header;
+        struct entry;
+        const header* _h;
+        std::size_t _size;
+    public:
+        static
+        std::string name();
+        // create the index of all segments of the daemon
+        static
+        void
+        create();
+        // remove the index
+        static
+        void
+        remove();
+
+        // open the index read only
+        index();
+        ~index();
+        index(const index&) = delete;
+        index&
+        operator=(const index&) = delete;
+
+        // the names of the segments starting with prefix, sorted
+        std::vector<std::string>
+        list(const std::string& prefix) const;
+    };
+
+    // the cpus, packages and gpus selected for the output, a
+    // default constructed selection contains everything
+    class selection {
+        using ranges=std::vector<std::pair<std::uint32_t, std::uint32_t>>;
+        // inclusive ranges, empty selects all
+        ranges _cpus;
+        ranges _pkgs;
+        // pci addresses, empty selects all
+        std::vector<std::string> _gpus;
+        static
+        bool
+        parse(const std::string& s, ranges& r);
+        static
+        bool
+        contains(const ranges& r, std::uint32_t v);
+    public:
+        selection();
+        // parse lists like 0-15,64, return false on errors
+        bool cpus(const std::string& s);
+        bool pkgs(const std::string& s);
+        // comma separated pci addresses like 0000:03:00.0
+        bool gpus(const std::string& s);
+        bool cpu(std::uint32_t c) const;
+        bool pkg(std::uint32_t p) const;
+        bool gpu(const std::string& pci) const;
+        // restrict the cpus to the cpus the process may use, the
+        // intersection of sched_getaffinity and cpuset.cpus.effective
+        // of the cgroup of the process, i.e. in containers, returns
+        // false if no cpu remains
+        bool affinity();
+        // true if the cpus are restricted
+        bool restricted() const;
+        // true if the packages are restricted
+        bool pkgs_restricted() const;
+        // the selected cpus as list like 0-15,64, empty if all cpus
+        // are selected
+        std::string cpu_list() const;
+    };
+
+    // the names of the segments of the daemon starting with prefix
+    // from the current index of the daemon
+    std::vector<std::string>
+    segments(const std::string& prefix);
+
+    // machine readable output of the client as json, csv or in a
+    // versioned, self describing binary format, collected in one
+    // preallocated buffer and written with one write().
+    // The output consists of objects of a kind, i.e. cpufreq, with
+    // an id, i.e. the cpu number, containing named scalar values and
+    // arrays of values.
+    class writer {
+    public:
+        enum format {
+            JSON,
+            CSV,
+            BIN
+        };
+        // record types of the binary format
+        enum tag : std::uint8_t {
+            END=0,
+            OBJECT=1,
+            U64=2,
+            I64=3,
+            F64=4,
+            STR=5,
+            U32_ARRAY=6,
+            U64_ARRAY=7,
+            F64_ARRAY=8
+        };
+        // version of all formats
+        static
+        constexpr const std::uint32_t version=1;
+    private:
+        format _fmt;
+        std::vector<char> _b;
+        std::size_t _n;
+        std::uint32_t _objects;
+        // kind and id of the current object, repeated in every csv
+        // line
+        std::string _prefix;
+
+        char* reserve(std::size_t n);
+        void put(const char* p, std::size_t n);
+        void put(const std::string& str);
+        void put(char c);
+        void put_u64(std::uint64_t v);
+        void put_i64(std::int64_t v);
+        void put_f64(double v);
+        void put_str(const char* p, std::size_t n);
+        template <typename _T>
+        void put_raw(const _T& v);
+        // the name of a field in the current object
+        void field(tag t, const char* name, std::size_t idx=~std::size_t(0));
+        template <typename _T>
+        void array(tag t, const char* name, const _T* b, std::size_t n);
+    public:
+        // parses json, csv and bin
+        static
+        bool
+        parse(const std::string& n, format& f);
+
+        writer(format f, std::size_t reserve=std::size_t(1)<<20);
+        writer(const writer&) = delete;
+        writer&
+        operator=(const writer&) = delete;
+
+        void begin(const char* kind, const std::string& id);
+        void begin(const char* kind, std::uint32_t id);
+        void end();
+
+        void value(const char* name, std::uint64_t v);
+        void value(const char* name, std::uint32_t v);
+        void value(const char* name, std::int64_t v);
+        void value(const char* name, double v);
+        void value(const char* name, const char* v);
+        void values(const char* name, const std::uint32_t* b, std::size_t n);
+        void values(const char* name, const std::uint64_t* b, std::size_t n);
+        void values(const char* name, const double* b, std::size_t n);
+
+        // finish the output and write it to fd
+        void flush(int fd);
+    };
+}
+
+inline
+const std::int64_t&
+cpu_stats::state::start_s()
+    const
+{
+    return _start_s;
+}
+
+inline
+const std::uint32_t&
+cpu_stats::state::timeout()
+    const
+{
+    return _timeout;
+}
+
+inline
+const std::uint64_t&
+cpu_stats::state::ticks()
+    const
+{
+    return _ticks;
 }
 
 // Local variables:
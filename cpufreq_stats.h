@@ -24,6 +24,12 @@
 #include <string>
 #include <iosfwd>
 
+namespace cpu_stats {
+    class mark;
+    class selection;
+    class writer;
+}
+
 namespace cpufreq_stats {
 
 
@@ -40,6 +46,30 @@ namespace cpufreq_stats {
         double max_freq(std::uint32_t cpu);
         static
         double cur_freq(std::uint32_t cpu);
+        // false if the cpu has no scaling_cur_freq, i.e. in most
+        // virtual machines
+        static
+        bool has_cur_freq(std::uint32_t cpu);
+        // true if scaling_cur_freq of all online cpus does not change
+        // during samples reads interval_ms apart, i.e. in virtual
+        // machines reporting a fixed frequency
+        static
+        bool static_cur_freq(std::uint32_t samples,
+                             std::uint32_t interval_ms);
+        static
+        std::uint32_t package_id(std::uint32_t cpu);
+        static
+        std::uint32_t core_id(std::uint32_t cpu);
+        // 0 if the kernel does not provide the die
+        static
+        std::uint32_t die_id(std::uint32_t cpu);
+        // relative performance of the cpu, distinguishes the core
+        // types of hybrid processors, 0 if missing
+        static
+        std::uint32_t capacity(std::uint32_t cpu);
+        // numa node of the cpu, 0 without numa
+        static
+        std::uint32_t node(std::uint32_t cpu);
     };
 
     // shared memory segment between server and client, one per
@@ -47,8 +77,6 @@ namespace cpufreq_stats {
     class shm_seg {
         shm_seg(std::uint32_t cpu);
         ~shm_seg();
-        static
-        std::string name(std::uint32_t cpu_num);
         // frequency step of 200 MHz/XXX khz
         static
         constexpr const double freq_step=200000;
@@ -59,7 +87,9 @@ namespace cpufreq_stats {
         constexpr const double max_freq=7000000;
     public:
         enum {
-            FREQ_ENTRIES=uint32_t(max_freq/freq_step)+1
+            FREQ_ENTRIES=uint32_t(max_freq/freq_step)+1,
+            // log2 scaled run lengths
+            RUN_ENTRIES=32
         };
     private:
         // cpu number
@@ -75,7 +105,28 @@ namespace cpufreq_stats {
         // (2^32)-1)/(3600*24*365.25) ~ 136.09 years are possible
         // if only one _entries[C] is used.
         std::uint32_t _entries[FREQ_ENTRIES];
+        // number of changes between frequency ranges
+        std::uint64_t _transitions;
+        // length of the current run of samples in the same
+        // frequency range
+        std::uint32_t _run_len;
+        // finished runs, _runs[i] counts runs of consecutive samples
+        // in the same frequency range with 2^i <= length < 2^(i+1)
+        std::uint32_t _runs[RUN_ENTRIES];
+        // array with ticks/freq range weighted by the busy fraction
+        // of the cpu during the interval in units of 1/busy_scale
+        std::uint64_t _busy_entries[FREQ_ENTRIES];
     public:
+        // scale of _busy_entries
+        static
+        constexpr const double busy_scale=1000.0;
+
+        static
+        const char* const prefix;
+
+        static
+        std::string name(std::uint32_t cpu_num);
+
         static
         shm_seg*
         create(std::uint32_t cpu_num);
@@ -104,6 +155,14 @@ namespace cpufreq_stats {
         double
         idx_to_freq(std::uint32_t f);
 
+        static
+        std::size_t
+        run_to_idx(std::uint32_t len);
+
+        // subtract the entries of r, used for the differences
+        // to a mark
+        shm_seg& operator-=(const shm_seg& r);
+
         const std::uint32_t& cpu() const;
         const double& min_f_khz() const;
         const double& max_f_khz() const;
@@ -113,27 +172,121 @@ namespace cpufreq_stats {
         std::uint32_t* end();
         const std::uint32_t* begin() const;
         const std::uint32_t* end() const;
+        shm_seg& transitions(const std::uint64_t& n);
+        const std::uint64_t& transitions() const;
+        shm_seg& run_len(const std::uint32_t& n);
+        const std::uint32_t& run_len() const;
+        std::uint32_t* runs_begin();
+        std::uint32_t* runs_end();
+        const std::uint32_t* runs_begin() const;
+        const std::uint32_t* runs_end() const;
+        std::uint64_t* busy_begin();
+        std::uint64_t* busy_end();
+        const std::uint64_t* busy_begin() const;
+        const std::uint64_t* busy_end() const;
     };
 
     class data {
         std::vector<const shm_seg*> _v;
+        // frequency range of the last sample per cpu
+        std::vector<std::size_t> _last_idx;
+        // jiffies of the last sample per cpu
+        std::vector<tools::proc_stat::cpu_times> _last_times;
+        // busy weighted ticks added by the last sample per cpu
+        std::vector<std::uint64_t> _last_busy;
+        // frequencies read by sample() per cpu
+        std::vector<double> _cur_f;
         bool _create;
+        // the list of the selected cpus if the client sums them up,
+        // i.e. the cpus of a container
+        std::string _aggregate;
 
+        // append the text output of p to s
+        static
+        void
+        to_text(std::string& s, const shm_seg* p, bool short_output);
+        // the text output of all cpus or the differences to m if m
+        // is not nullptr, rendered in parallel into chunks on large
+        // machines
+        void
+        to_text(std::vector<std::string>& chunks, const cpu_stats::mark* m,
+                bool short_output) const;
         static
         void
-        to_stream(std::ostream& s, const shm_seg* p, bool short_output);
+        to_writer(cpu_stats::writer& w, const shm_seg* p);
+        // sums of the segments of all cpus or of the differences to
+        // m if m is not nullptr
+        struct sums {
+            std::uint32_t _cpus;
+            std::uint64_t _samples;
+            std::uint64_t _transitions;
+            double _f_khz;
+            double _busy;
+            double _busy_f_khz;
+        };
+        sums
+        sum_up(const cpu_stats::mark* m) const;
+        // append the text output of the sums to s
+        void
+        aggregate_to_text(std::string& s, const cpu_stats::mark* m) const;
+        void
+        aggregate_to_writer(cpu_stats::writer& w,
+                            const cpu_stats::mark* m) const;
     public:
-        data(bool create);
+        // the client opens the segments of the cpus in sel or of
+        // all cpus if sel is nullptr, the statistics of restricted
+        // selections are summed up additionally
+        data(bool create, const cpu_stats::selection* sel=nullptr);
         ~data();
         data(const data&) = delete;
         data&
         operator=(const data& r) = delete;
-        // update _v
+        // the segments
+        const std::vector<const shm_seg*>&
+        segments() const;
+        // the names of the segments
+        std::vector<std::string>
+        names() const;
+        // read the current frequencies, called before update outside
+        // of the update of the segments
         void
-        update(std::uint32_t weight);
+        sample();
+        // update _v from the last sample, ps contains the current
+        // content of /proc/stat
+        void
+        update(std::uint32_t weight, const tools::proc_stat& ps);
+        // frequency range of the last sample per cpu
+        const std::vector<std::size_t>&
+        last_idx() const;
+        // busy weighted ticks added by the last sample per cpu
+        const std::vector<std::uint64_t>&
+        last_busy() const;
         // dump the data
         void
         to_stream(std::ostream& s, bool short_output=false);
+        // dump the differences to the data saved in mark m
+        void
+        to_stream(std::ostream& s, const cpu_stats::mark& m,
+                  bool short_output=false);
+        // write the text output to fd with one writev
+        void
+        to_fd(int fd, bool short_output=false);
+        // write the differences to the data saved in mark m to fd
+        void
+        to_fd(int fd, const cpu_stats::mark& m, bool short_output=false);
+        // dump the data line by line into syslog
+        void
+        to_syslog(int prio, bool short_output=false);
+        // write the data to w
+        void
+        to_writer(cpu_stats::writer& w);
+        // write the differences to the data saved in mark m to w
+        void
+        to_writer(cpu_stats::writer& w, const cpu_stats::mark& m);
+        // dump the last measured frequencies of all cpus, one
+        // character per cpu
+        void
+        heat_map_to_stream(std::ostream& s);
     };
 
 }
@@ -208,6 +361,106 @@ cpufreq_stats::shm_seg::end()
     return _entries+FREQ_ENTRIES;
 }
 
+inline
+cpufreq_stats::shm_seg&
+cpufreq_stats::shm_seg::transitions(const std::uint64_t& v)
+{
+    _transitions = v;
+    return *this;
+}
+
+inline
+const std::uint64_t&
+cpufreq_stats::shm_seg::transitions()
+    const
+{
+    return _transitions;
+}
+
+inline
+cpufreq_stats::shm_seg&
+cpufreq_stats::shm_seg::run_len(const std::uint32_t& v)
+{
+    _run_len = v;
+    return *this;
+}
+
+inline
+const std::uint32_t&
+cpufreq_stats::shm_seg::run_len()
+    const
+{
+    return _run_len;
+}
+
+inline
+std::uint32_t*
+cpufreq_stats::shm_seg::runs_begin()
+{
+    return _runs;
+}
+
+inline
+std::uint32_t*
+cpufreq_stats::shm_seg::runs_end()
+{
+    return _runs+RUN_ENTRIES;
+}
+
+inline
+const std::uint32_t*
+cpufreq_stats::shm_seg::runs_begin()
+    const
+{
+    return _runs;
+}
+
+inline
+const std::uint32_t*
+cpufreq_stats::shm_seg::runs_end()
+    const
+{
+    return _runs+RUN_ENTRIES;
+}
+
+inline
+std::uint64_t*
+cpufreq_stats::shm_seg::busy_begin()
+{
+    return _busy_entries;
+}
+
+inline
+std::uint64_t*
+cpufreq_stats::shm_seg::busy_end()
+{
+    return _busy_entries+FREQ_ENTRIES;
+}
+
+inline
+const std::uint64_t*
+cpufreq_stats::shm_seg::busy_begin()
+    const
+{
+    return _busy_entries;
+}
+
+inline
+const std::uint64_t*
+cpufreq_stats::shm_seg::busy_end()
+    const
+{
+    return _busy_entries+FREQ_ENTRIES;
+}
+
+inline
+const std::vector<const cpufreq_stats::shm_seg*>&
+cpufreq_stats::data::segments()
+    const
+{
+    return _v;
+}
+
 // Local variables:
 // mode: c++
 // end:
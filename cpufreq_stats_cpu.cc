@@ -17,6 +17,10 @@
 //
 #include "cpufreq_stats.h"
 #include <sstream>
+#include <cstdlib>
+#include <cstring>
+#include <dirent.h>
+#include <time.h>
 
 std::string
 cpufreq_stats::cpu::path(std::uint32_t cpu)
@@ -67,3 +71,77 @@ cpufreq_stats::cpu::cur_freq(std::uint32_t cpu)
     return tools::sys_fs::read<double>::from(p);
 }
 
+bool
+cpufreq_stats::cpu::has_cur_freq(std::uint32_t cpu)
+{
+    std::string p=path(cpu)+"cpufreq/scaling_cur_freq";
+    return tools::file::exists(p);
+}
+
+bool
+cpufreq_stats::cpu::static_cur_freq(std::uint32_t samples,
+                                    std::uint32_t interval_ms)
+{
+    std::vector<double> f0;
+    for (std::uint32_t i=0; exists(i); ++i)
+        f0.push_back(has_cur_freq(i) ? cur_freq(i) : 0.0);
+    struct timespec ts;
+    ts.tv_sec=interval_ms/1000;
+    ts.tv_nsec=(interval_ms%1000)*1000000L;
+    for (std::uint32_t j=1; j<samples; ++j) {
+        ::nanosleep(&ts, nullptr);
+        for (std::uint32_t i=0; i<f0.size(); ++i) {
+            if (f0[i] != (has_cur_freq(i) ? cur_freq(i) : 0.0))
+                return false;
+        }
+    }
+    return true;
+}
+
+std::uint32_t
+cpufreq_stats::cpu::package_id(std::uint32_t cpu)
+{
+    std::string p=path(cpu)+"topology/physical_package_id";
+    return tools::sys_fs::read<std::uint32_t>::from(p);
+}
+
+std::uint32_t
+cpufreq_stats::cpu::core_id(std::uint32_t cpu)
+{
+    std::string p=path(cpu)+"topology/core_id";
+    return tools::sys_fs::read<std::uint32_t>::from(p);
+}
+
+std::uint32_t
+cpufreq_stats::cpu::die_id(std::uint32_t cpu)
+{
+    std::string p=path(cpu)+"topology/die_id";
+    return tools::sys_fs::read<std::uint32_t>::from(p);
+}
+
+std::uint32_t
+cpufreq_stats::cpu::capacity(std::uint32_t cpu)
+{
+    std::string p=path(cpu)+"cpu_capacity";
+    return tools::sys_fs::read<std::uint32_t>::from(p);
+}
+
+std::uint32_t
+cpufreq_stats::cpu::node(std::uint32_t cpu)
+{
+    // the directory of the cpu contains a link nodeN
+    std::uint32_t r=0;
+    std::string p=path(cpu);
+    DIR* d=opendir(p.c_str());
+    if (d==nullptr)
+        return r;
+    while (const struct dirent* e=readdir(d)) {
+        if (std::strncmp(e->d_name, "node", 4)==0 &&
+            e->d_name[4] >= '0' && e->d_name[4] <= '9') {
+            r=std::strtoul(e->d_name+4, nullptr, 10);
+            break;
+        }
+    }
+    closedir(d);
+    return r;
+}
@@ -16,24 +16,54 @@
 //  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
 //
 #include "cpufreq_stats.h"
+#include "cpu-stats.h"
 #include <iostream>
 #include <iomanip>
 #include <cmath>
 #include <algorithm>
 #include <numeric>
+#include <cstring>
+#include <cstdlib>
+#include <cstdio>
+#include <charconv>
+#include <thread>
+#include <system_error>
+#include <syslog.h>
 
-cpufreq_stats::data::data(bool create)
-    : _v(), _create(create)
+cpufreq_stats::data::data(bool create, const cpu_stats::selection* sel)
+    : _v(), _last_idx(), _last_times(), _last_busy(), _cur_f(),
+      _create(create),
+      _aggregate()
 {
     try {
-        for (size_t i=0; cpu::exists(i); ++i) {
-            if (_create) {
+        if (_create) {
+            for (size_t i=0; cpu::exists(i); ++i) {
                 shm_seg* p=shm_seg::create(i);
                 _v.push_back(p);
-            } else {
-                const shm_seg* p=shm_seg::open(i);
-                _v.push_back(p);
+                _last_idx.push_back(0);
+                _last_times.push_back(tools::proc_stat::cpu_times{});
+                _last_busy.push_back(0);
+                _cur_f.push_back(0.0);
             }
+        } else {
+            // the index of the daemon avoids probing sysfs
+            std::string pf(shm_seg::prefix);
+            for (const auto& n : cpu_stats::segments(pf)) {
+                std::uint32_t i=std::strtoul(n.c_str()+pf.size(),
+                                             nullptr, 10);
+                if (sel != nullptr && !sel->cpu(i))
+                    continue;
+                try {
+                    _v.push_back(shm_seg::open(i));
+                }
+                catch (const std::runtime_error& e) {
+                    // listed in the index but not accessible, i.e. not
+                    // bound into a container
+                    continue;
+                }
+            }
+            if (sel != nullptr && sel->restricted())
+                _aggregate=sel->cpu_list();
         }
     }
     catch (const std::runtime_error& e) {
@@ -62,23 +92,124 @@ cpufreq_stats::data::~data()
 }
 
 void
-cpufreq_stats::data::update(std::uint32_t weight)
+cpufreq_stats::data::sample()
+{
+    if (_create == false)
+        return;
+    for (std::size_t i=0; i<_v.size(); ++i)
+        _cur_f[i]=cpu::cur_freq(_v[i]->cpu());
+}
+
+void
+cpufreq_stats::data::update(std::uint32_t weight,
+                            const tools::proc_stat& ps)
 {
     if (_create == false)
         return;
+    const auto& times=ps.cpus();
     for (std::size_t i=0; i<_v.size(); ++i) {
         shm_seg* p=const_cast<shm_seg*>(_v[i]);
-        double cur_f=cpu::cur_freq(p->cpu());
+        double cur_f=_cur_f[i];
         size_t idx=shm_seg::freq_to_idx(cur_f);
         std::uint32_t* pi=p->begin() + idx;
         (*pi)+=weight;
         p->last_f_khz(cur_f);
+        // track the runs in the same frequency range
+        std::uint32_t rl=p->run_len();
+        if (rl != 0 && idx != _last_idx[i]) {
+            std::uint32_t* pr=p->runs_begin() + shm_seg::run_to_idx(rl);
+            (*pr)+=1;
+            p->transitions(p->transitions()+1);
+            rl=0;
+        }
+        p->run_len(rl+weight);
+        _last_idx[i]=idx;
+        _last_busy[i]=0;
+        // weight the sample with the busy fraction of the interval
+        if (i < times.size() && times[i]._valid) {
+            const tools::proc_stat::cpu_times& t1=times[i];
+            tools::proc_stat::cpu_times& t0=_last_times[i];
+            if (t0._valid) {
+                std::uint64_t dt=t1.total()-t0.total();
+                std::uint64_t db=t1.busy()-t0.busy();
+                if (dt != 0 && db <= dt) {
+                    double b=(double(db)*shm_seg::busy_scale)/dt;
+                    std::uint64_t* pb=p->busy_begin() + idx;
+                    _last_busy[i]=std::uint64_t(std::rint(b*weight));
+                    (*pb)+=_last_busy[i];
+                }
+            }
+            t0=t1;
+        } else {
+            _last_times[i]._valid=false;
+        }
+    }
+}
+
+const std::vector<std::size_t>&
+cpufreq_stats::data::last_idx()
+    const
+{
+    return _last_idx;
+}
+
+const std::vector<std::uint64_t>&
+cpufreq_stats::data::last_busy()
+    const
+{
+    return _last_busy;
+}
+
+namespace {
+
+    // append helpers for the text output, the formats match the
+    // former iostream output with std::fixed and std::scientific
+    void
+    put(std::string& b, const char* str)
+    {
+        b += str;
+    }
+
+    void
+    put(std::string& b, std::uint64_t v)
+    {
+        char t[24];
+        char* e=std::to_chars(t, t+sizeof(t), v).ptr;
+        b.append(t, e);
+    }
+
+    void
+    put_fixed(std::string& b, double v, int prec, int width=0)
+    {
+        char t[352];
+        int n=std::snprintf(t, sizeof(t), "%*.*f", width, prec, v);
+        b.append(t, std::min(std::size_t(n), sizeof(t)-1));
+    }
+
+    void
+    put_scientific(std::string& b, double v, int prec)
+    {
+        char t[64];
+        int n=std::snprintf(t, sizeof(t), "%.*e", prec, v);
+        b.append(t, std::min(std::size_t(n), sizeof(t)-1));
+    }
+
+    // cpus per rendering thread
+    const std::size_t cpus_per_thread=32;
+    // maximum number of rendering threads
+    const std::size_t max_threads=64;
+
+    void
+    write(std::ostream& s, const std::vector<std::string>& chunks)
+    {
+        for (const auto& c : chunks)
+            s.write(c.data(), c.size());
     }
 }
 
 void
 cpufreq_stats::data::
-to_stream(std::ostream& s, const shm_seg* p, bool short_output)
+to_text(std::string& s, const shm_seg* p, bool short_output)
 {
     std::uint32_t vt[shm_seg::FREQ_ENTRIES];
     std::uint32_t cpu= p->cpu();
@@ -127,21 +258,24 @@ to_stream(std::ostream& s, const shm_seg* p, bool short_output)
 
     const std::uint32_t cols=3;
     for (std::uint32_t i=0; i<cols; ++i)
-        s << "========================";
-    s << '\n';
-    s << std::fixed << std::setprecision(0);
-    s << "cpu " << cpu
-      << ", f_min=" << min_f*1e-3
-      << ", f_max=" << max_f*1e-3
-      << ", samples=" << std::scientific << std::setprecision(22) << sum_ti
-      << std::fixed << '\n';
+        put(s, "========================");
+    put(s, "\n");
+    put(s, "cpu ");
+    put(s, cpu);
+    put(s, ", f_min=");
+    put_fixed(s, min_f*1e-3, 0);
+    put(s, ", f_max=");
+    put_fixed(s, max_f*1e-3, 0);
+    put(s, ", samples=");
+    put_scientific(s, sum_ti, 22);
+    put(s, "\n");
     if (!short_output) {
         for (std::uint32_t i=0; i<cols; ++i) {
             if (i)
-                s << " | ";
-            s << "f/MHz       %   sum % ";
+                put(s, " | ");
+            put(s, "f/MHz       %   sum % ");
         }
-        s << '\n';
+        put(s, "\n");
     }
     std::uint32_t lines=(cnt+cols-1)/cols;
     double sum=0.0, avg=0.0;
@@ -157,29 +291,372 @@ to_stream(std::ostream& s, const shm_seg* p, bool short_output)
             double spcti=vspct[k];
             if (!short_output) {
                 if (i)
-                    s << "  | ";
-                s << std::setw(5) << std::setprecision(0) << fi << ' '
-                << std::setw(7) << std::setprecision(2) << pcti << ' '
-                << std::setw(7) << std::setprecision(2) << spcti;
+                    put(s, "  | ");
+                put_fixed(s, fi, 0, 5);
+                put(s, " ");
+                put_fixed(s, pcti, 2, 7);
+                put(s, " ");
+                put_fixed(s, spcti, 2, 7);
             }
             sum +=pcti;
             avg +=pcti*fi;
         }
         if (!short_output)
-            s << '\n';
+            put(s, "\n");
     }
     avg *= 1e-2;
-    s << "average frequency: ~" << std::setprecision(0) << avg << " MHz, "
-      << "last measured frequency: ~" << last_f*1e-3 << " MHz\n";
+    put(s, "average frequency: ~");
+    put_fixed(s, avg, 0);
+    put(s, " MHz, last measured frequency: ~");
+    put_fixed(s, last_f*1e-3, 0);
+    put(s, " MHz\n");
+    // frequency weighted by the busy time
+    double busy_sum=0.0, busy_avg=0.0;
+    for (std::size_t i=0; i<shm_seg::FREQ_ENTRIES; ++i) {
+        double bi=p->busy_begin()[i];
+        busy_sum += bi;
+        busy_avg += bi*shm_seg::idx_to_freq(i)*1e-3;
+    }
+    if (busy_sum > 0.0) {
+        busy_avg /= busy_sum;
+        double busy_pct=(busy_sum*1e2)/(sum_ti*shm_seg::busy_scale);
+        put(s, "busy weighted average frequency: ~");
+        put_fixed(s, busy_avg, 0);
+        put(s, " MHz, busy: ~");
+        put_fixed(s, busy_pct, 1);
+        put(s, " %\n");
+        if (!short_output) {
+            put(s, "busy weighted f/MHz %:");
+            for (std::size_t i=shm_seg::FREQ_ENTRIES; i-- > 0; ) {
+                double bi=p->busy_begin()[i];
+                if (bi==0.0)
+                    continue;
+                put(s, "  ");
+                put_fixed(s, shm_seg::idx_to_freq(i)*1e-3, 0);
+                put(s, " ");
+                put_fixed(s, (bi*1e2)/busy_sum, 2);
+            }
+            put(s, "\n");
+        }
+    }
+    // mean length of the runs including the current one
+    std::uint64_t trans=p->transitions();
+    double avg_run=sum_ti/double(trans+1);
+    put(s, "frequency transitions: ");
+    put(s, trans);
+    put(s, ", average dwell: ~");
+    put_fixed(s, avg_run, 1);
+    put(s, " samples\n");
+    if (!short_output && trans != 0) {
+        put(s, "dwell/samples: runs");
+        for (std::uint32_t i=0; i<shm_seg::RUN_ENTRIES; ++i) {
+            std::uint32_t ri=p->runs_begin()[i];
+            if (ri==0)
+                continue;
+            std::uint64_t lo=std::uint64_t(1)<<i, hi=(lo<<1)-1;
+            put(s, "  ");
+            put(s, lo);
+            if (hi != lo) {
+                put(s, "-");
+                put(s, hi);
+            }
+            put(s, ": ");
+            put(s, std::uint64_t(ri));
+        }
+        put(s, "\n");
+    }
     if (std::fabs(sum-100) > 0.005) {
-        s << "invalid sum " << sum << std::endl;
+        put(s, "invalid sum ");
+        put_fixed(s, sum, 1);
+        put(s, "\n");
+    }
+}
+
+void
+cpufreq_stats::data::
+to_text(std::vector<std::string>& chunks, const cpu_stats::mark* m,
+        bool short_output)
+    const
+{
+    // contiguous ranges of cpus per thread keep the order of the
+    // output
+    std::size_t n=_v.size();
+    std::size_t threads=(n + cpus_per_thread - 1)/cpus_per_thread;
+    threads=std::max(std::min(threads, max_threads), std::size_t(1));
+    chunks.assign(threads, std::string());
+    auto render=[this, &chunks, m, short_output, n, threads](std::size_t t) {
+        std::size_t b=(n*t)/threads, e=(n*(t+1))/threads;
+        std::string& s=chunks[t];
+        alignas(shm_seg) char buf[sizeof(shm_seg)];
+        for (std::size_t i=b; i<e; ++i) {
+            const shm_seg* p=_v[i];
+            if (m != nullptr) {
+                std::string nm=shm_seg::name(p->cpu());
+                const void* pm=m->find(nm, sizeof(shm_seg));
+                if (pm==nullptr)
+                    continue;
+                m->read_live(buf, p, sizeof(shm_seg));
+                shm_seg* d=reinterpret_cast<shm_seg*>(buf);
+                (*d) -= *static_cast<const shm_seg*>(pm);
+                p=d;
+            }
+            // not sampled, i.e. in virtual machines without
+            // frequencies, or nothing happened since the mark
+            if (std::all_of(p->begin(), p->end(),
+                            [](std::uint32_t v) { return v==0; }))
+                continue;
+            to_text(s, p, short_output);
+        }
+    };
+    std::vector<std::thread> tv;
+    try {
+        for (std::size_t t=1; t<threads; ++t)
+            tv.emplace_back(render, t);
+    }
+    catch (const std::system_error& e) {
+        // render the remaining chunks in this thread
+        for (std::size_t t=tv.size()+1; t<threads; ++t)
+            render(t);
+    }
+    render(0);
+    for (auto& t : tv)
+        t.join();
+    if (!_aggregate.empty()) {
+        chunks.emplace_back();
+        aggregate_to_text(chunks.back(), m);
+    }
+}
+
+cpufreq_stats::data::sums
+cpufreq_stats::data::sum_up(const cpu_stats::mark* m)
+    const
+{
+    sums r{};
+    alignas(shm_seg) char buf[sizeof(shm_seg)];
+    for (const shm_seg* p : _v) {
+        if (m != nullptr) {
+            std::string nm=shm_seg::name(p->cpu());
+            const void* pm=m->find(nm, sizeof(shm_seg));
+            if (pm==nullptr)
+                continue;
+            m->read_live(buf, p, sizeof(shm_seg));
+            shm_seg* d=reinterpret_cast<shm_seg*>(buf);
+            (*d) -= *static_cast<const shm_seg*>(pm);
+            p=d;
+        }
+        ++r._cpus;
+        for (std::size_t i=0; i<shm_seg::FREQ_ENTRIES; ++i) {
+            double fi=shm_seg::idx_to_freq(i);
+            std::uint64_t ti=p->begin()[i];
+            double bi=p->busy_begin()[i];
+            r._samples += ti;
+            r._f_khz += ti*fi;
+            r._busy += bi;
+            r._busy_f_khz += bi*fi;
+        }
+        r._transitions += p->transitions();
+    }
+    return r;
+}
+
+void
+cpufreq_stats::data::
+aggregate_to_text(std::string& s, const cpu_stats::mark* m)
+    const
+{
+    sums a=sum_up(m);
+    if (a._samples==0)
+        return;
+    const std::uint32_t cols=3;
+    for (std::uint32_t i=0; i<cols; ++i)
+        put(s, "========================");
+    put(s, "\n");
+    put(s, "cpus ");
+    put(s, _aggregate.c_str());
+    put(s, " (");
+    put(s, a._cpus);
+    put(s, " cpus), samples=");
+    put_scientific(s, double(a._samples), 22);
+    put(s, "\n");
+    put(s, "average frequency: ~");
+    put_fixed(s, a._f_khz*1e-3/double(a._samples), 0);
+    put(s, " MHz\n");
+    if (a._busy > 0.0) {
+        double busy_pct=(a._busy*1e2)/(a._samples*shm_seg::busy_scale);
+        put(s, "busy weighted average frequency: ~");
+        put_fixed(s, a._busy_f_khz*1e-3/a._busy, 0);
+        put(s, " MHz, busy: ~");
+        put_fixed(s, busy_pct, 1);
+        put(s, " %\n");
     }
+    put(s, "frequency transitions: ");
+    put(s, a._transitions);
+    put(s, "\n");
+}
+
+void
+cpufreq_stats::data::
+aggregate_to_writer(cpu_stats::writer& w, const cpu_stats::mark* m)
+    const
+{
+    sums a=sum_up(m);
+    w.begin("cpufreq_sum", _aggregate);
+    w.value("cpus", a._cpus);
+    w.value("samples", a._samples);
+    w.value("avg_f_khz", a._samples ? a._f_khz/a._samples : 0.0);
+    w.value("busy_avg_f_khz", a._busy > 0.0 ? a._busy_f_khz/a._busy : 0.0);
+    w.value("busy_pct", a._samples ?
+            (a._busy*1e2)/(a._samples*shm_seg::busy_scale) : 0.0);
+    w.value("transitions", a._transitions);
+    w.end();
+}
+
+std::vector<std::string>
+cpufreq_stats::data::names()
+    const
+{
+    std::vector<std::string> r;
+    for (const auto* p : _v)
+        r.push_back(shm_seg::name(p->cpu()));
+    return r;
 }
 
 void
 cpufreq_stats::data::to_stream(std::ostream& s, bool short_output)
+{
+    std::vector<std::string> chunks;
+    to_text(chunks, nullptr, short_output);
+    write(s, chunks);
+}
+
+void
+cpufreq_stats::data::
+to_stream(std::ostream& s, const cpu_stats::mark& m, bool short_output)
+{
+    std::vector<std::string> chunks;
+    to_text(chunks, &m, short_output);
+    write(s, chunks);
+}
+
+void
+cpufreq_stats::data::to_fd(int fd, bool short_output)
+{
+    std::vector<std::string> chunks;
+    to_text(chunks, nullptr, short_output);
+    tools::file::write(fd, chunks);
+}
+
+void
+cpufreq_stats::data::
+to_fd(int fd, const cpu_stats::mark& m, bool short_output)
+{
+    std::vector<std::string> chunks;
+    to_text(chunks, &m, short_output);
+    tools::file::write(fd, chunks);
+}
+
+void
+cpufreq_stats::data::to_syslog(int prio, bool short_output)
+{
+    std::vector<std::string> chunks;
+    to_text(chunks, nullptr, short_output);
+    for (const auto& c : chunks) {
+        std::size_t b=0, e;
+        while ((e=c.find('\n', b)) != std::string::npos) {
+            syslog(prio, "%.*s", int(e-b), c.data()+b);
+            b=e+1;
+        }
+    }
+}
+
+void
+cpufreq_stats::data::heat_map_to_stream(std::ostream& s)
+{
+    // from below f_min to f_max
+    static const char ramp[]=" .:-=+*#%@";
+    const std::size_t levels=sizeof(ramp)-1;
+    if (std::all_of(_v.begin(), _v.end(),
+                    [](const shm_seg* p) { return p->last_f_khz()==0.0; }))
+        return;
+    const std::size_t per_line=64;
+    s << "last measured frequencies, '" << ramp[1] << "' f_min .. '"
+      << ramp[levels-1] << "' f_max\n";
+    for (std::size_t i=0; i<_v.size(); i+=per_line) {
+        s << "cpu " << std::setw(4) << _v[i]->cpu() << ": ";
+        std::size_t e=std::min(i+per_line, _v.size());
+        for (std::size_t j=i; j<e; ++j) {
+            const shm_seg* p=_v[j];
+            double f=p->last_f_khz();
+            double min_f=p->min_f_khz();
+            double max_f=p->max_f_khz();
+            std::size_t l=0;
+            if (f > 0.0) {
+                double r= max_f > min_f ? (f-min_f)/(max_f-min_f) : 1.0;
+                r=std::min(std::max(r, 0.0), 1.0);
+                l=1 + std::size_t(std::lrint(r*(levels-2)));
+            }
+            s << ramp[l];
+        }
+        s << '\n';
+    }
+}
+
+void
+cpufreq_stats::data::to_writer(cpu_stats::writer& w, const shm_seg* p)
+{
+    double f_khz[shm_seg::FREQ_ENTRIES];
+    std::uint64_t samples=0;
+    double avg=0.0, busy_sum=0.0, busy_avg=0.0;
+    for (std::size_t i=0; i<shm_seg::FREQ_ENTRIES; ++i) {
+        f_khz[i]=shm_seg::idx_to_freq(i);
+        samples += p->begin()[i];
+        avg += p->begin()[i]*f_khz[i];
+        busy_sum += p->busy_begin()[i];
+        busy_avg += p->busy_begin()[i]*f_khz[i];
+    }
+    w.begin("cpufreq", p->cpu());
+    w.value("min_f_khz", p->min_f_khz());
+    w.value("max_f_khz", p->max_f_khz());
+    w.value("last_f_khz", p->last_f_khz());
+    w.value("samples", samples);
+    w.value("avg_f_khz", samples ? avg/samples : 0.0);
+    w.value("busy_avg_f_khz", busy_sum > 0.0 ? busy_avg/busy_sum : 0.0);
+    w.value("busy_pct", samples ?
+            (busy_sum*1e2)/(samples*shm_seg::busy_scale) : 0.0);
+    w.value("transitions", p->transitions());
+    w.value("run_len", p->run_len());
+    w.values("f_khz", f_khz, shm_seg::FREQ_ENTRIES);
+    w.values("entries", p->begin(), shm_seg::FREQ_ENTRIES);
+    w.values("busy_entries", p->busy_begin(), shm_seg::FREQ_ENTRIES);
+    w.values("runs", p->runs_begin(), shm_seg::RUN_ENTRIES);
+    w.end();
+}
+
+void
+cpufreq_stats::data::to_writer(cpu_stats::writer& w)
+{
+    for (std::size_t i=0; i<_v.size(); ++i)
+        to_writer(w, _v[i]);
+    if (!_aggregate.empty())
+        aggregate_to_writer(w, nullptr);
+}
+
+void
+cpufreq_stats::data::
+to_writer(cpu_stats::writer& w, const cpu_stats::mark& m)
 {
     for (std::size_t i=0; i<_v.size(); ++i) {
-        to_stream(s, _v[i], short_output);
+        const shm_seg* p=_v[i];
+        std::string n=shm_seg::name(p->cpu());
+        const void* pm=m.find(n, sizeof(shm_seg));
+        if (pm==nullptr)
+            continue;
+        alignas(shm_seg) char b[sizeof(shm_seg)];
+        m.read_live(b, p, sizeof(shm_seg));
+        shm_seg* d=reinterpret_cast<shm_seg*>(b);
+        (*d) -= *static_cast<const shm_seg*>(pm);
+        to_writer(w, d);
     }
+    if (!_aggregate.empty())
+        aggregate_to_writer(w, &m);
 }
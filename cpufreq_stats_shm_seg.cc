@@ -20,16 +20,20 @@
 #include <sstream>
 #include <iomanip>
 #include <cmath>
+#include <algorithm>
 
 const double cpufreq_stats::shm_seg::freq_step;
 const double cpufreq_stats::shm_seg::inv_freq_step;
 const double cpufreq_stats::shm_seg::max_freq;
+const double cpufreq_stats::shm_seg::busy_scale;
+
+const char* const cpufreq_stats::shm_seg::prefix="/cpu_stats_f_cpu_";
 
 std::string
 cpufreq_stats::shm_seg::name(std::uint32_t cpu)
 {
     std::ostringstream s;
-    s << "/cpu_stats_f_cpu_" << std::setw(3) << std::setfill('0') << cpu;
+    s << prefix << std::setw(3) << std::setfill('0') << cpu;
     return s.str();
 }
 
@@ -37,7 +41,11 @@ cpufreq_stats::shm_seg::shm_seg(std::uint32_t cpu)
     : _cpu(cpu),
       _min_f_khz(cpu::min_freq(cpu)),
       _max_f_khz(cpu::max_freq(cpu)),
-      _entries{0}
+      _entries{0},
+      _transitions(0),
+      _run_len(0),
+      _runs{0},
+      _busy_entries{0}
 {
 }
 
@@ -99,3 +107,25 @@ cpufreq_stats::shm_seg::idx_to_freq(std::uint32_t i)
 {
     return i * freq_step;
 }
+
+std::size_t
+cpufreq_stats::shm_seg::run_to_idx(std::uint32_t len)
+{
+    if (len==0)
+        return 0;
+    std::size_t i=31-__builtin_clz(len);
+    return std::min(i, std::size_t(RUN_ENTRIES)-1);
+}
+
+cpufreq_stats::shm_seg&
+cpufreq_stats::shm_seg::operator-=(const shm_seg& r)
+{
+    for (std::size_t i=0; i<FREQ_ENTRIES; ++i)
+        _entries[i] -= r._entries[i];
+    _transitions -= r._transitions;
+    for (std::size_t i=0; i<RUN_ENTRIES; ++i)
+        _runs[i] -= r._runs[i];
+    for (std::size_t i=0; i<FREQ_ENTRIES; ++i)
+        _busy_entries[i] -= r._busy_entries[i];
+    return *this;
+}
@@ -0,0 +1,251 @@
+//
+//  Copyright (C) 2020-2026  Axel Zeuner
+//
+//  This program is free software; you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation; either version 2 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program; if not, write to the Free Software
+//  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+//
+#if !defined (__CPUIDLE_STATS_H__)
+#define __CPUIDLE_STATS_H__ 1
+
+#include <tools.h>
+#include <cstdint>
+#include <vector>
+#include <string>
+#include <iosfwd>
+
+namespace cpu_stats {
+    class mark;
+    class writer;
+    class selection;
+}
+
+// residency of the cpus in the idle states
+namespace cpuidle_stats {
+
+    struct cpu {
+        // path of the idle state st of cpu
+        static
+        std::string path(std::uint32_t cpu, std::uint32_t st);
+        static
+        bool exists(std::uint32_t cpu, std::uint32_t st);
+        // name of the state like POLL, C1, C6 without newline
+        static
+        std::string name(std::uint32_t cpu, std::uint32_t st);
+    };
+
+    // shared memory segment between server and client, one per
+    // logical core
+    class shm_seg {
+        shm_seg(std::uint32_t cpu, const std::vector<std::string>& names);
+        ~shm_seg();
+    public:
+        enum {
+            // maximum number of idle states
+            STATES=16,
+            NAME_LEN=16
+        };
+    private:
+        // cpu number
+        std::uint32_t _cpu;
+        // number of used states
+        std::uint32_t _states;
+        // names of the states
+        char _names[STATES][NAME_LEN];
+        // CLOCK_MONOTONIC nanoseconds covered by the sums
+        std::uint64_t _elapsed_ns;
+        // sum of the time spent in the states in us
+        std::uint64_t _time_us[STATES];
+        // sum of the entries into the states
+        std::uint64_t _usage[STATES];
+        // fraction of the last interval spent in the states
+        double _last_fraction[STATES];
+    public:
+        static
+        const char* const prefix;
+
+        static
+        std::string name(std::uint32_t cpu_num);
+
+        static
+        shm_seg*
+        create(std::uint32_t cpu_num, const std::vector<std::string>& names);
+
+        static
+        void
+        close(shm_seg* p);
+
+        static
+        const shm_seg*
+        open(std::uint32_t cpu_num);
+
+        static
+        void
+        close(const shm_seg* p);
+
+        // subtract the sums of r, used for the differences to a
+        // mark
+        shm_seg& operator-=(const shm_seg& r);
+
+        const std::uint32_t& cpu() const;
+        const std::uint32_t& states() const;
+        const char* state_name(std::uint32_t st) const;
+        const std::uint64_t& elapsed_ns() const;
+        const std::uint64_t& time_us(std::uint32_t st) const;
+        const std::uint64_t& usage(std::uint32_t st) const;
+        const double& last_fraction(std::uint32_t st) const;
+        // add the deltas of one interval of dt_ns nanoseconds
+        shm_seg& add(const std::uint64_t* time_us,
+                     const std::uint64_t* usage,
+                     std::uint64_t dt_ns);
+        // fraction of the elapsed time spent in state st
+        double fraction(std::uint32_t st) const;
+        // entries into state st per second
+        double rate(std::uint32_t st) const;
+        // average residency per entry into state st in us
+        double residency_us(std::uint32_t st) const;
+    };
+
+    class data {
+        std::vector<const shm_seg*> _v;
+        // the time and usage files of all states of all cpus kept
+        // open, the states of _v[i] start at _first[i]
+        std::vector<std::size_t> _first;
+        std::vector<tools::sys_fs::value_file> _time_f;
+        std::vector<tools::sys_fs::value_file> _usage_f;
+        // values of the last read
+        std::vector<std::uint64_t> _last_time;
+        std::vector<std::uint64_t> _last_usage;
+        // CLOCK_MONOTONIC time of the last read per cpu
+        std::vector<std::uint64_t> _last_ns;
+        // values and time of the read of sample(), time 0 if the
+        // read failed
+        std::vector<std::uint64_t> _s_time;
+        std::vector<std::uint64_t> _s_usage;
+        std::vector<std::uint64_t> _s_ns;
+        bool _create;
+
+        static
+        void
+        to_stream(std::ostream& s, const shm_seg* p, bool short_output);
+        // the average over all cpus in vp
+        static
+        void
+        to_stream(std::ostream& s, const std::vector<const shm_seg*>& vp);
+        void
+        close();
+        static
+        void
+        to_writer(cpu_stats::writer& w, const shm_seg* p);
+    public:
+        // the client opens the segments of the cpus in sel or of
+        // all cpus if sel is nullptr
+        data(bool create, const cpu_stats::selection* sel=nullptr);
+        ~data();
+        data(const data&) = delete;
+        data&
+        operator=(const data& r) = delete;
+        // the segments
+        const std::vector<const shm_seg*>&
+        segments() const;
+        // the names of the segments
+        std::vector<std::string>
+        names() const;
+        // read the counters of all cpus, called before update outside
+        // of the update of the segments
+        void
+        sample();
+        // update _v from the last sample
+        void
+        update();
+        // dump the data
+        void
+        to_stream(std::ostream& s, bool short_output=false);
+        // dump the differences to the data saved in mark m
+        void
+        to_stream(std::ostream& s, const cpu_stats::mark& m,
+                  bool short_output=false);
+        // write the data to w
+        void
+        to_writer(cpu_stats::writer& w);
+        // write the differences to the data saved in mark m to w
+        void
+        to_writer(cpu_stats::writer& w, const cpu_stats::mark& m);
+    };
+}
+
+inline
+const std::uint32_t&
+cpuidle_stats::shm_seg::cpu()
+    const
+{
+    return _cpu;
+}
+
+inline
+const std::uint32_t&
+cpuidle_stats::shm_seg::states()
+    const
+{
+    return _states;
+}
+
+inline
+const char*
+cpuidle_stats::shm_seg::state_name(std::uint32_t st)
+    const
+{
+    return _names[st];
+}
+
+inline
+const std::uint64_t&
+cpuidle_stats::shm_seg::elapsed_ns()
+    const
+{
+    return _elapsed_ns;
+}
+
+inline
+const std::uint64_t&
+cpuidle_stats::shm_seg::time_us(std::uint32_t st)
+    const
+{
+    return _time_us[st];
+}
+
+inline
+const std::uint64_t&
+cpuidle_stats::shm_seg::usage(std::uint32_t st)
+    const
+{
+    return _usage[st];
+}
+
+inline
+const double&
+cpuidle_stats::shm_seg::last_fraction(std::uint32_t st)
+    const
+{
+    return _last_fraction[st];
+}
+
+inline
+const std::vector<const cpuidle_stats::shm_seg*>&
+cpuidle_stats::data::segments()
+    const
+{
+    return _v;
+}
+
+#endif
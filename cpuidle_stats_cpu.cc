@@ -0,0 +1,45 @@
+//
+//  Copyright (C) 2020-2026  Axel Zeuner
+//
+//  This program is free software; you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation; either version 2 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program; if not, write to the Free Software
+//  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+//
+#include "cpuidle_stats.h"
+#include <sstream>
+
+std::string
+cpuidle_stats::cpu::path(std::uint32_t cpu, std::uint32_t st)
+{
+    std::ostringstream s;
+    s << "/sys/devices/system/cpu/cpu" << cpu << "/cpuidle/state"
+      << st << '/';
+    return s.str();
+}
+
+bool
+cpuidle_stats::cpu::exists(std::uint32_t cpu, std::uint32_t st)
+{
+    std::string p=path(cpu, st);
+    return tools::file::exists(p);
+}
+
+std::string
+cpuidle_stats::cpu::name(std::uint32_t cpu, std::uint32_t st)
+{
+    std::string p=path(cpu, st) + "name";
+    std::string n=tools::sys_fs::read<std::string>::from(p);
+    while (!n.empty() && (n.back()=='\n' || n.back()==0))
+        n.pop_back();
+    return n;
+}
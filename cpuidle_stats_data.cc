@@ -0,0 +1,343 @@
+//
+//  Copyright (C) 2020-2026  Axel Zeuner
+//
+//  This program is free software; you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation; either version 2 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program; if not, write to the Free Software
+//  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+//
+#include "cpuidle_stats.h"
+#include "cpufreq_stats.h"
+#include "cpu-stats.h"
+#include <iostream>
+#include <iomanip>
+#include <cmath>
+#include <algorithm>
+#include <cstring>
+#include <cstdlib>
+#include <syslog.h>
+
+cpuidle_stats::data::data(bool create, const cpu_stats::selection* sel)
+    : _v(),
+      _first(),
+      _time_f(),
+      _usage_f(),
+      _last_time(),
+      _last_usage(),
+      _last_ns(),
+      _s_time(),
+      _s_usage(),
+      _s_ns(),
+      _create(create)
+{
+    try {
+        if (_create) {
+            for (std::uint32_t i=0; cpufreq_stats::cpu::exists(i); ++i) {
+                if (!cpufreq_stats::cpu::online(i))
+                    continue;
+                std::vector<std::string> names;
+                std::size_t first=_time_f.size();
+                for (std::uint32_t j=0;
+                     j < shm_seg::STATES && cpu::exists(i, j); ++j) {
+                    std::string p=cpu::path(i, j);
+                    tools::sys_fs::value_file tf(p + "time");
+                    tools::sys_fs::value_file uf(p + "usage");
+                    if (!tf.valid() || !uf.valid())
+                        break;
+                    names.emplace_back(cpu::name(i, j));
+                    _time_f.emplace_back(std::move(tf));
+                    _usage_f.emplace_back(std::move(uf));
+                }
+                if (names.empty())
+                    continue;
+                _v.push_back(shm_seg::create(i, names));
+                _first.push_back(first);
+            }
+            _last_time.resize(_time_f.size(), 0);
+            _last_usage.resize(_usage_f.size(), 0);
+            _last_ns.resize(_v.size(), 0);
+            _s_time.resize(_time_f.size(), 0);
+            _s_usage.resize(_usage_f.size(), 0);
+            _s_ns.resize(_v.size(), 0);
+        } else {
+            std::string pf(shm_seg::prefix);
+            for (const auto& n : cpu_stats::segments(pf)) {
+                std::uint32_t cpu=std::strtoul(n.c_str()+pf.size(),
+                                               nullptr, 10);
+                if (sel != nullptr && !sel->cpu(cpu))
+                    continue;
+                try {
+                    _v.push_back(shm_seg::open(cpu));
+                }
+                catch (const std::runtime_error& e) {
+                    // listed in the index but not accessible, i.e. not
+                    // bound into a container
+                    continue;
+                }
+            }
+        }
+    }
+    catch (const std::runtime_error& e) {
+        close();
+        throw;
+    }
+}
+
+void
+cpuidle_stats::data::close()
+{
+    if (_create==true) {
+        for (std::size_t i=0; i<_v.size(); ++i) {
+            shm_seg* p=const_cast<shm_seg*>(_v[i]);
+            shm_seg::close(p);
+        }
+    } else {
+        for (std::size_t i=0; i<_v.size(); ++i) {
+            shm_seg::close(_v[i]);
+        }
+    }
+    _v.clear();
+}
+
+cpuidle_stats::data::~data()
+{
+    close();
+}
+
+void
+cpuidle_stats::data::sample()
+{
+    if (_create == false)
+        return;
+    for (std::size_t i=0; i<_v.size(); ++i) {
+        std::size_t f=_first[i];
+        std::uint32_t n=_v[i]->states();
+        // all attributes of one cpu are read back to back and share
+        // one time stamp
+        bool ok=true;
+        std::uint64_t ns_0=tools::monotonic_ns();
+        for (std::uint32_t j=0; j<n; ++j) {
+            ok &= _time_f[f+j].read(_s_time[f+j]);
+            ok &= _usage_f[f+j].read(_s_usage[f+j]);
+        }
+        std::uint64_t ns_1=tools::monotonic_ns();
+        _s_ns[i]= ok ? (ns_0 + ns_1)/2 : 0;
+    }
+}
+
+void
+cpuidle_stats::data::update()
+{
+    if (_create == false)
+        return;
+    std::uint64_t dvt[shm_seg::STATES];
+    std::uint64_t dvu[shm_seg::STATES];
+    for (std::size_t i=0; i<_v.size(); ++i) {
+        shm_seg* p=const_cast<shm_seg*>(_v[i]);
+        std::size_t f=_first[i];
+        std::uint32_t n=p->states();
+        std::uint64_t ns_now=_s_ns[i];
+        if (ns_now == 0)
+            continue;
+        _s_ns[i]=0;
+        const std::uint64_t* vt=&_s_time[f];
+        const std::uint64_t* vu=&_s_usage[f];
+        std::uint64_t ns_last=_last_ns[i];
+        _last_ns[i]=ns_now;
+        bool valid= ns_last != 0 && ns_now > ns_last;
+        for (std::uint32_t j=0; j<n; ++j) {
+            // the counters are reset if a cpu goes offline
+            if (vt[j] < _last_time[f+j] || vu[j] < _last_usage[f+j])
+                valid=false;
+            dvt[j]=vt[j] - _last_time[f+j];
+            dvu[j]=vu[j] - _last_usage[f+j];
+            _last_time[f+j]=vt[j];
+            _last_usage[f+j]=vu[j];
+        }
+        if (!valid)
+            continue;
+        p->add(dvt, dvu, ns_now - ns_last);
+    }
+}
+
+void
+cpuidle_stats::data::
+to_stream(std::ostream& s, const shm_seg* p, bool short_output)
+{
+    s << std::fixed;
+    if (short_output) {
+        s << "cpu " << std::setw(3) << p->cpu() << ':';
+        for (std::uint32_t j=0; j<p->states(); ++j) {
+            s << ' ' << p->state_name(j) << ' '
+              << std::setprecision(2) << p->fraction(j)*1e2 << " %";
+        }
+        s << '\n';
+        return;
+    }
+    for (std::uint32_t i=0; i<3; ++i)
+        s << "========================";
+    s << '\n';
+    s << "cpu " << p->cpu() << " idle states, time="
+      << std::setprecision(0) << p->elapsed_ns()*1e-9 << " s\n"
+      << "state            time %    entries/s  residency/us  last %\n";
+    for (std::uint32_t j=0; j<p->states(); ++j) {
+        s << std::left << std::setw(15) << p->state_name(j) << std::right
+          << ' ' << std::setw(7) << std::setprecision(2)
+          << p->fraction(j)*1e2
+          << ' ' << std::setw(12) << std::setprecision(1) << p->rate(j)
+          << ' ' << std::setw(13) << std::setprecision(1)
+          << p->residency_us(j)
+          << ' ' << std::setw(7) << std::setprecision(2)
+          << p->last_fraction(j)*1e2 << '\n';
+    }
+}
+
+void
+cpuidle_stats::data::
+to_stream(std::ostream& s, const std::vector<const shm_seg*>& vp)
+{
+    if (vp.empty())
+        return;
+    // the states of all cpus are expected to be the same, cpus
+    // with other states are skipped
+    const shm_seg* p0=vp[0];
+    std::uint32_t n=p0->states();
+    double t_us[shm_seg::STATES]={0}, usage[shm_seg::STATES]={0};
+    double elapsed_us=0;
+    std::size_t cpus=0;
+    for (const shm_seg* p : vp) {
+        if (p->states() != n)
+            continue;
+        bool same=true;
+        for (std::uint32_t j=0; j<n; ++j)
+            same &= std::strcmp(p->state_name(j), p0->state_name(j))==0;
+        if (!same)
+            continue;
+        for (std::uint32_t j=0; j<n; ++j) {
+            t_us[j] += p->time_us(j);
+            usage[j] += p->usage(j);
+        }
+        elapsed_us += p->elapsed_ns()*1e-3;
+        ++cpus;
+    }
+    if (elapsed_us == 0.0)
+        return;
+    double avg_s=elapsed_us*1e-6/cpus;
+    s << std::fixed << "all " << cpus << " cpus:";
+    for (std::uint32_t j=0; j<n; ++j) {
+        s << ' ' << p0->state_name(j) << ' '
+          << std::setprecision(2) << std::min(t_us[j]/elapsed_us, 1.0)*1e2
+          << " % " << std::setprecision(0) << usage[j]/avg_s << "/s";
+        if (usage[j] > 0)
+            s << ' ' << std::setprecision(1) << t_us[j]/usage[j] << " us";
+        s << ',';
+    }
+    s << '\n';
+}
+
+std::vector<std::string>
+cpuidle_stats::data::names()
+    const
+{
+    std::vector<std::string> r;
+    for (const auto* p : _v)
+        r.push_back(shm_seg::name(p->cpu()));
+    return r;
+}
+
+void
+cpuidle_stats::data::to_stream(std::ostream& s, bool short_output)
+{
+    for (std::size_t i=0; i<_v.size(); ++i) {
+        to_stream(s, _v[i], short_output);
+    }
+    to_stream(s, _v);
+}
+
+void
+cpuidle_stats::data::
+to_stream(std::ostream& s, const cpu_stats::mark& m, bool short_output)
+{
+    // the differences of all cpus are required for the average
+    static_assert(alignof(shm_seg) <= alignof(std::uint64_t),
+                  "alignment of shm_seg");
+    const std::size_t words=(sizeof(shm_seg)+7)/8;
+    std::vector<std::uint64_t> b(words*_v.size());
+    std::vector<const shm_seg*> vd;
+    for (std::size_t i=0; i<_v.size(); ++i) {
+        const shm_seg* p=_v[i];
+        std::string n=shm_seg::name(p->cpu());
+        const void* pm=m.find(n, sizeof(shm_seg));
+        if (pm==nullptr)
+            continue;
+        std::uint64_t* bi=b.data() + words*vd.size();
+        m.read_live(bi, p, sizeof(shm_seg));
+        shm_seg* d=reinterpret_cast<shm_seg*>(bi);
+        (*d) -= *static_cast<const shm_seg*>(pm);
+        if (d->elapsed_ns()==0)
+            continue;
+        to_stream(s, d, short_output);
+        vd.push_back(d);
+    }
+    to_stream(s, vd);
+}
+
+void
+cpuidle_stats::data::to_writer(cpu_stats::writer& w, const shm_seg* p)
+{
+    std::uint32_t n=p->states();
+    std::string names;
+    std::uint64_t time_us[shm_seg::STATES], usage[shm_seg::STATES];
+    double fraction[shm_seg::STATES], last[shm_seg::STATES];
+    for (std::uint32_t i=0; i<n; ++i) {
+        if (i)
+            names += ',';
+        names += p->state_name(i);
+        time_us[i]=p->time_us(i);
+        usage[i]=p->usage(i);
+        fraction[i]=p->fraction(i);
+        last[i]=p->last_fraction(i);
+    }
+    w.begin("cpuidle", p->cpu());
+    w.value("elapsed_ns", p->elapsed_ns());
+    w.value("states", names.c_str());
+    w.values("time_us", time_us, n);
+    w.values("usage", usage, n);
+    w.values("fraction", fraction, n);
+    w.values("last_fraction", last, n);
+    w.end();
+}
+
+void
+cpuidle_stats::data::to_writer(cpu_stats::writer& w)
+{
+    for (std::size_t i=0; i<_v.size(); ++i)
+        to_writer(w, _v[i]);
+}
+
+void
+cpuidle_stats::data::
+to_writer(cpu_stats::writer& w, const cpu_stats::mark& m)
+{
+    for (std::size_t i=0; i<_v.size(); ++i) {
+        const shm_seg* p=_v[i];
+        std::string n=shm_seg::name(p->cpu());
+        const void* pm=m.find(n, sizeof(shm_seg));
+        if (pm==nullptr)
+            continue;
+        alignas(shm_seg) char b[sizeof(shm_seg)];
+        m.read_live(b, p, sizeof(shm_seg));
+        shm_seg* d=reinterpret_cast<shm_seg*>(b);
+        (*d) -= *static_cast<const shm_seg*>(pm);
+        to_writer(w, d);
+    }
+}
@@ -0,0 +1,143 @@
+//
+//  Copyright (C) 2020-2026  Axel Zeuner
+//
+//  This program is free software; you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation; either version 2 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program; if not, write to the Free Software
+//  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+//
+#include "cpuidle_stats.h"
+#include "tools.h"
+#include <sstream>
+#include <iomanip>
+#include <cstring>
+#include <algorithm>
+
+const char* const cpuidle_stats::shm_seg::prefix="/cpu_stats_i_cpu_";
+
+std::string
+cpuidle_stats::shm_seg::name(std::uint32_t cpu)
+{
+    std::ostringstream s;
+    s << prefix << std::setw(3) << std::setfill('0') << cpu;
+    return s.str();
+}
+
+cpuidle_stats::shm_seg::shm_seg(std::uint32_t cpu,
+                                const std::vector<std::string>& names)
+    : _cpu(cpu),
+      _states(0),
+      _names{},
+      _elapsed_ns(0),
+      _time_us{0},
+      _usage{0},
+      _last_fraction{0}
+{
+    for (const auto& n : names) {
+        if (_states >= STATES)
+            break;
+        std::strncpy(_names[_states], n.c_str(), NAME_LEN-1);
+        ++_states;
+    }
+}
+
+cpuidle_stats::shm_seg::~shm_seg()
+{
+    std::string fn=name(_cpu);
+    tools::shm::unlink(fn);
+}
+
+cpuidle_stats::shm_seg*
+cpuidle_stats::shm_seg::create(std::uint32_t cpu,
+                               const std::vector<std::string>& names)
+{
+    std::string fn=name(cpu);
+    void* addr=tools::shm::create(fn, sizeof(shm_seg), 0644);
+    shm_seg* ret=new (addr) shm_seg(cpu, names);
+    return ret;
+}
+
+void
+cpuidle_stats::shm_seg::close(shm_seg* p)
+{
+    p->~shm_seg();
+    tools::shm::unmap(p, sizeof(shm_seg));
+}
+
+const cpuidle_stats::shm_seg*
+cpuidle_stats::shm_seg::open(std::uint32_t cpu)
+{
+    std::string fn=name(cpu);
+    void* addr=tools::shm::open_ro(fn, sizeof(shm_seg));
+    const shm_seg* ret=reinterpret_cast<const shm_seg*>(addr);
+    return ret;
+}
+
+void
+cpuidle_stats::shm_seg::close(const shm_seg* p)
+{
+    void* ap=const_cast<shm_seg*>(p);
+    tools::shm::unmap(ap, sizeof(shm_seg));
+}
+
+cpuidle_stats::shm_seg&
+cpuidle_stats::shm_seg::operator-=(const shm_seg& r)
+{
+    _elapsed_ns -= r._elapsed_ns;
+    for (std::size_t i=0; i<STATES; ++i) {
+        _time_us[i] -= r._time_us[i];
+        _usage[i] -= r._usage[i];
+    }
+    return *this;
+}
+
+cpuidle_stats::shm_seg&
+cpuidle_stats::shm_seg::add(const std::uint64_t* time_us,
+                            const std::uint64_t* usage,
+                            std::uint64_t dt_ns)
+{
+    _elapsed_ns += dt_ns;
+    double inv_dt_us= 1e3/double(dt_ns);
+    for (std::uint32_t i=0; i<_states; ++i) {
+        _time_us[i] += time_us[i];
+        _usage[i] += usage[i];
+        _last_fraction[i] = std::min(time_us[i]*inv_dt_us, 1.0);
+    }
+    return *this;
+}
+
+double
+cpuidle_stats::shm_seg::fraction(std::uint32_t st)
+    const
+{
+    if (_elapsed_ns == 0)
+        return 0.0;
+    return std::min(_time_us[st]*1e3/double(_elapsed_ns), 1.0);
+}
+
+double
+cpuidle_stats::shm_seg::rate(std::uint32_t st)
+    const
+{
+    if (_elapsed_ns == 0)
+        return 0.0;
+    return _usage[st]*1e9/double(_elapsed_ns);
+}
+
+double
+cpuidle_stats::shm_seg::residency_us(std::uint32_t st)
+    const
+{
+    if (_usage[st] == 0)
+        return 0.0;
+    return double(_time_us[st])/double(_usage[st]);
+}
@@ -0,0 +1,368 @@
+//
+//  Copyright (C) 2020-2026  Axel Zeuner
+//
+//  This program is free software; you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation; either version 2 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program; if not, write to the Free Software
+//  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+//
+#if !defined (__HWMON_STATS_H__)
+#define __HWMON_STATS_H__ 1
+
+#include <tools.h>
+#include <cstdint>
+#include <vector>
+#include <string>
+#include <iosfwd>
+
+namespace cpu_stats {
+    class mark;
+    class writer;
+}
+
+namespace hwmon_stats {
+
+    // discovery of hwmon devices and their channels
+    struct hwmon {
+        static
+        std::string path(std::uint32_t no);
+
+        static
+        bool
+        exists(std::uint32_t no);
+
+        // content of the name file without trailing newline
+        static
+        std::string
+        name(std::uint32_t no);
+
+        // content of the file ch_label, e.g. power1_label for the
+        // channel power1, empty if it does not exist
+        static
+        std::string
+        label(std::uint32_t no, const std::string& ch);
+
+        // names of all files of device no matching
+        // type<N>_suffix, sorted by N
+        static
+        std::vector<std::string>
+        channels(std::uint32_t no, const std::string& type,
+                 const std::string& suffix);
+    };
+
+    // kind of a power channel
+    enum class kind : std::uint32_t {
+        // powerN_input and powerN_average in uW
+        power,
+        // energyN_input in uJ
+        energy
+    };
+
+    // selection of devices and channels: entries are hwmon device
+    // names like power_meter, device names and channel files like
+    // amd_energy/energy1_input or all
+    class allow_list {
+        std::vector<std::string> _v;
+    public:
+        allow_list() = default;
+        // from a comma separated list
+        allow_list(const std::string& l);
+        bool empty() const;
+        bool allowed(const std::string& dev, const std::string& file) const;
+    };
+
+    class shm_seg {
+        shm_seg(std::uint32_t id, std::uint32_t hwmon, kind k,
+                const std::string& dev, const std::string& file,
+                const std::string& label);
+        ~shm_seg();
+    public:
+        // lowest power in W, the power ranges grow by a factor
+        // of 2^(1/4)
+        static
+        constexpr const double min_power=1.0/16;
+        static
+        constexpr const std::uint32_t steps_per_octave=4;
+        enum {
+            POWER_ENTRIES=64
+        };
+    private:
+        // number of the channel
+        std::uint32_t _id;
+        // hwmon device number during the lifetime of the daemon
+        std::uint32_t _hwmon;
+        kind _kind;
+        // name of the hwmon device
+        char _dev[32];
+        // file of the channel, e.g. power1_average
+        char _file[24];
+        // label of the channel, may be empty
+        char _label[32];
+        // micro joules since start
+        std::uint64_t _uj_lo;
+        std::uint64_t _uj_hi;
+        // CLOCK_MONOTONIC nanoseconds covered by the energy
+        std::uint64_t _elapsed_ns;
+        // mean power over the last interval
+        double _power;
+        // array with milliseconds/power_range
+        std::uint64_t _entries[POWER_ENTRIES];
+    public:
+        static
+        const char* const prefix;
+
+        static
+        std::string name(std::uint32_t id);
+
+        static
+        shm_seg*
+        create(std::uint32_t id, std::uint32_t hwmon, kind k,
+               const std::string& dev, const std::string& file,
+               const std::string& label);
+
+        static
+        void
+        close(shm_seg* p);
+
+        static
+        const shm_seg*
+        open(std::uint32_t id);
+
+        static
+        void
+        close(const shm_seg* p);
+
+        static
+        std::size_t
+        power_to_idx(double p_in_w);
+
+        // upper bound of the power range idx
+        static
+        double
+        idx_to_power(std::size_t idx);
+
+        // subtract the entries and the energy of r, used for the
+        // differences to a mark
+        shm_seg& operator-=(const shm_seg& r);
+
+        const std::uint32_t& id() const;
+        const std::uint32_t& hwmon() const;
+        const kind& channel_kind() const;
+        const char* dev() const;
+        const char* file() const;
+        const char* label() const;
+        // description of the channel for the output
+        std::string description() const;
+        // add uj micro joules consumed during dt_ns nanoseconds
+        shm_seg& add_energy(std::uint64_t uj, std::uint64_t dt_ns);
+        // energy in joule
+        double joule() const;
+        const std::uint64_t& elapsed_ns() const;
+        shm_seg& power(const double& pwr);
+        const double& power() const;
+        std::uint64_t* begin();
+        std::uint64_t* end();
+        const std::uint64_t* begin() const;
+        const std::uint64_t* end() const;
+    };
+
+    class data {
+        std::vector<const shm_seg*> _v;
+        struct priv_data {
+            tools::sys_fs::value_file _f;
+            // last value read
+            std::uint64_t _last;
+            // CLOCK_MONOTONIC time of the last read, 0 before the
+            // first successful read
+            std::uint64_t _ns;
+            // value and time of the read of sample()
+            std::uint64_t _s_v;
+            std::uint64_t _s_ns;
+            bool _s_ok;
+        };
+        std::vector<priv_data> _vp;
+        bool _create;
+
+        static
+        void
+        to_stream(std::ostream& s, const shm_seg* p, bool short_output);
+        static
+        void
+        to_writer(cpu_stats::writer& w, const shm_seg* p);
+    public:
+        // the daemon creates the segments of the channels allowed by
+        // a, the clients open all existing segments
+        data(bool create, const allow_list& a=allow_list());
+        ~data();
+        data(const data&) = delete;
+        data&
+        operator=(const data& r) = delete;
+        // the segments
+        const std::vector<const shm_seg*>&
+        segments() const;
+        // the names of the segments
+        std::vector<std::string>
+        names() const;
+        // read all channels, called before update outside of the
+        // update of the segments
+        void
+        sample();
+        // update _v from the last sample
+        void
+        update();
+        // dump the data
+        void
+        to_stream(std::ostream& s, bool short_output=false);
+        // dump the differences to the data saved in mark m
+        void
+        to_stream(std::ostream& s, const cpu_stats::mark& m,
+                  bool short_output=false);
+        // write the data to w
+        void
+        to_writer(cpu_stats::writer& w);
+        // write the differences to the data saved in mark m to w
+        void
+        to_writer(cpu_stats::writer& w, const cpu_stats::mark& m);
+    };
+}
+
+inline
+const std::uint32_t&
+hwmon_stats::shm_seg::id()
+    const
+{
+    return _id;
+}
+
+inline
+const std::uint32_t&
+hwmon_stats::shm_seg::hwmon()
+    const
+{
+    return _hwmon;
+}
+
+inline
+const hwmon_stats::kind&
+hwmon_stats::shm_seg::channel_kind()
+    const
+{
+    return _kind;
+}
+
+inline
+const char*
+hwmon_stats::shm_seg::dev()
+    const
+{
+    return _dev;
+}
+
+inline
+const char*
+hwmon_stats::shm_seg::file()
+    const
+{
+    return _file;
+}
+
+inline
+const char*
+hwmon_stats::shm_seg::label()
+    const
+{
+    return _label;
+}
+
+inline
+hwmon_stats::shm_seg&
+hwmon_stats::shm_seg::add_energy(std::uint64_t uj, std::uint64_t dt_ns)
+{
+    std::uint64_t ujl=_uj_lo + uj;
+    if (ujl < _uj_lo)
+        ++_uj_hi;
+    _uj_lo=ujl;
+    _elapsed_ns += dt_ns;
+    return *this;
+}
+
+inline
+double
+hwmon_stats::shm_seg::joule()
+    const
+{
+    return (double(_uj_lo) + double(_uj_hi)*0x1p64)*1e-6;
+}
+
+inline
+const std::uint64_t&
+hwmon_stats::shm_seg::elapsed_ns()
+    const
+{
+    return _elapsed_ns;
+}
+
+inline
+hwmon_stats::shm_seg&
+hwmon_stats::shm_seg::power(const double& v)
+{
+    _power=v;
+    return *this;
+}
+
+inline
+const double&
+hwmon_stats::shm_seg::power()
+    const
+{
+    return _power;
+}
+
+inline
+std::uint64_t*
+hwmon_stats::shm_seg::begin()
+{
+    return _entries;
+}
+
+inline
+std::uint64_t*
+hwmon_stats::shm_seg::end()
+{
+    return _entries+POWER_ENTRIES;
+}
+
+inline
+const std::uint64_t*
+hwmon_stats::shm_seg::begin()
+    const
+{
+    return _entries;
+}
+
+inline
+const std::uint64_t*
+hwmon_stats::shm_seg::end()
+    const
+{
+    return _entries+POWER_ENTRIES;
+}
+
+inline
+const std::vector<const hwmon_stats::shm_seg*>&
+hwmon_stats::data::segments()
+    const
+{
+    return _v;
+}
+
+#endif
@@ -0,0 +1,351 @@
+//
+//  Copyright (C) 2020-2026  Axel Zeuner
+//
+//  This program is free software; you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation; either version 2 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program; if not, write to the Free Software
+//  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+//
+#include "hwmon_stats.h"
+#include "cpu-stats.h"
+#include <iostream>
+#include <iomanip>
+#include <cmath>
+#include <algorithm>
+#include <numeric>
+#include <cstring>
+#include <cstdlib>
+#include <stdexcept>
+#include <syslog.h>
+
+hwmon_stats::data::data(bool create, const allow_list& a)
+    : _v(),
+      _vp(),
+      _create(create)
+{
+    try {
+        if (_create) {
+            if (a.empty())
+                return;
+            // the types and suffixes of the channels
+            static const struct {
+                const char* _type;
+                const char* _suffix;
+                kind _kind;
+            } chs[]={
+                {"power", "input", kind::power},
+                {"power", "average", kind::power},
+                {"energy", "input", kind::energy}
+            };
+            for (std::uint32_t i=0; hwmon::exists(i); ++i) {
+                std::string dev=hwmon::name(i);
+                for (const auto& c : chs) {
+                    for (const auto& f : hwmon::channels(i, c._type,
+                                                         c._suffix)) {
+                        if (!a.allowed(dev, f))
+                            continue;
+                        std::string fn=hwmon::path(i) + f;
+                        tools::sys_fs::value_file vf(fn);
+                        if (!vf.valid())
+                            continue;
+                        std::string ch=f.substr(0, f.find('_'));
+                        std::string l=hwmon::label(i, ch);
+                        std::uint32_t id=_v.size();
+                        const shm_seg* p=shm_seg::create(id, i, c._kind,
+                                                         dev, f, l);
+                        _v.push_back(p);
+                        _vp.push_back(priv_data{std::move(vf), 0, 0,
+                                                0, 0, false});
+                    }
+                }
+            }
+        } else {
+            std::string pf(shm_seg::prefix);
+            for (const auto& n : cpu_stats::segments(pf)) {
+                std::uint32_t id=std::strtoul(n.c_str()+pf.size(),
+                                              nullptr, 10);
+                try {
+                    _v.push_back(shm_seg::open(id));
+                }
+                catch (const std::runtime_error& e) {
+                    // listed in the index but not accessible, i.e. not
+                    // bound into a container
+                    continue;
+                }
+            }
+        }
+    }
+    catch (const std::runtime_error& e) {
+        if (_create) {
+            for (size_t i=0; i<_v.size(); ++i) {
+                shm_seg* p=const_cast<shm_seg*>(_v[i]);
+                shm_seg::close(p);
+            }
+        } else {
+            for (size_t i=0; i<_v.size(); ++i) {
+                shm_seg::close(_v[i]);
+            }
+        }
+        throw;
+    }
+}
+
+hwmon_stats::data::~data()
+{
+    if (_create==true) {
+        for (std::size_t i=0; i<_v.size(); ++i) {
+            shm_seg* p=const_cast<shm_seg*>(_v[i]);
+            shm_seg::close(p);
+        }
+    } else {
+        for (std::size_t i=0; i<_v.size(); ++i) {
+            shm_seg::close(_v[i]);
+        }
+    }
+}
+
+void
+hwmon_stats::data::sample()
+{
+    if (_create == false)
+        return;
+    for (std::size_t i=0; i<_v.size(); ++i) {
+        priv_data& pd=_vp[i];
+        std::uint64_t ns_0=tools::monotonic_ns();
+        pd._s_ok=pd._f.read(pd._s_v);
+        std::uint64_t ns_1=tools::monotonic_ns();
+        pd._s_ns=(ns_0 + ns_1)/2;
+    }
+}
+
+void
+hwmon_stats::data::update()
+{
+    if (_create == false)
+        return;
+    for (std::size_t i=0; i<_v.size(); ++i) {
+        shm_seg* p=const_cast<shm_seg*>(_v[i]);
+        priv_data& pd=_vp[i];
+        if (pd._s_ok==false)
+            continue;
+        pd._s_ok=false;
+        std::uint64_t v=pd._s_v;
+        std::uint64_t ns_now=pd._s_ns;
+        std::uint64_t ns_last=pd._ns;
+        std::uint64_t v_last=pd._last;
+        pd._ns=ns_now;
+        pd._last=v;
+        // the first read only initializes the reference values
+        if (ns_last == 0 || ns_now <= ns_last)
+            continue;
+        std::uint64_t dt_ns=ns_now - ns_last;
+        double dt_s=dt_ns*1e-9;
+        std::uint64_t uj;
+        double p_in_w;
+        if (p->channel_kind()==kind::energy) {
+            // energy counters are not expected to wrap, a smaller
+            // value means a reset of the device
+            if (v < v_last) {
+                syslog(LOG_INFO, "hwmon_stats: %s: counter reset",
+                       p->description().c_str());
+                continue;
+            }
+            uj=v - v_last;
+            p_in_w=uj*1e-6/dt_s;
+        } else {
+            p_in_w=v*1e-6;
+            uj=std::uint64_t(std::rint(p_in_w*dt_ns*1e-3));
+        }
+        p->add_energy(uj, dt_ns);
+        // the measured interval in milliseconds is the weight
+        std::size_t idx=shm_seg::power_to_idx(p_in_w);
+        std::uint64_t* pi=p->begin() + idx;
+        (*pi)+=(dt_ns + 500000)/1000000;
+        p->power(p_in_w);
+    }
+}
+
+void
+hwmon_stats::data::
+to_stream(std::ostream& s, const shm_seg* p, bool short_output)
+{
+    std::uint64_t vt[shm_seg::POWER_ENTRIES];
+    std::copy(p->begin(), p->end(), std::begin(vt));
+
+    // determine entries != 0
+    std::size_t cnt=0;
+    std::size_t vidx[shm_seg::POWER_ENTRIES];
+    double vpct[shm_seg::POWER_ENTRIES];
+    std::size_t idx_max=0;
+    std::uint64_t max_ti=0;
+    double sum_ti=0.0;
+    for (std::size_t i=0; i<shm_seg::POWER_ENTRIES; ++i) {
+        std::uint64_t ti=vt[i];
+        if (ti==0)
+            continue;
+        vidx[cnt]=i;
+        double dti=double(ti);
+        sum_ti += dti;
+        vpct[cnt]=dti;
+        if (ti > max_ti) {
+            idx_max = cnt;
+            max_ti = ti;
+        }
+        ++cnt;
+    }
+    // produce percents from the milliseconds in vpct
+    double sum_pct=0.0;
+    for (std::size_t i=0; i<cnt; ++i) {
+        double pcti=(vpct[i]*1e2)/sum_ti;
+        pcti=std::rint(1e2*pcti)*1e-2;
+        if (i != idx_max)
+            sum_pct += pcti;
+        vpct[i]=pcti;
+    }
+    if (cnt)
+        vpct[idx_max] = 100.0 - sum_pct;
+    double vspct[shm_seg::POWER_ENTRIES];
+    std::partial_sum(std::begin(vpct), std::begin(vpct)+cnt,
+                     std::begin(vspct));
+    std::reverse(std::begin(vidx), std::begin(vidx)+cnt);
+    std::reverse(std::begin(vpct), std::begin(vpct)+cnt);
+    std::reverse(std::begin(vspct), std::begin(vspct)+cnt);
+
+    const std::uint32_t cols=3;
+    for (std::uint32_t i=0; i<cols; ++i)
+        s << "========================";
+    s << '\n';
+    s << std::fixed << std::setprecision(0);
+    s << p->description()
+      << ", time=" << std::setprecision(0) << sum_ti*1e-3 << " s\n";
+    if (!short_output) {
+        for (std::uint32_t i=0; i<cols; ++i) {
+            if (i)
+                s << " | ";
+            s << "Pwr/W       %   sum % ";
+        }
+        s << '\n';
+        std::uint32_t lines=(cnt+cols-1)/cols;
+        for (std::uint32_t j=0; j<lines; ++j) {
+            for (std::uint32_t i=0; i<cols; ++i) {
+                std::size_t k=j+lines*i;
+                if (k >= cnt)
+                    continue;
+                std::size_t idx = vidx[k];
+                double pi=shm_seg::idx_to_power(idx);
+                if (i)
+                    s << "  | ";
+                s << std::setw(5) << std::setprecision(pi < 10 ? 2 : 0)
+                  << pi << ' '
+                  << std::setw(7) << std::setprecision(2) << vpct[k] << ' '
+                  << std::setw(7) << std::setprecision(2) << vspct[k];
+            }
+            s << '\n';
+        }
+    }
+    double ws=p->joule();
+    double elapsed_s=p->elapsed_ns()*1e-9;
+    double avg= elapsed_s > 0.0 ? ws/elapsed_s : 0.0;
+    double kwh=ws/(1000*3600);
+    kwh= rint(kwh*1e6)*1e-6;
+    s << std::setprecision(3)
+      << "average power: " << avg << " W, power over last interval: "
+      << p->power() << " W\n"
+      << "used energy:   " << ws << " Ws, "
+      << std::setprecision(6) << kwh << " kWh"
+      << '\n';
+}
+
+std::vector<std::string>
+hwmon_stats::data::names()
+    const
+{
+    std::vector<std::string> r;
+    for (const auto* p : _v)
+        r.push_back(shm_seg::name(p->id()));
+    return r;
+}
+
+void
+hwmon_stats::data::to_stream(std::ostream& s, bool short_output)
+{
+    for (std::size_t i=0; i<_v.size(); ++i) {
+        to_stream(s, _v[i], short_output);
+    }
+}
+
+void
+hwmon_stats::data::
+to_stream(std::ostream& s, const cpu_stats::mark& m, bool short_output)
+{
+    for (std::size_t i=0; i<_v.size(); ++i) {
+        const shm_seg* p=_v[i];
+        std::string n=shm_seg::name(p->id());
+        const void* pm=m.find(n, sizeof(shm_seg));
+        if (pm==nullptr)
+            continue;
+        alignas(shm_seg) char b[sizeof(shm_seg)];
+        m.read_live(b, p, sizeof(shm_seg));
+        shm_seg* d=reinterpret_cast<shm_seg*>(b);
+        (*d) -= *static_cast<const shm_seg*>(pm);
+        // nothing happened since the mark
+        if (std::all_of(d->begin(), d->end(),
+                        [](std::uint64_t v) { return v==0; }))
+            continue;
+        to_stream(s, d, short_output);
+    }
+}
+
+void
+hwmon_stats::data::to_writer(cpu_stats::writer& w, const shm_seg* p)
+{
+    double power_w[shm_seg::POWER_ENTRIES];
+    for (std::size_t i=0; i<shm_seg::POWER_ENTRIES; ++i)
+        power_w[i]=shm_seg::idx_to_power(i);
+    double s=p->elapsed_ns()*1e-9;
+    w.begin("hwmon", p->description());
+    w.value("dev", p->dev());
+    w.value("file", p->file());
+    w.value("label", p->label());
+    w.value("joule", p->joule());
+    w.value("elapsed_ns", p->elapsed_ns());
+    w.value("avg_power_w", s > 0.0 ? p->joule()/s : 0.0);
+    w.value("last_power_w", p->power());
+    w.values("power_w", power_w, shm_seg::POWER_ENTRIES);
+    w.values("entries", p->begin(), shm_seg::POWER_ENTRIES);
+    w.end();
+}
+
+void
+hwmon_stats::data::to_writer(cpu_stats::writer& w)
+{
+    for (std::size_t i=0; i<_v.size(); ++i)
+        to_writer(w, _v[i]);
+}
+
+void
+hwmon_stats::data::
+to_writer(cpu_stats::writer& w, const cpu_stats::mark& m)
+{
+    for (std::size_t i=0; i<_v.size(); ++i) {
+        const shm_seg* p=_v[i];
+        std::string n=shm_seg::name(p->id());
+        const void* pm=m.find(n, sizeof(shm_seg));
+        if (pm==nullptr)
+            continue;
+        alignas(shm_seg) char b[sizeof(shm_seg)];
+        m.read_live(b, p, sizeof(shm_seg));
+        shm_seg* d=reinterpret_cast<shm_seg*>(b);
+        (*d) -= *static_cast<const shm_seg*>(pm);
+        to_writer(w, d);
+    }
+}
@@ -0,0 +1,120 @@
+//
+//  Copyright (C) 2020-2026  Axel Zeuner
+//
+//  This program is free software; you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation; either version 2 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program; if not, write to the Free Software
+//  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+//
+#include "hwmon_stats.h"
+#include <sstream>
+#include <algorithm>
+#include <cstdlib>
+#include <dirent.h>
+
+std::string
+hwmon_stats::hwmon::path(std::uint32_t no)
+{
+    std::ostringstream s;
+    s << "/sys/class/hwmon/hwmon" << no << '/';
+    return s.str();
+}
+
+bool
+hwmon_stats::hwmon::exists(std::uint32_t no)
+{
+    std::string p=path(no);
+    return tools::file::exists(p);
+}
+
+std::string
+hwmon_stats::hwmon::name(std::uint32_t no)
+{
+    std::string p=path(no) + "name";
+    std::string n=tools::sys_fs::read<std::string>::from(p);
+    while (!n.empty() && (n.back()=='\n' || n.back()==0))
+        n.pop_back();
+    return n;
+}
+
+std::string
+hwmon_stats::hwmon::label(std::uint32_t no, const std::string& ch)
+{
+    std::string p=path(no) + ch + "_label";
+    std::string n=tools::sys_fs::read<std::string>::from(p);
+    while (!n.empty() && (n.back()=='\n' || n.back()==0))
+        n.pop_back();
+    return n;
+}
+
+std::vector<std::string>
+hwmon_stats::hwmon::channels(std::uint32_t no, const std::string& type,
+                             const std::string& suffix)
+{
+    std::vector<std::pair<unsigned long, std::string> > vc;
+    std::string p=path(no);
+    DIR* d=opendir(p.c_str());
+    if (d==nullptr)
+        return std::vector<std::string>();
+    const struct dirent* e;
+    while ((e=readdir(d))!=nullptr) {
+        std::string n(e->d_name);
+        if (n.compare(0, type.size(), type)!=0)
+            continue;
+        const char* b=n.c_str()+type.size();
+        char* ep;
+        unsigned long c=std::strtoul(b, &ep, 10);
+        if (ep==b || *ep != '_' || suffix != ep+1)
+            continue;
+        vc.emplace_back(c, std::move(n));
+    }
+    closedir(d);
+    std::sort(vc.begin(), vc.end());
+    std::vector<std::string> r;
+    for (auto& c : vc)
+        r.emplace_back(std::move(c.second));
+    return r;
+}
+
+hwmon_stats::allow_list::allow_list(const std::string& l)
+    : _v()
+{
+    std::string::size_type b=0;
+    while (b <= l.size()) {
+        std::string::size_type e=l.find(',', b);
+        if (e==std::string::npos)
+            e=l.size();
+        if (e > b)
+            _v.emplace_back(l.substr(b, e-b));
+        b=e+1;
+    }
+}
+
+bool
+hwmon_stats::allow_list::empty()
+    const
+{
+    return _v.empty();
+}
+
+bool
+hwmon_stats::allow_list::allowed(const std::string& dev,
+                                 const std::string& file)
+    const
+{
+    std::string df=dev + '/' + file;
+    for (const auto& a : _v) {
+        if (a=="all" || a==dev || a==df)
+            return true;
+    }
+    return false;
+}
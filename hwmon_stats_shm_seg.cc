@@ -0,0 +1,139 @@
+//
+//  Copyright (C) 2020-2026  Axel Zeuner
+//
+//  This program is free software; you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation; either version 2 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program; if not, write to the Free Software
+//  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+//
+#include "hwmon_stats.h"
+#include "tools.h"
+#include <sstream>
+#include <iomanip>
+#include <cmath>
+#include <cstring>
+
+constexpr const double hwmon_stats::shm_seg::min_power;
+constexpr const std::uint32_t hwmon_stats::shm_seg::steps_per_octave;
+
+const char* const hwmon_stats::shm_seg::prefix="/cpu_stats_h_ch_";
+
+std::string
+hwmon_stats::shm_seg::name(std::uint32_t id)
+{
+    std::ostringstream s;
+    s << prefix << std::setw(3) << std::setfill('0') << id;
+    return s.str();
+}
+
+hwmon_stats::shm_seg::shm_seg(std::uint32_t id, std::uint32_t hwmon, kind k,
+                              const std::string& dev,
+                              const std::string& file,
+                              const std::string& label)
+    : _id(id),
+      _hwmon(hwmon),
+      _kind(k),
+      _dev{0},
+      _file{0},
+      _label{0},
+      _uj_lo(0), _uj_hi(0),
+      _elapsed_ns(0),
+      _power(0.0),
+      _entries{0}
+{
+    std::strncpy(_dev, dev.c_str(), sizeof(_dev)-1);
+    std::strncpy(_file, file.c_str(), sizeof(_file)-1);
+    std::strncpy(_label, label.c_str(), sizeof(_label)-1);
+}
+
+hwmon_stats::shm_seg::~shm_seg()
+{
+    std::string fn=name(_id);
+    tools::shm::unlink(fn);
+}
+
+hwmon_stats::shm_seg*
+hwmon_stats::shm_seg::create(std::uint32_t id, std::uint32_t hwmon, kind k,
+                             const std::string& dev, const std::string& file,
+                             const std::string& label)
+{
+    std::string fn=name(id);
+    void* addr=tools::shm::create(fn, sizeof(shm_seg), 0644);
+    shm_seg* ret=new (addr) shm_seg(id, hwmon, k, dev, file, label);
+    return ret;
+}
+
+void
+hwmon_stats::shm_seg::close(shm_seg* p)
+{
+    p->~shm_seg();
+    tools::shm::unmap(p, sizeof(shm_seg));
+}
+
+const hwmon_stats::shm_seg*
+hwmon_stats::shm_seg::open(std::uint32_t id)
+{
+    std::string fn=name(id);
+    void* addr=tools::shm::open_ro(fn, sizeof(shm_seg));
+    const shm_seg* ret=reinterpret_cast<const shm_seg*>(addr);
+    return ret;
+}
+
+void
+hwmon_stats::shm_seg::close(const shm_seg* p)
+{
+    void* ap=const_cast<shm_seg*>(p);
+    tools::shm::unmap(ap, sizeof(shm_seg));
+}
+
+std::size_t
+hwmon_stats::shm_seg::power_to_idx(double p_in_w)
+{
+    // the channels range from a few mW (nvme) to kW (psus), so the
+    // ranges are logarithmic
+    if (!(p_in_w > min_power))
+        return 0;
+    double p0=std::floor(std::log2(p_in_w/min_power)*steps_per_octave);
+    auto i=static_cast<std::size_t>(p0);
+    i=std::min(i, std::size_t(POWER_ENTRIES)-1);
+    return i;
+}
+
+double
+hwmon_stats::shm_seg::idx_to_power(std::size_t idx)
+{
+    return min_power*std::exp2(double(idx+1)/steps_per_octave);
+}
+
+std::string
+hwmon_stats::shm_seg::description()
+    const
+{
+    std::ostringstream s;
+    s << "hwmon " << _dev << ' ' << _file;
+    if (_label[0] != 0)
+        s << " (" << _label << ')';
+    return s.str();
+}
+
+hwmon_stats::shm_seg&
+hwmon_stats::shm_seg::operator-=(const shm_seg& r)
+{
+    std::uint64_t ujl=_uj_lo - r._uj_lo;
+    std::uint64_t borrow= _uj_lo < r._uj_lo ? 1 : 0;
+    _uj_hi = _uj_hi - r._uj_hi - borrow;
+    _uj_lo = ujl;
+    _elapsed_ns -= r._elapsed_ns;
+    for (std::size_t i=0; i<POWER_ENTRIES; ++i)
+        _entries[i] -= r._entries[i];
+    return *this;
+}
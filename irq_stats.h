@@ -0,0 +1,421 @@
+//
+//  Copyright (C) 2020-2026  Axel Zeuner
+//
+//  This program is free software; you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation; either version 2 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program; if not, write to the Free Software
+//  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+//
+#if !defined (__IRQ_STATS_H__)
+#define __IRQ_STATS_H__ 1
+
+#include <tools.h>
+#include <cstdint>
+#include <vector>
+#include <string>
+#include <iosfwd>
+
+namespace cpu_stats {
+    class mark;
+    class writer;
+    class selection;
+}
+
+// interrupt and softirq rates of the cpus
+namespace irq_stats {
+
+    // reads /proc/interrupts or /proc/softirqs with one read into a
+    // reused buffer and parses the counters of all lines in a single
+    // pass, without allocations once the buffers have grown
+    class proc_counts {
+    public:
+        struct line {
+            // the first 8 characters of the label like 24, LOC or
+            // NET_RX, used to detect changed lines
+            std::uint64_t _key;
+            // label and description inside the buffer, valid until
+            // the next read
+            const char* _label;
+            std::uint32_t _label_len;
+            const char* _desc;
+            std::uint32_t _desc_len;
+            // number of counters found, less than the columns for
+            // lines like ERR and MIS
+            std::uint32_t _ncounts;
+        };
+    private:
+        tools::file_handle _fd;
+        std::vector<char> _buf;
+        // cpu numbers of the columns
+        std::vector<std::uint32_t> _cols;
+        std::vector<line> _lines;
+        // counters of the lines, columns().size() per line, missing
+        // columns are 0
+        std::vector<std::uint64_t> _counts;
+    public:
+        proc_counts(const char* fn);
+        proc_counts(proc_counts&& r) = default;
+        proc_counts& operator=(proc_counts&& r) = default;
+        // true if the file could be opened
+        bool valid() const;
+        // read and parse the file, returns false on errors
+        bool
+        read();
+        const std::vector<std::uint32_t>&
+        columns() const;
+        const std::vector<line>&
+        lines() const;
+        // the counters of line i
+        const std::uint64_t*
+        counts(std::size_t i) const;
+        // the counters of all lines
+        const std::vector<std::uint64_t>&
+        counts() const;
+    };
+
+    // shared memory segment with the interrupt rates of one cpu
+    class shm_seg {
+        shm_seg(std::uint32_t cpu);
+        ~shm_seg();
+    public:
+        // the rates range from a few to millions per second, so the
+        // ranges are logarithmic
+        static
+        constexpr const double min_rate=1.0;
+        static
+        constexpr const std::uint32_t steps_per_octave=4;
+        enum {
+            RATE_ENTRIES=80
+        };
+        enum kind {
+            IRQ=0,
+            SOFTIRQ=1,
+            KINDS=2
+        };
+    private:
+        std::uint32_t _cpu;
+        // counts since start
+        std::uint64_t _count[KINDS];
+        // CLOCK_MONOTONIC milliseconds covered by the histograms
+        std::uint64_t _elapsed_ms[KINDS];
+        // rate of the last interval
+        double _last[KINDS];
+        // milliseconds per rate range
+        std::uint64_t _entries[KINDS][RATE_ENTRIES];
+    public:
+        static
+        const char* const prefix;
+
+        static
+        std::string name(std::uint32_t cpu);
+
+        static
+        shm_seg*
+        create(std::uint32_t cpu);
+
+        static
+        void
+        close(shm_seg* p);
+
+        static
+        const shm_seg*
+        open(std::uint32_t cpu);
+
+        static
+        void
+        close(const shm_seg* p);
+
+        static
+        std::size_t
+        rate_to_idx(double r);
+
+        // upper limit of the range with index idx
+        static
+        double
+        idx_to_rate(std::size_t idx);
+
+        // subtract the sums of r, used for the differences to a mark
+        shm_seg& operator-=(const shm_seg& r);
+
+        const std::uint32_t& cpu() const;
+        const std::uint64_t& count(kind k) const;
+        const std::uint64_t& elapsed_ms(kind k) const;
+        const double& last(kind k) const;
+        const std::uint64_t* begin(kind k) const;
+        const std::uint64_t* end(kind k) const;
+        // add cnt events of kind k during an interval of dt_ns
+        shm_seg& add(kind k, std::uint64_t cnt, std::uint64_t dt_ns);
+    };
+
+    // shared memory segment with the busiest sources of the last
+    // interval
+    class top_seg {
+        top_seg();
+        ~top_seg();
+    public:
+        enum {
+            TOP=16
+        };
+        struct source {
+            // label and description like "LOC Local timer
+            // interrupts" or "softirq NET_RX"
+            char _name[48];
+            // rate over all cpus
+            double _rate;
+            // cpu with the most events and its share
+            std::uint32_t _cpu;
+            double _cpu_share;
+        };
+    private:
+        // number of valid entries
+        std::uint32_t _cnt;
+        // length of the last interval
+        std::uint64_t _elapsed_ms;
+        source _top[TOP];
+    public:
+        static
+        const char* const name;
+
+        static
+        top_seg*
+        create();
+
+        static
+        void
+        close(top_seg* p);
+
+        static
+        const top_seg*
+        open();
+
+        static
+        void
+        close(const top_seg* p);
+
+        const std::uint32_t& cnt() const;
+        const std::uint64_t& elapsed_ms() const;
+        const source* begin() const;
+        const source* end() const;
+        // replace the entries by the cnt entries of v
+        top_seg& assign(const source* v, std::uint32_t cnt,
+                        std::uint64_t ms);
+    };
+
+    class data {
+        std::vector<const shm_seg*> _v;
+        const top_seg* _top;
+        struct priv_data {
+            proc_counts _pc;
+            // keys and counters of the last read
+            std::vector<std::uint64_t> _keys;
+            std::vector<std::uint32_t> _cols;
+            std::vector<std::uint64_t> _counts;
+            // CLOCK_MONOTONIC time of the last read
+            std::uint64_t _ns;
+            // result and time of the read of sample(), the counters
+            // are parsed into _pc
+            bool _s_ok;
+            std::uint64_t _s_ns;
+            priv_data(const char* fn);
+        };
+        // interrupts and softirqs
+        std::vector<priv_data> _vp;
+        // index of the segment of every cpu, ~0 if none
+        std::vector<std::uint32_t> _cpu_idx;
+        // deltas per cpu of the current interval
+        std::vector<std::uint64_t> _deltas;
+        bool _create;
+
+        // update the segments from the file of kind k, the top
+        // sources are merged into top
+        void
+        update(shm_seg::kind k, top_seg::source* top, std::uint32_t& cnt,
+               std::uint64_t& ms);
+        static
+        void
+        to_stream(std::ostream& s, const std::vector<const shm_seg*>& v,
+                  bool short_output);
+        static
+        void
+        to_stream(std::ostream& s, const top_seg* p, bool short_output);
+        void
+        close();
+        static
+        void
+        to_writer(cpu_stats::writer& w, const shm_seg* p);
+        static
+        void
+        to_writer(cpu_stats::writer& w, const top_seg* p);
+    public:
+        // the client opens the segments of the cpus in sel or of
+        // all cpus if sel is nullptr
+        data(bool create, const cpu_stats::selection* sel=nullptr);
+        ~data();
+        data(const data&) = delete;
+        data&
+        operator=(const data& r) = delete;
+        const std::vector<const shm_seg*>&
+        segments() const;
+        // the names of the segments
+        std::vector<std::string>
+        names() const;
+        // read the interrupt files, called before update outside of
+        // the update of the segments
+        void
+        sample();
+        // update the segments from the last sample
+        void
+        update();
+        void
+        to_stream(std::ostream& s, bool short_output=false);
+        // the top sources are always the ones of the last interval
+        void
+        to_stream(std::ostream& s, const cpu_stats::mark& m,
+                  bool short_output=false);
+        // write the data to w
+        void
+        to_writer(cpu_stats::writer& w);
+        // write the differences to the data saved in mark m to w
+        void
+        to_writer(cpu_stats::writer& w, const cpu_stats::mark& m);
+    };
+}
+
+inline
+bool
+irq_stats::proc_counts::valid()
+    const
+{
+    return _fd() >= 0;
+}
+
+inline
+const std::vector<std::uint32_t>&
+irq_stats::proc_counts::columns()
+    const
+{
+    return _cols;
+}
+
+inline
+const std::vector<irq_stats::proc_counts::line>&
+irq_stats::proc_counts::lines()
+    const
+{
+    return _lines;
+}
+
+inline
+const std::uint64_t*
+irq_stats::proc_counts::counts(std::size_t i)
+    const
+{
+    return _counts.data() + i*_cols.size();
+}
+
+inline
+const std::vector<std::uint64_t>&
+irq_stats::proc_counts::counts()
+    const
+{
+    return _counts;
+}
+
+inline
+const std::uint32_t&
+irq_stats::shm_seg::cpu()
+    const
+{
+    return _cpu;
+}
+
+inline
+const std::uint64_t&
+irq_stats::shm_seg::count(kind k)
+    const
+{
+    return _count[k];
+}
+
+inline
+const std::uint64_t&
+irq_stats::shm_seg::elapsed_ms(kind k)
+    const
+{
+    return _elapsed_ms[k];
+}
+
+inline
+const double&
+irq_stats::shm_seg::last(kind k)
+    const
+{
+    return _last[k];
+}
+
+inline
+const std::uint64_t*
+irq_stats::shm_seg::begin(kind k)
+    const
+{
+    return _entries[k];
+}
+
+inline
+const std::uint64_t*
+irq_stats::shm_seg::end(kind k)
+    const
+{
+    return _entries[k] + RATE_ENTRIES;
+}
+
+inline
+const std::uint32_t&
+irq_stats::top_seg::cnt()
+    const
+{
+    return _cnt;
+}
+
+inline
+const std::uint64_t&
+irq_stats::top_seg::elapsed_ms()
+    const
+{
+    return _elapsed_ms;
+}
+
+inline
+const irq_stats::top_seg::source*
+irq_stats::top_seg::begin()
+    const
+{
+    return _top;
+}
+
+inline
+const irq_stats::top_seg::source*
+irq_stats::top_seg::end()
+    const
+{
+    return _top + _cnt;
+}
+
+inline
+const std::vector<const irq_stats::shm_seg*>&
+irq_stats::data::segments()
+    const
+{
+    return _v;
+}
+
+#endif
@@ -0,0 +1,459 @@
+//
+//  Copyright (C) 2020-2026  Axel Zeuner
+//
+//  This program is free software; you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation; either version 2 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program; if not, write to the Free Software
+//  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+//
+#include "irq_stats.h"
+#include "cpufreq_stats.h"
+#include "cpu-stats.h"
+#include <iostream>
+#include <iomanip>
+#include <cmath>
+#include <algorithm>
+#include <numeric>
+#include <cstring>
+#include <type_traits>
+
+namespace {
+
+    const char* const files[irq_stats::shm_seg::KINDS]={
+        "/proc/interrupts",
+        "/proc/softirqs"
+    };
+
+    const char* const kind_names[irq_stats::shm_seg::KINDS]={
+        "interrupts",
+        "softirqs"
+    };
+
+    constexpr const std::uint32_t no_segment=~std::uint32_t(0);
+
+    // append at most len characters of src to the 0 terminated name
+    // n of size ns, runs of blanks are collapsed
+    void
+    append(char* n, std::size_t ns, const char* src, std::size_t len)
+    {
+        std::size_t l=std::strlen(n);
+        for (std::size_t i=0; i<len && l+1<ns; ++i) {
+            if (src[i]==' ' && l>0 && n[l-1]==' ')
+                continue;
+            n[l++]=src[i];
+        }
+        n[l]=0;
+    }
+
+    // insert s into the cnt entries of top sorted by descending rate
+    void
+    insert(irq_stats::top_seg::source* top, std::uint32_t& cnt,
+           const irq_stats::top_seg::source& s)
+    {
+        using irq_stats::top_seg;
+        if (cnt == top_seg::TOP && !(s._rate > top[cnt-1]._rate))
+            return;
+        std::uint32_t i= cnt < top_seg::TOP ? cnt++ : cnt-1;
+        for (; i>0 && top[i-1]._rate < s._rate; --i)
+            top[i]=top[i-1];
+        top[i]=s;
+    }
+}
+
+irq_stats::data::priv_data::priv_data(const char* fn)
+    : _pc(fn),
+      _keys(),
+      _cols(),
+      _counts(),
+      _ns(0),
+      _s_ok(false),
+      _s_ns(0)
+{
+}
+
+irq_stats::data::data(bool create, const cpu_stats::selection* sel)
+    : _v(),
+      _top(nullptr),
+      _vp(),
+      _cpu_idx(),
+      _deltas(),
+      _create(create)
+{
+    try {
+        if (_create) {
+            for (const char* fn : files)
+                _vp.emplace_back(fn);
+            if (!_vp[shm_seg::IRQ]._pc.valid())
+                return;
+            for (std::uint32_t i=0; cpufreq_stats::cpu::exists(i); ++i) {
+                _cpu_idx.push_back(_v.size());
+                _v.push_back(shm_seg::create(i));
+            }
+            _top=top_seg::create();
+        } else {
+            std::string pf(shm_seg::prefix);
+            for (const auto& n : cpu_stats::segments(pf)) {
+                std::uint32_t id=std::strtoul(n.c_str()+pf.size(),
+                                              nullptr, 10);
+                if (sel != nullptr && !sel->cpu(id))
+                    continue;
+                try {
+                    _v.push_back(shm_seg::open(id));
+                }
+                catch (const std::runtime_error& e) {
+                    // listed in the index but not accessible, i.e. not
+                    // bound into a container
+                    continue;
+                }
+            }
+            if (!cpu_stats::segments(top_seg::name).empty())
+                _top=top_seg::open();
+        }
+    }
+    catch (const std::runtime_error& e) {
+        close();
+        throw;
+    }
+}
+
+void
+irq_stats::data::close()
+{
+    if (_create==true) {
+        for (std::size_t i=0; i<_v.size(); ++i) {
+            shm_seg* p=const_cast<shm_seg*>(_v[i]);
+            shm_seg::close(p);
+        }
+        if (_top != nullptr)
+            top_seg::close(const_cast<top_seg*>(_top));
+    } else {
+        for (std::size_t i=0; i<_v.size(); ++i) {
+            shm_seg::close(_v[i]);
+        }
+        if (_top != nullptr)
+            top_seg::close(_top);
+    }
+    _v.clear();
+    _top=nullptr;
+}
+
+irq_stats::data::~data()
+{
+    close();
+}
+
+void
+irq_stats::data::update(shm_seg::kind k, top_seg::source* top,
+                        std::uint32_t& cnt, std::uint64_t& ms)
+{
+    priv_data& pd=_vp[k];
+    proc_counts& pc=pd._pc;
+    if (!pd._s_ok)
+        return;
+    pd._s_ok=false;
+    std::uint64_t ns_now=pd._s_ns;
+    std::uint64_t ns_last=pd._ns;
+    pd._ns=ns_now;
+    const auto& cols=pc.columns();
+    const auto& lines=pc.lines();
+    std::size_t nc=cols.size();
+    std::uint64_t dt_ns=ns_now - ns_last;
+    // the deltas are only valid for the same online cpus
+    if (ns_last != 0 && dt_ns != 0 && cols == pd._cols) {
+        _deltas.assign(nc, 0);
+        for (std::size_t i=0; i<lines.size(); ++i) {
+            const proc_counts::line& l=lines[i];
+            if (i >= pd._keys.size() || pd._keys[i] != l._key ||
+                l._ncounts != nc)
+                continue;
+            const std::uint64_t* c1=pc.counts(i);
+            const std::uint64_t* c0=pd._counts.data() + i*nc;
+            std::uint64_t sum=0, mx=0;
+            std::uint32_t mxc=0;
+            for (std::size_t j=0; j<nc; ++j) {
+                std::uint64_t d= c1[j] >= c0[j] ? c1[j]-c0[j] : 0;
+                _deltas[j] += d;
+                sum += d;
+                if (d > mx) {
+                    mx=d;
+                    mxc=j;
+                }
+            }
+            if (sum == 0)
+                continue;
+            top_seg::source s;
+            s._rate=sum*1e9/dt_ns;
+            if (cnt == top_seg::TOP && !(s._rate > top[cnt-1]._rate))
+                continue;
+            s._name[0]=0;
+            if (k == shm_seg::SOFTIRQ)
+                append(s._name, sizeof(s._name), "softirq ", 8);
+            append(s._name, sizeof(s._name), l._label, l._label_len);
+            if (l._desc_len) {
+                append(s._name, sizeof(s._name), " ", 1);
+                append(s._name, sizeof(s._name), l._desc, l._desc_len);
+            }
+            s._cpu=cols[mxc];
+            s._cpu_share=double(mx)/sum;
+            insert(top, cnt, s);
+        }
+        for (std::size_t j=0; j<nc; ++j) {
+            std::uint32_t cpu=cols[j];
+            if (cpu >= _cpu_idx.size() || _cpu_idx[cpu]==no_segment)
+                continue;
+            shm_seg* p=const_cast<shm_seg*>(_v[_cpu_idx[cpu]]);
+            p->add(k, _deltas[j], dt_ns);
+        }
+        ms=std::max(ms, (dt_ns + 500000)/1000000);
+    }
+    // keep the counters for the next interval, the assignments do
+    // not allocate once the vectors have grown
+    pd._cols=cols;
+    pd._keys.resize(lines.size());
+    for (std::size_t i=0; i<lines.size(); ++i)
+        pd._keys[i]=lines[i]._key;
+    pd._counts=pc.counts();
+}
+
+void
+irq_stats::data::sample()
+{
+    if (_create == false || _top == nullptr)
+        return;
+    for (auto& pd : _vp) {
+        pd._s_ok= pd._pc.valid() && pd._pc.read();
+        pd._s_ns=tools::monotonic_ns();
+    }
+}
+
+void
+irq_stats::data::update()
+{
+    if (_create == false || _top == nullptr)
+        return;
+    top_seg::source top[top_seg::TOP];
+    std::uint32_t cnt=0;
+    std::uint64_t ms=0;
+    update(shm_seg::IRQ, top, cnt, ms);
+    update(shm_seg::SOFTIRQ, top, cnt, ms);
+    if (ms != 0)
+        const_cast<top_seg*>(_top)->assign(top, cnt, ms);
+}
+
+void
+irq_stats::data::
+to_stream(std::ostream& s, const std::vector<const shm_seg*>& v,
+          bool short_output)
+{
+    if (v.empty())
+        return;
+    s << std::fixed;
+    for (std::size_t k=0; k<shm_seg::KINDS; ++k) {
+        shm_seg::kind kk=static_cast<shm_seg::kind>(k);
+        // the sum of the histograms of all cpus
+        std::uint64_t vt[shm_seg::RATE_ENTRIES]={0};
+        double sum_r=0.0, max_r=0.0;
+        std::uint32_t max_cpu=0;
+        for (const shm_seg* p : v) {
+            for (std::size_t i=0; i<shm_seg::RATE_ENTRIES; ++i)
+                vt[i] += p->begin(kk)[i];
+            double r= p->elapsed_ms(kk) != 0 ?
+                p->count(kk)*1e3/p->elapsed_ms(kk) : 0.0;
+            sum_r += r;
+            if (r > max_r) {
+                max_r=r;
+                max_cpu=p->cpu();
+            }
+            if (short_output)
+                continue;
+            s << "cpu " << std::setw(3) << p->cpu() << ": "
+              << kind_names[k] << ' ' << std::setprecision(1)
+              << std::setw(10) << r << " /s, last " << std::setw(10)
+              << p->last(kk) << " /s\n";
+        }
+        if (!short_output) {
+            double sum_ti=std::accumulate(std::begin(vt), std::end(vt),
+                                          0.0);
+            const std::uint32_t cols=3;
+            for (std::uint32_t i=0; i<cols; ++i) {
+                if (i)
+                    s << " | ";
+                s << " rate/s       %   sum % ";
+            }
+            s << '\n';
+            std::size_t vidx[shm_seg::RATE_ENTRIES];
+            std::size_t cnt=0;
+            for (std::size_t i=shm_seg::RATE_ENTRIES; i-- > 0; ) {
+                if (vt[i] != 0)
+                    vidx[cnt++]=i;
+            }
+            double vspct[shm_seg::RATE_ENTRIES];
+            double spct=0.0;
+            for (std::size_t j=0; j<cnt; ++j) {
+                spct += vt[vidx[j]]*1e2/sum_ti;
+                vspct[j]=spct;
+            }
+            std::uint32_t lines=(cnt+cols-1)/cols;
+            for (std::uint32_t j=0; j<lines; ++j) {
+                for (std::uint32_t i=0; i<cols; ++i) {
+                    std::size_t m=j+lines*i;
+                    if (m >= cnt)
+                        continue;
+                    std::size_t idx = vidx[m];
+                    if (i)
+                        s << "  | ";
+                    s << std::setw(8) << std::setprecision(0)
+                      << shm_seg::idx_to_rate(idx) << ' '
+                      << std::setw(7) << std::setprecision(2)
+                      << vt[idx]*1e2/sum_ti << ' '
+                      << std::setw(7) << std::setprecision(2) << vspct[m];
+                }
+                s << '\n';
+            }
+        }
+        s << "all cpus: " << kind_names[k] << ' ' << std::setprecision(1)
+          << sum_r << " /s (max " << max_r << " /s on cpu " << max_cpu
+          << ")\n";
+    }
+}
+
+void
+irq_stats::data::
+to_stream(std::ostream& s, const top_seg* p, bool short_output)
+{
+    if (p == nullptr || p->cnt() == 0)
+        return;
+    const std::uint32_t short_cnt=5;
+    s << std::fixed << "top sources of the last interval ("
+      << std::setprecision(1) << p->elapsed_ms()*1e-3 << " s):\n";
+    std::uint32_t n=0;
+    for (const top_seg::source* t=p->begin(); t != p->end(); ++t) {
+        if (short_output && n++ == short_cnt)
+            break;
+        s << std::setw(12) << std::setprecision(1) << t->_rate << " /s "
+          << t->_name << " (cpu " << t->_cpu << ' '
+          << std::setprecision(0) << t->_cpu_share*1e2 << " %)\n";
+    }
+}
+
+std::vector<std::string>
+irq_stats::data::names()
+    const
+{
+    std::vector<std::string> r;
+    for (const auto* p : _v)
+        r.push_back(shm_seg::name(p->cpu()));
+    return r;
+}
+
+void
+irq_stats::data::to_stream(std::ostream& s, bool short_output)
+{
+    to_stream(s, _v, short_output);
+    to_stream(s, _top, short_output);
+}
+
+void
+irq_stats::data::
+to_stream(std::ostream& s, const cpu_stats::mark& m, bool short_output)
+{
+    // aligned copies of the segments for the differences to the mark
+    using buf_t=std::aligned_storage<sizeof(shm_seg),
+                                     alignof(shm_seg)>::type;
+    std::vector<buf_t> b(_v.size());
+    std::vector<const shm_seg*> v;
+    for (std::size_t i=0; i<_v.size(); ++i) {
+        const shm_seg* p=_v[i];
+        std::string n=shm_seg::name(p->cpu());
+        const void* pm=m.find(n, sizeof(shm_seg));
+        if (pm==nullptr)
+            continue;
+        m.read_live(&b[i], p, sizeof(shm_seg));
+        shm_seg* d=reinterpret_cast<shm_seg*>(&b[i]);
+        (*d) -= *static_cast<const shm_seg*>(pm);
+        // nothing happened since the mark
+        if (d->elapsed_ms(shm_seg::IRQ)==0)
+            continue;
+        v.push_back(d);
+    }
+    to_stream(s, v, short_output);
+    to_stream(s, _top, short_output);
+}
+
+void
+irq_stats::data::to_writer(cpu_stats::writer& w, const shm_seg* p)
+{
+    double rate[shm_seg::RATE_ENTRIES];
+    for (std::size_t i=0; i<shm_seg::RATE_ENTRIES; ++i)
+        rate[i]=shm_seg::idx_to_rate(i);
+    static const char* const kinds[shm_seg::KINDS]={"irq", "softirq"};
+    w.begin("irq", p->cpu());
+    for (std::uint32_t k=0; k<shm_seg::KINDS; ++k) {
+        shm_seg::kind kk=static_cast<shm_seg::kind>(k);
+        std::string n=kinds[k];
+        double ms=p->elapsed_ms(kk);
+        w.value((n + "_count").c_str(), p->count(kk));
+        w.value((n + "_elapsed_ms").c_str(), p->elapsed_ms(kk));
+        w.value((n + "_rate").c_str(), ms > 0.0 ? p->count(kk)*1e3/ms : 0.0);
+        w.value((n + "_last_rate").c_str(), p->last(kk));
+    }
+    w.values("rate", rate, shm_seg::RATE_ENTRIES);
+    w.values("irq_entries", p->begin(shm_seg::IRQ), shm_seg::RATE_ENTRIES);
+    w.values("softirq_entries", p->begin(shm_seg::SOFTIRQ),
+             shm_seg::RATE_ENTRIES);
+    w.end();
+}
+
+void
+irq_stats::data::to_writer(cpu_stats::writer& w)
+{
+    for (std::size_t i=0; i<_v.size(); ++i)
+        to_writer(w, _v[i]);
+    to_writer(w, _top);
+}
+
+void
+irq_stats::data::
+to_writer(cpu_stats::writer& w, const cpu_stats::mark& m)
+{
+    for (std::size_t i=0; i<_v.size(); ++i) {
+        const shm_seg* p=_v[i];
+        std::string n=shm_seg::name(p->cpu());
+        const void* pm=m.find(n, sizeof(shm_seg));
+        if (pm==nullptr)
+            continue;
+        alignas(shm_seg) char b[sizeof(shm_seg)];
+        m.read_live(b, p, sizeof(shm_seg));
+        shm_seg* d=reinterpret_cast<shm_seg*>(b);
+        (*d) -= *static_cast<const shm_seg*>(pm);
+        to_writer(w, d);
+    }
+    // the top sources of the last interval
+    to_writer(w, _top);
+}
+
+void
+irq_stats::data::to_writer(cpu_stats::writer& w, const top_seg* p)
+{
+    if (p==nullptr)
+        return;
+    std::uint32_t rank=0;
+    for (const top_seg::source* i=p->begin(); i!=p->end(); ++i, ++rank) {
+        w.begin("irq_top", rank);
+        w.value("source", i->_name);
+        w.value("elapsed_ms", p->elapsed_ms());
+        w.value("rate", i->_rate);
+        w.value("cpu", i->_cpu);
+        w.value("cpu_share", i->_cpu_share);
+        w.end();
+    }
+}
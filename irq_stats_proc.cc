@@ -0,0 +1,130 @@
+//
+//  Copyright (C) 2020-2026  Axel Zeuner
+//
+//  This program is free software; you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation; either version 2 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program; if not, write to the Free Software
+//  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+//
+#include "irq_stats.h"
+#include <fcntl.h>
+#include <cstring>
+
+namespace {
+
+    bool
+    is_digit(char c)
+    {
+        return c >= '0' && c <= '9';
+    }
+}
+
+irq_stats::proc_counts::proc_counts(const char* fn)
+    : _fd(open(fn, O_RDONLY|O_CLOEXEC)),
+      _buf(65536),
+      _cols(),
+      _lines(),
+      _counts()
+{
+}
+
+bool
+irq_stats::proc_counts::read()
+{
+    if (_fd() < 0)
+        return false;
+    ssize_t rs;
+    // grow the buffer until the whole file fits
+    while ((rs=pread(_fd(), _buf.data(), _buf.size(), 0)) ==
+           ssize_t(_buf.size())) {
+        _buf.resize(_buf.size()*2);
+    }
+    if (rs <= 0)
+        return false;
+    _buf[rs]=0;
+    const char* p=_buf.data();
+    const char* e=p + rs;
+    const char* eol=static_cast<const char*>(std::memchr(p, '\n', e-p));
+    if (eol==nullptr)
+        eol=e;
+    // the header with the CPUn columns of the online cpus
+    std::size_t nc=0;
+    for (const char* q=p; q < eol; ) {
+        while (q < eol && *q==' ')
+            ++q;
+        if (eol-q > 3 && q[0]=='C' && q[1]=='P' && q[2]=='U') {
+            q += 3;
+            std::uint32_t c=0;
+            while (q < eol && is_digit(*q))
+                c = c*10 + (*q++ - '0');
+            if (nc < _cols.size())
+                _cols[nc]=c;
+            else
+                _cols.push_back(c);
+            ++nc;
+        } else {
+            while (q < eol && *q!=' ')
+                ++q;
+        }
+    }
+    _cols.resize(nc);
+    std::size_t nl=0;
+    for (p=eol+1; p < e; p=eol+1) {
+        eol=static_cast<const char*>(std::memchr(p, '\n', e-p));
+        if (eol==nullptr)
+            eol=e;
+        const char* q=p;
+        while (q < eol && *q==' ')
+            ++q;
+        const char* lb=q;
+        while (q < eol && *q!=':')
+            ++q;
+        if (q >= eol)
+            continue;
+        line l;
+        l._label=lb;
+        l._label_len=q-lb;
+        l._key=0;
+        std::memcpy(&l._key, lb, l._label_len < 8 ? l._label_len : 8);
+        ++q;
+        if (nl >= _lines.size())
+            _lines.resize(nl+1);
+        if ((nl+1)*nc > _counts.size())
+            _counts.resize((nl+1)*nc);
+        std::uint64_t* cn=_counts.data() + nl*nc;
+        std::size_t c=0;
+        for (; c<nc; ++c) {
+            while (q < eol && *q==' ')
+                ++q;
+            if (q >= eol || !is_digit(*q))
+                break;
+            std::uint64_t v=0;
+            while (q < eol && is_digit(*q))
+                v = v*10 + (*q++ - '0');
+            cn[c]=v;
+        }
+        l._ncounts=c;
+        for (; c<nc; ++c)
+            cn[c]=0;
+        while (q < eol && *q==' ')
+            ++q;
+        const char* de=eol;
+        while (de > q && de[-1]==' ')
+            --de;
+        l._desc=q;
+        l._desc_len=de-q;
+        _lines[nl++]=l;
+    }
+    _lines.resize(nl);
+    _counts.resize(nl*nc);
+    return true;
+}
@@ -0,0 +1,180 @@
+//
+//  Copyright (C) 2020-2026  Axel Zeuner
+//
+//  This program is free software; you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation; either version 2 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program; if not, write to the Free Software
+//  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+//
+#include "irq_stats.h"
+#include "tools.h"
+#include <sstream>
+#include <iomanip>
+#include <cmath>
+#include <cstring>
+#include <algorithm>
+
+constexpr const double irq_stats::shm_seg::min_rate;
+constexpr const std::uint32_t irq_stats::shm_seg::steps_per_octave;
+
+const char* const irq_stats::shm_seg::prefix="/cpu_stats_q_cpu_";
+
+std::string
+irq_stats::shm_seg::name(std::uint32_t cpu)
+{
+    std::ostringstream s;
+    s << prefix << std::setw(3) << std::setfill('0') << cpu;
+    return s.str();
+}
+
+irq_stats::shm_seg::shm_seg(std::uint32_t cpu)
+    : _cpu(cpu),
+      _count{0},
+      _elapsed_ms{0},
+      _last{0.0},
+      _entries{{0}}
+{
+}
+
+irq_stats::shm_seg::~shm_seg()
+{
+    std::string fn=name(_cpu);
+    tools::shm::unlink(fn);
+}
+
+irq_stats::shm_seg*
+irq_stats::shm_seg::create(std::uint32_t cpu)
+{
+    std::string fn=name(cpu);
+    void* addr=tools::shm::create(fn, sizeof(shm_seg), 0644);
+    shm_seg* ret=new (addr) shm_seg(cpu);
+    return ret;
+}
+
+void
+irq_stats::shm_seg::close(shm_seg* p)
+{
+    p->~shm_seg();
+    tools::shm::unmap(p, sizeof(shm_seg));
+}
+
+const irq_stats::shm_seg*
+irq_stats::shm_seg::open(std::uint32_t cpu)
+{
+    std::string fn=name(cpu);
+    void* addr=tools::shm::open_ro(fn, sizeof(shm_seg));
+    const shm_seg* ret=reinterpret_cast<const shm_seg*>(addr);
+    return ret;
+}
+
+void
+irq_stats::shm_seg::close(const shm_seg* p)
+{
+    void* ap=const_cast<shm_seg*>(p);
+    tools::shm::unmap(ap, sizeof(shm_seg));
+}
+
+std::size_t
+irq_stats::shm_seg::rate_to_idx(double r)
+{
+    if (!(r > min_rate))
+        return 0;
+    double r0=std::floor(std::log2(r/min_rate)*steps_per_octave);
+    auto i=static_cast<std::size_t>(r0);
+    i=std::min(i, std::size_t(RATE_ENTRIES)-1);
+    return i;
+}
+
+double
+irq_stats::shm_seg::idx_to_rate(std::size_t idx)
+{
+    return min_rate*std::exp2(double(idx+1)/steps_per_octave);
+}
+
+irq_stats::shm_seg&
+irq_stats::shm_seg::operator-=(const shm_seg& r)
+{
+    for (std::size_t k=0; k<KINDS; ++k) {
+        _count[k] -= r._count[k];
+        _elapsed_ms[k] -= r._elapsed_ms[k];
+        for (std::size_t i=0; i<RATE_ENTRIES; ++i)
+            _entries[k][i] -= r._entries[k][i];
+    }
+    return *this;
+}
+
+irq_stats::shm_seg&
+irq_stats::shm_seg::add(kind k, std::uint64_t cnt, std::uint64_t dt_ns)
+{
+    std::uint64_t ms=(dt_ns + 500000)/1000000;
+    double r=cnt*1e9/dt_ns;
+    _count[k] += cnt;
+    _elapsed_ms[k] += ms;
+    _last[k]=r;
+    _entries[k][rate_to_idx(r)] += ms;
+    return *this;
+}
+
+const char* const irq_stats::top_seg::name="/cpu_stats_q_top";
+
+irq_stats::top_seg::top_seg()
+    : _cnt(0),
+      _elapsed_ms(0),
+      _top{}
+{
+}
+
+irq_stats::top_seg::~top_seg()
+{
+    tools::shm::unlink(name);
+}
+
+irq_stats::top_seg*
+irq_stats::top_seg::create()
+{
+    void* addr=tools::shm::create(name, sizeof(top_seg), 0644);
+    top_seg* ret=new (addr) top_seg();
+    return ret;
+}
+
+void
+irq_stats::top_seg::close(top_seg* p)
+{
+    p->~top_seg();
+    tools::shm::unmap(p, sizeof(top_seg));
+}
+
+const irq_stats::top_seg*
+irq_stats::top_seg::open()
+{
+    void* addr=tools::shm::open_ro(name, sizeof(top_seg));
+    const top_seg* ret=reinterpret_cast<const top_seg*>(addr);
+    return ret;
+}
+
+void
+irq_stats::top_seg::close(const top_seg* p)
+{
+    void* ap=const_cast<top_seg*>(p);
+    tools::shm::unmap(ap, sizeof(top_seg));
+}
+
+irq_stats::top_seg&
+irq_stats::top_seg::assign(const source* v, std::uint32_t cnt,
+                           std::uint64_t ms)
+{
+    cnt=std::min(cnt, std::uint32_t(TOP));
+    std::copy(v, v+cnt, _top);
+    _cnt=cnt;
+    _elapsed_ms=ms;
+    return *this;
+}
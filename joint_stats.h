@@ -0,0 +1,255 @@
+//
+//  Copyright (C) 2020-2026  Axel Zeuner
+//
+//  This program is free software; you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation; either version 2 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program; if not, write to the Free Software
+//  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+//
+#if !defined (__JOINT_STATS_H__)
+#define __JOINT_STATS_H__ 1
+
+#include <tools.h>
+#include <cstdint>
+#include <vector>
+#include <string>
+#include <iosfwd>
+
+namespace cpu_stats {
+    class mark;
+    class writer;
+}
+
+namespace cpufreq_stats {
+    class data;
+}
+
+namespace rapl_stats {
+    struct data;
+}
+
+namespace joint_stats {
+
+    // shared memory segment with the joint histogram of the average
+    // frequency of the cores and the power of a rapl package
+    class shm_seg {
+        shm_seg(std::uint32_t pkg);
+        ~shm_seg();
+    public:
+        // coarse frequency step of 500 MHz/XXX khz
+        static
+        constexpr const double freq_step=500000;
+        static
+        constexpr const double inv_freq_step=1.0/freq_step;
+        // maximum frequency = 7GHz
+        static
+        constexpr const double max_freq=7000000;
+        // coarse power step of 20 W
+        static
+        constexpr const double power_step=20;
+        static
+        constexpr const double inv_power_step=1.0/power_step;
+        // maximum power, server packages draw more than 250 W
+        static
+        constexpr const double max_power=500;
+        enum {
+            FREQ_ENTRIES=uint32_t(max_freq/freq_step)+1,
+            POWER_ENTRIES=uint32_t(max_power/power_step)+1
+        };
+    private:
+        // physical package id
+        std::uint32_t _pkg;
+        // number of cpus contributing to the average frequency
+        std::uint32_t _cpus;
+        // average frequency of the last interval
+        double _last_f_khz;
+        // power of the last interval
+        double _last_power;
+        // ticks per frequency x power range, _entries[f][p] with
+        // f*freq_step <= average frequency < (f+1)*freq_step and
+        // p*power_step <= power < (p+1)*power_step
+        std::uint32_t _entries[FREQ_ENTRIES][POWER_ENTRIES];
+    public:
+        static
+        std::string name(std::uint32_t pkg);
+
+        static
+        shm_seg*
+        create(std::uint32_t pkg);
+
+        static
+        void
+        close(shm_seg* p);
+
+        static
+        const shm_seg*
+        open(std::uint32_t pkg);
+
+        static
+        void
+        close(const shm_seg* p);
+
+        static
+        std::size_t
+        freq_to_idx(double f);
+
+        static
+        double
+        idx_to_freq(std::size_t i);
+
+        static
+        std::size_t
+        power_to_idx(double p_in_w);
+
+        static
+        double
+        idx_to_power(std::size_t i);
+
+        // subtract the entries of r, used for the differences
+        // to a mark
+        shm_seg& operator-=(const shm_seg& r);
+
+        const std::uint32_t& pkg() const;
+        shm_seg& cpus(const std::uint32_t& n);
+        const std::uint32_t& cpus() const;
+        shm_seg& last_f_khz(const double& f);
+        const double& last_f_khz() const;
+        shm_seg& last_power(const double& p);
+        const double& last_power() const;
+        std::uint32_t& at(std::size_t f, std::size_t p);
+        const std::uint32_t& at(std::size_t f, std::size_t p) const;
+    };
+
+    class data {
+        std::vector<const shm_seg*> _v;
+        // the segment index of every cpu, -1 if the package of the
+        // cpu has no rapl domain
+        std::vector<std::int32_t> _cpu_seg;
+        // index of the rapl segment of the package of every segment
+        std::vector<std::size_t> _rapl_idx;
+        // sum of the frequencies and number of cpus per segment
+        std::vector<double> _f_sum;
+        std::vector<std::uint32_t> _f_cnt;
+        bool _create;
+
+        static
+        void
+        to_stream(std::ostream& s, const shm_seg* p, bool short_output);
+        static
+        void
+        to_writer(cpu_stats::writer& w, const shm_seg* p);
+    public:
+        // the segments are created or opened for the rapl packages
+        // in r, subzones and psys are ignored
+        data(bool create, const rapl_stats::data& r);
+        ~data();
+        data(const data&) = delete;
+        data&
+        operator=(const data& r) = delete;
+        // the names of the segments
+        std::vector<std::string>
+        names() const;
+        // update _v from the data sampled at the same tick
+        void
+        update(std::uint32_t weight, const rapl_stats::data& r,
+               const cpufreq_stats::data& f);
+        // dump the data
+        void
+        to_stream(std::ostream& s, bool short_output=false);
+        // dump the differences to the data saved in mark m
+        void
+        to_stream(std::ostream& s, const cpu_stats::mark& m,
+                  bool short_output=false);
+        // write the data to w
+        void
+        to_writer(cpu_stats::writer& w);
+        // write the differences to the data saved in mark m to w
+        void
+        to_writer(cpu_stats::writer& w, const cpu_stats::mark& m);
+    };
+}
+
+inline
+const std::uint32_t&
+joint_stats::shm_seg::pkg()
+    const
+{
+    return _pkg;
+}
+
+inline
+joint_stats::shm_seg&
+joint_stats::shm_seg::cpus(const std::uint32_t& v)
+{
+    _cpus=v;
+    return *this;
+}
+
+inline
+const std::uint32_t&
+joint_stats::shm_seg::cpus()
+    const
+{
+    return _cpus;
+}
+
+inline
+joint_stats::shm_seg&
+joint_stats::shm_seg::last_f_khz(const double& v)
+{
+    _last_f_khz=v;
+    return *this;
+}
+
+inline
+const double&
+joint_stats::shm_seg::last_f_khz()
+    const
+{
+    return _last_f_khz;
+}
+
+inline
+joint_stats::shm_seg&
+joint_stats::shm_seg::last_power(const double& v)
+{
+    _last_power=v;
+    return *this;
+}
+
+inline
+const double&
+joint_stats::shm_seg::last_power()
+    const
+{
+    return _last_power;
+}
+
+inline
+std::uint32_t&
+joint_stats::shm_seg::at(std::size_t f, std::size_t p)
+{
+    return _entries[f][p];
+}
+
+inline
+const std::uint32_t&
+joint_stats::shm_seg::at(std::size_t f, std::size_t p)
+    const
+{
+    return _entries[f][p];
+}
+
+// Local variables:
+// mode: c++
+// end:
+#endif
@@ -0,0 +1,277 @@
+//
+//  Copyright (C) 2020-2026  Axel Zeuner
+//
+//  This program is free software; you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation; either version 2 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program; if not, write to the Free Software
+//  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+//
+#include "joint_stats.h"
+#include "cpufreq_stats.h"
+#include "rapl_stats.h"
+#include "cpu-stats.h"
+#include <iostream>
+#include <iomanip>
+#include <cmath>
+#include <algorithm>
+#include <cstring>
+
+joint_stats::data::data(bool create, const rapl_stats::data& r)
+    : _v(), _cpu_seg(), _rapl_idx(), _f_sum(), _f_cnt(), _create(create)
+{
+    try {
+        std::vector<std::uint32_t> ids;
+        const auto& rv=r.segments();
+        for (std::size_t i=0; i<rv.size(); ++i) {
+            const rapl_stats::shm_seg* rp=rv[i];
+            if (!rp->is_package())
+                continue;
+            // the segments are named by the physical package id
+            std::uint32_t pkg=rp->package_id();
+            if (_create) {
+                shm_seg* p=shm_seg::create(pkg);
+                _v.push_back(p);
+                ids.push_back(pkg);
+            } else {
+                try {
+                    _v.push_back(shm_seg::open(pkg));
+                }
+                catch (const std::runtime_error& e) {
+                    // not bound into a container
+                    continue;
+                }
+            }
+            _rapl_idx.push_back(i);
+        }
+        if (_create) {
+            for (std::uint32_t i=0; cpufreq_stats::cpu::exists(i); ++i) {
+                std::uint32_t pid=cpufreq_stats::cpu::package_id(i);
+                auto f=std::find(ids.begin(), ids.end(), pid);
+                std::int32_t k= f==ids.end() ? -1 : f - ids.begin();
+                _cpu_seg.push_back(k);
+            }
+            _f_sum.resize(_v.size());
+            _f_cnt.resize(_v.size());
+        }
+    }
+    catch (const std::runtime_error& e) {
+        if (_create) {
+            for (size_t i=0; i<_v.size(); ++i) {
+                shm_seg* p=const_cast<shm_seg*>(_v[i]);
+                shm_seg::close(p);
+            }
+        }
+        throw;
+    }
+}
+
+joint_stats::data::~data()
+{
+    if (_create==true) {
+        for (std::size_t i=0; i<_v.size(); ++i) {
+            shm_seg* p=const_cast<shm_seg*>(_v[i]);
+            shm_seg::close(p);
+        }
+    } else {
+        for (std::size_t i=0; i<_v.size(); ++i) {
+            shm_seg::close(_v[i]);
+        }
+    }
+}
+
+void
+joint_stats::data::update(std::uint32_t weight, const rapl_stats::data& r,
+                          const cpufreq_stats::data& f)
+{
+    if (_create == false)
+        return;
+    std::fill(_f_sum.begin(), _f_sum.end(), 0.0);
+    std::fill(_f_cnt.begin(), _f_cnt.end(), 0);
+    const auto& fv=f.segments();
+    std::size_t n=std::min(fv.size(), _cpu_seg.size());
+    for (std::size_t i=0; i<n; ++i) {
+        std::int32_t k=_cpu_seg[i];
+        double fi=fv[i]->last_f_khz();
+        // offline cpus
+        if (k < 0 || fi <= 0.0)
+            continue;
+        _f_sum[k] += fi;
+        _f_cnt[k] += 1;
+    }
+    const auto& rv=r.segments();
+    for (std::size_t i=0; i<_v.size(); ++i) {
+        shm_seg* p=const_cast<shm_seg*>(_v[i]);
+        double avg_f= _f_cnt[i] ? _f_sum[i]/_f_cnt[i] : 0.0;
+        double pwr=rv[_rapl_idx[i]]->power();
+        std::size_t fi=shm_seg::freq_to_idx(avg_f);
+        std::size_t pi=shm_seg::power_to_idx(pwr);
+        p->at(fi, pi) += weight;
+        p->cpus(_f_cnt[i]);
+        p->last_f_khz(avg_f);
+        p->last_power(pwr);
+    }
+}
+
+void
+joint_stats::data::
+to_stream(std::ostream& s, const shm_seg* p, bool short_output)
+{
+    // sums per frequency and power range
+    double f_ti[shm_seg::FREQ_ENTRIES]={0};
+    double f_pwr[shm_seg::FREQ_ENTRIES]={0};
+    double p_ti[shm_seg::POWER_ENTRIES]={0};
+    double sum_ti=0.0;
+    for (std::size_t i=0; i<shm_seg::FREQ_ENTRIES; ++i) {
+        for (std::size_t j=0; j<shm_seg::POWER_ENTRIES; ++j) {
+            double ti=p->at(i, j);
+            if (ti==0.0)
+                continue;
+            // use the middle of the power range
+            double pj=shm_seg::idx_to_power(j) + shm_seg::power_step*0.5;
+            f_ti[i] += ti;
+            f_pwr[i] += ti*pj;
+            p_ti[j] += ti;
+            sum_ti += ti;
+        }
+    }
+    const std::uint32_t cols=3;
+    for (std::uint32_t i=0; i<cols; ++i)
+        s << "========================";
+    s << '\n';
+    s << std::fixed << std::setprecision(0);
+    s << "rapl package " << p->pkg() << " frequency x power"
+      << ", samples=" << std::scientific << std::setprecision(22) << sum_ti
+      << std::fixed << '\n';
+    if (sum_ti == 0.0)
+        return;
+    s << "f/MHz       %   Pwr/W   MHz/W\n";
+    for (std::size_t i=shm_seg::FREQ_ENTRIES; i-- > 0; ) {
+        if (f_ti[i]==0.0)
+            continue;
+        // use the middle of the frequency range
+        double fi=(shm_seg::idx_to_freq(i) + shm_seg::freq_step*0.5)*1e-3;
+        double pcti=(f_ti[i]*1e2)/sum_ti;
+        double pwri=f_pwr[i]/f_ti[i];
+        s << std::setw(5) << std::setprecision(0) << fi << ' '
+          << std::setw(7) << std::setprecision(2) << pcti << ' '
+          << std::setw(7) << std::setprecision(1) << pwri << ' '
+          << std::setw(7) << std::setprecision(1) << fi/pwri << '\n';
+    }
+    if (!short_output) {
+        s << "f/MHz \\ Pwr/W";
+        for (std::size_t j=0; j<shm_seg::POWER_ENTRIES; ++j) {
+            if (p_ti[j]==0.0)
+                continue;
+            s << ' ' << std::setw(6) << std::setprecision(0)
+              << shm_seg::idx_to_power(j);
+        }
+        s << '\n';
+        for (std::size_t i=shm_seg::FREQ_ENTRIES; i-- > 0; ) {
+            if (f_ti[i]==0.0)
+                continue;
+            s << std::setw(13) << std::setprecision(0)
+              << shm_seg::idx_to_freq(i)*1e-3;
+            for (std::size_t j=0; j<shm_seg::POWER_ENTRIES; ++j) {
+                if (p_ti[j]==0.0)
+                    continue;
+                double pct=(p->at(i, j)*1e2)/sum_ti;
+                s << ' ' << std::setw(6) << std::setprecision(2) << pct;
+            }
+            s << '\n';
+        }
+    }
+    s << "last interval: ~" << std::setprecision(0) << p->last_f_khz()*1e-3
+      << " MHz average over " << p->cpus() << " cpus at "
+      << std::setprecision(1) << p->last_power() << " W\n";
+}
+
+std::vector<std::string>
+joint_stats::data::names()
+    const
+{
+    std::vector<std::string> r;
+    for (const auto* p : _v)
+        r.push_back(shm_seg::name(p->pkg()));
+    return r;
+}
+
+void
+joint_stats::data::to_stream(std::ostream& s, bool short_output)
+{
+    for (std::size_t i=0; i<_v.size(); ++i) {
+        to_stream(s, _v[i], short_output);
+    }
+}
+
+void
+joint_stats::data::
+to_stream(std::ostream& s, const cpu_stats::mark& m, bool short_output)
+{
+    for (std::size_t i=0; i<_v.size(); ++i) {
+        const shm_seg* p=_v[i];
+        std::string n=shm_seg::name(p->pkg());
+        const void* pm=m.find(n, sizeof(shm_seg));
+        if (pm==nullptr)
+            continue;
+        alignas(shm_seg) char b[sizeof(shm_seg)];
+        m.read_live(b, p, sizeof(shm_seg));
+        shm_seg* d=reinterpret_cast<shm_seg*>(b);
+        (*d) -= *static_cast<const shm_seg*>(pm);
+        to_stream(s, d, short_output);
+    }
+}
+
+void
+joint_stats::data::to_writer(cpu_stats::writer& w, const shm_seg* p)
+{
+    double f_khz[shm_seg::FREQ_ENTRIES];
+    double power_w[shm_seg::POWER_ENTRIES];
+    for (std::size_t i=0; i<shm_seg::FREQ_ENTRIES; ++i)
+        f_khz[i]=shm_seg::idx_to_freq(i);
+    for (std::size_t i=0; i<shm_seg::POWER_ENTRIES; ++i)
+        power_w[i]=shm_seg::idx_to_power(i);
+    w.begin("joint", p->pkg());
+    w.value("cpus", p->cpus());
+    w.value("last_f_khz", p->last_f_khz());
+    w.value("last_power_w", p->last_power());
+    w.values("f_khz", f_khz, shm_seg::FREQ_ENTRIES);
+    w.values("power_w", power_w, shm_seg::POWER_ENTRIES);
+    // row major, one row of power entries per frequency
+    w.values("entries", &p->at(0, 0),
+             shm_seg::FREQ_ENTRIES*shm_seg::POWER_ENTRIES);
+    w.end();
+}
+
+void
+joint_stats::data::to_writer(cpu_stats::writer& w)
+{
+    for (std::size_t i=0; i<_v.size(); ++i)
+        to_writer(w, _v[i]);
+}
+
+void
+joint_stats::data::
+to_writer(cpu_stats::writer& w, const cpu_stats::mark& m)
+{
+    for (std::size_t i=0; i<_v.size(); ++i) {
+        const shm_seg* p=_v[i];
+        std::string n=shm_seg::name(p->pkg());
+        const void* pm=m.find(n, sizeof(shm_seg));
+        if (pm==nullptr)
+            continue;
+        alignas(shm_seg) char b[sizeof(shm_seg)];
+        m.read_live(b, p, sizeof(shm_seg));
+        shm_seg* d=reinterpret_cast<shm_seg*>(b);
+        (*d) -= *static_cast<const shm_seg*>(pm);
+        to_writer(w, d);
+    }
+}
@@ -0,0 +1,123 @@
+//
+//  Copyright (C) 2020-2026  Axel Zeuner
+//
+//  This program is free software; you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation; either version 2 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program; if not, write to the Free Software
+//  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+//
+#include "joint_stats.h"
+#include "tools.h"
+#include <sstream>
+#include <iomanip>
+#include <cmath>
+
+constexpr const double joint_stats::shm_seg::freq_step;
+constexpr const double joint_stats::shm_seg::inv_freq_step;
+constexpr const double joint_stats::shm_seg::max_freq;
+constexpr const double joint_stats::shm_seg::power_step;
+constexpr const double joint_stats::shm_seg::inv_power_step;
+constexpr const double joint_stats::shm_seg::max_power;
+
+std::string
+joint_stats::shm_seg::name(std::uint32_t pkg)
+{
+    std::ostringstream s;
+    s << "/cpu_stats_j_pkg_" << std::setw(3) << std::setfill('0') << pkg;
+    return s.str();
+}
+
+joint_stats::shm_seg::shm_seg(std::uint32_t pkg)
+    : _pkg(pkg),
+      _cpus(0),
+      _last_f_khz(0.0),
+      _last_power(0.0),
+      _entries{{0}}
+{
+}
+
+joint_stats::shm_seg::~shm_seg()
+{
+    std::string fn=name(_pkg);
+    tools::shm::unlink(fn);
+}
+
+joint_stats::shm_seg*
+joint_stats::shm_seg::create(std::uint32_t pkg)
+{
+    std::string fn=name(pkg);
+    void* addr=tools::shm::create(fn, sizeof(shm_seg), 0644);
+    shm_seg* ret=new (addr) shm_seg(pkg);
+    return ret;
+}
+
+void
+joint_stats::shm_seg::close(shm_seg* p)
+{
+    p->~shm_seg();
+    tools::shm::unmap(p, sizeof(shm_seg));
+}
+
+const joint_stats::shm_seg*
+joint_stats::shm_seg::open(std::uint32_t pkg)
+{
+    std::string fn=name(pkg);
+    void* addr=tools::shm::open_ro(fn, sizeof(shm_seg));
+    const shm_seg* ret=reinterpret_cast<const shm_seg*>(addr);
+    return ret;
+}
+
+void
+joint_stats::shm_seg::close(const shm_seg* p)
+{
+    void* ap=const_cast<shm_seg*>(p);
+    tools::shm::unmap(ap, sizeof(shm_seg));
+}
+
+std::size_t
+joint_stats::shm_seg::freq_to_idx(double f)
+{
+    double f0=std::floor(f*inv_freq_step);
+    auto i=static_cast<std::size_t>(std::max(f0, 0.0));
+    i=std::min(i, std::size_t(FREQ_ENTRIES)-1);
+    return i;
+}
+
+double
+joint_stats::shm_seg::idx_to_freq(std::size_t i)
+{
+    return i*freq_step;
+}
+
+std::size_t
+joint_stats::shm_seg::power_to_idx(double p_in_w)
+{
+    double p0=std::floor(p_in_w*inv_power_step);
+    auto i=static_cast<std::size_t>(std::max(p0, 0.0));
+    i=std::min(i, std::size_t(POWER_ENTRIES)-1);
+    return i;
+}
+
+double
+joint_stats::shm_seg::idx_to_power(std::size_t i)
+{
+    return i*power_step;
+}
+
+joint_stats::shm_seg&
+joint_stats::shm_seg::operator-=(const shm_seg& r)
+{
+    for (std::size_t i=0; i<FREQ_ENTRIES; ++i)
+        for (std::size_t j=0; j<POWER_ENTRIES; ++j)
+            _entries[i][j] -= r._entries[i][j];
+    return *this;
+}
@@ -0,0 +1,346 @@
+//
+//  Copyright (C) 2020-2026  Axel Zeuner
+//
+//  This program is free software; you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation; either version 2 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program; if not, write to the Free Software
+//  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+//
+#if !defined (__MSR_STATS_H__)
+#define __MSR_STATS_H__ 1
+
+#include <tools.h>
+#include <cstdint>
+#include <vector>
+#include <string>
+#include <iosfwd>
+
+namespace cpu_stats {
+    class mark;
+    class writer;
+    class selection;
+}
+
+// per core and package energy of amd cpus from the model specific
+// registers
+namespace msr_stats {
+
+    // model specific registers of amd family 17h and later
+    enum : std::uint32_t {
+        MSR_RAPL_PWR_UNIT=0xC0010299,
+        MSR_CORE_ENERGY_STAT=0xC001029A,
+        MSR_PKG_ENERGY_STAT=0xC001029B
+    };
+
+    // reader of the msr device file of one cpu
+    class msr {
+        // path with %u replaced
+        std::string _path;
+        // the device file or if _path contains %r one file per
+        // register
+        tools::file_handle _fd;
+        std::vector<std::pair<std::uint32_t, tools::file_handle> > _regs;
+    public:
+        // default template of the msr device files, %u is replaced
+        // by the cpu number, a %r is replaced by the register number
+        // in hex, the value is then read from offset 0 of the file,
+        // allowing tests with regular files
+        static
+        const char* const default_path;
+
+        // tmpl with %u replaced by cpu
+        static
+        std::string path(const std::string& tmpl, std::uint32_t cpu);
+
+        msr(const std::string& tmpl, std::uint32_t cpu);
+        msr(msr&& r) = default;
+        msr& operator=(msr&& r) = default;
+        const std::string& path() const;
+        bool valid() const;
+        // read register reg with one pread, returns false on errors
+        bool read(std::uint32_t reg, std::uint64_t& v);
+    };
+
+    class shm_seg {
+        shm_seg(bool is_pkg, std::uint32_t cpu, std::uint32_t core,
+                std::uint32_t pkg);
+        ~shm_seg();
+    public:
+        // powerstep of 0.5 W's
+        static
+        constexpr const double power_step=0.5;
+        static
+        constexpr const double inv_power_step=1.0/power_step;
+        static
+        constexpr const double max_power=400;
+        enum {
+            POWER_ENTRIES=uint32_t(max_power/power_step)+1
+        };
+    private:
+        // true for a package segment
+        bool _is_pkg;
+        // cpu of the msr read
+        std::uint32_t _cpu;
+        // core and package id from the topology
+        std::uint32_t _core;
+        std::uint32_t _pkg;
+        // micro joules since start
+        std::uint64_t _uj_lo;
+        std::uint64_t _uj_hi;
+        // mean power over the last interval
+        double _power;
+        // array with milliseconds/power_range measured with
+        // CLOCK_MONOTONIC
+        std::uint64_t _entries[POWER_ENTRIES];
+    public:
+        static
+        const char* const core_prefix;
+        static
+        const char* const pkg_prefix;
+
+        // name of the segment of the core with the first cpu cpu or
+        // of the package pkg
+        static
+        std::string name(bool is_pkg, std::uint32_t cpu_or_pkg);
+
+        static
+        shm_seg*
+        create(bool is_pkg, std::uint32_t cpu, std::uint32_t core,
+               std::uint32_t pkg);
+
+        static
+        void
+        close(shm_seg* p);
+
+        static
+        const shm_seg*
+        open(const std::string& name);
+
+        static
+        void
+        close(const shm_seg* p);
+
+        static
+        std::size_t
+        power_to_idx(double p_in_w);
+
+        static
+        double
+        idx_to_power(std::size_t p);
+
+        // subtract the entries and the energy of r, used for the
+        // differences to a mark
+        shm_seg& operator-=(const shm_seg& r);
+
+        std::string name() const;
+        const bool& is_pkg() const;
+        const std::uint32_t& cpu() const;
+        const std::uint32_t& core() const;
+        const std::uint32_t& pkg() const;
+        // description of the segment for the output
+        std::string label() const;
+        // add uj micro joules
+        shm_seg& add_energy(std::uint64_t uj);
+        // energy in joule
+        double joule() const;
+        shm_seg& power(const double& pwr);
+        const double& power() const;
+        std::uint64_t* begin();
+        std::uint64_t* end();
+        const std::uint64_t* begin() const;
+        const std::uint64_t* end() const;
+    };
+
+    class data {
+        std::vector<const shm_seg*> _v;
+        struct priv_data {
+            msr _msr;
+            // last raw counter value
+            std::uint32_t _last;
+            // CLOCK_MONOTONIC time of the last read
+            std::uint64_t _ns;
+            // remainder of the conversion into micro joules
+            std::uint64_t _rem;
+            // counter and time of the read of sample()
+            std::uint32_t _s_v;
+            std::uint64_t _s_ns;
+            bool _s_ok;
+        };
+        std::vector<priv_data> _vp;
+        // energy status unit: 1/2^_esu J
+        std::uint32_t _esu;
+        bool _create;
+        // highest plausible power of a core or a package in W, the
+        // counters wrap at most once within range/max_zone_power
+        static
+        constexpr const double max_zone_power=1000;
+
+        // read the counter of p into pd
+        bool
+        read(const shm_seg* p, priv_data& pd, std::uint32_t& v);
+        // cores_j is the energy of the cores of a package
+        static
+        void
+        to_stream(std::ostream& s, const shm_seg* p, bool short_output,
+                  double cores_j);
+        void
+        close();
+        static
+        void
+        to_writer(cpu_stats::writer& w, const shm_seg* p);
+    public:
+        // the daemon creates the segments for all cores and packages
+        // if the msr device files following the template msr_path
+        // are readable, the clients open all existing segments
+        // the client opens the cores of the cpus and the packages in
+        // sel or all if sel is nullptr
+        data(bool create, const std::string& msr_path=msr::default_path,
+             const cpu_stats::selection* sel=nullptr);
+        ~data();
+        data(const data&) = delete;
+        data&
+        operator=(const data& r) = delete;
+        // the segments, the packages follow their cores
+        const std::vector<const shm_seg*>&
+        segments() const;
+        // the names of the segments
+        std::vector<std::string>
+        names() const;
+        // read the counters, called before update outside of the
+        // update of the segments
+        void
+        sample();
+        // update _v from the last sample
+        void
+        update();
+        // dump the data
+        void
+        to_stream(std::ostream& s, bool short_output=false);
+        // dump the differences to the data saved in mark m
+        void
+        to_stream(std::ostream& s, const cpu_stats::mark& m,
+                  bool short_output=false);
+        // write the data to w
+        void
+        to_writer(cpu_stats::writer& w);
+        // write the differences to the data saved in mark m to w
+        void
+        to_writer(cpu_stats::writer& w, const cpu_stats::mark& m);
+    };
+}
+
+inline
+const bool&
+msr_stats::shm_seg::is_pkg()
+    const
+{
+    return _is_pkg;
+}
+
+inline
+const std::uint32_t&
+msr_stats::shm_seg::cpu()
+    const
+{
+    return _cpu;
+}
+
+inline
+const std::uint32_t&
+msr_stats::shm_seg::core()
+    const
+{
+    return _core;
+}
+
+inline
+const std::uint32_t&
+msr_stats::shm_seg::pkg()
+    const
+{
+    return _pkg;
+}
+
+inline
+msr_stats::shm_seg&
+msr_stats::shm_seg::add_energy(std::uint64_t uj)
+{
+    std::uint64_t ujl=_uj_lo + uj;
+    if (ujl < _uj_lo)
+        ++_uj_hi;
+    _uj_lo=ujl;
+    return *this;
+}
+
+inline
+double
+msr_stats::shm_seg::joule()
+    const
+{
+    return (double(_uj_lo) + double(_uj_hi)*0x1p64)*1e-6;
+}
+
+inline
+msr_stats::shm_seg&
+msr_stats::shm_seg::power(const double& v)
+{
+    _power=v;
+    return *this;
+}
+
+inline
+const double&
+msr_stats::shm_seg::power()
+    const
+{
+    return _power;
+}
+
+inline
+std::uint64_t*
+msr_stats::shm_seg::begin()
+{
+    return _entries;
+}
+
+inline
+std::uint64_t*
+msr_stats::shm_seg::end()
+{
+    return _entries+POWER_ENTRIES;
+}
+
+inline
+const std::uint64_t*
+msr_stats::shm_seg::begin()
+    const
+{
+    return _entries;
+}
+
+inline
+const std::uint64_t*
+msr_stats::shm_seg::end()
+    const
+{
+    return _entries+POWER_ENTRIES;
+}
+
+inline
+const std::vector<const msr_stats::shm_seg*>&
+msr_stats::data::segments()
+    const
+{
+    return _v;
+}
+
+#endif
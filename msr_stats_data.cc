@@ -0,0 +1,439 @@
+//
+//  Copyright (C) 2020-2026  Axel Zeuner
+//
+//  This program is free software; you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation; either version 2 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program; if not, write to the Free Software
+//  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+//
+#include "msr_stats.h"
+#include "cpufreq_stats.h"
+#include "cpu-stats.h"
+#include <iostream>
+#include <iomanip>
+#include <cmath>
+#include <algorithm>
+#include <numeric>
+#include <cstring>
+#include <map>
+#include <cstdlib>
+#include <syslog.h>
+
+constexpr const double msr_stats::data::max_zone_power;
+
+msr_stats::data::data(bool create, const std::string& msr_path,
+                      const cpu_stats::selection* sel)
+    : _v(),
+      _vp(),
+      _esu(0),
+      _create(create)
+{
+    try {
+        if (_create) {
+            if (msr_path.empty())
+                return;
+            // the first online cpu of every core and of every
+            // package, sorted by package and core
+            std::map<std::uint32_t,
+                     std::map<std::uint32_t, std::uint32_t> > pkgs;
+            for (std::uint32_t i=0; cpufreq_stats::cpu::exists(i); ++i) {
+                if (!cpufreq_stats::cpu::online(i))
+                    continue;
+                std::uint32_t pkg=cpufreq_stats::cpu::package_id(i);
+                std::uint32_t core=cpufreq_stats::cpu::core_id(i);
+                pkgs[pkg].emplace(core, i);
+            }
+            for (const auto& pc : pkgs) {
+                std::uint32_t pkg=pc.first;
+                std::uint32_t pkg_cpu=~0u;
+                for (const auto& cc : pc.second) {
+                    std::uint32_t cpu=cc.second;
+                    pkg_cpu=std::min(pkg_cpu, cpu);
+                    msr m(msr_path, cpu);
+                    if (!m.valid())
+                        continue;
+                    if (_esu==0) {
+                        // the energy status unit in bits 12:8
+                        std::uint64_t u;
+                        if (!m.read(MSR_RAPL_PWR_UNIT, u) ||
+                            ((u>>8) & 0x1f)==0) {
+                            syslog(LOG_INFO,
+                                   "msr_stats: %s does not provide "
+                                   "the energy unit", m.path().c_str());
+                            close();
+                            return;
+                        }
+                        _esu=(u>>8) & 0x1f;
+                    }
+                    shm_seg* p=shm_seg::create(false, cpu, cc.first, pkg);
+                    _v.push_back(p);
+                    _vp.push_back(priv_data{std::move(m), 0, 0, 0, 0, 0, false});
+                }
+                if (pkg_cpu == ~0u)
+                    continue;
+                msr m(msr_path, pkg_cpu);
+                if (!m.valid() || _esu==0)
+                    continue;
+                shm_seg* p=shm_seg::create(true, pkg_cpu, 0, pkg);
+                _v.push_back(p);
+                _vp.push_back(priv_data{std::move(m), 0, 0, 0, 0, 0, false});
+            }
+            // initialize the counters
+            for (std::size_t i=0; i<_v.size(); ++i) {
+                priv_data& pd=_vp[i];
+                std::uint32_t v;
+                if (read(_v[i], pd, v))
+                    pd._last=v;
+                pd._ns=tools::monotonic_ns();
+            }
+        } else {
+            // cores by their first cpu, packages by their number
+            std::string cf(shm_seg::core_prefix);
+            for (const auto& n : cpu_stats::segments(cf)) {
+                std::uint32_t id=std::strtoul(n.c_str()+cf.size(),
+                                              nullptr, 10);
+                if (sel != nullptr && !sel->cpu(id))
+                    continue;
+                try {
+                    _v.push_back(shm_seg::open(n));
+                }
+                catch (const std::runtime_error& e) {
+                    // listed in the index but not accessible, i.e. not
+                    // bound into a container
+                    continue;
+                }
+            }
+            std::string pf(shm_seg::pkg_prefix);
+            for (const auto& n : cpu_stats::segments(pf)) {
+                std::uint32_t id=std::strtoul(n.c_str()+pf.size(),
+                                              nullptr, 10);
+                if (sel != nullptr && !sel->pkg(id))
+                    continue;
+                try {
+                    _v.push_back(shm_seg::open(n));
+                }
+                catch (const std::runtime_error& e) {
+                    // listed in the index but not accessible, i.e. not
+                    // bound into a container
+                    continue;
+                }
+            }
+            std::stable_sort(_v.begin(), _v.end(),
+                             [](const shm_seg* a, const shm_seg* b) {
+                                 if (a->pkg() != b->pkg())
+                                     return a->pkg() < b->pkg();
+                                 return a->is_pkg() < b->is_pkg();
+                             });
+        }
+    }
+    catch (const std::runtime_error& e) {
+        close();
+        throw;
+    }
+}
+
+void
+msr_stats::data::close()
+{
+    if (_create==true) {
+        for (std::size_t i=0; i<_v.size(); ++i) {
+            shm_seg* p=const_cast<shm_seg*>(_v[i]);
+            shm_seg::close(p);
+        }
+    } else {
+        for (std::size_t i=0; i<_v.size(); ++i) {
+            shm_seg::close(_v[i]);
+        }
+    }
+    _v.clear();
+    _vp.clear();
+}
+
+msr_stats::data::~data()
+{
+    close();
+}
+
+bool
+msr_stats::data::read(const shm_seg* p, priv_data& pd, std::uint32_t& v)
+{
+    std::uint32_t reg= p->is_pkg() ? MSR_PKG_ENERGY_STAT :
+        MSR_CORE_ENERGY_STAT;
+    std::uint64_t r;
+    if (!pd._msr.read(reg, r))
+        return false;
+    // only the lower 32 bits are used
+    v=std::uint32_t(r);
+    return true;
+}
+
+void
+msr_stats::data::sample()
+{
+    if (_create == false)
+        return;
+    for (std::size_t i=0; i<_v.size(); ++i) {
+        priv_data& pd=_vp[i];
+        std::uint64_t ns_0=tools::monotonic_ns();
+        pd._s_ok=read(_v[i], pd, pd._s_v);
+        std::uint64_t ns_1=tools::monotonic_ns();
+        pd._s_ns=(ns_0 + ns_1)/2;
+    }
+}
+
+void
+msr_stats::data::update()
+{
+    if (_create == false)
+        return;
+    // range of the counters in micro joules
+    const double range_uj=0x1p32*1e6/double(std::uint64_t(1)<<_esu);
+    for (std::size_t i=0; i<_v.size(); ++i) {
+        shm_seg* p=const_cast<shm_seg*>(_v[i]);
+        priv_data& pd=_vp[i];
+        if (pd._s_ok==false)
+            continue;
+        pd._s_ok=false;
+        std::uint32_t e_now=pd._s_v;
+        std::uint64_t ns_now=pd._s_ns;
+        std::uint64_t dt_ns=ns_now - pd._ns;
+        std::uint32_t e_last=pd._last;
+        pd._last=e_now;
+        pd._ns=ns_now;
+        if (dt_ns == 0)
+            continue;
+        double dt_s=dt_ns*1e-9;
+        // the number of wraps of the counter is unknown if the
+        // interval is longer than the time to wrap it at the highest
+        // plausible power, the interval is not counted then
+        double min_wrap_s=range_uj*1e-6/max_zone_power;
+        if (dt_s >= min_wrap_s) {
+            syslog(LOG_WARNING,
+                   "msr_stats: %s: interval of %.3f s exceeds the "
+                   "minimum wrap time of %.3f s, dropped",
+                   p->label().c_str(), dt_s, min_wrap_s);
+            continue;
+        }
+        // 32 bit counter arithmetic handles one wrap
+        std::uint64_t delta=std::uint32_t(e_now - e_last);
+        // conversion into micro joules, the remainder is carried to
+        // the next interval
+        std::uint64_t t=delta*1000000 + pd._rem;
+        std::uint64_t uj=t >> _esu;
+        pd._rem=t & ((std::uint64_t(1)<<_esu)-1);
+        p->add_energy(uj);
+        double p_in_w=uj*1e-6/dt_s;
+        std::size_t idx=shm_seg::power_to_idx(p_in_w);
+        if (p_in_w > shm_seg::max_power) {
+            syslog(LOG_INFO,
+                   "msr_stats: %s: %f W over %.3f s",
+                   p->label().c_str(), p_in_w, dt_s);
+        }
+        // the measured interval in milliseconds is the weight
+        std::uint64_t* pi=p->begin() + idx;
+        (*pi)+=(dt_ns + 500000)/1000000;
+        p->power(p_in_w);
+    }
+}
+
+void
+msr_stats::data::
+to_stream(std::ostream& s, const shm_seg* p, bool short_output,
+          double cores_j)
+{
+    std::uint64_t vt[shm_seg::POWER_ENTRIES];
+    std::copy(p->begin(), p->end(), std::begin(vt));
+
+    // determine entries != 0
+    std::size_t cnt=0;
+    std::size_t vidx[shm_seg::POWER_ENTRIES];
+    double vpct[shm_seg::POWER_ENTRIES];
+    std::size_t idx_max=0;
+    std::uint64_t max_ti=0;
+    double sum_ti=0.0;
+    for (std::size_t i=0; i<shm_seg::POWER_ENTRIES; ++i) {
+        std::uint64_t ti=vt[i];
+        if (ti==0)
+            continue;
+        vidx[cnt]=i;
+        double dti=double(ti);
+        sum_ti += dti;
+        vpct[cnt]=dti;
+        if (ti > max_ti) {
+            idx_max = cnt;
+            max_ti = ti;
+        }
+        ++cnt;
+    }
+    double ws=p->joule();
+    double avg= sum_ti > 0.0 ? ws/(sum_ti*1e-3) : 0.0;
+    s << std::fixed;
+    if (short_output && !p->is_pkg()) {
+        // one line per core
+        s << p->label() << ": average power: " << std::setprecision(2)
+          << avg << " W, last: " << p->power() << " W, energy: "
+          << std::setprecision(0) << ws << " Ws\n";
+        return;
+    }
+    // produce percents from the milliseconds in vpct
+    double sum_pct=0.0;
+    for (std::size_t i=0; i<cnt; ++i) {
+        double pcti=(vpct[i]*1e2)/sum_ti;
+        pcti=std::rint(1e2*pcti)*1e-2;
+        if (i != idx_max)
+            sum_pct += pcti;
+        vpct[i]=pcti;
+    }
+    if (cnt)
+        vpct[idx_max] = 100.0 - sum_pct;
+    double vspct[shm_seg::POWER_ENTRIES];
+    std::partial_sum(std::begin(vpct), std::begin(vpct)+cnt,
+                     std::begin(vspct));
+    std::reverse(std::begin(vidx), std::begin(vidx)+cnt);
+    std::reverse(std::begin(vpct), std::begin(vpct)+cnt);
+    std::reverse(std::begin(vspct), std::begin(vspct)+cnt);
+
+    const std::uint32_t cols=3;
+    for (std::uint32_t i=0; i<cols; ++i)
+        s << "========================";
+    s << '\n';
+    s << std::setprecision(0);
+    s << p->label()
+      << ", time=" << std::setprecision(0) << sum_ti*1e-3 << " s\n";
+    for (std::uint32_t i=0; i<cols; ++i) {
+        if (i)
+            s << " | ";
+        s << "Pwr/W       %   sum % ";
+    }
+    s << '\n';
+    std::uint32_t lines=(cnt+cols-1)/cols;
+    for (std::uint32_t j=0; j<lines; ++j) {
+        for (std::uint32_t i=0; i<cols; ++i) {
+            std::size_t k=j+lines*i;
+            if (k >= cnt)
+                continue;
+            std::size_t idx = vidx[k];
+            double pi=shm_seg::idx_to_power(idx);
+            if (i)
+                s << "  | ";
+            s << std::setw(5) << std::setprecision(1) << pi << ' '
+              << std::setw(7) << std::setprecision(2) << vpct[k] << ' '
+              << std::setw(7) << std::setprecision(2) << vspct[k];
+        }
+        s << '\n';
+    }
+    double kwh=ws/(1000*3600);
+    kwh= rint(kwh*1e3)*1e-3;
+    s << std::setprecision(2)
+      << "average power: " << avg << " W, power over last interval: "
+      << p->power() << " W\n"
+      << "used energy:   "
+      << std::scientific << std::setprecision(15) << rint(ws) << " Ws, "
+      << std::setprecision(15) << kwh << " kWh"
+      << '\n';
+    if (p->is_pkg() && ws > 0.0) {
+        s << "energy of the cores relative to the package: ~" << std::fixed
+          << std::setprecision(1) << (cores_j*1e2)/ws << " %\n";
+    }
+}
+
+std::vector<std::string>
+msr_stats::data::names()
+    const
+{
+    std::vector<std::string> r;
+    for (const auto* p : _v)
+        r.push_back(p->name());
+    return r;
+}
+
+void
+msr_stats::data::to_stream(std::ostream& s, bool short_output)
+{
+    double cores_j=0.0;
+    for (std::size_t i=0; i<_v.size(); ++i) {
+        const shm_seg* p=_v[i];
+        to_stream(s, p, short_output, cores_j);
+        cores_j = p->is_pkg() ? 0.0 : cores_j + p->joule();
+    }
+}
+
+void
+msr_stats::data::
+to_stream(std::ostream& s, const cpu_stats::mark& m, bool short_output)
+{
+    double cores_j=0.0;
+    for (std::size_t i=0; i<_v.size(); ++i) {
+        const shm_seg* p=_v[i];
+        const void* pm=m.find(p->name(), sizeof(shm_seg));
+        if (pm==nullptr)
+            continue;
+        alignas(shm_seg) char b[sizeof(shm_seg)];
+        m.read_live(b, p, sizeof(shm_seg));
+        shm_seg* d=reinterpret_cast<shm_seg*>(b);
+        (*d) -= *static_cast<const shm_seg*>(pm);
+        // nothing happened since the mark
+        if (std::all_of(d->begin(), d->end(),
+                        [](std::uint64_t v) { return v==0; }))
+            continue;
+        to_stream(s, d, short_output, cores_j);
+        cores_j = d->is_pkg() ? 0.0 : cores_j + d->joule();
+    }
+}
+
+void
+msr_stats::data::to_writer(cpu_stats::writer& w, const shm_seg* p)
+{
+    double power_w[shm_seg::POWER_ENTRIES];
+    std::uint64_t samples=0;
+    for (std::size_t i=0; i<shm_seg::POWER_ENTRIES; ++i) {
+        power_w[i]=shm_seg::idx_to_power(i);
+        samples += p->begin()[i];
+    }
+    w.begin(p->is_pkg() ? "msr_pkg" : "msr_core", p->label());
+    w.value("cpu", p->cpu());
+    w.value("core", p->core());
+    w.value("pkg", p->pkg());
+    w.value("joule", p->joule());
+    w.value("last_power_w", p->power());
+    w.value("samples", samples);
+    // the samples are the measured milliseconds like in to_stream
+    w.value("avg_power_w", samples ? p->joule()/(samples*1e-3) : 0.0);
+    w.values("power_w", power_w, shm_seg::POWER_ENTRIES);
+    w.values("entries", p->begin(), shm_seg::POWER_ENTRIES);
+    w.end();
+}
+
+void
+msr_stats::data::to_writer(cpu_stats::writer& w)
+{
+    for (std::size_t i=0; i<_v.size(); ++i)
+        to_writer(w, _v[i]);
+}
+
+void
+msr_stats::data::
+to_writer(cpu_stats::writer& w, const cpu_stats::mark& m)
+{
+    for (std::size_t i=0; i<_v.size(); ++i) {
+        const shm_seg* p=_v[i];
+        std::string n=p->name();
+        const void* pm=m.find(n, sizeof(shm_seg));
+        if (pm==nullptr)
+            continue;
+        alignas(shm_seg) char b[sizeof(shm_seg)];
+        m.read_live(b, p, sizeof(shm_seg));
+        shm_seg* d=reinterpret_cast<shm_seg*>(b);
+        (*d) -= *static_cast<const shm_seg*>(pm);
+        to_writer(w, d);
+    }
+}
@@ -0,0 +1,84 @@
+//
+//  Copyright (C) 2020-2026  Axel Zeuner
+//
+//  This program is free software; you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation; either version 2 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program; if not, write to the Free Software
+//  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+//
+#include "msr_stats.h"
+#include <sstream>
+#include <fcntl.h>
+
+const char* const msr_stats::msr::default_path="/dev/cpu/%u/msr";
+
+std::string
+msr_stats::msr::path(const std::string& tmpl, std::uint32_t cpu)
+{
+    std::string r(tmpl);
+    std::string::size_type p=r.find("%u");
+    if (p != std::string::npos)
+        r.replace(p, 2, std::to_string(cpu));
+    return r;
+}
+
+msr_stats::msr::msr(const std::string& tmpl, std::uint32_t cpu)
+    : _path(path(tmpl, cpu)),
+      _fd(-1),
+      _regs()
+{
+    if (_path.find("%r") == std::string::npos)
+        _fd=tools::file_handle(open(_path.c_str(), O_RDONLY|O_CLOEXEC));
+}
+
+const std::string&
+msr_stats::msr::path()
+    const
+{
+    return _path;
+}
+
+bool
+msr_stats::msr::valid()
+    const
+{
+    if (_path.find("%r") == std::string::npos)
+        return _fd() >= 0;
+    return true;
+}
+
+bool
+msr_stats::msr::read(std::uint32_t reg, std::uint64_t& v)
+{
+    if (_fd() >= 0) {
+        // the msr driver uses the file offset as register number
+        ssize_t rs=pread(_fd(), &v, sizeof(v), off_t(reg));
+        return rs == ssize_t(sizeof(v));
+    }
+    std::size_t i=0;
+    while (i<_regs.size() && _regs[i].first != reg)
+        ++i;
+    if (i == _regs.size()) {
+        std::ostringstream s;
+        s << std::hex << reg;
+        std::string fn(_path);
+        fn.replace(fn.find("%r"), 2, s.str());
+        _regs.emplace_back(reg,
+                           tools::file_handle(open(fn.c_str(),
+                                                   O_RDONLY|O_CLOEXEC)));
+    }
+    const tools::file_handle& fd=_regs[i].second;
+    if (fd() < 0)
+        return false;
+    ssize_t rs=pread(fd(), &v, sizeof(v), 0);
+    return rs == ssize_t(sizeof(v));
+}
@@ -0,0 +1,136 @@
+//
+//  Copyright (C) 2020-2026  Axel Zeuner
+//
+//  This program is free software; you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation; either version 2 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program; if not, write to the Free Software
+//  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+//
+#include "msr_stats.h"
+#include "tools.h"
+#include <sstream>
+#include <iomanip>
+#include <cmath>
+
+constexpr const double msr_stats::shm_seg::power_step;
+constexpr const double msr_stats::shm_seg::inv_power_step;
+constexpr const double msr_stats::shm_seg::max_power;
+
+const char* const msr_stats::shm_seg::core_prefix="/cpu_stats_m_core_";
+const char* const msr_stats::shm_seg::pkg_prefix="/cpu_stats_m_pkg_";
+
+std::string
+msr_stats::shm_seg::name(bool is_pkg, std::uint32_t cpu_or_pkg)
+{
+    std::ostringstream s;
+    s << (is_pkg ? pkg_prefix : core_prefix)
+      << std::setw(3) << std::setfill('0') << cpu_or_pkg;
+    return s.str();
+}
+
+std::string
+msr_stats::shm_seg::name()
+    const
+{
+    return name(_is_pkg, _is_pkg ? _pkg : _cpu);
+}
+
+msr_stats::shm_seg::shm_seg(bool is_pkg, std::uint32_t cpu,
+                            std::uint32_t core, std::uint32_t pkg)
+    : _is_pkg(is_pkg),
+      _cpu(cpu),
+      _core(core),
+      _pkg(pkg),
+      _uj_lo(0), _uj_hi(0),
+      _power(0.0),
+      _entries{0}
+{
+}
+
+msr_stats::shm_seg::~shm_seg()
+{
+    std::string fn=name();
+    tools::shm::unlink(fn);
+}
+
+msr_stats::shm_seg*
+msr_stats::shm_seg::create(bool is_pkg, std::uint32_t cpu,
+                           std::uint32_t core, std::uint32_t pkg)
+{
+    std::string fn=name(is_pkg, is_pkg ? pkg : cpu);
+    void* addr=tools::shm::create(fn, sizeof(shm_seg), 0644);
+    shm_seg* ret=new (addr) shm_seg(is_pkg, cpu, core, pkg);
+    return ret;
+}
+
+void
+msr_stats::shm_seg::close(shm_seg* p)
+{
+    p->~shm_seg();
+    tools::shm::unmap(p, sizeof(shm_seg));
+}
+
+const msr_stats::shm_seg*
+msr_stats::shm_seg::open(const std::string& fn)
+{
+    void* addr=tools::shm::open_ro(fn, sizeof(shm_seg));
+    const shm_seg* ret=reinterpret_cast<const shm_seg*>(addr);
+    return ret;
+}
+
+void
+msr_stats::shm_seg::close(const shm_seg* p)
+{
+    void* ap=const_cast<shm_seg*>(p);
+    tools::shm::unmap(ap, sizeof(shm_seg));
+}
+
+std::size_t
+msr_stats::shm_seg::power_to_idx(double p_in_w)
+{
+    double p0=std::floor(p_in_w*inv_power_step);
+    auto i=static_cast<std::size_t>(std::max(p0, 0.0));
+    i=std::min(i, std::size_t(POWER_ENTRIES)-1);
+    return i;
+}
+
+double
+msr_stats::shm_seg::idx_to_power(std::size_t idx)
+{
+    return (1+idx)*power_step;
+}
+
+std::string
+msr_stats::shm_seg::label()
+    const
+{
+    std::ostringstream s;
+    if (_is_pkg) {
+        s << "msr package " << _pkg;
+    } else {
+        s << "msr core " << _core << " of package " << _pkg
+          << " (cpu " << _cpu << ')';
+    }
+    return s.str();
+}
+
+msr_stats::shm_seg&
+msr_stats::shm_seg::operator-=(const shm_seg& r)
+{
+    std::uint64_t ujl=_uj_lo - r._uj_lo;
+    std::uint64_t borrow= _uj_lo < r._uj_lo ? 1 : 0;
+    _uj_hi = _uj_hi - r._uj_hi - borrow;
+    _uj_lo = ujl;
+    for (std::size_t i=0; i<POWER_ENTRIES; ++i)
+        _entries[i] -= r._entries[i];
+    return *this;
+}
@@ -0,0 +1,115 @@
+//
+//  Copyright (C) 2020-2026  Axel Zeuner
+//
+//  This program is free software; you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation; either version 2 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program; if not, write to the Free Software
+//  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+//
+// test of the msr collector with synthetic register files: the
+// template with %r reads the energy unit and the counters from
+// regular files, the test checks the conversion into joules and an
+// interval with one wrap of the 32 bit counters. The test creates the
+// msr segments and must not run together with cpu-stats-daemon.
+#include "msr_stats.h"
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <cmath>
+#include <cstdlib>
+#include <cstdio>
+
+namespace {
+
+    std::string
+    reg_file(const std::string& dir, std::uint32_t reg)
+    {
+        std::ostringstream s;
+        s << dir << '/' << std::hex << reg;
+        return s.str();
+    }
+
+    void
+    write_reg(const std::string& dir, std::uint32_t reg, std::uint64_t v)
+    {
+        std::ofstream f(reg_file(dir, reg),
+                        std::ios::binary | std::ios::trunc);
+        f.write(reinterpret_cast<const char*>(&v), sizeof(v));
+    }
+
+    void
+    write_counters(const std::string& dir, std::uint32_t v)
+    {
+        write_reg(dir, msr_stats::MSR_CORE_ENERGY_STAT, v);
+        write_reg(dir, msr_stats::MSR_PKG_ENERGY_STAT, v);
+    }
+
+    // all segments must contain j joules
+    bool
+    check(const msr_stats::data& d, double j, const char* what)
+    {
+        bool r=true;
+        for (const auto* p : d.segments()) {
+            if (std::fabs(p->joule() - j) > 1e-9) {
+                std::cerr << what << ": " << p->joule()
+                          << " J instead of " << j << " J\n";
+                r=false;
+            }
+        }
+        return r;
+    }
+}
+
+int main()
+{
+    char tmpl[]="/tmp/msr_stats_test.XXXXXX";
+    if (mkdtemp(tmpl)==nullptr) {
+        std::cerr << "could not create a temporary directory\n";
+        return 1;
+    }
+    std::string dir(tmpl);
+    // energy status unit 2^-14 J in bits 12:8
+    write_reg(dir, msr_stats::MSR_RAPL_PWR_UNIT, 14 << 8);
+    // the counters wrap in the first interval
+    write_counters(dir, 0xfffff000);
+    int r=0;
+    try {
+        msr_stats::data d(true, dir + "/%r");
+        if (d.segments().empty()) {
+            std::cerr << "no msr segments created\n";
+            r=1;
+        } else {
+            // 0x2000 units of 2^-14 J
+            write_counters(dir, 0x00001000);
+            d.sample();
+            d.update();
+            if (!check(d, 0.5, "single wrap"))
+                r=1;
+            // 0x4000 units without wrap
+            write_counters(dir, 0x00005000);
+            d.sample();
+            d.update();
+            if (!check(d, 1.5, "no wrap"))
+                r=1;
+        }
+    }
+    catch (const std::runtime_error& e) {
+        std::cerr << e.what() << '\n';
+        r=1;
+    }
+    std::remove(reg_file(dir, msr_stats::MSR_RAPL_PWR_UNIT).c_str());
+    std::remove(reg_file(dir, msr_stats::MSR_CORE_ENERGY_STAT).c_str());
+    std::remove(reg_file(dir, msr_stats::MSR_PKG_ENERGY_STAT).c_str());
+    std::remove(dir.c_str());
+    std::cout << "msr_stats_test: " << (r ? "failed" : "passed") << '\n';
+    return r;
+}
@@ -0,0 +1,285 @@
+//
+//  Copyright (C) 2020-2026  Axel Zeuner
+//
+//  This program is free software; you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation; either version 2 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program; if not, write to the Free Software
+//  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+//
+#if !defined (__PSI_STATS_H__)
+#define __PSI_STATS_H__ 1
+
+#include <tools.h>
+#include <cstdint>
+#include <vector>
+#include <string>
+#include <iosfwd>
+
+namespace cpu_stats {
+    class mark;
+    class writer;
+}
+
+// pressure stall information of the system and of selected cgroups
+namespace psi_stats {
+
+    // the resources with pressure files
+    extern const char* const resources[3];
+
+    // path of the pressure file of resource res of the system if
+    // cgroup is empty or of cgroup, relative to /sys/fs/cgroup if
+    // not absolute, otherwise
+    std::string
+    path(const std::string& cgroup, const char* res);
+
+    // shared memory segment with the stall times of one pressure file
+    class shm_seg {
+        shm_seg(std::uint32_t id, const std::string& source,
+                const char* res);
+        ~shm_seg();
+    public:
+        // some: at least one task stalled, full: all non idle tasks
+        // stalled
+        enum kind {
+            SOME=0,
+            FULL=1,
+            KINDS=2
+        };
+        // stall percentage step of the histograms
+        static
+        constexpr const double pct_step=1.0;
+        static
+        constexpr const double inv_pct_step=1.0/pct_step;
+        enum {
+            PCT_ENTRIES=std::uint32_t(100.0/pct_step)
+        };
+    private:
+        std::uint32_t _id;
+        // system or the cgroup
+        char _source[96];
+        // cpu, memory or io
+        char _resource[8];
+        // true if the file contains a full line
+        std::uint32_t _has_full;
+        // microseconds stalled since start
+        std::uint64_t _stall_us[KINDS];
+        // CLOCK_MONOTONIC milliseconds covered by the sums
+        std::uint64_t _elapsed_ms;
+        // stall fraction of the last interval
+        double _last[KINDS];
+        // milliseconds per stall percentage range
+        std::uint64_t _entries[KINDS][PCT_ENTRIES];
+    public:
+        static
+        const char* const prefix;
+
+        static
+        std::string name(std::uint32_t id);
+
+        static
+        shm_seg*
+        create(std::uint32_t id, const std::string& source,
+               const char* res);
+
+        static
+        void
+        close(shm_seg* p);
+
+        static
+        const shm_seg*
+        open(std::uint32_t id);
+
+        static
+        void
+        close(const shm_seg* p);
+
+        // index of the stall percentage pct
+        static
+        std::size_t
+        pct_to_idx(double pct);
+
+        // upper limit of the range with index idx
+        static
+        double
+        idx_to_pct(std::size_t idx);
+
+        // subtract the sums of r, used for the differences to a mark
+        shm_seg& operator-=(const shm_seg& r);
+
+        const std::uint32_t& id() const;
+        const char* source() const;
+        const char* resource() const;
+        bool has_full() const;
+        shm_seg& has_full(bool v);
+        const std::uint64_t& stall_us(kind k) const;
+        const std::uint64_t& elapsed_ms() const;
+        const double& last(kind k) const;
+        const std::uint64_t* begin(kind k) const;
+        const std::uint64_t* end(kind k) const;
+        // add an interval of ms milliseconds with the stall times
+        // us[KINDS] and the interval length in microseconds dt_us
+        shm_seg& add(const std::uint64_t* us, std::uint64_t dt_us,
+                     std::uint64_t ms);
+    };
+
+    class data {
+        std::vector<const shm_seg*> _v;
+        struct priv_data {
+            tools::sys_fs::value_file _f;
+            // last total= values of some and full
+            std::uint64_t _total[shm_seg::KINDS];
+            // CLOCK_MONOTONIC time of the last read
+            std::uint64_t _ns;
+            // contents and time of the read of sample()
+            char _s_b[256];
+            std::uint64_t _s_ns;
+            bool _s_ok;
+        };
+        std::vector<priv_data> _vp;
+        bool _create;
+
+        // parse the total= values of the some and full lines of b
+        // into total, returns the number of lines found
+        static
+        std::uint32_t
+        parse(const char* b, std::uint64_t* total);
+        static
+        void
+        to_stream(std::ostream& s, const shm_seg* p, bool short_output);
+        void
+        close();
+        static
+        void
+        to_writer(cpu_stats::writer& w, const shm_seg* p);
+    public:
+        // the daemon creates the segments of the system pressure
+        // files and of the comma separated list of cgroups
+        data(bool create, const std::string& cgroups=std::string());
+        ~data();
+        data(const data&) = delete;
+        data&
+        operator=(const data& r) = delete;
+        const std::vector<const shm_seg*>&
+        segments() const;
+        // the names of the segments
+        std::vector<std::string>
+        names() const;
+        // read the pressure files, called before update outside of
+        // the update of the segments
+        void
+        sample();
+        // update _v from the last sample
+        void
+        update();
+        void
+        to_stream(std::ostream& s, bool short_output=false);
+        void
+        to_stream(std::ostream& s, const cpu_stats::mark& m,
+                  bool short_output=false);
+        // write the data to w
+        void
+        to_writer(cpu_stats::writer& w);
+        // write the differences to the data saved in mark m to w
+        void
+        to_writer(cpu_stats::writer& w, const cpu_stats::mark& m);
+    };
+}
+
+inline
+const std::uint32_t&
+psi_stats::shm_seg::id()
+    const
+{
+    return _id;
+}
+
+inline
+const char*
+psi_stats::shm_seg::source()
+    const
+{
+    return _source;
+}
+
+inline
+const char*
+psi_stats::shm_seg::resource()
+    const
+{
+    return _resource;
+}
+
+inline
+bool
+psi_stats::shm_seg::has_full()
+    const
+{
+    return _has_full != 0;
+}
+
+inline
+psi_stats::shm_seg&
+psi_stats::shm_seg::has_full(bool v)
+{
+    _has_full= v ? 1 : 0;
+    return *this;
+}
+
+inline
+const std::uint64_t&
+psi_stats::shm_seg::stall_us(kind k)
+    const
+{
+    return _stall_us[k];
+}
+
+inline
+const std::uint64_t&
+psi_stats::shm_seg::elapsed_ms()
+    const
+{
+    return _elapsed_ms;
+}
+
+inline
+const double&
+psi_stats::shm_seg::last(kind k)
+    const
+{
+    return _last[k];
+}
+
+inline
+const std::uint64_t*
+psi_stats::shm_seg::begin(kind k)
+    const
+{
+    return _entries[k];
+}
+
+inline
+const std::uint64_t*
+psi_stats::shm_seg::end(kind k)
+    const
+{
+    return _entries[k] + PCT_ENTRIES;
+}
+
+inline
+const std::vector<const psi_stats::shm_seg*>&
+psi_stats::data::segments()
+    const
+{
+    return _v;
+}
+
+#endif
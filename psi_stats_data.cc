@@ -0,0 +1,384 @@
+//
+//  Copyright (C) 2020-2026  Axel Zeuner
+//
+//  This program is free software; you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation; either version 2 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program; if not, write to the Free Software
+//  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+//
+#include "psi_stats.h"
+#include "cpu-stats.h"
+#include <iostream>
+#include <iomanip>
+#include <cmath>
+#include <algorithm>
+#include <numeric>
+#include <cstring>
+#include <cstdlib>
+
+const char* const psi_stats::resources[3]={
+    "cpu",
+    "memory",
+    "io"
+};
+
+std::string
+psi_stats::path(const std::string& cgroup, const char* res)
+{
+    std::string p;
+    if (cgroup.empty()) {
+        p = "/proc/pressure/";
+        p += res;
+        return p;
+    }
+    if (cgroup[0] != '/')
+        p = "/sys/fs/cgroup/";
+    p += cgroup;
+    if (p.back() != '/')
+        p += '/';
+    p += res;
+    p += ".pressure";
+    return p;
+}
+
+namespace {
+
+    const char* const kind_names[psi_stats::shm_seg::KINDS]={
+        "some",
+        "full"
+    };
+
+    void
+    histogram_to_stream(std::ostream& s, const char* kn,
+                        const std::uint64_t* vt)
+    {
+        using psi_stats::shm_seg;
+        double sum_ti=std::accumulate(vt, vt+shm_seg::PCT_ENTRIES, 0.0);
+        const std::uint32_t cols=3;
+        s << kn << ":\n";
+        for (std::uint32_t i=0; i<cols; ++i) {
+            if (i)
+                s << " | ";
+            s << "stall%       %   sum % ";
+        }
+        s << '\n';
+        std::size_t vidx[shm_seg::PCT_ENTRIES];
+        std::size_t cnt=0;
+        for (std::size_t i=shm_seg::PCT_ENTRIES; i-- > 0; ) {
+            if (vt[i] != 0)
+                vidx[cnt++]=i;
+        }
+        double vspct[shm_seg::PCT_ENTRIES];
+        double spct=0.0;
+        for (std::size_t k=0; k<cnt; ++k) {
+            spct += vt[vidx[k]]*1e2/sum_ti;
+            vspct[k]=spct;
+        }
+        std::uint32_t lines=(cnt+cols-1)/cols;
+        for (std::uint32_t j=0; j<lines; ++j) {
+            for (std::uint32_t i=0; i<cols; ++i) {
+                std::size_t k=j+lines*i;
+                if (k >= cnt)
+                    continue;
+                std::size_t idx = vidx[k];
+                if (i)
+                    s << "  | ";
+                s << std::setw(6) << std::setprecision(0)
+                  << shm_seg::idx_to_pct(idx) << ' '
+                  << std::setw(7) << std::setprecision(2)
+                  << vt[idx]*1e2/sum_ti << ' '
+                  << std::setw(7) << std::setprecision(2) << vspct[k];
+            }
+            s << '\n';
+        }
+    }
+}
+
+psi_stats::data::data(bool create, const std::string& cgroups)
+    : _v(),
+      _vp(),
+      _create(create)
+{
+    try {
+        if (_create) {
+            // the system followed by the cgroups
+            std::vector<std::string> vs(1);
+            for (std::size_t b=0; b<cgroups.size(); ) {
+                std::size_t e=cgroups.find(',', b);
+                if (e == std::string::npos)
+                    e=cgroups.size();
+                if (e > b)
+                    vs.emplace_back(cgroups.substr(b, e-b));
+                b=e+1;
+            }
+            for (const auto& cg : vs) {
+                for (const char* res : resources) {
+                    tools::sys_fs::value_file vf(path(cg, res));
+                    if (!vf.valid())
+                        continue;
+                    std::uint32_t id=_v.size();
+                    shm_seg* p=shm_seg::create(
+                        id, cg.empty() ? "system" : cg, res);
+                    _v.push_back(p);
+                    _vp.push_back(priv_data{std::move(vf), {0, 0}, 0,
+                                            {0}, 0, false});
+                }
+            }
+        } else {
+            std::string pf(shm_seg::prefix);
+            for (const auto& n : cpu_stats::segments(pf)) {
+                std::uint32_t id=std::strtoul(n.c_str()+pf.size(),
+                                              nullptr, 10);
+                try {
+                    _v.push_back(shm_seg::open(id));
+                }
+                catch (const std::runtime_error& e) {
+                    // listed in the index but not accessible, i.e. not
+                    // bound into a container
+                    continue;
+                }
+            }
+        }
+    }
+    catch (const std::runtime_error& e) {
+        close();
+        throw;
+    }
+}
+
+void
+psi_stats::data::close()
+{
+    if (_create==true) {
+        for (std::size_t i=0; i<_v.size(); ++i) {
+            shm_seg* p=const_cast<shm_seg*>(_v[i]);
+            shm_seg::close(p);
+        }
+    } else {
+        for (std::size_t i=0; i<_v.size(); ++i) {
+            shm_seg::close(_v[i]);
+        }
+    }
+    _v.clear();
+}
+
+psi_stats::data::~data()
+{
+    close();
+}
+
+std::uint32_t
+psi_stats::data::parse(const char* b, std::uint64_t* total)
+{
+    // some avg10=0.00 avg60=0.00 avg300=0.00 total=12345\n
+    // full avg10=0.00 avg60=0.00 avg300=0.00 total=0\n
+    std::uint32_t r=0;
+    for (const char* l=b; *l != 0; ) {
+        std::size_t k;
+        if (std::strncmp(l, "some ", 5)==0)
+            k=shm_seg::SOME;
+        else if (std::strncmp(l, "full ", 5)==0)
+            k=shm_seg::FULL;
+        else
+            k=shm_seg::KINDS;
+        const char* e=std::strchr(l, '\n');
+        if (e == nullptr)
+            e=l+std::strlen(l);
+        if (k != shm_seg::KINDS) {
+            const char* t=std::strstr(l, "total=");
+            if (t != nullptr && t < e) {
+                total[k]=std::strtoull(t+6, nullptr, 10);
+                ++r;
+            }
+        }
+        l= *e ? e+1 : e;
+    }
+    return r;
+}
+
+void
+psi_stats::data::sample()
+{
+    if (_create == false)
+        return;
+    for (std::size_t i=0; i<_v.size(); ++i) {
+        priv_data& pd=_vp[i];
+        pd._s_ok= pd._f.read(pd._s_b, sizeof(pd._s_b)) > 0;
+        pd._s_ns=tools::monotonic_ns();
+    }
+}
+
+void
+psi_stats::data::update()
+{
+    if (_create == false)
+        return;
+    for (std::size_t i=0; i<_v.size(); ++i) {
+        shm_seg* p=const_cast<shm_seg*>(_v[i]);
+        priv_data& pd=_vp[i];
+        if (pd._s_ok==false)
+            continue;
+        pd._s_ok=false;
+        const char* b=pd._s_b;
+        std::uint64_t ns_now=pd._s_ns;
+        std::uint64_t total[shm_seg::KINDS]={pd._total[0], pd._total[1]};
+        std::uint32_t lines=parse(b, total);
+        if (lines == 0)
+            continue;
+        std::uint64_t ns_last=pd._ns;
+        pd._ns=ns_now;
+        std::uint64_t us[shm_seg::KINDS];
+        for (std::size_t k=0; k<shm_seg::KINDS; ++k) {
+            us[k]=total[k]-pd._total[k];
+            pd._total[k]=total[k];
+        }
+        // the first read only initializes the counters
+        if (ns_last == 0) {
+            p->has_full(lines > 1);
+            continue;
+        }
+        std::uint64_t dt_ns=ns_now - ns_last;
+        if (dt_ns < 1000)
+            continue;
+        std::uint64_t ms=(dt_ns + 500000)/1000000;
+        p->add(us, dt_ns/1000, ms);
+    }
+}
+
+void
+psi_stats::data::
+to_stream(std::ostream& s, const shm_seg* p, bool short_output)
+{
+    s << std::fixed;
+    if (!short_output) {
+        const std::uint32_t cols=3;
+        for (std::uint32_t i=0; i<cols; ++i)
+            s << "========================";
+        s << '\n';
+        s << "pressure " << p->source() << ' ' << p->resource()
+          << ", time=" << std::setprecision(0) << p->elapsed_ms()*1e-3
+          << " s\n";
+        histogram_to_stream(s, kind_names[shm_seg::SOME],
+                            p->begin(shm_seg::SOME));
+        if (p->has_full())
+            histogram_to_stream(s, kind_names[shm_seg::FULL],
+                                p->begin(shm_seg::FULL));
+    }
+    s << "pressure " << p->source() << ' ' << p->resource() << ':';
+    std::size_t kinds= p->has_full() ? shm_seg::KINDS : 1;
+    for (std::size_t k=0; k<kinds; ++k) {
+        shm_seg::kind kk=static_cast<shm_seg::kind>(k);
+        double avg= p->elapsed_ms() != 0 ?
+            p->stall_us(kk)*1e-1/p->elapsed_ms() : 0.0;
+        if (k)
+            s << ',';
+        s << ' ' << kind_names[k] << " stalled: " << std::setprecision(2)
+          << avg << " %, last: " << p->last(kk)*1e2 << " %";
+    }
+    s << '\n';
+}
+
+std::vector<std::string>
+psi_stats::data::names()
+    const
+{
+    std::vector<std::string> r;
+    for (const auto* p : _v)
+        r.push_back(shm_seg::name(p->id()));
+    return r;
+}
+
+void
+psi_stats::data::to_stream(std::ostream& s, bool short_output)
+{
+    for (std::size_t i=0; i<_v.size(); ++i) {
+        to_stream(s, _v[i], short_output);
+    }
+}
+
+void
+psi_stats::data::
+to_stream(std::ostream& s, const cpu_stats::mark& m, bool short_output)
+{
+    for (std::size_t i=0; i<_v.size(); ++i) {
+        const shm_seg* p=_v[i];
+        std::string n=shm_seg::name(p->id());
+        const void* pm=m.find(n, sizeof(shm_seg));
+        if (pm==nullptr)
+            continue;
+        alignas(shm_seg) char b[sizeof(shm_seg)];
+        m.read_live(b, p, sizeof(shm_seg));
+        shm_seg* d=reinterpret_cast<shm_seg*>(b);
+        (*d) -= *static_cast<const shm_seg*>(pm);
+        // nothing happened since the mark
+        if (d->elapsed_ms()==0)
+            continue;
+        to_stream(s, d, short_output);
+    }
+}
+
+void
+psi_stats::data::to_writer(cpu_stats::writer& w, const shm_seg* p)
+{
+    double pct[shm_seg::PCT_ENTRIES];
+    for (std::size_t i=0; i<shm_seg::PCT_ENTRIES; ++i)
+        pct[i]=shm_seg::idx_to_pct(i);
+    double ms=p->elapsed_ms();
+    std::string id=p->source();
+    id += ':';
+    id += p->resource();
+    w.begin("psi", id);
+    w.value("source", p->source());
+    w.value("resource", p->resource());
+    w.value("elapsed_ms", p->elapsed_ms());
+    w.value("some_stall_us", p->stall_us(shm_seg::SOME));
+    w.value("some_pct",
+            ms > 0.0 ? p->stall_us(shm_seg::SOME)*1e-1/ms : 0.0);
+    w.value("some_last_pct", p->last(shm_seg::SOME)*1e2);
+    if (p->has_full()) {
+        w.value("full_stall_us", p->stall_us(shm_seg::FULL));
+        w.value("full_pct",
+                ms > 0.0 ? p->stall_us(shm_seg::FULL)*1e-1/ms : 0.0);
+        w.value("full_last_pct", p->last(shm_seg::FULL)*1e2);
+    }
+    w.values("pct", pct, shm_seg::PCT_ENTRIES);
+    w.values("some_entries", p->begin(shm_seg::SOME), shm_seg::PCT_ENTRIES);
+    if (p->has_full())
+        w.values("full_entries", p->begin(shm_seg::FULL),
+                 shm_seg::PCT_ENTRIES);
+    w.end();
+}
+
+void
+psi_stats::data::to_writer(cpu_stats::writer& w)
+{
+    for (std::size_t i=0; i<_v.size(); ++i)
+        to_writer(w, _v[i]);
+}
+
+void
+psi_stats::data::
+to_writer(cpu_stats::writer& w, const cpu_stats::mark& m)
+{
+    for (std::size_t i=0; i<_v.size(); ++i) {
+        const shm_seg* p=_v[i];
+        std::string n=shm_seg::name(p->id());
+        const void* pm=m.find(n, sizeof(shm_seg));
+        if (pm==nullptr)
+            continue;
+        alignas(shm_seg) char b[sizeof(shm_seg)];
+        m.read_live(b, p, sizeof(shm_seg));
+        shm_seg* d=reinterpret_cast<shm_seg*>(b);
+        (*d) -= *static_cast<const shm_seg*>(pm);
+        to_writer(w, d);
+    }
+}
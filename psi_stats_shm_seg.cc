@@ -0,0 +1,133 @@
+//
+//  Copyright (C) 2020-2026  Axel Zeuner
+//
+//  This program is free software; you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation; either version 2 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program; if not, write to the Free Software
+//  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+//
+#include "psi_stats.h"
+#include "tools.h"
+#include <sstream>
+#include <iomanip>
+#include <cmath>
+#include <cstring>
+#include <algorithm>
+
+constexpr const double psi_stats::shm_seg::pct_step;
+constexpr const double psi_stats::shm_seg::inv_pct_step;
+
+const char* const psi_stats::shm_seg::prefix="/cpu_stats_s_psi_";
+
+std::string
+psi_stats::shm_seg::name(std::uint32_t id)
+{
+    std::ostringstream s;
+    s << prefix << std::setw(3) << std::setfill('0') << id;
+    return s.str();
+}
+
+psi_stats::shm_seg::shm_seg(std::uint32_t id, const std::string& source,
+                            const char* res)
+    : _id(id),
+      _source{0},
+      _resource{0},
+      _has_full(0),
+      _stall_us{0},
+      _elapsed_ms(0),
+      _last{0.0},
+      _entries{{0}}
+{
+    std::strncpy(_source, source.c_str(), sizeof(_source)-1);
+    std::strncpy(_resource, res, sizeof(_resource)-1);
+}
+
+psi_stats::shm_seg::~shm_seg()
+{
+    std::string fn=name(_id);
+    tools::shm::unlink(fn);
+}
+
+psi_stats::shm_seg*
+psi_stats::shm_seg::create(std::uint32_t id, const std::string& source,
+                           const char* res)
+{
+    std::string fn=name(id);
+    void* addr=tools::shm::create(fn, sizeof(shm_seg), 0644);
+    shm_seg* ret=new (addr) shm_seg(id, source, res);
+    return ret;
+}
+
+void
+psi_stats::shm_seg::close(shm_seg* p)
+{
+    p->~shm_seg();
+    tools::shm::unmap(p, sizeof(shm_seg));
+}
+
+const psi_stats::shm_seg*
+psi_stats::shm_seg::open(std::uint32_t id)
+{
+    std::string fn=name(id);
+    void* addr=tools::shm::open_ro(fn, sizeof(shm_seg));
+    const shm_seg* ret=reinterpret_cast<const shm_seg*>(addr);
+    return ret;
+}
+
+void
+psi_stats::shm_seg::close(const shm_seg* p)
+{
+    void* ap=const_cast<shm_seg*>(p);
+    tools::shm::unmap(ap, sizeof(shm_seg));
+}
+
+std::size_t
+psi_stats::shm_seg::pct_to_idx(double pct)
+{
+    double p0=std::floor(pct*inv_pct_step);
+    auto i=static_cast<std::size_t>(std::max(p0, 0.0));
+    i=std::min(i, std::size_t(PCT_ENTRIES)-1);
+    return i;
+}
+
+double
+psi_stats::shm_seg::idx_to_pct(std::size_t idx)
+{
+    return (1+idx)*pct_step;
+}
+
+psi_stats::shm_seg&
+psi_stats::shm_seg::operator-=(const shm_seg& r)
+{
+    for (std::size_t k=0; k<KINDS; ++k) {
+        _stall_us[k] -= r._stall_us[k];
+        for (std::size_t i=0; i<PCT_ENTRIES; ++i)
+            _entries[k][i] -= r._entries[k][i];
+    }
+    _elapsed_ms -= r._elapsed_ms;
+    return *this;
+}
+
+psi_stats::shm_seg&
+psi_stats::shm_seg::add(const std::uint64_t* us, std::uint64_t dt_us,
+                        std::uint64_t ms)
+{
+    for (std::size_t k=0; k<KINDS; ++k) {
+        _stall_us[k] += us[k];
+        // the stall time may exceed the measured interval slightly
+        double f=std::min(double(us[k])/dt_us, 1.0);
+        _last[k]=f;
+        _entries[k][pct_to_idx(f*1e2)] += ms;
+    }
+    _elapsed_ms += ms;
+    return *this;
+}
@@ -21,35 +21,82 @@
 #include <tools.h>
 #include <cstdint>
 #include <vector>
+#include <string>
+#include <iosfwd>
+
+namespace cpu_stats {
+    class mark;
+    class writer;
+    class selection;
+}
 
 namespace rapl_stats {
 
+    // zones of the powercap tree: the top level zones of the
+    // control types intel-rapl and intel-rapl-mmio are packages
+    // (name package-X) or the platform (psys), their subzones are
+    // core, uncore and dram. no numbers the top level zones in the
+    // order of the walk, sub is the index of a subzone
     struct pkg {
+        // sub of the top level zones, package id of zones outside
+        // of a package
+        static
+        constexpr const std::uint32_t top=~std::uint32_t(0);
+
+        // a zone found in the powercap tree
+        struct zone {
+            std::uint32_t _no;
+            std::uint32_t _sub;
+            // directory of the zone with a trailing /
+            std::string _path;
+            // control type of the zone
+            std::string _type;
+        };
+
+        // all zones, the top level zones followed by their subzones
+        static
+        const std::vector<zone>&
+        zones();
+
+        // throws std::runtime_error for unknown zones
         static
-        std::string path(std::uint32_t no);
+        std::string path(std::uint32_t no, std::uint32_t sub=top);
 
         static
         bool
-        exists(std::uint32_t no);
+        exists(std::uint32_t no, std::uint32_t sub=top);
+
+        static
+        std::string
+        name(std::uint32_t no, std::uint32_t sub=top);
 
         static
         std::uint32_t
-        enabled(std::uint32_t no);
+        enabled(std::uint32_t no, std::uint32_t sub=top);
 
         static
         std::uint64_t
-        energy_uj(std::uint32_t no);
+        energy_uj(std::uint32_t no, std::uint32_t sub=top);
 
         static
         std::uint64_t
-        max_energy_range_uj(std::uint32_t no);
+        max_energy_range_uj(std::uint32_t no, std::uint32_t sub=top);
+
+        // physical package id from the name package-X of the top
+        // level zone no, top if the zone is no package
+        static
+        std::uint32_t
+        package_id(std::uint32_t no);
+
+        // true for the zones of intel-rapl-mmio
+        static
+        bool
+        mmio(std::uint32_t no);
     };
 
     class shm_seg {
-        shm_seg(std::uint32_t pkg);
+        shm_seg(std::uint32_t pkg, std::uint32_t sub);
         ~shm_seg();
-        static
-        std::string name(std::uint32_t pkg);
     public:
         // powerstep of 2.5 W's
         static
@@ -63,19 +110,34 @@ namespace rapl_stats {
             POWER_ENTRIES=uint32_t(max_power/power_step)+1
         };
     private:
-        // package number
+        // zone number
         std::uint32_t _pkg;
+        // subzone number or pkg::top
+        std::uint32_t _sub;
+        // physical package id or pkg::top
+        std::uint32_t _pkg_id;
+        // zone of intel-rapl-mmio
+        bool _mmio;
+        // name of the zone
+        char _name[16];
         // micro joules since start
         std::uint64_t _uj_lo;
         std::uint64_t _uj_hi;
         // mean power over the last interval
         double _power;
-        // array with ticks/power_range
-        std::uint32_t _entries[POWER_ENTRIES];
+        // array with milliseconds/power_range measured with
+        // CLOCK_MONOTONIC
+        std::uint64_t _entries[POWER_ENTRIES];
     public:
+        static
+        const char* const prefix;
+
+        static
+        std::string name(std::uint32_t pkg, std::uint32_t sub=pkg::top);
+
         static
         shm_seg*
-        create(std::uint32_t pkg);
+        create(std::uint32_t pkg, std::uint32_t sub=pkg::top);
 
         static
         void
@@ -83,7 +145,7 @@ namespace rapl_stats {
 
         static
         const shm_seg*
-        open(std::uint32_t pkg);
+        open(std::uint32_t pkg, std::uint32_t sub=pkg::top);
 
         static
         void
@@ -97,17 +159,34 @@ namespace rapl_stats {
         double
         idx_to_power(std::size_t p);
 
+        // subtract the entries and the energy of r, used for the
+        // differences to a mark
+        shm_seg& operator-=(const shm_seg& r);
+
         const std::uint32_t& pkg() const;
+        const std::uint32_t& sub() const;
+        // physical package id of the zone, pkg::top for zones outside
+        // of a package like psys
+        const std::uint32_t& package_id() const;
+        const bool& mmio() const;
+        const char* zone_name() const;
+        // true for the top level zone of a package of intel-rapl,
+        // the zones of intel-rapl-mmio duplicate them
+        bool is_package() const;
+        // description of the zone for the output
+        std::string label() const;
         const std::uint64_t& uj_lo() const;
         shm_seg& uj_lo(const std::uint64_t& uj);
         const std::uint64_t& uj_hi() const;
         shm_seg& uj_hi(const std::uint64_t& uj);
+        // energy in joule from uj_lo and uj_hi
+        double joule() const;
         shm_seg& power(const double& pwr);
         const double& power() const;
-        std::uint32_t* begin();
-        std::uint32_t* end();
-        const std::uint32_t* begin() const;
-        const std::uint32_t* end() const;
+        std::uint64_t* begin();
+        std::uint64_t* end();
+        const std::uint64_t* begin() const;
+        const std::uint64_t* end() const;
     };
 
     struct data {
@@ -115,25 +194,65 @@ namespace rapl_stats {
         struct priv_data {
             std::uint64_t _energy_uj;
             std::uint64_t _max_energy_range_uj;
+            // CLOCK_MONOTONIC time of the read of _energy_uj
+            std::uint64_t _ns;
+            // counter and time of the read of sample()
+            std::uint64_t _s_uj;
+            std::uint64_t _s_ns;
         };
         std::vector<priv_data> _vp;
         bool _create;
+        // highest plausible power of a zone in W, the counters wrap
+        // at most once within range/max_zone_power
+        static
+        constexpr const double max_zone_power=1000;
 
+        // create or open the segment of zone no, sub
+        void
+        add(std::uint32_t no, std::uint32_t sub);
+        // pkg_j is the energy of the package of a subzone
         static
         void
-        to_stream(std::ostream& s, const shm_seg* p, bool short_output);
+        to_stream(std::ostream& s, const shm_seg* p, bool short_output,
+                  double pkg_j);
+        static
+        void
+        to_writer(cpu_stats::writer& w, const shm_seg* p);
     public:
-        data(bool create);
+        // the client opens the zones of the packages in sel or of
+        // all packages if sel is nullptr
+        data(bool create, const cpu_stats::selection* sel=nullptr);
         ~data();
         data(const data&) = delete;
         data&
         operator=(const data& r) = delete;
-        // update _v
+        // the segments
+        const std::vector<const shm_seg*>&
+        segments() const;
+        // the names of the segments
+        std::vector<std::string>
+        names() const;
+        // read the energy counters, called before update outside
+        // of the update of the segments
         void
-        update(std::uint32_t tmo_sec, std::uint32_t weight);
+        sample();
+        // update _v from the last sample, the power is computed from
+        // the measured interval, tmo_sec is the nominal interval
+        void
+        update(std::uint32_t tmo_sec);
         // dump the data
         void
         to_stream(std::ostream& s, bool short_output=false);
+        // dump the differences to the data saved in mark m
+        void
+        to_stream(std::ostream& s, const cpu_stats::mark& m,
+                  bool short_output=false);
+        // write the data to w
+        void
+        to_writer(cpu_stats::writer& w);
+        // write the differences to the data saved in mark m to w
+        void
+        to_writer(cpu_stats::writer& w, const cpu_stats::mark& m);
     };
 }
 
@@ -145,6 +264,38 @@ rapl_stats::shm_seg::pkg()
     return _pkg;
 }
 
+inline
+const std::uint32_t&
+rapl_stats::shm_seg::sub()
+    const
+{
+    return _sub;
+}
+
+inline
+const std::uint32_t&
+rapl_stats::shm_seg::package_id()
+    const
+{
+    return _pkg_id;
+}
+
+inline
+const bool&
+rapl_stats::shm_seg::mmio()
+    const
+{
+    return _mmio;
+}
+
+inline
+const char*
+rapl_stats::shm_seg::zone_name()
+    const
+{
+    return _name;
+}
+
 inline
 const std::uint64_t&
 rapl_stats::shm_seg::uj_lo()
@@ -177,6 +328,14 @@ rapl_stats::shm_seg::uj_hi(const std::uint64_t& v)
     return *this;
 }
 
+inline
+double
+rapl_stats::shm_seg::joule()
+    const
+{
+    return (double(_uj_lo) + double(_uj_hi)*0x1p64)*1e-6;
+}
+
 inline
 rapl_stats::shm_seg&
 rapl_stats::shm_seg::power(const double& v)
@@ -194,21 +353,21 @@ rapl_stats::shm_seg::power()
 }
 
 inline
-std::uint32_t*
+std::uint64_t*
 rapl_stats::shm_seg::begin()
 {
     return _entries;
 }
 
 inline
-std::uint32_t*
+std::uint64_t*
 rapl_stats::shm_seg::end()
 {
     return _entries+POWER_ENTRIES;
 }
 
 inline
-const std::uint32_t*
+const std::uint64_t*
 rapl_stats::shm_seg::begin()
     const
 {
@@ -216,12 +375,19 @@ rapl_stats::shm_seg::begin()
 }
 
 inline
-const std::uint32_t*
+const std::uint64_t*
 rapl_stats::shm_seg::end()
     const
 {
     return _entries+POWER_ENTRIES;
 }
 
+inline
+const std::vector<const rapl_stats::shm_seg*>&
+rapl_stats::data::segments()
+    const
+{
+    return _v;
+}
 
 #endif
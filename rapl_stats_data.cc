@@ -16,34 +16,56 @@
 //  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
 //
 #include "rapl_stats.h"
+#include "cpu-stats.h"
 #include <iostream>
 #include <iomanip>
 #include <cmath>
 #include <algorithm>
 #include <numeric>
+#include <cstring>
+#include <cstdlib>
 #include <syslog.h>
 
-rapl_stats::data::data(bool create)
+constexpr const double rapl_stats::data::max_zone_power;
+
+rapl_stats::data::data(bool create, const cpu_stats::selection* sel)
     : _v(),
       _vp(),
       _create(create)
 {
     try {
         if (_create) {
-            for (size_t i=0; pkg::exists(i); ++i) {
-                shm_seg* p=shm_seg::create(i);
-                _v.push_back(p);
-                std::uint64_t e=pkg::energy_uj(i);
-                std::uint64_t me=pkg::max_energy_range_uj(i);
-                syslog(LOG_INFO,
-                       "rapl_stats: max_energy_range_uj: %lu ", me);
-                priv_data pd{e, me};
-                _vp.push_back(pd);
+            // the zones of the packages are followed by their subzones
+            for (const auto& z : pkg::zones()) {
+                add(z._no, z._sub);
             }
         } else {
-            for (size_t i=0; pkg::exists(i); ++i) {
-                const shm_seg* p=shm_seg::open(i);
-                _v.push_back(p);
+            // the sorted names of the index keep this order
+            std::string pf(shm_seg::prefix);
+            for (const auto& n : cpu_stats::segments(pf)) {
+                char* e;
+                std::uint32_t i=std::strtoul(n.c_str()+pf.size(), &e, 10);
+                std::uint32_t j= *e=='_' ?
+                    std::strtoul(e+1, nullptr, 10) : pkg::top;
+                try {
+                    add(i, j);
+                }
+                catch (const std::runtime_error&) {
+                    // listed in the index but not accessible, i.e. not
+                    // bound into a container
+                    continue;
+                }
+                if (sel == nullptr)
+                    continue;
+                // i numbers the zones, the package id is stored in
+                // the segment, zones outside of a package like psys
+                // are shown only if all packages are selected
+                const shm_seg* p=_v.back();
+                std::uint32_t id=p->package_id();
+                if (id == pkg::top ? sel->pkgs_restricted() : !sel->pkg(id)) {
+                    shm_seg::close(p);
+                    _v.pop_back();
+                }
             }
         }
     }
@@ -58,6 +80,27 @@ rapl_stats::data::data(bool create)
     }
 }
 
+void
+rapl_stats::data::add(std::uint32_t no, std::uint32_t sub)
+{
+    if (_create) {
+        shm_seg* p=shm_seg::create(no, sub);
+        _v.push_back(p);
+        std::uint64_t me=pkg::max_energy_range_uj(no, sub);
+        std::uint64_t ns=tools::monotonic_ns();
+        std::uint64_t e=pkg::energy_uj(no, sub);
+        ns=(ns + tools::monotonic_ns())/2;
+        syslog(LOG_INFO,
+               "rapl_stats: %s max_energy_range_uj: %lu ",
+               p->label().c_str(), me);
+        priv_data pd{e, me, ns, e, ns};
+        _vp.push_back(pd);
+    } else {
+        const shm_seg* p=shm_seg::open(no, sub);
+        _v.push_back(p);
+    }
+}
+
 rapl_stats::data::~data()
 {
     if (_create==true) {
@@ -72,30 +115,57 @@ rapl_stats::data::~data()
     }
 }
 
+void
+rapl_stats::data::sample()
+{
+    if (_create == false)
+        return;
+    for (std::size_t i=0; i<_v.size(); ++i) {
+        const shm_seg* p=_v[i];
+        priv_data& pd=_vp[i];
+        // the time stamp of a read is the middle of the read
+        std::uint64_t ns_0=tools::monotonic_ns();
+        pd._s_uj=pkg::energy_uj(p->pkg(), p->sub());
+        std::uint64_t ns_1=tools::monotonic_ns();
+        pd._s_ns=(ns_0 + ns_1)/2;
+    }
+}
+
 void
 rapl_stats::data::
-update(std::uint32_t tmo_sec, std::uint32_t weight)
+update(std::uint32_t tmo_sec)
 {
     if (_create == false)
         return;
     for (std::size_t i=0; i<_v.size(); ++i) {
         shm_seg* p=const_cast<shm_seg*>(_v[i]);
-        std::uint64_t e_now=pkg::energy_uj(p->pkg());
-        // std::cout << "e_now: " << e_now;
-        std::uint64_t e_last=_vp[i]._energy_uj;
-        _vp[i]._energy_uj=e_now;
-        // std::cout << " e_last: " << e_last;
-        std::uint64_t e_1 = e_now, e_0 = e_last;
+        priv_data& pd=_vp[i];
+        std::uint64_t e_now=pd._s_uj;
+        std::uint64_t ns_now=pd._s_ns;
+        std::uint64_t e_last=pd._energy_uj;
+        std::uint64_t ns_last=pd._ns;
+        pd._energy_uj=e_now;
+        pd._ns=ns_now;
+        std::uint64_t dt_ns=ns_now - ns_last;
+        if (dt_ns == 0)
+            continue;
+        double dt_s=dt_ns*1e-9;
+        std::uint64_t range=pd._max_energy_range_uj;
+        // the number of wraps of the counter is unknown if the
+        // interval is longer than the time to wrap it at the highest
+        // plausible power, the interval is not counted then
+        double min_wrap_s=range*1e-6/max_zone_power;
+        if (range != 0 && dt_s >= min_wrap_s) {
+            syslog(LOG_WARNING,
+                   "rapl_stats: %s: interval of %.3f s exceeds the "
+                   "minimum wrap time of %.3f s, dropped",
+                   p->label().c_str(), dt_s, min_wrap_s);
+            continue;
+        }
+        std::uint64_t delta_uj=e_now - e_last;
         if (e_now < e_last) {
-            e_1 = (_vp[i]._max_energy_range_uj - e_last) + e_now;
-            e_0 = 0;
-            syslog(LOG_INFO,
-                   "rapl_stats: correction of counter overflow "
-                   "now: %lu last: %lu with timeout %u "
-                   "e_1: %lu e_0: %lu",
-                   e_now, e_last, tmo_sec, e_1, e_0);
+            delta_uj = (range - e_last) + e_now;
         }
-        std::uint64_t delta_uj=e_1 - e_0;
         std::uint64_t cur_uj=p->uj_lo();
         std::uint64_t uj=cur_uj + delta_uj;
         p->uj_lo(uj);
@@ -104,36 +174,27 @@ update(std::uint32_t tmo_sec, std::uint32_t weight)
             p->uj_hi(ujh+1);
         }
         // conversion factor between ujoule and joule and
-        // division by time to obtain power in watt
-        double factor= 1.0e-6/double(tmo_sec);
-        double p_in_w = delta_uj*factor;
-        // std::cout << " p in w: " << p_in_w;
+        // division by the measured time to obtain power in watt
+        double p_in_w = delta_uj*1.0e-6/dt_s;
         size_t idx=shm_seg::power_to_idx(p_in_w);
-        if ((idx>=shm_seg::POWER_ENTRIES-1) ||
-            (p_in_w > shm_seg::max_power)) {
-            syslog(LOG_INFO,
-                   "rapl_stats: reading from rapl: "
-                   "now: %lu last: %lu with timeout %u and p: %f",
-                   e_now, e_last, tmo_sec, p_in_w);
+        if (p_in_w > shm_seg::max_power) {
             syslog(LOG_INFO,
-                   "rapl_stats: reading from rapl: "
-                   "e_0: %lu e_1: %lu max: %lu",
-                   e_0, e_1, _vp[i]._max_energy_range_uj);
+                   "rapl_stats: %s: %f W over %.3f s, timeout %u s",
+                   p->label().c_str(), p_in_w, dt_s, tmo_sec);
         }
-        // std::cout << " idx: " << idx << std::endl;
-        std::uint32_t* pi=p->begin() + idx;
-        (*pi)+=weight;
+        // the measured interval in milliseconds is the weight
+        std::uint64_t* pi=p->begin() + idx;
+        (*pi)+=(dt_ns + 500000)/1000000;
         p->power(p_in_w);
     }
 }
 
 void
 rapl_stats::data::
-to_stream(std::ostream& s, const shm_seg* p, bool short_output)
+to_stream(std::ostream& s, const shm_seg* p, bool short_output,
+          double pkg_j)
 {
-    std::uint32_t vt[shm_seg::POWER_ENTRIES];
-    std::uint32_t pkg= p->pkg();
-    std::uint64_t ujl= p->uj_lo(), ujh=p->uj_hi();
+    std::uint64_t vt[shm_seg::POWER_ENTRIES];
     std::copy(p->begin(), p->end(), std::begin(vt));
 
     // determine entries != 0
@@ -141,11 +202,11 @@ to_stream(std::ostream& s, const shm_seg* p, bool short_output)
     std::size_t vidx[shm_seg::POWER_ENTRIES];
     double vpct[shm_seg::POWER_ENTRIES];
     std::size_t idx_max=0;
-    std::uint32_t max_ti=0;
+    std::uint64_t max_ti=0;
     double sum_ti=0.0;
     double p_in_w=p->power();
     for (std::size_t i=0; i<shm_seg::POWER_ENTRIES; ++i) {
-        std::uint32_t ti=vt[i];
+        std::uint64_t ti=vt[i];
         if (vt[i]==0)
             continue;
         vidx[cnt]=i;
@@ -180,9 +241,8 @@ to_stream(std::ostream& s, const shm_seg* p, bool short_output)
         s << "========================";
     s << '\n';
     s << std::fixed << std::setprecision(0);
-    s << "rapl package " << pkg
-      << ", samples=" << std::scientific << std::setprecision(22) << sum_ti
-      << std::fixed << '\n';
+    s << p->label()
+      << ", time=" << std::setprecision(0) << sum_ti*1e-3 << " s\n";
     for (std::uint32_t i=0; i<cols; ++i) {
         if (i)
             s << " | ";
@@ -190,7 +250,7 @@ to_stream(std::ostream& s, const shm_seg* p, bool short_output)
     }
     s << '\n';
     std::uint32_t lines=(cnt+cols-1)/cols;
-    double sum=0.0, avg=0.0;
+    double sum=0.0;
     for (std::uint32_t j=0; j<lines; ++j) {
         for (std::uint32_t i=0; i<cols; ++i) {
             std::size_t k=j+lines*i;
@@ -206,31 +266,121 @@ to_stream(std::ostream& s, const shm_seg* p, bool short_output)
               << std::setw(7) << std::setprecision(2) << pcti << ' '
               << std::setw(7) << std::setprecision(2) << spcti;
             sum += pcti;
-            avg += pi*pcti;
         }
         s << '\n';
     }
-    avg = avg*1.0e-2 - (shm_seg::power_step*.5);
-    double ws=(double(ujl) + double(ujh)*0x1p64)*1e-6;
+    // the measured energy over the measured time in milliseconds
+    double ws=p->joule();
+    double avg= sum_ti > 0.0 ? ws/(sum_ti*1e-3) : 0.0;
     double kwh=ws/(1000*3600);
     ws = rint(ws);
     kwh= rint(kwh*1e3)*1e-3;
-    s << "average power: ~" << avg << " W, power over last interval: "
+    s << "average power: " << avg << " W, power over last interval: "
       << p_in_w << " W\n"
       << "used energy:   ~"
       << std::scientific << std::setprecision(15) << ws << " Ws, ~"
       << std::setprecision(15) << kwh << " kWh"
       << '\n';
+    if (p->sub() != pkg::top && pkg_j > 0.0) {
+        s << "energy relative to the package: ~" << std::fixed
+          << std::setprecision(1) << (p->joule()*1e2)/pkg_j << " %\n";
+    }
 
     if (std::fabs(sum-100) > 0.005) {
         s << "invalid sum " << sum << std::endl;
     }
 }
 
+std::vector<std::string>
+rapl_stats::data::names()
+    const
+{
+    std::vector<std::string> r;
+    for (const auto* p : _v)
+        r.push_back(shm_seg::name(p->pkg(), p->sub()));
+    return r;
+}
+
 void
 rapl_stats::data::to_stream(std::ostream& s, bool short_output)
 {
+    double pkg_j=0.0;
     for (std::size_t i=0; i<_v.size(); ++i) {
-        to_stream(s, _v[i], short_output);
+        const shm_seg* p=_v[i];
+        if (p->sub()==pkg::top)
+            pkg_j=p->joule();
+        to_stream(s, p, short_output, pkg_j);
+    }
+}
+
+void
+rapl_stats::data::
+to_stream(std::ostream& s, const cpu_stats::mark& m, bool short_output)
+{
+    double pkg_j=0.0;
+    for (std::size_t i=0; i<_v.size(); ++i) {
+        const shm_seg* p=_v[i];
+        std::string n=shm_seg::name(p->pkg(), p->sub());
+        const void* pm=m.find(n, sizeof(shm_seg));
+        if (pm==nullptr)
+            continue;
+        alignas(shm_seg) char b[sizeof(shm_seg)];
+        m.read_live(b, p, sizeof(shm_seg));
+        shm_seg* d=reinterpret_cast<shm_seg*>(b);
+        (*d) -= *static_cast<const shm_seg*>(pm);
+        if (d->sub()==pkg::top)
+            pkg_j=d->joule();
+        // nothing happened since the mark
+        if (std::all_of(d->begin(), d->end(),
+                        [](std::uint64_t v) { return v==0; }))
+            continue;
+        to_stream(s, d, short_output, pkg_j);
+    }
+}
+
+void
+rapl_stats::data::to_writer(cpu_stats::writer& w, const shm_seg* p)
+{
+    double power_w[shm_seg::POWER_ENTRIES];
+    std::uint64_t samples=0;
+    for (std::size_t i=0; i<shm_seg::POWER_ENTRIES; ++i) {
+        power_w[i]=shm_seg::idx_to_power(i);
+        samples += p->begin()[i];
+    }
+    w.begin("rapl", p->label());
+    w.value("pkg", p->pkg());
+    w.value("zone", p->zone_name());
+    w.value("joule", p->joule());
+    w.value("last_power_w", p->power());
+    w.value("samples", samples);
+    // the samples are the measured milliseconds
+    w.value("avg_power_w", samples ? p->joule()/(samples*1e-3) : 0.0);
+    w.values("power_w", power_w, shm_seg::POWER_ENTRIES);
+    w.values("entries", p->begin(), shm_seg::POWER_ENTRIES);
+    w.end();
+}
+
+void
+rapl_stats::data::to_writer(cpu_stats::writer& w)
+{
+    for (std::size_t i=0; i<_v.size(); ++i)
+        to_writer(w, _v[i]);
+}
+
+void
+rapl_stats::data::
+to_writer(cpu_stats::writer& w, const cpu_stats::mark& m)
+{
+    for (std::size_t i=0; i<_v.size(); ++i) {
+        const shm_seg* p=_v[i];
+        std::string n=shm_seg::name(p->pkg(), p->sub());
+        const void* pm=m.find(n, sizeof(shm_seg));
+        if (pm==nullptr)
+            continue;
+        alignas(shm_seg) char b[sizeof(shm_seg)];
+        m.read_live(b, p, sizeof(shm_seg));
+        shm_seg* d=reinterpret_cast<shm_seg*>(b);
+        (*d) -= *static_cast<const shm_seg*>(pm);
+        to_writer(w, d);
     }
 }
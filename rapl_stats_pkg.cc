@@ -17,40 +17,152 @@
 //
 #include "rapl_stats.h"
 #include <sstream>
+#include <stdexcept>
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <dirent.h>
+
+constexpr const std::uint32_t rapl_stats::pkg::top;
+
+namespace {
+
+    // the entries of directory d starting with pfx followed by a
+    // number, sorted by the number
+    std::vector<std::pair<std::uint32_t, std::string> >
+    numbered_entries(const std::string& d, const std::string& pfx)
+    {
+        std::vector<std::pair<std::uint32_t, std::string> > r;
+        DIR* dp=opendir(d.c_str());
+        if (dp==nullptr)
+            return r;
+        while (const struct dirent* e=readdir(dp)) {
+            if (std::strncmp(e->d_name, pfx.c_str(), pfx.size())!=0)
+                continue;
+            const char* b=e->d_name+pfx.size();
+            char* ep;
+            unsigned long n=std::strtoul(b, &ep, 10);
+            if (ep==b || *ep != 0)
+                continue;
+            r.emplace_back(n, e->d_name);
+        }
+        closedir(dp);
+        std::sort(r.begin(), r.end());
+        return r;
+    }
+
+    std::vector<rapl_stats::pkg::zone>
+    walk()
+    {
+        const std::string base="/sys/devices/virtual/powercap/";
+        const char* const types[]={"intel-rapl", "intel-rapl-mmio"};
+        std::vector<rapl_stats::pkg::zone> r;
+        std::uint32_t no=0;
+        for (const char* t : types) {
+            std::string tp=base + t + '/';
+            std::string pfx=std::string(t) + ':';
+            for (const auto& z : numbered_entries(tp, pfx)) {
+                std::string zp=tp + z.second + '/';
+                r.push_back(rapl_stats::pkg::zone{
+                        no, rapl_stats::pkg::top, zp, t});
+                for (const auto& s : numbered_entries(zp, z.second + ':')) {
+                    r.push_back(rapl_stats::pkg::zone{
+                            no, s.first, zp + s.second + '/', t});
+                }
+                ++no;
+            }
+        }
+        return r;
+    }
+
+    const rapl_stats::pkg::zone*
+    find(std::uint32_t no, std::uint32_t sub)
+    {
+        for (const auto& z : rapl_stats::pkg::zones()) {
+            if (z._no==no && z._sub==sub)
+                return &z;
+        }
+        return nullptr;
+    }
+}
+
+const std::vector<rapl_stats::pkg::zone>&
+rapl_stats::pkg::zones()
+{
+    static const std::vector<zone> z=walk();
+    return z;
+}
 
 std::string
-rapl_stats::pkg::path(std::uint32_t no)
+rapl_stats::pkg::path(std::uint32_t no, std::uint32_t sub)
 {
-    std::ostringstream s;
-    s << "/sys/devices/virtual/powercap/intel-rapl/intel-rapl:" << no << '/';
-    return s.str();
+    const zone* z=find(no, sub);
+    if (z==nullptr) {
+        std::ostringstream s;
+        s << "rapl_stats::pkg::path: unknown zone " << no;
+        if (sub != top)
+            s << ':' << sub;
+        throw std::runtime_error(s.str());
+    }
+    return z->_path;
 }
 
 bool
-rapl_stats::pkg::exists(std::uint32_t no)
+rapl_stats::pkg::exists(std::uint32_t no, std::uint32_t sub)
+{
+    return find(no, sub) != nullptr;
+}
+
+std::string
+rapl_stats::pkg::name(std::uint32_t no, std::uint32_t sub)
 {
-    std::string p=path(no);
-    return tools::file::exists(p);
+    std::string p=path(no, sub) + "name";
+    std::string n=tools::sys_fs::read<std::string>::from(p);
+    std::string::size_type e=n.find_first_of("\n");
+    if (e != std::string::npos)
+        n.resize(e);
+    return n;
 }
 
 std::uint32_t
-rapl_stats::pkg::enabled(std::uint32_t no)
+rapl_stats::pkg::enabled(std::uint32_t no, std::uint32_t sub)
 {
-    std::string p=path(no) + "enabled";
+    std::string p=path(no, sub) + "enabled";
     return tools::sys_fs::read<std::int32_t>::from(p);
 }
 
 std::uint64_t
-rapl_stats::pkg::energy_uj(std::uint32_t no)
+rapl_stats::pkg::energy_uj(std::uint32_t no, std::uint32_t sub)
 {
-    std::string p=path(no) + "energy_uj";
+    std::string p=path(no, sub) + "energy_uj";
     return tools::sys_fs::read<std::uint64_t>::from(p);
 }
 
 std::uint64_t
-rapl_stats::pkg::max_energy_range_uj(std::uint32_t no)
+rapl_stats::pkg::max_energy_range_uj(std::uint32_t no, std::uint32_t sub)
 {
-    std::string p=path(no) + "max_energy_range_uj";
+    std::string p=path(no, sub) + "max_energy_range_uj";
     return tools::sys_fs::read<std::uint64_t>::from(p);
 }
 
+std::uint32_t
+rapl_stats::pkg::package_id(std::uint32_t no)
+{
+    std::string n=name(no);
+    const std::string pfx="package-";
+    if (n.compare(0, pfx.length(), pfx)!=0)
+        return top;
+    const char* b=n.c_str()+pfx.length();
+    char* e;
+    unsigned long r=std::strtoul(b, &e, 10);
+    if (e==b)
+        return top;
+    return r;
+}
+
+bool
+rapl_stats::pkg::mmio(std::uint32_t no)
+{
+    const zone* z=find(no, top);
+    return z != nullptr && z->_type=="intel-rapl-mmio";
+}
@@ -20,38 +20,49 @@
 #include <sstream>
 #include <iomanip>
 #include <cmath>
+#include <cstring>
 
 constexpr const double rapl_stats::shm_seg::power_step;
 constexpr const double rapl_stats::shm_seg::inv_power_step;
 constexpr const double rapl_stats::shm_seg::max_power;
 
+const char* const rapl_stats::shm_seg::prefix="/cpu_stats_p_pkg_";
+
 std::string
-rapl_stats::shm_seg::name(std::uint32_t pkg)
+rapl_stats::shm_seg::name(std::uint32_t pkg, std::uint32_t sub)
 {
     std::ostringstream s;
-    s << "/cpu_stats_p_pkg_" << std::setw(3) << std::setfill('0') << pkg;
+    s << prefix << std::setw(3) << std::setfill('0') << pkg;
+    if (sub != pkg::top)
+        s << '_' << std::setw(3) << sub;
     return s.str();
 }
 
-rapl_stats::shm_seg::shm_seg(std::uint32_t pkg)
+rapl_stats::shm_seg::shm_seg(std::uint32_t pkg, std::uint32_t sub)
     : _pkg(pkg),
+      _sub(sub),
+      _pkg_id(pkg::package_id(pkg)),
+      _mmio(pkg::mmio(pkg)),
+      _name{0},
       _uj_lo(0), _uj_hi(0),
       _entries{0}
 {
+    std::string n=pkg::name(pkg, sub);
+    std::strncpy(_name, n.c_str(), sizeof(_name)-1);
 }
 
 rapl_stats::shm_seg::~shm_seg()
 {
-    std::string fn=name(_pkg);
+    std::string fn=name(_pkg, _sub);
     tools::shm::unlink(fn);
 }
 
 rapl_stats::shm_seg*
-rapl_stats::shm_seg::create(std::uint32_t cpu)
+rapl_stats::shm_seg::create(std::uint32_t pkg, std::uint32_t sub)
 {
-    std::string fn=name(cpu);
+    std::string fn=name(pkg, sub);
     void* addr=tools::shm::create(fn, sizeof(shm_seg), 0644);
-    shm_seg* ret=new (addr) shm_seg(cpu);
+    shm_seg* ret=new (addr) shm_seg(pkg, sub);
     return ret;
 }
 
@@ -63,9 +74,9 @@ rapl_stats::shm_seg::close(shm_seg* p)
 }
 
 const rapl_stats::shm_seg*
-rapl_stats::shm_seg::open(std::uint32_t cpu)
+rapl_stats::shm_seg::open(std::uint32_t pkg, std::uint32_t sub)
 {
-    std::string fn=name(cpu);
+    std::string fn=name(pkg, sub);
     void* addr=tools::shm::open_ro(fn, sizeof(shm_seg));
     const shm_seg* ret=reinterpret_cast<const shm_seg*>(addr);
     return ret;
@@ -92,3 +103,40 @@ rapl_stats::shm_seg::idx_to_power(std::size_t idx)
 {
     return (1+idx)*power_step;
 }
+
+bool
+rapl_stats::shm_seg::is_package()
+    const
+{
+    return _sub==pkg::top && _pkg_id!=pkg::top && _mmio==false;
+}
+
+std::string
+rapl_stats::shm_seg::label()
+    const
+{
+    std::ostringstream s;
+    s << (_mmio ? "rapl mmio " : "rapl ");
+    if (_pkg_id != pkg::top) {
+        s << "package " << _pkg_id;
+    } else if (_sub != pkg::top) {
+        s << "zone " << _pkg;
+    } else {
+        s << _name << ' ' << _pkg;
+    }
+    if (_sub != pkg::top)
+        s << ' ' << _name;
+    return s.str();
+}
+
+rapl_stats::shm_seg&
+rapl_stats::shm_seg::operator-=(const shm_seg& r)
+{
+    std::uint64_t ujl=_uj_lo - r._uj_lo;
+    std::uint64_t borrow= _uj_lo < r._uj_lo ? 1 : 0;
+    _uj_hi = _uj_hi - r._uj_hi - borrow;
+    _uj_lo = ujl;
+    for (std::size_t i=0; i<POWER_ENTRIES; ++i)
+        _entries[i] -= r._entries[i];
+    return *this;
+}
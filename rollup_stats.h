@@ -0,0 +1,183 @@
+//
+//  Copyright (C) 2020-2026  Axel Zeuner
+//
+//  This program is free software; you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation; either version 2 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program; if not, write to the Free Software
+//  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+//
+#if !defined (__ROLLUP_STATS_H__)
+#define __ROLLUP_STATS_H__ 1
+
+#include <tools.h>
+#include <cstdint>
+#include <vector>
+#include <string>
+#include <iosfwd>
+
+namespace rollup_stats {
+
+    // default directory of the rollup files
+    extern const char* default_dir;
+
+    enum {
+        // number of resolutions: minutes, hours, days
+        LEVELS=3,
+        // number of histogram entries per series in a record
+        HIST_ENTRIES=16,
+        // maximum length of a series name
+        NAME_LEN=32
+    };
+
+    // resolutions in seconds
+    extern const std::uint32_t resolution_s[LEVELS];
+    // default number of records kept per resolution
+    extern const std::uint32_t default_retention[LEVELS];
+
+    // description of a series of values, e.g. the power of a rapl
+    // package
+    struct series {
+        char _name[NAME_LEN];
+        // the histogram covers [0, _max)
+        double _max;
+
+        series(const std::string& n, double max);
+    };
+
+    // a series in a record
+    struct entry {
+        float _min;
+        float _max;
+        float _mean;
+        std::uint32_t _samples;
+        // array with samples/(_max/HIST_ENTRIES) value range
+        std::uint32_t _entries[HIST_ENTRIES];
+    };
+
+    // memory mapped circular file with records of one resolution,
+    // each record contains one entry per series
+    class file {
+        struct header;
+        header* _h;
+        std::size_t _size;
+        bool _rw;
+        std::size_t
+        record_size() const;
+        const char*
+        record_base(std::uint64_t i) const;
+        // rename the file for resolution res_s if its series or
+        // capacity differ, returns false on errors
+        static
+        bool
+        move_aside(const std::string& dir, std::uint32_t res_s,
+                   std::uint32_t capacity, const std::vector<series>& v);
+    public:
+        static
+        std::string
+        name(const std::string& dir, std::uint32_t res_s);
+
+        // open or create the file for resolution res_s with
+        // capacity records of the series in v, the records
+        // of an existing file are kept if the series and the
+        // capacity did not change, otherwise the file is renamed to
+        // rollup_<res_s>s.dat.<start of its oldest record>
+        file(const std::string& dir, std::uint32_t res_s,
+             std::uint32_t capacity, const std::vector<series>& v);
+        // open the file for resolution res_s read only
+        file(const std::string& dir, std::uint32_t res_s);
+        ~file();
+        file(const file&) = delete;
+        file&
+        operator=(const file&) = delete;
+
+        std::uint32_t resolution_s() const;
+        std::uint32_t capacity() const;
+        std::uint32_t series_count() const;
+        const series& series_at(std::uint32_t i) const;
+        // number of records written since creation, the valid records
+        // are [head()-min(head(), capacity()), head())
+        std::uint64_t head() const;
+        // start time of record i in seconds since the epoch
+        std::int64_t start_s(std::uint64_t i) const;
+        // entries of record i, only for the writer, clients use read
+        const entry* record(std::uint64_t i) const;
+        // the longest wait for the end of an append in read
+        static
+        constexpr const std::uint32_t max_append_ms=500;
+        // copy the start time and the series_count() entries of
+        // record i consistently into start_s and e, returns false if
+        // i is not valid (anymore) or if an append does not finish
+        // within max_append_ms
+        bool
+        read(std::uint64_t i, std::int64_t& start_s, entry* e) const;
+        // append a record, replaces the last record if it has the
+        // same start time, the records are protected by a sequence
+        // counter against torn reads
+        void
+        append(std::int64_t start_s, const entry* e);
+    };
+
+    class data {
+        struct level {
+            file* _f;
+            std::int64_t _start_s;
+            std::vector<entry> _cur;
+            std::vector<double> _sum;
+        };
+        std::vector<series> _series;
+        std::vector<level> _levels;
+
+        static
+        void
+        reset(level& l, std::int64_t start_s);
+        // continue the last record of the file of l if it belongs
+        // to the current period of l
+        static
+        void
+        resume(level& l);
+        // append the current record of l to its file
+        static
+        void
+        finish(level& l);
+        static
+        void
+        to_stream(std::ostream& s, const file& f, std::uint32_t series,
+                  std::int64_t from_s, bool short_output);
+    public:
+        // retention contains the number of records per resolution
+        data(const std::string& dir, const std::uint32_t* retention,
+             const std::vector<series>& v);
+        ~data();
+        data(const data&) = delete;
+        data&
+        operator=(const data& r) = delete;
+        // add a value to series s
+        void
+        sample(std::size_t s, double v, std::uint32_t weight);
+        // write the records finished before now_s, must be called
+        // before the samples of a tick are added
+        void
+        update(std::int64_t now_s);
+        // dump the records of resolution res_s of the last range_s
+        // seconds
+        static
+        void
+        to_stream(std::ostream& s, const std::string& dir,
+                  std::uint32_t res_s, std::uint32_t range_s,
+                  bool short_output=false);
+    };
+}
+
+// Local variables:
+// mode: c++
+// end:
+#endif
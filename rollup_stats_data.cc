@@ -0,0 +1,213 @@
+//
+//  Copyright (C) 2020-2026  Axel Zeuner
+//
+//  This program is free software; you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation; either version 2 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program; if not, write to the Free Software
+//  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+//
+#include "rollup_stats.h"
+#include <iostream>
+#include <iomanip>
+#include <cmath>
+#include <algorithm>
+#include <limits>
+#include <time.h>
+#include <syslog.h>
+
+rollup_stats::data::data(const std::string& dir,
+                         const std::uint32_t* retention,
+                         const std::vector<series>& v)
+    : _series(v), _levels()
+{
+    if (!tools::file::make_dir(dir)) {
+        std::string msg="could not create directory " + dir;
+        throw std::runtime_error(msg);
+    }
+    std::int64_t now_s=::time(nullptr);
+    try {
+        for (std::size_t i=0; i<LEVELS; ++i) {
+            if (retention[i]==0)
+                continue;
+            level l;
+            l._f=new file(dir, resolution_s[i], retention[i], _series);
+            l._start_s=0;
+            _levels.push_back(l);
+            reset(_levels.back(), now_s - now_s % resolution_s[i]);
+            resume(_levels.back());
+        }
+    }
+    catch (const std::runtime_error& e) {
+        for (std::size_t i=0; i<_levels.size(); ++i)
+            delete _levels[i]._f;
+        throw;
+    }
+}
+
+rollup_stats::data::~data()
+{
+    for (std::size_t i=0; i<_levels.size(); ++i) {
+        // keep the incomplete records
+        finish(_levels[i]);
+        delete _levels[i]._f;
+    }
+}
+
+void
+rollup_stats::data::finish(level& l)
+{
+    bool used=false;
+    for (std::size_t j=0; j<l._cur.size(); ++j) {
+        entry& e=l._cur[j];
+        if (e._samples) {
+            e._mean=l._sum[j]/e._samples;
+            used=true;
+        } else {
+            e._min=0;
+        }
+    }
+    if (used)
+        l._f->append(l._start_s, l._cur.data());
+}
+
+void
+rollup_stats::data::reset(level& l, std::int64_t start_s)
+{
+    std::size_t n=l._f->series_count();
+    l._start_s=start_s;
+    l._cur.resize(n);
+    l._sum.resize(n);
+    for (std::size_t i=0; i<n; ++i) {
+        entry& e=l._cur[i];
+        e._min=std::numeric_limits<float>::max();
+        e._max=0;
+        e._mean=0;
+        e._samples=0;
+        std::fill(std::begin(e._entries), std::end(e._entries), 0);
+        l._sum[i]=0.0;
+    }
+}
+
+void
+rollup_stats::data::resume(level& l)
+{
+    std::uint64_t h=l._f->head();
+    if (h==0 || l._f->start_s(h-1) != l._start_s)
+        return;
+    const entry* pe=l._f->record(h-1);
+    for (std::size_t i=0; i<l._cur.size(); ++i) {
+        if (pe[i]._samples==0)
+            continue;
+        l._cur[i]=pe[i];
+        l._sum[i]=double(pe[i]._mean)*pe[i]._samples;
+    }
+}
+
+void
+rollup_stats::data::sample(std::size_t s, double v, std::uint32_t weight)
+{
+    if (s >= _series.size())
+        return;
+    double h=std::floor(v*HIST_ENTRIES/_series[s]._max);
+    std::size_t idx=std::min(std::size_t(std::max(h, 0.0)),
+                             std::size_t(HIST_ENTRIES)-1);
+    float fv=v;
+    for (std::size_t i=0; i<_levels.size(); ++i) {
+        level& l=_levels[i];
+        entry& e=l._cur[s];
+        e._min=std::min(e._min, fv);
+        e._max=std::max(e._max, fv);
+        e._samples += weight;
+        e._entries[idx] += weight;
+        l._sum[s] += v*weight;
+    }
+}
+
+void
+rollup_stats::data::update(std::int64_t now_s)
+{
+    for (std::size_t i=0; i<_levels.size(); ++i) {
+        level& l=_levels[i];
+        std::int64_t res=l._f->resolution_s();
+        std::int64_t start_s=now_s - now_s % res;
+        if (l._start_s==start_s)
+            continue;
+        // the first record after the start of the daemon may be
+        // incomplete
+        finish(l);
+        reset(l, start_s);
+    }
+}
+
+void
+rollup_stats::data::
+to_stream(std::ostream& s, const file& f, std::uint32_t series,
+          std::int64_t from_s, bool short_output)
+{
+    const rollup_stats::series& sr=f.series_at(series);
+    const std::uint32_t cols=3;
+    for (std::uint32_t i=0; i<cols; ++i)
+        s << "========================";
+    s << '\n';
+    s << std::fixed << std::setprecision(0);
+    s << sr._name << ", resolution=" << f.resolution_s() << " s\n";
+    s << "start                    min     mean      max  samples\n";
+    std::uint64_t h=f.head();
+    std::uint64_t n=std::min(h, std::uint64_t(f.capacity()));
+    // the daemon may overwrite the records while they are read
+    std::vector<entry> rec(f.series_count());
+    for (std::uint64_t i=h-n; i<h; ++i) {
+        std::int64_t st;
+        if (!f.read(i, st, rec.data()) || st < from_s)
+            continue;
+        const entry& e=rec[series];
+        time_t t=st;
+        struct tm tm;
+        localtime_r(&t, &tm);
+        char tb[32];
+        strftime(tb, sizeof(tb), "%Y-%m-%d %H:%M", &tm);
+        s << tb << ' '
+          << std::setw(11) << std::setprecision(1) << e._min << ' '
+          << std::setw(8) << e._mean << ' '
+          << std::setw(8) << e._max << ' '
+          << std::setw(8) << std::setprecision(0) << double(e._samples)
+          << '\n';
+        if (!short_output && e._samples) {
+            s << "histogram/%:";
+            for (std::uint32_t j=0; j<HIST_ENTRIES; ++j) {
+                double pct=(e._entries[j]*1e2)/e._samples;
+                s << ' ' << std::setw(3) << std::setprecision(0) << pct;
+            }
+            s << '\n';
+        }
+    }
+    if (!short_output) {
+        s << "histogram step: " << std::setprecision(1)
+          << sr._max/HIST_ENTRIES << '\n';
+    }
+}
+
+void
+rollup_stats::data::
+to_stream(std::ostream& s, const std::string& dir,
+          std::uint32_t res_s, std::uint32_t range_s, bool short_output)
+{
+    file f(dir, res_s);
+    std::int64_t from_s=0;
+    if (range_s != 0) {
+        std::int64_t now_s=::time(nullptr);
+        from_s=now_s - now_s % res_s - range_s;
+    }
+    for (std::uint32_t i=0; i<f.series_count(); ++i) {
+        to_stream(s, f, i, from_s, short_output);
+    }
+}
@@ -0,0 +1,274 @@
+//
+//  Copyright (C) 2020-2026  Axel Zeuner
+//
+//  This program is free software; you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation; either version 2 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program; if not, write to the Free Software
+//  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+//
+#include "rollup_stats.h"
+#include <sstream>
+#include <cstring>
+#include <atomic>
+#include <stdexcept>
+#include <algorithm>
+#include <cstdio>
+#include <time.h>
+#include <sched.h>
+#include <syslog.h>
+
+const char* rollup_stats::default_dir="/var/lib/cpu-stats";
+
+constexpr const std::uint32_t rollup_stats::file::max_append_ms;
+
+const std::uint32_t
+rollup_stats::resolution_s[LEVELS]={60, 3600, 86400};
+
+// one day of minutes, one week of hours and one year of days
+const std::uint32_t
+rollup_stats::default_retention[LEVELS]={1440, 168, 366};
+
+struct rollup_stats::file::header {
+    char _magic[8];
+    std::uint32_t _version;
+    std::uint32_t _resolution_s;
+    std::uint32_t _capacity;
+    std::uint32_t _series;
+    // number of records written
+    std::atomic<std::uint64_t> _head;
+    // sequence counter, odd during an append
+    std::atomic<std::uint64_t> _seq;
+    // followed by _series series and _capacity records, each
+    // record starts with an std::int64_t with the start time
+    // followed by _series entries
+};
+
+namespace {
+    const char rollup_magic[8]="cpustru";
+    const std::uint32_t rollup_version=2;
+}
+
+rollup_stats::series::series(const std::string& n, double max)
+    : _name{0}, _max(max)
+{
+    std::strncpy(_name, n.c_str(), sizeof(_name)-1);
+}
+
+std::string
+rollup_stats::file::name(const std::string& dir, std::uint32_t res_s)
+{
+    std::ostringstream s;
+    s << dir << "/rollup_" << res_s << "s.dat";
+    return s.str();
+}
+
+rollup_stats::file::file(const std::string& dir, std::uint32_t res_s,
+                         std::uint32_t capacity,
+                         const std::vector<series>& v)
+    : _h(nullptr), _size(0), _rw(true)
+{
+    std::size_t rs=sizeof(std::int64_t) + v.size()*sizeof(entry);
+    _size=sizeof(header) + v.size()*sizeof(series) + capacity*rs;
+    std::string fn=name(dir, res_s);
+    if (tools::file::exists(fn) && !move_aside(dir, res_s, capacity, v)) {
+        std::string msg="could not move " + fn + " aside";
+        throw std::runtime_error(msg);
+    }
+    _h=static_cast<header*>(tools::file::map(fn, _size, 0644));
+    bool keep= std::memcmp(_h->_magic, rollup_magic,
+                           sizeof(_h->_magic))==0;
+    if (!keep) {
+        std::memset(static_cast<void*>(_h), 0, _size);
+        _h->_version=rollup_version;
+        _h->_resolution_s=res_s;
+        _h->_capacity=capacity;
+        _h->_series=v.size();
+        std::memcpy(reinterpret_cast<series*>(_h+1), v.data(),
+                    v.size()*sizeof(series));
+        std::memcpy(_h->_magic, rollup_magic, sizeof(_h->_magic));
+    }
+    // a daemon killed during an append left an odd counter
+    std::uint64_t seq=_h->_seq.load(std::memory_order_relaxed);
+    if ((seq & 1) != 0)
+        _h->_seq.store(seq+1, std::memory_order_release);
+}
+
+bool
+rollup_stats::file::move_aside(const std::string& dir, std::uint32_t res_s,
+                               std::uint32_t capacity,
+                               const std::vector<series>& v)
+{
+    std::string fn=name(dir, res_s);
+    // the records are named by the start of the oldest one, an
+    // invalid or empty file by the current time
+    std::int64_t start_s=::time(nullptr);
+    try {
+        const file f(dir, res_s);
+        std::size_t rs=sizeof(std::int64_t) + v.size()*sizeof(entry);
+        bool keep= f._h->_resolution_s==res_s &&
+            f._h->_capacity==capacity &&
+            f._h->_series==v.size() &&
+            f._size==sizeof(header) + v.size()*sizeof(series) +
+            capacity*rs &&
+            std::memcmp(f._h+1, v.data(), v.size()*sizeof(series))==0;
+        if (keep)
+            return true;
+        std::uint64_t h=f.head();
+        if (h != 0)
+            start_s=f.start_s(h - std::min(h, std::uint64_t(capacity)));
+    }
+    catch (const std::runtime_error& e) {
+        // not a valid rollup file
+    }
+    // clients may have mapped the file, it is never resized in place
+    std::string an=fn + "." + std::to_string(start_s);
+    if (std::rename(fn.c_str(), an.c_str())!=0)
+        return false;
+    syslog(LOG_INFO, "rollup_stats: moved %s aside to %s",
+           fn.c_str(), an.c_str());
+    return true;
+}
+
+rollup_stats::file::file(const std::string& dir, std::uint32_t res_s)
+    : _h(nullptr), _size(0), _rw(false)
+{
+    std::string fn=name(dir, res_s);
+    const void* addr=tools::file::map_ro(fn, _size);
+    _h=static_cast<header*>(const_cast<void*>(addr));
+    if (_size < sizeof(header) ||
+        std::memcmp(_h->_magic, rollup_magic, sizeof(_h->_magic))!=0 ||
+        _h->_version!=rollup_version ||
+        sizeof(header) + _h->_series*sizeof(series) +
+        std::size_t(_h->_capacity)*record_size() > _size) {
+        tools::file::unmap(_h, _size);
+        std::string msg="invalid rollup file " + fn;
+        throw std::runtime_error(msg);
+    }
+}
+
+rollup_stats::file::~file()
+{
+    tools::file::unmap(_h, _size);
+}
+
+std::size_t
+rollup_stats::file::record_size()
+    const
+{
+    return sizeof(std::int64_t) + _h->_series*sizeof(entry);
+}
+
+const char*
+rollup_stats::file::record_base(std::uint64_t i)
+    const
+{
+    const char* b=reinterpret_cast<const char*>(_h+1) +
+        _h->_series*sizeof(series);
+    return b + (i % _h->_capacity)*record_size();
+}
+
+std::uint32_t
+rollup_stats::file::resolution_s()
+    const
+{
+    return _h->_resolution_s;
+}
+
+std::uint32_t
+rollup_stats::file::capacity()
+    const
+{
+    return _h->_capacity;
+}
+
+std::uint32_t
+rollup_stats::file::series_count()
+    const
+{
+    return _h->_series;
+}
+
+const rollup_stats::series&
+rollup_stats::file::series_at(std::uint32_t i)
+    const
+{
+    return reinterpret_cast<const series*>(_h+1)[i];
+}
+
+std::uint64_t
+rollup_stats::file::head()
+    const
+{
+    return _h->_head.load(std::memory_order_acquire);
+}
+
+std::int64_t
+rollup_stats::file::start_s(std::uint64_t i)
+    const
+{
+    std::int64_t r;
+    std::memcpy(&r, record_base(i), sizeof(r));
+    return r;
+}
+
+const rollup_stats::entry*
+rollup_stats::file::record(std::uint64_t i)
+    const
+{
+    return reinterpret_cast<const entry*>(record_base(i) +
+                                          sizeof(std::int64_t));
+}
+
+void
+rollup_stats::file::append(std::int64_t start_s, const entry* e)
+{
+    if (!_rw || _h->_capacity==0)
+        return;
+    std::uint64_t h=_h->_head.load(std::memory_order_relaxed);
+    // the record of a period continued after a restart replaces the
+    // one written at the shutdown
+    if (h != 0 && this->start_s(h-1)==start_s)
+        --h;
+    _h->_seq.fetch_add(1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    char* p=const_cast<char*>(record_base(h));
+    std::memcpy(p, &start_s, sizeof(start_s));
+    std::memcpy(p + sizeof(start_s), e, _h->_series*sizeof(entry));
+    _h->_head.store(h+1, std::memory_order_release);
+    _h->_seq.fetch_add(1, std::memory_order_release);
+}
+
+bool
+rollup_stats::file::read(std::uint64_t i, std::int64_t& start_s, entry* e)
+    const
+{
+    std::uint64_t t0=tools::monotonic_ns();
+    for (;;) {
+        std::uint64_t seq=_h->_seq.load(std::memory_order_acquire);
+        if ((seq & 1) != 0) {
+            std::uint64_t ms=(tools::monotonic_ns() - t0)/1000000;
+            if (ms >= max_append_ms)
+                return false;
+            sched_yield();
+            continue;
+        }
+        std::uint64_t h=head();
+        if (i >= h || h - i > _h->_capacity)
+            return false;
+        const char* p=record_base(i);
+        std::memcpy(&start_s, p, sizeof(start_s));
+        std::memcpy(e, p + sizeof(start_s), _h->_series*sizeof(entry));
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (_h->_seq.load(std::memory_order_relaxed) == seq)
+            return true;
+    }
+}
@@ -0,0 +1,245 @@
+//
+//  Copyright (C) 2020-2026  Axel Zeuner
+//
+//  This program is free software; you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation; either version 2 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program; if not, write to the Free Software
+//  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+//
+#if !defined (__STEAL_STATS_H__)
+#define __STEAL_STATS_H__ 1
+
+#include <tools.h>
+#include <cstdint>
+#include <vector>
+#include <string>
+#include <iosfwd>
+
+namespace cpu_stats {
+    class mark;
+    class writer;
+    class selection;
+}
+
+// steal and guest time of the cpus from /proc/stat
+namespace steal_stats {
+
+    // name of the hypervisor like KVMKVMKVM or XenVMMXenVMM if
+    // running in a virtual machine, empty on bare metal
+    std::string
+    hypervisor();
+
+    // shared memory segment with the steal and guest time of one cpu
+    class shm_seg {
+        shm_seg(std::uint32_t cpu, const std::string& hv);
+        ~shm_seg();
+    public:
+        // steal percentage step of the histogram
+        static
+        constexpr const double pct_step=1.0;
+        static
+        constexpr const double inv_pct_step=1.0/pct_step;
+        enum {
+            PCT_ENTRIES=std::uint32_t(100.0/pct_step)
+        };
+    private:
+        std::uint32_t _cpu;
+        // hypervisor detected by the daemon, empty on bare metal
+        char _hypervisor[16];
+        // jiffies since start
+        std::uint64_t _steal;
+        std::uint64_t _guest;
+        std::uint64_t _total;
+        // CLOCK_MONOTONIC milliseconds covered by the histogram
+        std::uint64_t _elapsed_ms;
+        // steal fraction of the last interval
+        double _last;
+        // milliseconds per steal percentage range
+        std::uint64_t _entries[PCT_ENTRIES];
+    public:
+        static
+        const char* const prefix;
+
+        static
+        std::string name(std::uint32_t cpu);
+
+        static
+        shm_seg*
+        create(std::uint32_t cpu, const std::string& hv);
+
+        static
+        void
+        close(shm_seg* p);
+
+        static
+        const shm_seg*
+        open(std::uint32_t cpu);
+
+        static
+        void
+        close(const shm_seg* p);
+
+        // index of the steal percentage pct
+        static
+        std::size_t
+        pct_to_idx(double pct);
+
+        // upper limit of the range with index idx
+        static
+        double
+        idx_to_pct(std::size_t idx);
+
+        // subtract the sums of r, used for the differences to a mark
+        shm_seg& operator-=(const shm_seg& r);
+
+        const std::uint32_t& cpu() const;
+        const char* hypervisor() const;
+        const std::uint64_t& steal() const;
+        const std::uint64_t& guest() const;
+        const std::uint64_t& total() const;
+        const std::uint64_t& elapsed_ms() const;
+        const double& last() const;
+        const std::uint64_t* begin() const;
+        const std::uint64_t* end() const;
+        // add the jiffies of one interval of ms milliseconds
+        shm_seg& add(std::uint64_t steal, std::uint64_t guest,
+                     std::uint64_t total, std::uint64_t ms);
+    };
+
+    class data {
+        std::vector<const shm_seg*> _v;
+        // jiffies of the last sample per cpu
+        std::vector<tools::proc_stat::cpu_times> _last_times;
+        // CLOCK_MONOTONIC time of the last update
+        std::uint64_t _ns;
+        bool _create;
+
+        static
+        void
+        to_stream(std::ostream& s, const std::vector<const shm_seg*>& v,
+                  bool short_output);
+        void
+        close();
+        static
+        void
+        to_writer(cpu_stats::writer& w, const shm_seg* p);
+    public:
+        // the client opens the segments of the cpus in sel or of
+        // all cpus if sel is nullptr
+        data(bool create, const cpu_stats::selection* sel=nullptr);
+        ~data();
+        data(const data&) = delete;
+        data&
+        operator=(const data& r) = delete;
+        const std::vector<const shm_seg*>&
+        segments() const;
+        // the names of the segments
+        std::vector<std::string>
+        names() const;
+        // update _v, ps contains the current content of /proc/stat
+        void
+        update(const tools::proc_stat& ps);
+        void
+        to_stream(std::ostream& s, bool short_output=false);
+        void
+        to_stream(std::ostream& s, const cpu_stats::mark& m,
+                  bool short_output=false);
+        // write the data to w
+        void
+        to_writer(cpu_stats::writer& w);
+        // write the differences to the data saved in mark m to w
+        void
+        to_writer(cpu_stats::writer& w, const cpu_stats::mark& m);
+    };
+}
+
+inline
+const std::uint32_t&
+steal_stats::shm_seg::cpu()
+    const
+{
+    return _cpu;
+}
+
+inline
+const char*
+steal_stats::shm_seg::hypervisor()
+    const
+{
+    return _hypervisor;
+}
+
+inline
+const std::uint64_t&
+steal_stats::shm_seg::steal()
+    const
+{
+    return _steal;
+}
+
+inline
+const std::uint64_t&
+steal_stats::shm_seg::guest()
+    const
+{
+    return _guest;
+}
+
+inline
+const std::uint64_t&
+steal_stats::shm_seg::total()
+    const
+{
+    return _total;
+}
+
+inline
+const std::uint64_t&
+steal_stats::shm_seg::elapsed_ms()
+    const
+{
+    return _elapsed_ms;
+}
+
+inline
+const double&
+steal_stats::shm_seg::last()
+    const
+{
+    return _last;
+}
+
+inline
+const std::uint64_t*
+steal_stats::shm_seg::begin()
+    const
+{
+    return _entries;
+}
+
+inline
+const std::uint64_t*
+steal_stats::shm_seg::end()
+    const
+{
+    return _entries + PCT_ENTRIES;
+}
+
+inline
+const std::vector<const steal_stats::shm_seg*>&
+steal_stats::data::segments()
+    const
+{
+    return _v;
+}
+
+#endif
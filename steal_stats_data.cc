@@ -0,0 +1,328 @@
+//
+//  Copyright (C) 2020-2026  Axel Zeuner
+//
+//  This program is free software; you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation; either version 2 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program; if not, write to the Free Software
+//  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+//
+#include "steal_stats.h"
+#include "cpufreq_stats.h"
+#include "cpu-stats.h"
+#include <iostream>
+#include <iomanip>
+#include <cmath>
+#include <algorithm>
+#include <numeric>
+#include <cstring>
+#include <cstdlib>
+#include <type_traits>
+#if defined (__x86_64__) || defined (__i386__)
+#include <cpuid.h>
+#endif
+
+std::string
+steal_stats::hypervisor()
+{
+#if defined (__x86_64__) || defined (__i386__)
+    unsigned int a, b, c, d;
+    // the hypervisor present bit
+    if (__get_cpuid(1, &a, &b, &c, &d) && (c & (1u<<31)) != 0) {
+        // the vendor signature of the hypervisor leaves
+        __cpuid(0x40000000, a, b, c, d);
+        char n[13];
+        std::memcpy(n, &b, 4);
+        std::memcpy(n+4, &c, 4);
+        std::memcpy(n+8, &d, 4);
+        n[12]=0;
+        std::string r(n);
+        if (r.empty())
+            r="unknown";
+        return r;
+    }
+#endif
+    // xen guests of other architectures
+    const char* xt="/sys/hypervisor/type";
+    if (tools::file::exists(xt)) {
+        std::string r=tools::sys_fs::read<std::string>::from(xt);
+        while (!r.empty() && (r.back()=='\n' || r.back()==0))
+            r.pop_back();
+        return r;
+    }
+    return std::string();
+}
+
+namespace {
+
+    std::uint64_t
+    guest_jiffies(const tools::proc_stat::cpu_times& t)
+    {
+        return t._guest + t._guest_nice;
+    }
+}
+
+steal_stats::data::data(bool create, const cpu_stats::selection* sel)
+    : _v(),
+      _last_times(),
+      _ns(0),
+      _create(create)
+{
+    try {
+        if (_create) {
+            std::string hv=hypervisor();
+            for (std::uint32_t i=0; cpufreq_stats::cpu::exists(i); ++i) {
+                _v.push_back(shm_seg::create(i, hv));
+                _last_times.push_back(tools::proc_stat::cpu_times{});
+            }
+        } else {
+            std::string pf(shm_seg::prefix);
+            for (const auto& n : cpu_stats::segments(pf)) {
+                std::uint32_t id=std::strtoul(n.c_str()+pf.size(),
+                                              nullptr, 10);
+                if (sel != nullptr && !sel->cpu(id))
+                    continue;
+                try {
+                    _v.push_back(shm_seg::open(id));
+                }
+                catch (const std::runtime_error& e) {
+                    // listed in the index but not accessible, i.e. not
+                    // bound into a container
+                    continue;
+                }
+            }
+        }
+    }
+    catch (const std::runtime_error& e) {
+        close();
+        throw;
+    }
+}
+
+void
+steal_stats::data::close()
+{
+    if (_create==true) {
+        for (std::size_t i=0; i<_v.size(); ++i) {
+            shm_seg* p=const_cast<shm_seg*>(_v[i]);
+            shm_seg::close(p);
+        }
+    } else {
+        for (std::size_t i=0; i<_v.size(); ++i) {
+            shm_seg::close(_v[i]);
+        }
+    }
+    _v.clear();
+}
+
+steal_stats::data::~data()
+{
+    close();
+}
+
+void
+steal_stats::data::update(const tools::proc_stat& ps)
+{
+    if (_create == false)
+        return;
+    std::uint64_t ns_now=tools::monotonic_ns();
+    std::uint64_t ns_last=_ns;
+    _ns=ns_now;
+    std::uint64_t ms=(ns_now - ns_last + 500000)/1000000;
+    const auto& times=ps.cpus();
+    for (std::size_t i=0; i<_v.size(); ++i) {
+        shm_seg* p=const_cast<shm_seg*>(_v[i]);
+        std::uint32_t cpu=p->cpu();
+        if (cpu >= times.size() || !times[cpu]._valid) {
+            // offline cpu
+            _last_times[i]._valid=false;
+            continue;
+        }
+        const tools::proc_stat::cpu_times& t1=times[cpu];
+        tools::proc_stat::cpu_times& t0=_last_times[i];
+        if (t0._valid && ns_last != 0) {
+            std::uint64_t dt=t1.total()-t0.total();
+            std::uint64_t ds=t1._steal-t0._steal;
+            std::uint64_t dg=guest_jiffies(t1)-guest_jiffies(t0);
+            if (dt != 0 && ds <= dt)
+                p->add(ds, dg, dt, ms);
+        }
+        t0=t1;
+    }
+}
+
+void
+steal_stats::data::
+to_stream(std::ostream& s, const std::vector<const shm_seg*>& v,
+          bool short_output)
+{
+    if (v.empty())
+        return;
+    s << std::fixed;
+    // the sum of the histograms of all cpus
+    std::uint64_t vt[shm_seg::PCT_ENTRIES]={0};
+    std::uint64_t steal=0, guest=0, total=0;
+    double max_pct=0.0;
+    std::uint32_t max_cpu=0;
+    if (v[0]->hypervisor()[0] != 0)
+        s << "hypervisor: " << v[0]->hypervisor() << '\n';
+    for (const shm_seg* p : v) {
+        for (std::size_t i=0; i<shm_seg::PCT_ENTRIES; ++i)
+            vt[i] += p->begin()[i];
+        steal += p->steal();
+        guest += p->guest();
+        total += p->total();
+        double sp= p->total() != 0 ? p->steal()*1e2/p->total() : 0.0;
+        double gp= p->total() != 0 ? p->guest()*1e2/p->total() : 0.0;
+        if (sp > max_pct) {
+            max_pct=sp;
+            max_cpu=p->cpu();
+        }
+        if (short_output)
+            continue;
+        s << "cpu " << std::setw(3) << p->cpu() << ": steal "
+          << std::setprecision(2) << std::setw(6) << sp
+          << " %, last " << std::setw(6) << p->last()*1e2
+          << " %, guest " << std::setw(6) << gp << " %\n";
+    }
+    if (!short_output) {
+        double sum_ti=std::accumulate(std::begin(vt), std::end(vt), 0.0);
+        const std::uint32_t cols=3;
+        for (std::uint32_t i=0; i<cols; ++i) {
+            if (i)
+                s << " | ";
+            s << "steal%       %   sum % ";
+        }
+        s << '\n';
+        std::size_t vidx[shm_seg::PCT_ENTRIES];
+        std::size_t cnt=0;
+        for (std::size_t i=shm_seg::PCT_ENTRIES; i-- > 0; ) {
+            if (vt[i] != 0)
+                vidx[cnt++]=i;
+        }
+        double vspct[shm_seg::PCT_ENTRIES];
+        double spct=0.0;
+        for (std::size_t k=0; k<cnt; ++k) {
+            spct += vt[vidx[k]]*1e2/sum_ti;
+            vspct[k]=spct;
+        }
+        std::uint32_t lines=(cnt+cols-1)/cols;
+        for (std::uint32_t j=0; j<lines; ++j) {
+            for (std::uint32_t i=0; i<cols; ++i) {
+                std::size_t k=j+lines*i;
+                if (k >= cnt)
+                    continue;
+                std::size_t idx = vidx[k];
+                if (i)
+                    s << "  | ";
+                s << std::setw(6) << std::setprecision(0)
+                  << shm_seg::idx_to_pct(idx) << ' '
+                  << std::setw(7) << std::setprecision(2)
+                  << vt[idx]*1e2/sum_ti << ' '
+                  << std::setw(7) << std::setprecision(2) << vspct[k];
+            }
+            s << '\n';
+        }
+    }
+    double sp= total != 0 ? steal*1e2/total : 0.0;
+    double gp= total != 0 ? guest*1e2/total : 0.0;
+    s << "all cpus: steal " << std::setprecision(2) << sp
+      << " % (max " << max_pct << " % on cpu " << max_cpu
+      << "), guest " << gp << " %\n";
+}
+
+std::vector<std::string>
+steal_stats::data::names()
+    const
+{
+    std::vector<std::string> r;
+    for (const auto* p : _v)
+        r.push_back(shm_seg::name(p->cpu()));
+    return r;
+}
+
+void
+steal_stats::data::to_stream(std::ostream& s, bool short_output)
+{
+    to_stream(s, _v, short_output);
+}
+
+void
+steal_stats::data::
+to_stream(std::ostream& s, const cpu_stats::mark& m, bool short_output)
+{
+    // aligned copies of the segments for the differences to the mark
+    using buf_t=std::aligned_storage<sizeof(shm_seg),
+                                     alignof(shm_seg)>::type;
+    std::vector<buf_t> b(_v.size());
+    std::vector<const shm_seg*> v;
+    for (std::size_t i=0; i<_v.size(); ++i) {
+        const shm_seg* p=_v[i];
+        std::string n=shm_seg::name(p->cpu());
+        const void* pm=m.find(n, sizeof(shm_seg));
+        if (pm==nullptr)
+            continue;
+        m.read_live(&b[i], p, sizeof(shm_seg));
+        shm_seg* d=reinterpret_cast<shm_seg*>(&b[i]);
+        (*d) -= *static_cast<const shm_seg*>(pm);
+        // nothing happened since the mark
+        if (d->elapsed_ms()==0)
+            continue;
+        v.push_back(d);
+    }
+    to_stream(s, v, short_output);
+}
+
+void
+steal_stats::data::to_writer(cpu_stats::writer& w, const shm_seg* p)
+{
+    double pct[shm_seg::PCT_ENTRIES];
+    for (std::size_t i=0; i<shm_seg::PCT_ENTRIES; ++i)
+        pct[i]=shm_seg::idx_to_pct(i);
+    double total=p->total();
+    w.begin("steal", p->cpu());
+    w.value("hypervisor", p->hypervisor());
+    w.value("steal", p->steal());
+    w.value("guest", p->guest());
+    w.value("total", p->total());
+    w.value("elapsed_ms", p->elapsed_ms());
+    w.value("steal_pct", total > 0.0 ? (p->steal()*1e2)/total : 0.0);
+    w.value("guest_pct", total > 0.0 ? (p->guest()*1e2)/total : 0.0);
+    w.value("last_pct", p->last()*1e2);
+    w.values("pct", pct, shm_seg::PCT_ENTRIES);
+    w.values("entries", p->begin(), shm_seg::PCT_ENTRIES);
+    w.end();
+}
+
+void
+steal_stats::data::to_writer(cpu_stats::writer& w)
+{
+    for (std::size_t i=0; i<_v.size(); ++i)
+        to_writer(w, _v[i]);
+}
+
+void
+steal_stats::data::
+to_writer(cpu_stats::writer& w, const cpu_stats::mark& m)
+{
+    for (std::size_t i=0; i<_v.size(); ++i) {
+        const shm_seg* p=_v[i];
+        std::string n=shm_seg::name(p->cpu());
+        const void* pm=m.find(n, sizeof(shm_seg));
+        if (pm==nullptr)
+            continue;
+        alignas(shm_seg) char b[sizeof(shm_seg)];
+        m.read_live(b, p, sizeof(shm_seg));
+        shm_seg* d=reinterpret_cast<shm_seg*>(b);
+        (*d) -= *static_cast<const shm_seg*>(pm);
+        to_writer(w, d);
+    }
+}
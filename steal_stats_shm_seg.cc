@@ -0,0 +1,129 @@
+//
+//  Copyright (C) 2020-2026  Axel Zeuner
+//
+//  This program is free software; you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation; either version 2 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program; if not, write to the Free Software
+//  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+//
+#include "steal_stats.h"
+#include "tools.h"
+#include <sstream>
+#include <iomanip>
+#include <cmath>
+#include <cstring>
+#include <algorithm>
+
+constexpr const double steal_stats::shm_seg::pct_step;
+constexpr const double steal_stats::shm_seg::inv_pct_step;
+
+const char* const steal_stats::shm_seg::prefix="/cpu_stats_v_cpu_";
+
+std::string
+steal_stats::shm_seg::name(std::uint32_t cpu)
+{
+    std::ostringstream s;
+    s << prefix << std::setw(3) << std::setfill('0') << cpu;
+    return s.str();
+}
+
+steal_stats::shm_seg::shm_seg(std::uint32_t cpu, const std::string& hv)
+    : _cpu(cpu),
+      _hypervisor{0},
+      _steal(0),
+      _guest(0),
+      _total(0),
+      _elapsed_ms(0),
+      _last(0.0),
+      _entries{0}
+{
+    std::strncpy(_hypervisor, hv.c_str(), sizeof(_hypervisor)-1);
+}
+
+steal_stats::shm_seg::~shm_seg()
+{
+    std::string fn=name(_cpu);
+    tools::shm::unlink(fn);
+}
+
+steal_stats::shm_seg*
+steal_stats::shm_seg::create(std::uint32_t cpu, const std::string& hv)
+{
+    std::string fn=name(cpu);
+    void* addr=tools::shm::create(fn, sizeof(shm_seg), 0644);
+    shm_seg* ret=new (addr) shm_seg(cpu, hv);
+    return ret;
+}
+
+void
+steal_stats::shm_seg::close(shm_seg* p)
+{
+    p->~shm_seg();
+    tools::shm::unmap(p, sizeof(shm_seg));
+}
+
+const steal_stats::shm_seg*
+steal_stats::shm_seg::open(std::uint32_t cpu)
+{
+    std::string fn=name(cpu);
+    void* addr=tools::shm::open_ro(fn, sizeof(shm_seg));
+    const shm_seg* ret=reinterpret_cast<const shm_seg*>(addr);
+    return ret;
+}
+
+void
+steal_stats::shm_seg::close(const shm_seg* p)
+{
+    void* ap=const_cast<shm_seg*>(p);
+    tools::shm::unmap(ap, sizeof(shm_seg));
+}
+
+std::size_t
+steal_stats::shm_seg::pct_to_idx(double pct)
+{
+    double p0=std::floor(pct*inv_pct_step);
+    auto i=static_cast<std::size_t>(std::max(p0, 0.0));
+    i=std::min(i, std::size_t(PCT_ENTRIES)-1);
+    return i;
+}
+
+double
+steal_stats::shm_seg::idx_to_pct(std::size_t idx)
+{
+    return (1+idx)*pct_step;
+}
+
+steal_stats::shm_seg&
+steal_stats::shm_seg::operator-=(const shm_seg& r)
+{
+    _steal -= r._steal;
+    _guest -= r._guest;
+    _total -= r._total;
+    _elapsed_ms -= r._elapsed_ms;
+    for (std::size_t i=0; i<PCT_ENTRIES; ++i)
+        _entries[i] -= r._entries[i];
+    return *this;
+}
+
+steal_stats::shm_seg&
+steal_stats::shm_seg::add(std::uint64_t steal, std::uint64_t guest,
+                          std::uint64_t total, std::uint64_t ms)
+{
+    _steal += steal;
+    _guest += guest;
+    _total += total;
+    _elapsed_ms += ms;
+    double f= total != 0 ? std::min(double(steal)/total, 1.0) : 0.0;
+    _last=f;
+    _entries[pct_to_idx(f*1e2)] += ms;
+    return *this;
+}
@@ -0,0 +1,306 @@
+//
+//  Copyright (C) 2020-2026  Axel Zeuner
+//
+//  This program is free software; you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation; either version 2 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program; if not, write to the Free Software
+//  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+//
+#if !defined (__THERMAL_STATS_H__)
+#define __THERMAL_STATS_H__ 1
+
+#include <tools.h>
+#include <cstdint>
+#include <vector>
+#include <string>
+#include <iosfwd>
+
+namespace cpu_stats {
+    class mark;
+    class writer;
+}
+
+// temperatures of the hwmon sensors of cpus and gpus
+namespace thermal_stats {
+
+    // hwmon devices monitored by default
+    extern const char* const default_devices;
+
+    class shm_seg {
+        shm_seg(std::uint32_t id, std::uint32_t hwmon,
+                const std::string& dev, const std::string& file,
+                const std::string& label, double t_max, double t_crit);
+        ~shm_seg();
+    public:
+        // temperature step of 1 degree celsius
+        static
+        constexpr const double temp_step=1.0;
+        static
+        constexpr const double inv_temp_step=1.0/temp_step;
+        static
+        constexpr const double max_temp=127.0;
+        enum {
+            TEMP_ENTRIES=uint32_t(max_temp/temp_step)+1
+        };
+    private:
+        // number of the sensor
+        std::uint32_t _id;
+        // hwmon device number during the lifetime of the daemon
+        std::uint32_t _hwmon;
+        // name of the hwmon device
+        char _dev[32];
+        // file of the sensor, e.g. temp1_input
+        char _file[24];
+        // label of the sensor, may be empty
+        char _label[32];
+        // tempN_max and tempN_crit in degree celsius, NaN if not
+        // available
+        double _t_max;
+        double _t_crit;
+        // last and highest temperature
+        double _last;
+        double _highest;
+        // milliseconds above _t_max and above _t_crit
+        std::uint64_t _above_max_ms;
+        std::uint64_t _above_crit_ms;
+        // array with milliseconds/temperature range measured with
+        // CLOCK_MONOTONIC
+        std::uint64_t _entries[TEMP_ENTRIES];
+    public:
+        static
+        const char* const prefix;
+
+        static
+        std::string name(std::uint32_t id);
+
+        static
+        shm_seg*
+        create(std::uint32_t id, std::uint32_t hwmon,
+               const std::string& dev, const std::string& file,
+               const std::string& label, double t_max, double t_crit);
+
+        static
+        void
+        close(shm_seg* p);
+
+        static
+        const shm_seg*
+        open(std::uint32_t id);
+
+        static
+        void
+        close(const shm_seg* p);
+
+        static
+        std::size_t
+        temp_to_idx(double t);
+
+        static
+        double
+        idx_to_temp(std::size_t idx);
+
+        // subtract the entries of r, used for the differences to a
+        // mark
+        shm_seg& operator-=(const shm_seg& r);
+
+        const std::uint32_t& id() const;
+        const std::uint32_t& hwmon() const;
+        const char* dev() const;
+        const char* file() const;
+        const char* label() const;
+        // description of the sensor for the output
+        std::string description() const;
+        const double& t_max() const;
+        const double& t_crit() const;
+        const double& last() const;
+        const double& highest() const;
+        const std::uint64_t& above_max_ms() const;
+        const std::uint64_t& above_crit_ms() const;
+        // add a temperature t measured for ms milliseconds
+        shm_seg& add(double t, std::uint64_t ms);
+        const std::uint64_t* begin() const;
+        const std::uint64_t* end() const;
+    };
+
+    class data {
+        std::vector<const shm_seg*> _v;
+        struct priv_data {
+            tools::sys_fs::value_file _f;
+            // CLOCK_MONOTONIC time of the last read
+            std::uint64_t _ns;
+            // value and time of the read of sample()
+            std::int64_t _s_v;
+            std::uint64_t _s_ns;
+            bool _s_ok;
+        };
+        std::vector<priv_data> _vp;
+        bool _create;
+
+        static
+        void
+        to_stream(std::ostream& s, const shm_seg* p, bool short_output);
+        void
+        close();
+        static
+        void
+        to_writer(cpu_stats::writer& w, const shm_seg* p);
+    public:
+        // the daemon creates the segments of the tempN_input sensors
+        // of the hwmon devices in the comma separated list devices,
+        // the clients open all existing segments
+        data(bool create, const std::string& devices=default_devices);
+        ~data();
+        data(const data&) = delete;
+        data&
+        operator=(const data& r) = delete;
+        // the segments
+        const std::vector<const shm_seg*>&
+        segments() const;
+        // the names of the segments
+        std::vector<std::string>
+        names() const;
+        // read all sensors, called before update outside of the
+        // update of the segments
+        void
+        sample();
+        // update _v from the last sample
+        void
+        update();
+        // dump the data
+        void
+        to_stream(std::ostream& s, bool short_output=false);
+        // dump the differences to the data saved in mark m
+        void
+        to_stream(std::ostream& s, const cpu_stats::mark& m,
+                  bool short_output=false);
+        // write the data to w
+        void
+        to_writer(cpu_stats::writer& w);
+        // write the differences to the data saved in mark m to w
+        void
+        to_writer(cpu_stats::writer& w, const cpu_stats::mark& m);
+    };
+}
+
+inline
+const std::uint32_t&
+thermal_stats::shm_seg::id()
+    const
+{
+    return _id;
+}
+
+inline
+const std::uint32_t&
+thermal_stats::shm_seg::hwmon()
+    const
+{
+    return _hwmon;
+}
+
+inline
+const char*
+thermal_stats::shm_seg::dev()
+    const
+{
+    return _dev;
+}
+
+inline
+const char*
+thermal_stats::shm_seg::file()
+    const
+{
+    return _file;
+}
+
+inline
+const char*
+thermal_stats::shm_seg::label()
+    const
+{
+    return _label;
+}
+
+inline
+const double&
+thermal_stats::shm_seg::t_max()
+    const
+{
+    return _t_max;
+}
+
+inline
+const double&
+thermal_stats::shm_seg::t_crit()
+    const
+{
+    return _t_crit;
+}
+
+inline
+const double&
+thermal_stats::shm_seg::last()
+    const
+{
+    return _last;
+}
+
+inline
+const double&
+thermal_stats::shm_seg::highest()
+    const
+{
+    return _highest;
+}
+
+inline
+const std::uint64_t&
+thermal_stats::shm_seg::above_max_ms()
+    const
+{
+    return _above_max_ms;
+}
+
+inline
+const std::uint64_t&
+thermal_stats::shm_seg::above_crit_ms()
+    const
+{
+    return _above_crit_ms;
+}
+
+inline
+const std::uint64_t*
+thermal_stats::shm_seg::begin()
+    const
+{
+    return _entries;
+}
+
+inline
+const std::uint64_t*
+thermal_stats::shm_seg::end()
+    const
+{
+    return _entries+TEMP_ENTRIES;
+}
+
+inline
+const std::vector<const thermal_stats::shm_seg*>&
+thermal_stats::data::segments()
+    const
+{
+    return _v;
+}
+
+#endif
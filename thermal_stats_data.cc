@@ -0,0 +1,308 @@
+//
+//  Copyright (C) 2020-2026  Axel Zeuner
+//
+//  This program is free software; you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation; either version 2 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program; if not, write to the Free Software
+//  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+//
+#include "thermal_stats.h"
+#include "hwmon_stats.h"
+#include "cpu-stats.h"
+#include <iostream>
+#include <iomanip>
+#include <cmath>
+#include <algorithm>
+#include <numeric>
+#include <cstring>
+#include <cstdlib>
+
+const char* const thermal_stats::default_devices="coretemp,k10temp,amdgpu";
+
+namespace {
+
+    // limit ch_lim of sensor ch of hwmon device no in degree
+    // celsius, NaN if not available
+    double
+    limit(std::uint32_t no, const std::string& ch, const char* lim)
+    {
+        std::string p=hwmon_stats::hwmon::path(no) + ch + '_' + lim;
+        if (!tools::file::exists(p))
+            return std::nan("");
+        std::int64_t v=tools::sys_fs::read<std::int64_t>::from(p);
+        return v*1e-3;
+    }
+}
+
+thermal_stats::data::data(bool create, const std::string& devices)
+    : _v(),
+      _vp(),
+      _create(create)
+{
+    try {
+        if (_create) {
+            using hwmon_stats::hwmon;
+            hwmon_stats::allow_list a(devices);
+            for (std::uint32_t i=0; hwmon::exists(i); ++i) {
+                std::string dev=hwmon::name(i);
+                for (const auto& f : hwmon::channels(i, "temp", "input")) {
+                    if (!a.allowed(dev, f))
+                        continue;
+                    tools::sys_fs::value_file vf(hwmon::path(i) + f);
+                    if (!vf.valid())
+                        continue;
+                    std::string ch=f.substr(0, f.find('_'));
+                    std::uint32_t id=_v.size();
+                    const shm_seg* p=shm_seg::create(
+                        id, i, dev, f, hwmon::label(i, ch),
+                        limit(i, ch, "max"), limit(i, ch, "crit"));
+                    _v.push_back(p);
+                    _vp.push_back(priv_data{std::move(vf), 0, 0, 0, false});
+                }
+            }
+        } else {
+            std::string pf(shm_seg::prefix);
+            for (const auto& n : cpu_stats::segments(pf)) {
+                std::uint32_t id=std::strtoul(n.c_str()+pf.size(),
+                                              nullptr, 10);
+                try {
+                    _v.push_back(shm_seg::open(id));
+                }
+                catch (const std::runtime_error& e) {
+                    // listed in the index but not accessible, i.e. not
+                    // bound into a container
+                    continue;
+                }
+            }
+        }
+    }
+    catch (const std::runtime_error& e) {
+        close();
+        throw;
+    }
+}
+
+void
+thermal_stats::data::close()
+{
+    if (_create==true) {
+        for (std::size_t i=0; i<_v.size(); ++i) {
+            shm_seg* p=const_cast<shm_seg*>(_v[i]);
+            shm_seg::close(p);
+        }
+    } else {
+        for (std::size_t i=0; i<_v.size(); ++i) {
+            shm_seg::close(_v[i]);
+        }
+    }
+    _v.clear();
+}
+
+thermal_stats::data::~data()
+{
+    close();
+}
+
+void
+thermal_stats::data::sample()
+{
+    if (_create == false)
+        return;
+    for (std::size_t i=0; i<_v.size(); ++i) {
+        priv_data& pd=_vp[i];
+        pd._s_ok=pd._f.read(pd._s_v);
+        pd._s_ns=tools::monotonic_ns();
+    }
+}
+
+void
+thermal_stats::data::update()
+{
+    if (_create == false)
+        return;
+    for (std::size_t i=0; i<_v.size(); ++i) {
+        shm_seg* p=const_cast<shm_seg*>(_v[i]);
+        priv_data& pd=_vp[i];
+        if (pd._s_ok==false)
+            continue;
+        pd._s_ok=false;
+        std::int64_t v=pd._s_v;
+        std::uint64_t ns_now=pd._s_ns;
+        std::uint64_t ns_last=pd._ns;
+        pd._ns=ns_now;
+        // the first read only initializes the time stamp
+        if (ns_last == 0)
+            continue;
+        // the temperature is accounted for the interval before
+        // the read with millidegree resolution
+        std::uint64_t ms=(ns_now - ns_last + 500000)/1000000;
+        p->add(v*1e-3, ms);
+    }
+}
+
+void
+thermal_stats::data::
+to_stream(std::ostream& s, const shm_seg* p, bool short_output)
+{
+    std::uint64_t vt[shm_seg::TEMP_ENTRIES];
+    std::copy(p->begin(), p->end(), std::begin(vt));
+    double sum_ti=std::accumulate(std::begin(vt), std::end(vt), 0.0);
+    double avg=0.0;
+    for (std::size_t i=0; i<shm_seg::TEMP_ENTRIES; ++i)
+        avg += shm_seg::idx_to_temp(i)*vt[i];
+    if (sum_ti > 0.0)
+        avg = avg/sum_ti - shm_seg::temp_step*0.5;
+    double pct_max= sum_ti > 0.0 ? p->above_max_ms()*1e2/sum_ti : 0.0;
+    double pct_crit= sum_ti > 0.0 ? p->above_crit_ms()*1e2/sum_ti : 0.0;
+    s << std::fixed;
+    if (!short_output) {
+        const std::uint32_t cols=3;
+        for (std::uint32_t i=0; i<cols; ++i)
+            s << "========================";
+        s << '\n';
+        s << p->description() << " (" << p->file() << "), time="
+          << std::setprecision(0) << sum_ti*1e-3 << " s\n";
+        for (std::uint32_t i=0; i<cols; ++i) {
+            if (i)
+                s << " | ";
+            s << "  T/C       %   sum % ";
+        }
+        s << '\n';
+        std::size_t vidx[shm_seg::TEMP_ENTRIES];
+        std::size_t cnt=0;
+        for (std::size_t i=shm_seg::TEMP_ENTRIES; i-- > 0; ) {
+            if (vt[i] != 0)
+                vidx[cnt++]=i;
+        }
+        double vspct[shm_seg::TEMP_ENTRIES];
+        double spct=0.0;
+        for (std::size_t k=0; k<cnt; ++k) {
+            spct += vt[vidx[k]]*1e2/sum_ti;
+            vspct[k]=spct;
+        }
+        std::uint32_t lines=(cnt+cols-1)/cols;
+        for (std::uint32_t j=0; j<lines; ++j) {
+            for (std::uint32_t i=0; i<cols; ++i) {
+                std::size_t k=j+lines*i;
+                if (k >= cnt)
+                    continue;
+                std::size_t idx = vidx[k];
+                if (i)
+                    s << "  | ";
+                s << std::setw(5) << std::setprecision(0)
+                  << shm_seg::idx_to_temp(idx) << ' '
+                  << std::setw(7) << std::setprecision(2)
+                  << vt[idx]*1e2/sum_ti << ' '
+                  << std::setw(7) << std::setprecision(2) << vspct[k];
+            }
+            s << '\n';
+        }
+    } else {
+        s << p->description() << ": ";
+    }
+    s << "average temperature: " << std::setprecision(1) << avg
+      << " C, last: " << p->last() << " C, highest: " << p->highest()
+      << " C";
+    if (!std::isnan(p->t_max()))
+        s << ", above max (" << std::setprecision(0) << p->t_max()
+          << " C): " << std::setprecision(2) << pct_max << " %";
+    if (!std::isnan(p->t_crit()))
+        s << ", above crit (" << std::setprecision(0) << p->t_crit()
+          << " C): " << std::setprecision(2) << pct_crit << " %";
+    s << '\n';
+}
+
+std::vector<std::string>
+thermal_stats::data::names()
+    const
+{
+    std::vector<std::string> r;
+    for (const auto* p : _v)
+        r.push_back(shm_seg::name(p->id()));
+    return r;
+}
+
+void
+thermal_stats::data::to_stream(std::ostream& s, bool short_output)
+{
+    for (std::size_t i=0; i<_v.size(); ++i) {
+        to_stream(s, _v[i], short_output);
+    }
+}
+
+void
+thermal_stats::data::
+to_stream(std::ostream& s, const cpu_stats::mark& m, bool short_output)
+{
+    for (std::size_t i=0; i<_v.size(); ++i) {
+        const shm_seg* p=_v[i];
+        std::string n=shm_seg::name(p->id());
+        const void* pm=m.find(n, sizeof(shm_seg));
+        if (pm==nullptr)
+            continue;
+        alignas(shm_seg) char b[sizeof(shm_seg)];
+        m.read_live(b, p, sizeof(shm_seg));
+        shm_seg* d=reinterpret_cast<shm_seg*>(b);
+        (*d) -= *static_cast<const shm_seg*>(pm);
+        // nothing happened since the mark
+        if (std::all_of(d->begin(), d->end(),
+                        [](std::uint64_t v) { return v==0; }))
+            continue;
+        to_stream(s, d, short_output);
+    }
+}
+
+void
+thermal_stats::data::to_writer(cpu_stats::writer& w, const shm_seg* p)
+{
+    double temp_c[shm_seg::TEMP_ENTRIES];
+    for (std::size_t i=0; i<shm_seg::TEMP_ENTRIES; ++i)
+        temp_c[i]=shm_seg::idx_to_temp(i);
+    w.begin("thermal", p->description());
+    w.value("dev", p->dev());
+    w.value("file", p->file());
+    w.value("label", p->label());
+    w.value("t_max_c", p->t_max());
+    w.value("t_crit_c", p->t_crit());
+    w.value("last_c", p->last());
+    w.value("highest_c", p->highest());
+    w.value("above_max_ms", p->above_max_ms());
+    w.value("above_crit_ms", p->above_crit_ms());
+    w.values("temp_c", temp_c, shm_seg::TEMP_ENTRIES);
+    w.values("entries", p->begin(), shm_seg::TEMP_ENTRIES);
+    w.end();
+}
+
+void
+thermal_stats::data::to_writer(cpu_stats::writer& w)
+{
+    for (std::size_t i=0; i<_v.size(); ++i)
+        to_writer(w, _v[i]);
+}
+
+void
+thermal_stats::data::
+to_writer(cpu_stats::writer& w, const cpu_stats::mark& m)
+{
+    for (std::size_t i=0; i<_v.size(); ++i) {
+        const shm_seg* p=_v[i];
+        std::string n=shm_seg::name(p->id());
+        const void* pm=m.find(n, sizeof(shm_seg));
+        if (pm==nullptr)
+            continue;
+        alignas(shm_seg) char b[sizeof(shm_seg)];
+        m.read_live(b, p, sizeof(shm_seg));
+        shm_seg* d=reinterpret_cast<shm_seg*>(b);
+        (*d) -= *static_cast<const shm_seg*>(pm);
+        to_writer(w, d);
+    }
+}
@@ -0,0 +1,157 @@
+//
+//  Copyright (C) 2020-2026  Axel Zeuner
+//
+//  This program is free software; you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation; either version 2 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program; if not, write to the Free Software
+//  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+//
+#include "thermal_stats.h"
+#include "tools.h"
+#include <sstream>
+#include <iomanip>
+#include <cmath>
+#include <cstring>
+#include <algorithm>
+
+constexpr const double thermal_stats::shm_seg::temp_step;
+constexpr const double thermal_stats::shm_seg::inv_temp_step;
+constexpr const double thermal_stats::shm_seg::max_temp;
+
+const char* const thermal_stats::shm_seg::prefix="/cpu_stats_t_sensor_";
+
+std::string
+thermal_stats::shm_seg::name(std::uint32_t id)
+{
+    std::ostringstream s;
+    s << prefix << std::setw(3) << std::setfill('0') << id;
+    return s.str();
+}
+
+thermal_stats::shm_seg::shm_seg(std::uint32_t id, std::uint32_t hwmon,
+                                const std::string& dev,
+                                const std::string& file,
+                                const std::string& label,
+                                double t_max, double t_crit)
+    : _id(id),
+      _hwmon(hwmon),
+      _dev{0},
+      _file{0},
+      _label{0},
+      _t_max(t_max),
+      _t_crit(t_crit),
+      _last(std::nan("")),
+      _highest(std::nan("")),
+      _above_max_ms(0),
+      _above_crit_ms(0),
+      _entries{0}
+{
+    std::strncpy(_dev, dev.c_str(), sizeof(_dev)-1);
+    std::strncpy(_file, file.c_str(), sizeof(_file)-1);
+    std::strncpy(_label, label.c_str(), sizeof(_label)-1);
+}
+
+thermal_stats::shm_seg::~shm_seg()
+{
+    std::string fn=name(_id);
+    tools::shm::unlink(fn);
+}
+
+thermal_stats::shm_seg*
+thermal_stats::shm_seg::create(std::uint32_t id, std::uint32_t hwmon,
+                               const std::string& dev,
+                               const std::string& file,
+                               const std::string& label,
+                               double t_max, double t_crit)
+{
+    std::string fn=name(id);
+    void* addr=tools::shm::create(fn, sizeof(shm_seg), 0644);
+    shm_seg* ret=new (addr) shm_seg(id, hwmon, dev, file, label,
+                                    t_max, t_crit);
+    return ret;
+}
+
+void
+thermal_stats::shm_seg::close(shm_seg* p)
+{
+    p->~shm_seg();
+    tools::shm::unmap(p, sizeof(shm_seg));
+}
+
+const thermal_stats::shm_seg*
+thermal_stats::shm_seg::open(std::uint32_t id)
+{
+    std::string fn=name(id);
+    void* addr=tools::shm::open_ro(fn, sizeof(shm_seg));
+    const shm_seg* ret=reinterpret_cast<const shm_seg*>(addr);
+    return ret;
+}
+
+void
+thermal_stats::shm_seg::close(const shm_seg* p)
+{
+    void* ap=const_cast<shm_seg*>(p);
+    tools::shm::unmap(ap, sizeof(shm_seg));
+}
+
+std::size_t
+thermal_stats::shm_seg::temp_to_idx(double t)
+{
+    double t0=std::floor(t*inv_temp_step);
+    auto i=static_cast<std::size_t>(std::max(t0, 0.0));
+    i=std::min(i, std::size_t(TEMP_ENTRIES)-1);
+    return i;
+}
+
+double
+thermal_stats::shm_seg::idx_to_temp(std::size_t idx)
+{
+    return (1+idx)*temp_step;
+}
+
+std::string
+thermal_stats::shm_seg::description()
+    const
+{
+    std::ostringstream s;
+    s << _dev << ' ';
+    if (_label[0] != 0)
+        s << _label;
+    else
+        s << _file;
+    return s.str();
+}
+
+thermal_stats::shm_seg&
+thermal_stats::shm_seg::operator-=(const shm_seg& r)
+{
+    _above_max_ms -= r._above_max_ms;
+    _above_crit_ms -= r._above_crit_ms;
+    for (std::size_t i=0; i<TEMP_ENTRIES; ++i)
+        _entries[i] -= r._entries[i];
+    return *this;
+}
+
+thermal_stats::shm_seg&
+thermal_stats::shm_seg::add(double t, std::uint64_t ms)
+{
+    _last=t;
+    if (!(t <= _highest))
+        _highest=t;
+    _entries[temp_to_idx(t)] += ms;
+    // comparisons with NaN limits are false
+    if (t >= _t_max)
+        _above_max_ms += ms;
+    if (t >= _t_crit)
+        _above_crit_ms += ms;
+    return *this;
+}
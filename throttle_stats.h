@@ -0,0 +1,386 @@
+//
+//  Copyright (C) 2020-2026  Axel Zeuner
+//
+//  This program is free software; you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation; either version 2 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program; if not, write to the Free Software
+//  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+//
+#if !defined (__THROTTLE_STATS_H__)
+#define __THROTTLE_STATS_H__ 1
+
+#include <tools.h>
+#include <cstdint>
+#include <vector>
+#include <string>
+#include <iosfwd>
+
+namespace cpu_stats {
+    class mark;
+    class writer;
+    class selection;
+}
+
+namespace rapl_stats {
+    class data;
+}
+
+// thermal throttling of the cpus and residency of the packages at
+// their rapl power limits
+namespace throttle_stats {
+
+    struct cpu {
+        // path of the thermal_throttle directory of cpu
+        static
+        std::string path(std::uint32_t cpu);
+        static
+        bool exists(std::uint32_t cpu);
+    };
+
+    // default margin below the power limits counted as at the
+    // limit
+    constexpr const double default_margin=0.05;
+
+    // shared memory segment with the throttling of one cpu
+    class shm_seg {
+        shm_seg(std::uint32_t cpu);
+        ~shm_seg();
+    private:
+        // cpu number
+        std::uint32_t _cpu;
+        // sums of the deltas of the throttle counters
+        std::uint64_t _core_count;
+        std::uint64_t _core_time_ms;
+        std::uint64_t _pkg_count;
+        std::uint64_t _pkg_time_ms;
+        // CLOCK_MONOTONIC milliseconds covered by the sums
+        std::uint64_t _elapsed_ms;
+    public:
+        static
+        const char* const prefix;
+
+        static
+        std::string name(std::uint32_t cpu);
+
+        static
+        shm_seg*
+        create(std::uint32_t cpu);
+
+        static
+        void
+        close(shm_seg* p);
+
+        static
+        const shm_seg*
+        open(std::uint32_t cpu);
+
+        static
+        void
+        close(const shm_seg* p);
+
+        // subtract the sums of r, used for the differences to a mark
+        shm_seg& operator-=(const shm_seg& r);
+
+        const std::uint32_t& cpu() const;
+        const std::uint64_t& core_count() const;
+        const std::uint64_t& core_time_ms() const;
+        const std::uint64_t& pkg_count() const;
+        const std::uint64_t& pkg_time_ms() const;
+        const std::uint64_t& elapsed_ms() const;
+        // add the deltas of one interval
+        shm_seg& add(std::uint64_t core_count, std::uint64_t core_time_ms,
+                     std::uint64_t pkg_count, std::uint64_t pkg_time_ms,
+                     std::uint64_t elapsed_ms);
+    };
+
+    // shared memory segment with the time of a rapl package zone
+    // near its power limits
+    class limit_seg {
+        limit_seg(std::uint32_t pkg, double margin);
+        ~limit_seg();
+    private:
+        // physical package id of the rapl package zone
+        std::uint32_t _pkg;
+        // margin relative to the limits
+        double _margin;
+        // last read long term (PL1) and short term (PL2) limits in
+        // W, NaN if not available
+        double _pl1_w;
+        double _pl2_w;
+        // milliseconds with a power within the margin of or above
+        // the limits
+        std::uint64_t _pl1_ms;
+        std::uint64_t _pl2_ms;
+        // CLOCK_MONOTONIC milliseconds covered by the sums
+        std::uint64_t _elapsed_ms;
+    public:
+        static
+        const char* const prefix;
+
+        static
+        std::string name(std::uint32_t pkg);
+
+        static
+        limit_seg*
+        create(std::uint32_t pkg, double margin);
+
+        static
+        void
+        close(limit_seg* p);
+
+        static
+        const limit_seg*
+        open(std::uint32_t pkg);
+
+        static
+        void
+        close(const limit_seg* p);
+
+        // subtract the sums of r, used for the differences to a mark
+        limit_seg& operator-=(const limit_seg& r);
+
+        const std::uint32_t& pkg() const;
+        const double& margin() const;
+        const double& pl1_w() const;
+        const double& pl2_w() const;
+        const std::uint64_t& pl1_ms() const;
+        const std::uint64_t& pl2_ms() const;
+        const std::uint64_t& elapsed_ms() const;
+        // add an interval of ms milliseconds with the power p_in_w
+        // and the limits pl1_w and pl2_w
+        limit_seg& add(double p_in_w, double pl1_w, double pl2_w,
+                       std::uint64_t ms);
+    };
+
+    class data {
+        std::vector<const shm_seg*> _v;
+        std::vector<const limit_seg*> _vl;
+        struct priv_data {
+            // core_throttle_count, core_throttle_total_time_ms,
+            // package_throttle_count, package_throttle_total_time_ms
+            tools::sys_fs::value_file _f[4];
+            std::uint64_t _last[4];
+            // CLOCK_MONOTONIC time of the last read
+            std::uint64_t _ns;
+            // counters and time of the read of sample()
+            std::uint64_t _s_v[4];
+            std::uint64_t _s_ns;
+        };
+        std::vector<priv_data> _vp;
+        struct priv_limit {
+            // index of the zone in the segments of the rapl data
+            std::size_t _rapl_idx;
+            // the power limit files of PL1 and PL2
+            tools::sys_fs::value_file _pl1;
+            tools::sys_fs::value_file _pl2;
+            std::uint64_t _ns;
+            // limits and time of the read of sample()
+            double _s_pl1;
+            double _s_pl2;
+            std::uint64_t _s_ns;
+        };
+        std::vector<priv_limit> _vpl;
+        bool _create;
+
+        static
+        void
+        to_stream(std::ostream& s, const std::vector<const shm_seg*>& v,
+                  bool short_output);
+        static
+        void
+        to_stream(std::ostream& s, const limit_seg* p);
+        void
+        close();
+        static
+        void
+        to_writer(cpu_stats::writer& w, const shm_seg* p);
+        static
+        void
+        to_writer(cpu_stats::writer& w, const limit_seg* p);
+    public:
+        // the daemon creates the segments for all cpus with
+        // thermal_throttle and for all rapl packages of r, margin is
+        // the relative distance to the limits counted as at the
+        // limit, the client opens the segments of the cpus and
+        // packages in sel or all if sel is nullptr
+        data(bool create, const rapl_stats::data& r,
+             double margin=default_margin,
+             const cpu_stats::selection* sel=nullptr);
+        ~data();
+        data(const data&) = delete;
+        data&
+        operator=(const data& r) = delete;
+        const std::vector<const shm_seg*>&
+        segments() const;
+        const std::vector<const limit_seg*>&
+        limit_segments() const;
+        // the names of the segments and of the limit segments
+        std::vector<std::string>
+        names() const;
+        std::vector<std::string>
+        limit_names() const;
+        // read the throttle counters and the limits, called before
+        // update outside of the update of the segments
+        void
+        sample();
+        // account the last sample and compare the power of the
+        // packages in r with the limits, after r.update()
+        void
+        update(const rapl_stats::data& r);
+        // dump the throttling of the cpus
+        void
+        to_stream(std::ostream& s, bool short_output=false);
+        void
+        to_stream(std::ostream& s, const cpu_stats::mark& m,
+                  bool short_output=false);
+        // write the data to w
+        void
+        to_writer(cpu_stats::writer& w);
+        // write the differences to the data saved in mark m to w
+        void
+        to_writer(cpu_stats::writer& w, const cpu_stats::mark& m);
+        // dump the time at the power limits
+        void
+        limits_to_stream(std::ostream& s);
+        void
+        limits_to_stream(std::ostream& s, const cpu_stats::mark& m);
+        // write the time at the power limits to w
+        void
+        limits_to_writer(cpu_stats::writer& w);
+        // write the differences of the time at the power limits to
+        // mark m to w
+        void
+        limits_to_writer(cpu_stats::writer& w, const cpu_stats::mark& m);
+    };
+}
+
+inline
+const std::uint32_t&
+throttle_stats::shm_seg::cpu()
+    const
+{
+    return _cpu;
+}
+
+inline
+const std::uint64_t&
+throttle_stats::shm_seg::core_count()
+    const
+{
+    return _core_count;
+}
+
+inline
+const std::uint64_t&
+throttle_stats::shm_seg::core_time_ms()
+    const
+{
+    return _core_time_ms;
+}
+
+inline
+const std::uint64_t&
+throttle_stats::shm_seg::pkg_count()
+    const
+{
+    return _pkg_count;
+}
+
+inline
+const std::uint64_t&
+throttle_stats::shm_seg::pkg_time_ms()
+    const
+{
+    return _pkg_time_ms;
+}
+
+inline
+const std::uint64_t&
+throttle_stats::shm_seg::elapsed_ms()
+    const
+{
+    return _elapsed_ms;
+}
+
+inline
+const std::uint32_t&
+throttle_stats::limit_seg::pkg()
+    const
+{
+    return _pkg;
+}
+
+inline
+const double&
+throttle_stats::limit_seg::margin()
+    const
+{
+    return _margin;
+}
+
+inline
+const double&
+throttle_stats::limit_seg::pl1_w()
+    const
+{
+    return _pl1_w;
+}
+
+inline
+const double&
+throttle_stats::limit_seg::pl2_w()
+    const
+{
+    return _pl2_w;
+}
+
+inline
+const std::uint64_t&
+throttle_stats::limit_seg::pl1_ms()
+    const
+{
+    return _pl1_ms;
+}
+
+inline
+const std::uint64_t&
+throttle_stats::limit_seg::pl2_ms()
+    const
+{
+    return _pl2_ms;
+}
+
+inline
+const std::uint64_t&
+throttle_stats::limit_seg::elapsed_ms()
+    const
+{
+    return _elapsed_ms;
+}
+
+inline
+const std::vector<const throttle_stats::shm_seg*>&
+throttle_stats::data::segments()
+    const
+{
+    return _v;
+}
+
+inline
+const std::vector<const throttle_stats::limit_seg*>&
+throttle_stats::data::limit_segments()
+    const
+{
+    return _vl;
+}
+
+#endif
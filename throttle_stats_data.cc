@@ -0,0 +1,471 @@
+//
+//  Copyright (C) 2020-2026  Axel Zeuner
+//
+//  This program is free software; you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation; either version 2 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program; if not, write to the Free Software
+//  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+//
+#include "throttle_stats.h"
+#include "rapl_stats.h"
+#include "cpufreq_stats.h"
+#include "cpu-stats.h"
+#include <iostream>
+#include <iomanip>
+#include <cmath>
+#include <algorithm>
+#include <cstring>
+#include <cstdlib>
+#include <type_traits>
+
+namespace {
+
+    const char* const throttle_files[4]={
+        "core_throttle_count",
+        "core_throttle_total_time_ms",
+        "package_throttle_count",
+        "package_throttle_total_time_ms"
+    };
+
+    // path of the power limit file of the constraint with the name
+    // cn of rapl zone no, empty if the zone has no such constraint
+    std::string
+    constraint(std::uint32_t no, const char* cn)
+    {
+        std::string zp=rapl_stats::pkg::path(no);
+        for (std::uint32_t i=0; ; ++i) {
+            std::string p=zp + "constraint_" + std::to_string(i) + '_';
+            if (!tools::file::exists(p + "name"))
+                break;
+            std::string n=tools::sys_fs::read<std::string>::from(p + "name");
+            while (!n.empty() && (n.back()=='\n' || n.back()==0))
+                n.pop_back();
+            if (n == cn)
+                return p + "power_limit_uw";
+        }
+        return std::string();
+    }
+
+    // power limit in W, NaN if not available or disabled
+    double
+    limit_in_w(tools::sys_fs::value_file& f)
+    {
+        std::uint64_t v;
+        if (!f.valid() || !f.read(v) || v == 0)
+            return std::nan("");
+        return v*1e-6;
+    }
+
+    double
+    pct(std::uint64_t v, std::uint64_t t)
+    {
+        return t != 0 ? v*1e2/t : 0.0;
+    }
+}
+
+throttle_stats::data::data(bool create, const rapl_stats::data& r,
+                           double margin, const cpu_stats::selection* sel)
+    : _v(),
+      _vl(),
+      _vp(),
+      _vpl(),
+      _create(create)
+{
+    try {
+        if (_create) {
+            for (std::uint32_t i=0; cpufreq_stats::cpu::exists(i); ++i) {
+                if (!cpufreq_stats::cpu::online(i) || !cpu::exists(i))
+                    continue;
+                std::string p=cpu::path(i);
+                tools::sys_fs::value_file cc(p + throttle_files[0]);
+                if (!cc.valid())
+                    continue;
+                _v.push_back(shm_seg::create(i));
+                _vp.push_back(priv_data{
+                        {std::move(cc),
+                         tools::sys_fs::value_file(p + throttle_files[1]),
+                         tools::sys_fs::value_file(p + throttle_files[2]),
+                         tools::sys_fs::value_file(p + throttle_files[3])},
+                        {0, 0, 0, 0}, 0, {0, 0, 0, 0}, 0});
+            }
+            const auto& rv=r.segments();
+            for (std::size_t i=0; i<rv.size(); ++i) {
+                const rapl_stats::shm_seg* rp=rv[i];
+                // psys has limits too but is no package
+                if (!rp->is_package())
+                    continue;
+                std::string pl1=constraint(rp->pkg(), "long_term");
+                std::string pl2=constraint(rp->pkg(), "short_term");
+                if (pl1.empty() && pl2.empty())
+                    continue;
+                // the segments are named by the physical package id
+                std::uint32_t id=rp->package_id();
+                _vl.push_back(limit_seg::create(id, margin));
+                _vpl.push_back(priv_limit{
+                        i,
+                        tools::sys_fs::value_file(pl1),
+                        tools::sys_fs::value_file(pl2),
+                        0, 0.0, 0.0, 0});
+            }
+        } else {
+            std::string pf(shm_seg::prefix);
+            for (const auto& n : cpu_stats::segments(pf)) {
+                std::uint32_t id=std::strtoul(n.c_str()+pf.size(),
+                                              nullptr, 10);
+                if (sel != nullptr && !sel->cpu(id))
+                    continue;
+                try {
+                    _v.push_back(shm_seg::open(id));
+                }
+                catch (const std::runtime_error& e) {
+                    // listed in the index but not accessible, i.e. not
+                    // bound into a container
+                    continue;
+                }
+            }
+            std::string lf(limit_seg::prefix);
+            for (const auto& n : cpu_stats::segments(lf)) {
+                std::uint32_t id=std::strtoul(n.c_str()+lf.size(),
+                                              nullptr, 10);
+                if (sel != nullptr && !sel->pkg(id))
+                    continue;
+                try {
+                    _vl.push_back(limit_seg::open(id));
+                }
+                catch (const std::runtime_error& e) {
+                    // listed in the index but not accessible, i.e. not
+                    // bound into a container
+                    continue;
+                }
+            }
+        }
+    }
+    catch (const std::runtime_error& e) {
+        close();
+        throw;
+    }
+}
+
+void
+throttle_stats::data::close()
+{
+    if (_create==true) {
+        for (std::size_t i=0; i<_v.size(); ++i) {
+            shm_seg* p=const_cast<shm_seg*>(_v[i]);
+            shm_seg::close(p);
+        }
+        for (std::size_t i=0; i<_vl.size(); ++i) {
+            limit_seg* p=const_cast<limit_seg*>(_vl[i]);
+            limit_seg::close(p);
+        }
+    } else {
+        for (std::size_t i=0; i<_v.size(); ++i) {
+            shm_seg::close(_v[i]);
+        }
+        for (std::size_t i=0; i<_vl.size(); ++i) {
+            limit_seg::close(_vl[i]);
+        }
+    }
+    _v.clear();
+    _vl.clear();
+}
+
+throttle_stats::data::~data()
+{
+    close();
+}
+
+void
+throttle_stats::data::sample()
+{
+    if (_create == false)
+        return;
+    for (std::size_t i=0; i<_v.size(); ++i) {
+        priv_data& pd=_vp[i];
+        for (std::size_t j=0; j<4; ++j) {
+            // missing package counters stay at zero
+            if (!pd._f[j].valid() || !pd._f[j].read(pd._s_v[j]))
+                pd._s_v[j]=pd._last[j];
+        }
+        pd._s_ns=tools::monotonic_ns();
+    }
+    for (std::size_t i=0; i<_vl.size(); ++i) {
+        priv_limit& pl=_vpl[i];
+        // the limits may be changed at runtime
+        pl._s_pl1=limit_in_w(pl._pl1);
+        pl._s_pl2=limit_in_w(pl._pl2);
+        pl._s_ns=tools::monotonic_ns();
+    }
+}
+
+void
+throttle_stats::data::update(const rapl_stats::data& r)
+{
+    if (_create == false)
+        return;
+    for (std::size_t i=0; i<_v.size(); ++i) {
+        shm_seg* p=const_cast<shm_seg*>(_v[i]);
+        priv_data& pd=_vp[i];
+        const std::uint64_t* v=pd._s_v;
+        std::uint64_t ns_now=pd._s_ns;
+        std::uint64_t ns_last=pd._ns;
+        if (ns_now == ns_last)
+            continue;
+        pd._ns=ns_now;
+        std::uint64_t d[4];
+        for (std::size_t j=0; j<4; ++j) {
+            d[j]=v[j]-pd._last[j];
+            pd._last[j]=v[j];
+        }
+        // the first read only initializes the counters
+        if (ns_last == 0)
+            continue;
+        std::uint64_t ms=(ns_now - ns_last + 500000)/1000000;
+        p->add(d[0], d[1], d[2], d[3], ms);
+    }
+    const auto& rv=r.segments();
+    for (std::size_t i=0; i<_vl.size(); ++i) {
+        limit_seg* p=const_cast<limit_seg*>(_vl[i]);
+        priv_limit& pl=_vpl[i];
+        double pl1=pl._s_pl1;
+        double pl2=pl._s_pl2;
+        std::uint64_t ns_now=pl._s_ns;
+        std::uint64_t ns_last=pl._ns;
+        if (ns_now == ns_last)
+            continue;
+        pl._ns=ns_now;
+        if (ns_last == 0)
+            continue;
+        std::uint64_t ms=(ns_now - ns_last + 500000)/1000000;
+        // the power of the package over the last rapl interval
+        p->add(rv[pl._rapl_idx]->power(), pl1, pl2, ms);
+    }
+}
+
+void
+throttle_stats::data::
+to_stream(std::ostream& s, const std::vector<const shm_seg*>& v,
+          bool short_output)
+{
+    if (v.empty())
+        return;
+    std::uint64_t core_cnt=0, pkg_cnt=0;
+    double core_sum=0.0, core_max=0.0, pkg_max=0.0;
+    std::uint32_t core_max_cpu=0;
+    s << std::fixed;
+    for (std::size_t i=0; i<v.size(); ++i) {
+        const shm_seg* p=v[i];
+        double cp=pct(p->core_time_ms(), p->elapsed_ms());
+        double pp=pct(p->pkg_time_ms(), p->elapsed_ms());
+        core_cnt += p->core_count();
+        pkg_cnt = std::max(pkg_cnt, p->pkg_count());
+        core_sum += cp;
+        if (cp > core_max) {
+            core_max=cp;
+            core_max_cpu=p->cpu();
+        }
+        pkg_max=std::max(pkg_max, pp);
+        if (short_output)
+            continue;
+        s << "cpu " << std::setw(3) << p->cpu()
+          << ": time throttled: core " << std::setprecision(2)
+          << std::setw(6) << cp << " % (" << p->core_count()
+          << " events), package " << std::setw(6) << pp << " % ("
+          << p->pkg_count() << " events)\n";
+    }
+    s << "all cpus: time throttled: core " << std::setprecision(2)
+      << core_sum/v.size() << " % (max " << core_max << " % on cpu "
+      << core_max_cpu << ", " << core_cnt << " events), package "
+      << pkg_max << " % (" << pkg_cnt << " events)\n";
+}
+
+std::vector<std::string>
+throttle_stats::data::names()
+    const
+{
+    std::vector<std::string> r;
+    for (const auto* p : _v)
+        r.push_back(shm_seg::name(p->cpu()));
+    return r;
+}
+
+std::vector<std::string>
+throttle_stats::data::limit_names()
+    const
+{
+    std::vector<std::string> r;
+    for (const auto* p : _vl)
+        r.push_back(limit_seg::name(p->pkg()));
+    return r;
+}
+
+void
+throttle_stats::data::to_stream(std::ostream& s, bool short_output)
+{
+    to_stream(s, _v, short_output);
+}
+
+void
+throttle_stats::data::
+to_stream(std::ostream& s, const cpu_stats::mark& m, bool short_output)
+{
+    // aligned copies of the segments for the differences to the mark
+    using buf_t=std::aligned_storage<sizeof(shm_seg),
+                                     alignof(shm_seg)>::type;
+    std::vector<buf_t> b(_v.size());
+    std::vector<const shm_seg*> v;
+    for (std::size_t i=0; i<_v.size(); ++i) {
+        const shm_seg* p=_v[i];
+        std::string n=shm_seg::name(p->cpu());
+        const void* pm=m.find(n, sizeof(shm_seg));
+        if (pm==nullptr)
+            continue;
+        m.read_live(&b[i], p, sizeof(shm_seg));
+        shm_seg* d=reinterpret_cast<shm_seg*>(&b[i]);
+        (*d) -= *static_cast<const shm_seg*>(pm);
+        // nothing happened since the mark
+        if (d->elapsed_ms()==0)
+            continue;
+        v.push_back(d);
+    }
+    to_stream(s, v, short_output);
+}
+
+void
+throttle_stats::data::to_stream(std::ostream& s, const limit_seg* p)
+{
+    s << std::fixed;
+    s << "rapl package " << p->pkg() << ": time at power limit (margin "
+      << std::setprecision(0) << p->margin()*1e2 << " %):";
+    const char* sep=" ";
+    if (!std::isnan(p->pl1_w())) {
+        s << sep << "PL1 " << std::setprecision(1) << p->pl1_w() << " W: "
+          << std::setprecision(2) << pct(p->pl1_ms(), p->elapsed_ms())
+          << " %";
+        sep=", ";
+    }
+    if (!std::isnan(p->pl2_w()))
+        s << sep << "PL2 " << std::setprecision(1) << p->pl2_w() << " W: "
+          << std::setprecision(2) << pct(p->pl2_ms(), p->elapsed_ms())
+          << " %";
+    s << '\n';
+}
+
+void
+throttle_stats::data::limits_to_stream(std::ostream& s)
+{
+    for (std::size_t i=0; i<_vl.size(); ++i) {
+        to_stream(s, _vl[i]);
+    }
+}
+
+void
+throttle_stats::data::
+limits_to_stream(std::ostream& s, const cpu_stats::mark& m)
+{
+    for (std::size_t i=0; i<_vl.size(); ++i) {
+        const limit_seg* p=_vl[i];
+        std::string n=limit_seg::name(p->pkg());
+        const void* pm=m.find(n, sizeof(limit_seg));
+        if (pm==nullptr)
+            continue;
+        alignas(limit_seg) char b[sizeof(limit_seg)];
+        m.read_live(b, p, sizeof(limit_seg));
+        limit_seg* d=reinterpret_cast<limit_seg*>(b);
+        (*d) -= *static_cast<const limit_seg*>(pm);
+        // nothing happened since the mark
+        if (d->elapsed_ms()==0)
+            continue;
+        to_stream(s, d);
+    }
+}
+
+void
+throttle_stats::data::to_writer(cpu_stats::writer& w, const shm_seg* p)
+{
+    double s=p->elapsed_ms();
+    w.begin("throttle", p->cpu());
+    w.value("elapsed_ms", p->elapsed_ms());
+    w.value("core_count", p->core_count());
+    w.value("core_time_ms", p->core_time_ms());
+    w.value("core_pct", s > 0.0 ? p->core_time_ms()*1e2/s : 0.0);
+    w.value("pkg_count", p->pkg_count());
+    w.value("pkg_time_ms", p->pkg_time_ms());
+    w.value("pkg_pct", s > 0.0 ? p->pkg_time_ms()*1e2/s : 0.0);
+    w.end();
+}
+
+void
+throttle_stats::data::to_writer(cpu_stats::writer& w)
+{
+    for (std::size_t i=0; i<_v.size(); ++i)
+        to_writer(w, _v[i]);
+}
+
+void
+throttle_stats::data::
+to_writer(cpu_stats::writer& w, const cpu_stats::mark& m)
+{
+    for (std::size_t i=0; i<_v.size(); ++i) {
+        const shm_seg* p=_v[i];
+        std::string n=shm_seg::name(p->cpu());
+        const void* pm=m.find(n, sizeof(shm_seg));
+        if (pm==nullptr)
+            continue;
+        alignas(shm_seg) char b[sizeof(shm_seg)];
+        m.read_live(b, p, sizeof(shm_seg));
+        shm_seg* d=reinterpret_cast<shm_seg*>(b);
+        (*d) -= *static_cast<const shm_seg*>(pm);
+        to_writer(w, d);
+    }
+}
+
+void
+throttle_stats::data::to_writer(cpu_stats::writer& w, const limit_seg* p)
+{
+    double s=p->elapsed_ms();
+    w.begin("power_limit", p->pkg());
+    w.value("margin", p->margin());
+    w.value("pl1_w", p->pl1_w());
+    w.value("pl2_w", p->pl2_w());
+    w.value("elapsed_ms", p->elapsed_ms());
+    w.value("pl1_ms", p->pl1_ms());
+    w.value("pl1_pct", s > 0.0 ? p->pl1_ms()*1e2/s : 0.0);
+    w.value("pl2_ms", p->pl2_ms());
+    w.value("pl2_pct", s > 0.0 ? p->pl2_ms()*1e2/s : 0.0);
+    w.end();
+}
+
+void
+throttle_stats::data::limits_to_writer(cpu_stats::writer& w)
+{
+    for (std::size_t i=0; i<_vl.size(); ++i)
+        to_writer(w, _vl[i]);
+}
+
+void
+throttle_stats::data::
+limits_to_writer(cpu_stats::writer& w, const cpu_stats::mark& m)
+{
+    for (std::size_t i=0; i<_vl.size(); ++i) {
+        const limit_seg* p=_vl[i];
+        std::string n=limit_seg::name(p->pkg());
+        const void* pm=m.find(n, sizeof(limit_seg));
+        if (pm==nullptr)
+            continue;
+        alignas(limit_seg) char b[sizeof(limit_seg)];
+        m.read_live(b, p, sizeof(limit_seg));
+        limit_seg* d=reinterpret_cast<limit_seg*>(b);
+        (*d) -= *static_cast<const limit_seg*>(pm);
+        to_writer(w, d);
+    }
+}
@@ -0,0 +1,190 @@
+//
+//  Copyright (C) 2020-2026  Axel Zeuner
+//
+//  This program is free software; you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation; either version 2 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program; if not, write to the Free Software
+//  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+//
+#include "throttle_stats.h"
+#include "tools.h"
+#include <sstream>
+#include <iomanip>
+#include <cmath>
+
+const char* const throttle_stats::shm_seg::prefix="/cpu_stats_x_cpu_";
+
+std::string
+throttle_stats::shm_seg::name(std::uint32_t cpu)
+{
+    std::ostringstream s;
+    s << prefix << std::setw(3) << std::setfill('0') << cpu;
+    return s.str();
+}
+
+throttle_stats::shm_seg::shm_seg(std::uint32_t cpu)
+    : _cpu(cpu),
+      _core_count(0),
+      _core_time_ms(0),
+      _pkg_count(0),
+      _pkg_time_ms(0),
+      _elapsed_ms(0)
+{
+}
+
+throttle_stats::shm_seg::~shm_seg()
+{
+    std::string fn=name(_cpu);
+    tools::shm::unlink(fn);
+}
+
+throttle_stats::shm_seg*
+throttle_stats::shm_seg::create(std::uint32_t cpu)
+{
+    std::string fn=name(cpu);
+    void* addr=tools::shm::create(fn, sizeof(shm_seg), 0644);
+    shm_seg* ret=new (addr) shm_seg(cpu);
+    return ret;
+}
+
+void
+throttle_stats::shm_seg::close(shm_seg* p)
+{
+    p->~shm_seg();
+    tools::shm::unmap(p, sizeof(shm_seg));
+}
+
+const throttle_stats::shm_seg*
+throttle_stats::shm_seg::open(std::uint32_t cpu)
+{
+    std::string fn=name(cpu);
+    void* addr=tools::shm::open_ro(fn, sizeof(shm_seg));
+    const shm_seg* ret=reinterpret_cast<const shm_seg*>(addr);
+    return ret;
+}
+
+void
+throttle_stats::shm_seg::close(const shm_seg* p)
+{
+    void* ap=const_cast<shm_seg*>(p);
+    tools::shm::unmap(ap, sizeof(shm_seg));
+}
+
+throttle_stats::shm_seg&
+throttle_stats::shm_seg::operator-=(const shm_seg& r)
+{
+    _core_count -= r._core_count;
+    _core_time_ms -= r._core_time_ms;
+    _pkg_count -= r._pkg_count;
+    _pkg_time_ms -= r._pkg_time_ms;
+    _elapsed_ms -= r._elapsed_ms;
+    return *this;
+}
+
+throttle_stats::shm_seg&
+throttle_stats::shm_seg::add(std::uint64_t core_count,
+                             std::uint64_t core_time_ms,
+                             std::uint64_t pkg_count,
+                             std::uint64_t pkg_time_ms,
+                             std::uint64_t elapsed_ms)
+{
+    _core_count += core_count;
+    _core_time_ms += core_time_ms;
+    _pkg_count += pkg_count;
+    _pkg_time_ms += pkg_time_ms;
+    _elapsed_ms += elapsed_ms;
+    return *this;
+}
+
+const char* const throttle_stats::limit_seg::prefix="/cpu_stats_x_pkg_";
+
+std::string
+throttle_stats::limit_seg::name(std::uint32_t pkg)
+{
+    std::ostringstream s;
+    s << prefix << std::setw(3) << std::setfill('0') << pkg;
+    return s.str();
+}
+
+throttle_stats::limit_seg::limit_seg(std::uint32_t pkg, double margin)
+    : _pkg(pkg),
+      _margin(margin),
+      _pl1_w(std::nan("")),
+      _pl2_w(std::nan("")),
+      _pl1_ms(0),
+      _pl2_ms(0),
+      _elapsed_ms(0)
+{
+}
+
+throttle_stats::limit_seg::~limit_seg()
+{
+    std::string fn=name(_pkg);
+    tools::shm::unlink(fn);
+}
+
+throttle_stats::limit_seg*
+throttle_stats::limit_seg::create(std::uint32_t pkg, double margin)
+{
+    std::string fn=name(pkg);
+    void* addr=tools::shm::create(fn, sizeof(limit_seg), 0644);
+    limit_seg* ret=new (addr) limit_seg(pkg, margin);
+    return ret;
+}
+
+void
+throttle_stats::limit_seg::close(limit_seg* p)
+{
+    p->~limit_seg();
+    tools::shm::unmap(p, sizeof(limit_seg));
+}
+
+const throttle_stats::limit_seg*
+throttle_stats::limit_seg::open(std::uint32_t pkg)
+{
+    std::string fn=name(pkg);
+    void* addr=tools::shm::open_ro(fn, sizeof(limit_seg));
+    const limit_seg* ret=reinterpret_cast<const limit_seg*>(addr);
+    return ret;
+}
+
+void
+throttle_stats::limit_seg::close(const limit_seg* p)
+{
+    void* ap=const_cast<limit_seg*>(p);
+    tools::shm::unmap(ap, sizeof(limit_seg));
+}
+
+throttle_stats::limit_seg&
+throttle_stats::limit_seg::operator-=(const limit_seg& r)
+{
+    _pl1_ms -= r._pl1_ms;
+    _pl2_ms -= r._pl2_ms;
+    _elapsed_ms -= r._elapsed_ms;
+    return *this;
+}
+
+throttle_stats::limit_seg&
+throttle_stats::limit_seg::add(double p_in_w, double pl1_w, double pl2_w,
+                               std::uint64_t ms)
+{
+    _pl1_w=pl1_w;
+    _pl2_w=pl2_w;
+    // comparisons with NaN limits are false
+    double f=1.0-_margin;
+    if (p_in_w >= pl1_w*f)
+        _pl1_ms += ms;
+    if (p_in_w >= pl2_w*f)
+        _pl2_ms += ms;
+    _elapsed_ms += ms;
+    return *this;
+}
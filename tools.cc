@@ -18,8 +18,16 @@
 #include "tools.h"
 #include <sys/mman.h>
 #include <sys/stat.h>
+#include <sys/uio.h>
+#include <climits>
 #include <fcntl.h>
+#include <dirent.h>
+#include <cerrno>
 #include <stdexcept>
+#include <algorithm>
+#include <cstring>
+#include <cstdlib>
+#include <cstdio>
 
 tools::iarraybuf::
 iarraybuf(const char* base, size_t size)
@@ -108,6 +116,98 @@ unlink(const std::string& fname)
     shm_unlink(fname.c_str());
 }
 
+bool
+tools::shm::
+rename(const std::string& from, const std::string& to)
+{
+    // glibc implements posix shared memory in /dev/shm
+    std::string f="/dev/shm" + from;
+    std::string t="/dev/shm" + to;
+    return ::rename(f.c_str(), t.c_str())==0;
+}
+
+std::size_t
+tools::shm::
+size(const std::string& fname)
+{
+    tools::file_handle fd(
+        shm_open(fname.c_str(), O_RDONLY, 0));
+    struct stat st;
+    if (fd()==-1 || fstat(fd(), &st)!=0) {
+        return 0;
+    }
+    return st.st_size;
+}
+
+std::vector<std::string>
+tools::shm::
+list(const std::string& prefix)
+{
+    // glibc implements posix shared memory in /dev/shm
+    std::vector<std::string> r;
+    DIR* d=opendir("/dev/shm");
+    if (d==nullptr)
+        return r;
+    const struct dirent* e;
+    while ((e=readdir(d))!=nullptr) {
+        std::string n=std::string("/") + e->d_name;
+        if (n.compare(0, prefix.length(), prefix)!=0)
+            continue;
+        r.emplace_back(std::move(n));
+    }
+    closedir(d);
+    std::sort(r.begin(), r.end());
+    return r;
+}
+tools::sys_fs::value_file::value_file(const std::string& fn)
+    : _fd(open(fn.c_str(), O_RDONLY|O_CLOEXEC))
+{
+}
+
+bool
+tools::sys_fs::value_file::valid()
+    const
+{
+    return _fd() >= 0;
+}
+
+bool
+tools::sys_fs::value_file::read(std::uint64_t& v)
+{
+    char b[32];
+    ssize_t rs=pread(_fd(), b, sizeof(b)-1, 0);
+    if (rs <= 0)
+        return false;
+    b[rs]=0;
+    char* e;
+    v=std::strtoull(b, &e, 10);
+    return e != b;
+}
+
+bool
+tools::sys_fs::value_file::read(std::int64_t& v)
+{
+    char b[32];
+    ssize_t rs=pread(_fd(), b, sizeof(b)-1, 0);
+    if (rs <= 0)
+        return false;
+    b[rs]=0;
+    char* e;
+    v=std::strtoll(b, &e, 10);
+    return e != b;
+}
+
+ssize_t
+tools::sys_fs::value_file::read(char* b, std::size_t n)
+{
+    ssize_t rs=pread(_fd(), b, n-1, 0);
+    if (rs < 0)
+        return -1;
+    b[rs]=0;
+    return rs;
+}
+
+
 bool
 tools::file::exists(const std::string& fn)
 {
@@ -118,6 +218,67 @@ tools::file::exists(const std::string& fn)
     return r;
 }
 
+tools::proc_stat::proc_stat()
+    : _fd(open("/proc/stat", O_RDONLY|O_CLOEXEC)),
+      _buf(16384),
+      _cpus()
+{
+}
+
+bool
+tools::proc_stat::read()
+{
+    if (_fd() < 0)
+        return false;
+    ssize_t rs;
+    // grow the buffer until the whole file fits
+    while ((rs=pread(_fd(), _buf.data(), _buf.size(), 0)) ==
+           ssize_t(_buf.size())) {
+        _buf.resize(_buf.size()*2);
+    }
+    if (rs <= 0)
+        return false;
+    _buf[rs]=0;
+    for (auto& c : _cpus)
+        c._valid=false;
+    const char* p=_buf.data();
+    const char* e=p + rs;
+    while (p < e) {
+        const char* eol=static_cast<const char*>(std::memchr(p, '\n', e-p));
+        if (eol==nullptr)
+            eol=e;
+        // cpuN lines only, the first line contains the sums
+        if (eol-p > 4 && p[0]=='c' && p[1]=='p' && p[2]=='u' &&
+            p[3]>='0' && p[3]<='9') {
+            char* q;
+            std::uint64_t cpu=std::strtoull(p+3, &q, 10);
+            std::uint64_t v[10]={0};
+            for (std::size_t i=0; i<10 && q<eol; ++i)
+                v[i]=std::strtoull(q, &q, 10);
+            if (cpu >= _cpus.size())
+                _cpus.resize(cpu+1, cpu_times{});
+            cpu_times& c=_cpus[cpu];
+            c._user=v[0];
+            c._nice=v[1];
+            c._system=v[2];
+            c._idle=v[3];
+            c._iowait=v[4];
+            c._irq=v[5];
+            c._softirq=v[6];
+            c._steal=v[7];
+            c._guest=v[8];
+            c._guest_nice=v[9];
+            c._valid=true;
+        } else if (eol-p > 4 && p[0]=='i' && p[1]=='n' && p[2]=='t' &&
+                   p[3]==' ') {
+            // the cpu lines are followed by intr
+            break;
+        }
+        p=eol+1;
+    }
+    return true;
+}
+
 std::string
 tools::sys_fs::read<std::string>::from(const std::string& fn)
 {
@@ -143,3 +304,99 @@ tools::sys_fs::read<std::string>::from(const std::string& fn)
     return r;
 }
 
+
+bool
+tools::file::make_dir(const std::string& dn, mode_t m)
+{
+    if (mkdir(dn.c_str(), m)==0 || errno==EEXIST)
+        return true;
+    return false;
+}
+
+void*
+tools::file::map(const std::string& fn, std::size_t s, mode_t m)
+{
+    tools::file_handle fd(open(fn.c_str(), O_RDWR|O_CREAT|O_CLOEXEC, m));
+    if (fd()==-1) {
+        std::string msg="could not open " + fn;
+        throw std::runtime_error(msg);
+    }
+    struct stat st;
+    if (fstat(fd(), &st)!=0 ||
+        (std::size_t(st.st_size)!=s && ftruncate(fd(), s)!=0)) {
+        std::string msg="could not resize " + fn;
+        throw std::runtime_error(msg);
+    }
+    void* addr=mmap(nullptr,
+                    s,
+                    PROT_READ|PROT_WRITE,
+                    MAP_SHARED,
+                    fd(),
+                    0);
+    if (addr==MAP_FAILED) {
+        std::string msg="could not map " + fn;
+        throw std::runtime_error(msg);
+    }
+    return addr;
+}
+
+const void*
+tools::file::map_ro(const std::string& fn, std::size_t& s)
+{
+    tools::file_handle fd(open(fn.c_str(), O_RDONLY|O_CLOEXEC));
+    struct stat st;
+    if (fd()==-1 || fstat(fd(), &st)!=0 || st.st_size==0) {
+        std::string msg="could not open " + fn;
+        throw std::runtime_error(msg);
+    }
+    s=st.st_size;
+    void* addr=mmap(nullptr,
+                    s,
+                    PROT_READ,
+                    MAP_SHARED,
+                    fd(),
+                    0);
+    if (addr==MAP_FAILED) {
+        std::string msg="could not map " + fn;
+        throw std::runtime_error(msg);
+    }
+    return addr;
+}
+
+void
+tools::file::unmap(const void* p, std::size_t s)
+{
+    munmap(const_cast<void*>(p), s);
+}
+
+bool
+tools::file::write(int fd, const std::vector<std::string>& v)
+{
+    std::vector<struct iovec> iov;
+    iov.reserve(v.size());
+    for (const auto& c : v) {
+        if (!c.empty())
+            iov.push_back(iovec{const_cast<char*>(c.data()), c.size()});
+    }
+    std::size_t i=0;
+    while (i < iov.size()) {
+        int n=std::min(iov.size()-i, std::size_t(IOV_MAX));
+        ssize_t r=::writev(fd, iov.data()+i, n);
+        if (r < 0) {
+            if (errno==EINTR)
+                continue;
+            return false;
+        }
+        // skip the written chunks, continue after short writes
+        std::size_t w=r;
+        while (i < iov.size() && w >= iov[i].iov_len) {
+            w -= iov[i].iov_len;
+            ++i;
+        }
+        if (w != 0) {
+            iov[i].iov_base=static_cast<char*>(iov[i].iov_base) + w;
+            iov[i].iov_len -= w;
+        }
+    }
+    return true;
+}
@@ -23,13 +23,20 @@
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <unistd.h>
+#include <time.h>
 #include <cstddef>
+#include <cstdint>
 #include <string>
+#include <vector>
 #include <streambuf>
 #include <istream>
 
 namespace tools {
 
+    // current value of CLOCK_MONOTONIC in nanoseconds
+    std::uint64_t
+    monotonic_ns();
+
     // block all signals in the current scope
     class block_signals {
         sigset_t _old;
@@ -95,13 +102,81 @@ namespace tools {
         // delete file name
         void
         unlink(const std::string& fname);
+        // replace the shared memory posix file to atomically by
+        // from, returns false on errors
+        bool
+        rename(const std::string& from, const std::string& to);
+        // size of the shared memory posix file fname, 0 if it does
+        // not exist
+        std::size_t
+        size(const std::string& fname);
+        // names of all shared memory posix files starting with
+        // prefix, prefix and names start with a slash
+        std::vector<std::string>
+        list(const std::string& prefix);
     };
 
     namespace file {
         bool
         exists(const std::string& fn);
+        // create directory dn if it does not exist
+        bool
+        make_dir(const std::string& dn, mode_t m=0755);
+        // open or create the file fn with size s and mode m and
+        // map it into memory
+        void*
+        map(const std::string& fn, std::size_t s, mode_t m=0644);
+        // open the file fn and map it read only into memory, returns
+        // the size of the file in s
+        const void*
+        map_ro(const std::string& fn, std::size_t& s);
+        // unmap p
+        void
+        unmap(const void* p, std::size_t s);
+        // write the chunks v to fd, with one writev if possible
+        bool
+        write(int fd, const std::vector<std::string>& v);
     }
 
+    // reads /proc/stat with one read into a reused buffer and parses
+    // the cpuN lines
+    class proc_stat {
+    public:
+        // jiffies of one cpu
+        struct cpu_times {
+            std::uint64_t _user;
+            std::uint64_t _nice;
+            std::uint64_t _system;
+            std::uint64_t _idle;
+            std::uint64_t _iowait;
+            std::uint64_t _irq;
+            std::uint64_t _softirq;
+            std::uint64_t _steal;
+            std::uint64_t _guest;
+            std::uint64_t _guest_nice;
+            // false if the cpu was not found, i.e. it is offline
+            bool _valid;
+            // time spent running code on the cpu
+            std::uint64_t busy() const;
+            // busy, idle, iowait and steal time
+            std::uint64_t total() const;
+        };
+    private:
+        file_handle _fd;
+        std::vector<char> _buf;
+        std::vector<cpu_times> _cpus;
+    public:
+        proc_stat();
+        proc_stat(const proc_stat&) = delete;
+        proc_stat& operator=(const proc_stat&) = delete;
+        // read and parse /proc/stat, returns false on errors
+        bool
+        read();
+        // the times of all cpus, indexed by the cpu number
+        const std::vector<cpu_times>&
+        cpus() const;
+    };
+
     namespace sys_fs {
         // helper struct to read<_T>::from files
         template <typename _T>
@@ -117,9 +192,36 @@ namespace tools {
             std::string
             from(const std::string& fn);
         };
+
+        // sysfs or procfs file kept open between the reads, every
+        // read is a single pread
+        class value_file {
+            file_handle _fd;
+        public:
+            value_file(const std::string& fn);
+            value_file(value_file&& r) = default;
+            value_file& operator=(value_file&& r) = default;
+            // true if the file could be opened
+            bool valid() const;
+            // read the value, returns false on errors
+            bool read(std::uint64_t& v);
+            bool read(std::int64_t& v);
+            // read at most n-1 bytes of the contents into b and
+            // terminate them by 0, returns the length or -1 on errors
+            ssize_t read(char* b, std::size_t n);
+        };
     }
 }
 
+inline
+std::uint64_t
+tools::monotonic_ns()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return std::uint64_t(ts.tv_sec)*1000000000ULL + ts.tv_nsec;
+}
+
 inline
 tools::block_signals::block_signals()
 {
@@ -190,6 +292,31 @@ tools::file_handle::operator()() const
     return _fd;
 }
 
+inline
+std::uint64_t
+tools::proc_stat::cpu_times::busy()
+    const
+{
+    // guest time is contained in user time
+    return _user + _nice + _system + _irq + _softirq;
+}
+
+inline
+std::uint64_t
+tools::proc_stat::cpu_times::total()
+    const
+{
+    return busy() + _idle + _iowait + _steal;
+}
+
+inline
+const std::vector<tools::proc_stat::cpu_times>&
+tools::proc_stat::cpus()
+    const
+{
+    return _cpus;
+}
+
 template <typename _T>
 _T
 tools::sys_fs::read<_T>::from(const std::string& fn)
@@ -0,0 +1,354 @@
+//
+//  Copyright (C) 2020-2026  Axel Zeuner
+//
+//  This program is free software; you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation; either version 2 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program; if not, write to the Free Software
+//  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+//
+#if !defined (__TOPO_STATS_H__)
+#define __TOPO_STATS_H__ 1
+
+#include <tools.h>
+#include <cpufreq_stats.h>
+#include <cstdint>
+#include <vector>
+#include <string>
+#include <iosfwd>
+
+namespace cpu_stats {
+    class mark;
+    class selection;
+    class writer;
+}
+
+namespace rapl_stats {
+    struct data;
+}
+
+namespace topo_stats {
+
+    // kinds of the aggregates over groups of cpus
+    enum kind : std::uint32_t {
+        SYSTEM,
+        PACKAGE,
+        DIE,
+        NODE,
+        CORE_TYPE,
+        CORE,
+        KINDS
+    };
+
+    // short name of k used in the names of the segments
+    const char*
+    kind_name(kind k);
+
+    // position of a group of cpus in the topology, members are
+    // mixed if the cpus of the group differ in them
+    struct location {
+        static
+        constexpr const std::uint32_t mixed=UINT32_MAX;
+        std::uint32_t _pkg;
+        std::uint32_t _die;
+        std::uint32_t _core;
+        std::uint32_t _node;
+        std::uint32_t _capacity;
+    };
+
+    // shared memory segment with the frequency histogram summed
+    // over the cpus of one group, the sums of the per cpu
+    // histograms of cpufreq_stats
+    class shm_seg {
+        shm_seg(kind k, std::uint32_t id, const location& l,
+                std::uint32_t cpus, std::uint32_t rapl);
+        ~shm_seg();
+    public:
+        enum {
+            FREQ_ENTRIES=cpufreq_stats::shm_seg::FREQ_ENTRIES
+        };
+        // no rapl package zone
+        static
+        constexpr const std::uint32_t no_rapl=UINT32_MAX;
+    private:
+        kind _kind;
+        // number of the group within its kind
+        std::uint32_t _id;
+        location _loc;
+        // number of cpus in the group
+        std::uint32_t _cpus;
+        // rapl package zone of the package, no_rapl for other kinds
+        std::uint32_t _rapl;
+        // average of the last measured frequencies
+        double _last_f_khz;
+        // energy since the start and power of the last interval of
+        // the rapl zone
+        double _joule;
+        double _last_power;
+        // sum of the frequency transitions of the cpus
+        std::uint64_t _transitions;
+        // sums of the ticks/freq range of the cpus
+        std::uint64_t _entries[FREQ_ENTRIES];
+        // sums of the busy weighted ticks/freq range of the cpus
+        std::uint64_t _busy_entries[FREQ_ENTRIES];
+    public:
+        static
+        const char* const prefix;
+
+        static
+        std::string name(kind k, std::uint32_t id);
+
+        static
+        shm_seg*
+        create(kind k, std::uint32_t id, const location& l,
+               std::uint32_t cpus, std::uint32_t rapl);
+
+        static
+        void
+        close(shm_seg* p);
+
+        // open the segment with the name n
+        static
+        const shm_seg*
+        open(const std::string& n);
+
+        static
+        void
+        close(const shm_seg* p);
+
+        // subtract the entries of r, used for the differences
+        // to a mark
+        shm_seg& operator-=(const shm_seg& r);
+
+        const kind& knd() const;
+        const std::uint32_t& id() const;
+        const location& loc() const;
+        const std::uint32_t& cpus() const;
+        const std::uint32_t& rapl() const;
+        shm_seg& last_f_khz(const double& f);
+        const double& last_f_khz() const;
+        shm_seg& joule(const double& j);
+        const double& joule() const;
+        shm_seg& last_power(const double& p);
+        const double& last_power() const;
+        shm_seg& transitions(const std::uint64_t& n);
+        const std::uint64_t& transitions() const;
+        std::uint64_t* begin();
+        const std::uint64_t* begin() const;
+        std::uint64_t* busy_begin();
+        const std::uint64_t* busy_begin() const;
+    };
+
+    class data {
+        std::vector<const shm_seg*> _v;
+        // the segment indices of every cpu, -1 if the cpu does not
+        // belong to a group of a kind
+        std::vector<std::int32_t> _cpu_seg;
+        // index of the rapl package zone of every segment, -1 if
+        // the segment is not a package or has no rapl zone
+        std::vector<std::int32_t> _rapl_idx;
+        // transitions of every cpu at the last update
+        std::vector<std::uint64_t> _last_trans;
+        // sum of the last frequencies and number of cpus per segment
+        std::vector<double> _f_sum;
+        std::vector<std::uint32_t> _f_cnt;
+        bool _create;
+
+        static
+        void
+        to_stream(std::ostream& s, const shm_seg* p, bool short_output);
+        static
+        void
+        to_writer(cpu_stats::writer& w, const shm_seg* p);
+    public:
+        // the daemon reads the topology of the cpus and creates the
+        // segments of all groups, the packages are mapped to the rapl
+        // package zones in r. The client opens the segments of all
+        // groups or of the groups in the packages in sel.
+        data(bool create, const rapl_stats::data& r,
+             const cpu_stats::selection* sel=nullptr);
+        ~data();
+        data(const data&) = delete;
+        data&
+        operator=(const data& r) = delete;
+        // the segments
+        const std::vector<const shm_seg*>&
+        segments() const;
+        // the names of the segments
+        std::vector<std::string>
+        names() const;
+        // add the last samples of f, sampled at the same tick, to
+        // the groups of the cpus
+        void
+        update(std::uint32_t weight, const rapl_stats::data& r,
+               const cpufreq_stats::data& f);
+        // dump the data
+        void
+        to_stream(std::ostream& s, bool short_output=false);
+        // dump the differences to the data saved in mark m
+        void
+        to_stream(std::ostream& s, const cpu_stats::mark& m,
+                  bool short_output=false);
+        // write the data to w
+        void
+        to_writer(cpu_stats::writer& w);
+        // write the differences to the data saved in mark m to w
+        void
+        to_writer(cpu_stats::writer& w, const cpu_stats::mark& m);
+    };
+}
+
+inline
+const topo_stats::kind&
+topo_stats::shm_seg::knd()
+    const
+{
+    return _kind;
+}
+
+inline
+const std::uint32_t&
+topo_stats::shm_seg::id()
+    const
+{
+    return _id;
+}
+
+inline
+const topo_stats::location&
+topo_stats::shm_seg::loc()
+    const
+{
+    return _loc;
+}
+
+inline
+const std::uint32_t&
+topo_stats::shm_seg::cpus()
+    const
+{
+    return _cpus;
+}
+
+inline
+const std::uint32_t&
+topo_stats::shm_seg::rapl()
+    const
+{
+    return _rapl;
+}
+
+inline
+topo_stats::shm_seg&
+topo_stats::shm_seg::last_f_khz(const double& v)
+{
+    _last_f_khz=v;
+    return *this;
+}
+
+inline
+const double&
+topo_stats::shm_seg::last_f_khz()
+    const
+{
+    return _last_f_khz;
+}
+
+inline
+topo_stats::shm_seg&
+topo_stats::shm_seg::joule(const double& v)
+{
+    _joule=v;
+    return *this;
+}
+
+inline
+const double&
+topo_stats::shm_seg::joule()
+    const
+{
+    return _joule;
+}
+
+inline
+topo_stats::shm_seg&
+topo_stats::shm_seg::last_power(const double& v)
+{
+    _last_power=v;
+    return *this;
+}
+
+inline
+const double&
+topo_stats::shm_seg::last_power()
+    const
+{
+    return _last_power;
+}
+
+inline
+topo_stats::shm_seg&
+topo_stats::shm_seg::transitions(const std::uint64_t& v)
+{
+    _transitions=v;
+    return *this;
+}
+
+inline
+const std::uint64_t&
+topo_stats::shm_seg::transitions()
+    const
+{
+    return _transitions;
+}
+
+inline
+std::uint64_t*
+topo_stats::shm_seg::begin()
+{
+    return _entries;
+}
+
+inline
+const std::uint64_t*
+topo_stats::shm_seg::begin()
+    const
+{
+    return _entries;
+}
+
+inline
+std::uint64_t*
+topo_stats::shm_seg::busy_begin()
+{
+    return _busy_entries;
+}
+
+inline
+const std::uint64_t*
+topo_stats::shm_seg::busy_begin()
+    const
+{
+    return _busy_entries;
+}
+
+inline
+const std::vector<const topo_stats::shm_seg*>&
+topo_stats::data::segments()
+    const
+{
+    return _v;
+}
+
+// Local variables:
+// mode: c++
+// end:
+#endif
@@ -0,0 +1,432 @@
+//
+//  Copyright (C) 2020-2026  Axel Zeuner
+//
+//  This program is free software; you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation; either version 2 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program; if not, write to the Free Software
+//  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+//
+#include "topo_stats.h"
+#include "rapl_stats.h"
+#include "cpu-stats.h"
+#include <iostream>
+#include <iomanip>
+#include <algorithm>
+#include <array>
+#include <map>
+#include <cstring>
+
+namespace {
+
+    // the key of the group of a cpu within a kind
+    using key=std::array<std::uint32_t, 3>;
+
+    struct group {
+        std::uint32_t _id;
+        topo_stats::location _loc;
+        std::uint32_t _cpus;
+    };
+
+    // merge the location of a cpu into the location of its group
+    void
+    merge(topo_stats::location& g, const topo_stats::location& c)
+    {
+        const std::uint32_t mx=topo_stats::location::mixed;
+        if (g._pkg != c._pkg)
+            g._pkg=mx;
+        if (g._die != c._die)
+            g._die=mx;
+        if (g._core != c._core)
+            g._core=mx;
+        if (g._node != c._node)
+            g._node=mx;
+        if (g._capacity != c._capacity)
+            g._capacity=mx;
+    }
+}
+
+topo_stats::data::data(bool create, const rapl_stats::data& r,
+                       const cpu_stats::selection* sel)
+    : _v(), _cpu_seg(), _rapl_idx(), _last_trans(), _f_sum(), _f_cnt(),
+      _create(create)
+{
+    try {
+        if (_create) {
+            std::vector<location> cl;
+            for (std::uint32_t i=0; cpufreq_stats::cpu::exists(i); ++i) {
+                location l;
+                l._pkg=cpufreq_stats::cpu::package_id(i);
+                l._die=cpufreq_stats::cpu::die_id(i);
+                l._core=cpufreq_stats::cpu::core_id(i);
+                l._node=cpufreq_stats::cpu::node(i);
+                l._capacity=cpufreq_stats::cpu::capacity(i);
+                cl.push_back(l);
+            }
+            // the groups of every kind ordered by their keys
+            std::map<key, group> g[KINDS];
+            std::vector<key> ck(cl.size()*KINDS);
+            for (std::size_t i=0; i<cl.size(); ++i) {
+                const location& l=cl[i];
+                key* k=&ck[i*KINDS];
+                k[SYSTEM]=key{0, 0, 0};
+                k[PACKAGE]=key{l._pkg, 0, 0};
+                k[DIE]=key{l._pkg, l._die, 0};
+                k[NODE]=key{l._node, 0, 0};
+                k[CORE_TYPE]=key{l._capacity, 0, 0};
+                k[CORE]=key{l._pkg, l._die, l._core};
+                for (std::uint32_t j=0; j<KINDS; ++j) {
+                    auto ins=g[j].emplace(k[j], group{0, l, 0});
+                    group& gi=ins.first->second;
+                    merge(gi._loc, l);
+                    ++gi._cpus;
+                }
+            }
+            // dies, nodes and core types equal to the packages or to
+            // the system are not repeated
+            bool skip[KINDS]={false};
+            skip[DIE]= g[DIE].size()==g[PACKAGE].size();
+            skip[NODE]= g[NODE].size()<2;
+            skip[CORE_TYPE]= g[CORE_TYPE].size()<2;
+            const auto& rv=r.segments();
+            for (std::uint32_t j=0; j<KINDS; ++j) {
+                if (skip[j])
+                    continue;
+                std::uint32_t id=0;
+                for (auto& e : g[j]) {
+                    group& gi=e.second;
+                    gi._id=_v.size();
+                    std::int32_t ri=-1;
+                    std::uint32_t rapl=shm_seg::no_rapl;
+                    for (std::size_t k=0; j==PACKAGE && k<rv.size(); ++k) {
+                        const rapl_stats::shm_seg* rp=rv[k];
+                        if (rp->is_package() &&
+                            rp->package_id()==gi._loc._pkg) {
+                            ri=k;
+                            rapl=rp->pkg();
+                            break;
+                        }
+                    }
+                    shm_seg* p=shm_seg::create(kind(j), id++, gi._loc,
+                                               gi._cpus, rapl);
+                    _v.push_back(p);
+                    _rapl_idx.push_back(ri);
+                }
+            }
+            _cpu_seg.resize(cl.size()*KINDS);
+            for (std::size_t i=0; i<cl.size(); ++i) {
+                for (std::uint32_t j=0; j<KINDS; ++j) {
+                    _cpu_seg[i*KINDS+j]= skip[j] ?
+                        -1 : std::int32_t(g[j].at(ck[i*KINDS+j])._id);
+                }
+            }
+            _last_trans.resize(cl.size());
+            _f_sum.resize(_v.size());
+            _f_cnt.resize(_v.size());
+        } else {
+            for (const auto& n : cpu_stats::segments(shm_seg::prefix)) {
+                const shm_seg* p;
+                try {
+                    p=shm_seg::open(n);
+                }
+                catch (const std::runtime_error& e) {
+                    // listed in the index but not accessible, i.e. not
+                    // bound into a container
+                    continue;
+                }
+                kind k=p->knd();
+                if (sel != nullptr &&
+                    (k==PACKAGE || k==DIE || k==CORE) &&
+                    !sel->pkg(p->loc()._pkg)) {
+                    shm_seg::close(p);
+                    continue;
+                }
+                _v.push_back(p);
+            }
+            // the names are sorted by the names of the kinds
+            std::stable_sort(_v.begin(), _v.end(),
+                             [](const shm_seg* a, const shm_seg* b) {
+                                 return a->knd() < b->knd();
+                             });
+        }
+    }
+    catch (const std::runtime_error& e) {
+        for (size_t i=0; i<_v.size(); ++i) {
+            if (_create) {
+                shm_seg* p=const_cast<shm_seg*>(_v[i]);
+                shm_seg::close(p);
+            } else {
+                shm_seg::close(_v[i]);
+            }
+        }
+        throw;
+    }
+}
+
+topo_stats::data::~data()
+{
+    if (_create==true) {
+        for (std::size_t i=0; i<_v.size(); ++i) {
+            shm_seg* p=const_cast<shm_seg*>(_v[i]);
+            shm_seg::close(p);
+        }
+    } else {
+        for (std::size_t i=0; i<_v.size(); ++i) {
+            shm_seg::close(_v[i]);
+        }
+    }
+}
+
+void
+topo_stats::data::update(std::uint32_t weight, const rapl_stats::data& r,
+                         const cpufreq_stats::data& f)
+{
+    if (_create == false)
+        return;
+    std::fill(_f_sum.begin(), _f_sum.end(), 0.0);
+    std::fill(_f_cnt.begin(), _f_cnt.end(), 0);
+    const auto& fv=f.segments();
+    const auto& li=f.last_idx();
+    const auto& lb=f.last_busy();
+    std::size_t n=std::min(fv.size(), _last_trans.size());
+    // only the bins of the last samples change
+    for (std::size_t i=0; i<n; ++i) {
+        const cpufreq_stats::shm_seg* fp=fv[i];
+        std::size_t idx=li[i];
+        std::uint64_t busy=lb[i];
+        double fi=fp->last_f_khz();
+        std::uint64_t tr=fp->transitions();
+        std::uint64_t dtr=tr-_last_trans[i];
+        _last_trans[i]=tr;
+        for (std::uint32_t j=0; j<KINDS; ++j) {
+            std::int32_t k=_cpu_seg[i*KINDS+j];
+            if (k < 0)
+                continue;
+            shm_seg* p=const_cast<shm_seg*>(_v[k]);
+            p->begin()[idx] += weight;
+            p->busy_begin()[idx] += busy;
+            if (dtr != 0)
+                p->transitions(p->transitions()+dtr);
+            // offline cpus
+            if (fi > 0.0) {
+                _f_sum[k] += fi;
+                _f_cnt[k] += 1;
+            }
+        }
+    }
+    const auto& rv=r.segments();
+    for (std::size_t i=0; i<_v.size(); ++i) {
+        shm_seg* p=const_cast<shm_seg*>(_v[i]);
+        p->last_f_khz(_f_cnt[i] ? _f_sum[i]/_f_cnt[i] : 0.0);
+        if (_rapl_idx[i] >= 0) {
+            const rapl_stats::shm_seg* rp=rv[_rapl_idx[i]];
+            p->joule(rp->joule());
+            p->last_power(rp->power());
+        }
+    }
+}
+
+namespace {
+
+    void
+    label(std::ostream& s, const topo_stats::shm_seg* p)
+    {
+        const topo_stats::location& l=p->loc();
+        switch (p->knd()) {
+        case topo_stats::SYSTEM:
+            s << "all cpus";
+            break;
+        case topo_stats::PACKAGE:
+            s << "package " << l._pkg;
+            break;
+        case topo_stats::DIE:
+            s << "die " << l._die << " of package " << l._pkg;
+            break;
+        case topo_stats::NODE:
+            s << "numa node " << l._node;
+            break;
+        case topo_stats::CORE_TYPE:
+            s << "cores with capacity " << l._capacity;
+            break;
+        case topo_stats::CORE:
+            s << "core " << l._core << " of package " << l._pkg;
+            if (l._die != 0)
+                s << " die " << l._die;
+            break;
+        default:
+            s << topo_stats::kind_name(p->knd()) << ' ' << p->id();
+            break;
+        }
+    }
+}
+
+void
+topo_stats::data::
+to_stream(std::ostream& s, const shm_seg* p, bool short_output)
+{
+    double sum_ti=0.0, avg=0.0, busy_sum=0.0, busy_avg=0.0;
+    for (std::size_t i=0; i<shm_seg::FREQ_ENTRIES; ++i) {
+        double ti=p->begin()[i];
+        double bi=p->busy_begin()[i];
+        double fi=cpufreq_stats::shm_seg::idx_to_freq(i)*1e-3;
+        sum_ti += ti;
+        avg += ti*fi;
+        busy_sum += bi;
+        busy_avg += bi*fi;
+    }
+    // not sampled, i.e. in virtual machines without frequencies
+    if (sum_ti == 0.0)
+        return;
+    const std::uint32_t cols=3;
+    for (std::uint32_t i=0; i<cols; ++i)
+        s << "========================";
+    s << '\n';
+    label(s, p);
+    s << ": " << p->cpus() << " cpus, samples="
+      << std::scientific << std::setprecision(22) << sum_ti
+      << std::fixed << '\n';
+    s << std::setprecision(0)
+      << "average frequency: ~" << avg/sum_ti
+      << " MHz, last measured frequency: ~" << p->last_f_khz()*1e-3
+      << " MHz\n";
+    if (busy_sum > 0.0) {
+        double busy_pct=(busy_sum*1e2)/
+            (sum_ti*cpufreq_stats::shm_seg::busy_scale);
+        s << "busy weighted average frequency: ~" << busy_avg/busy_sum
+          << " MHz, busy: ~" << std::setprecision(1) << busy_pct << " %\n";
+    }
+    s << "frequency transitions: " << p->transitions() << '\n';
+    if (!short_output) {
+        s << "f/MHz %:";
+        for (std::size_t i=shm_seg::FREQ_ENTRIES; i-- > 0; ) {
+            double ti=p->begin()[i];
+            if (ti==0.0)
+                continue;
+            s << "  " << std::setprecision(0)
+              << cpufreq_stats::shm_seg::idx_to_freq(i)*1e-3 << ' '
+              << std::setprecision(2) << (ti*1e2)/sum_ti;
+        }
+        s << '\n';
+    }
+    if (p->rapl() != shm_seg::no_rapl) {
+        s << "rapl package " << p->rapl() << ": energy "
+          << std::setprecision(1) << p->joule() << " J, last power "
+          << p->last_power() << " W\n";
+    }
+}
+
+std::vector<std::string>
+topo_stats::data::names()
+    const
+{
+    std::vector<std::string> r;
+    for (const auto* p : _v)
+        r.push_back(shm_seg::name(p->knd(), p->id()));
+    return r;
+}
+
+void
+topo_stats::data::to_stream(std::ostream& s, bool short_output)
+{
+    for (std::size_t i=0; i<_v.size(); ++i) {
+        // the short output omits the cores
+        if (short_output && _v[i]->knd()==CORE)
+            continue;
+        to_stream(s, _v[i], short_output);
+    }
+}
+
+void
+topo_stats::data::
+to_stream(std::ostream& s, const cpu_stats::mark& m, bool short_output)
+{
+    for (std::size_t i=0; i<_v.size(); ++i) {
+        const shm_seg* p=_v[i];
+        if (short_output && p->knd()==CORE)
+            continue;
+        std::string n=shm_seg::name(p->knd(), p->id());
+        const void* pm=m.find(n, sizeof(shm_seg));
+        if (pm==nullptr)
+            continue;
+        alignas(shm_seg) char b[sizeof(shm_seg)];
+        m.read_live(b, p, sizeof(shm_seg));
+        shm_seg* d=reinterpret_cast<shm_seg*>(b);
+        (*d) -= *static_cast<const shm_seg*>(pm);
+        to_stream(s, d, short_output);
+    }
+}
+
+void
+topo_stats::data::to_writer(cpu_stats::writer& w, const shm_seg* p)
+{
+    double f_khz[shm_seg::FREQ_ENTRIES];
+    std::uint64_t samples=0;
+    double avg=0.0, busy_sum=0.0, busy_avg=0.0;
+    for (std::size_t i=0; i<shm_seg::FREQ_ENTRIES; ++i) {
+        f_khz[i]=cpufreq_stats::shm_seg::idx_to_freq(i);
+        samples += p->begin()[i];
+        avg += p->begin()[i]*f_khz[i];
+        busy_sum += p->busy_begin()[i];
+        busy_avg += p->busy_begin()[i]*f_khz[i];
+    }
+    const location& l=p->loc();
+    w.begin("topology", std::string(kind_name(p->knd())) + '_' +
+            std::to_string(p->id()));
+    w.value("group", kind_name(p->knd()));
+    w.value("pkg", l._pkg);
+    w.value("die", l._die);
+    w.value("core", l._core);
+    w.value("node", l._node);
+    w.value("capacity", l._capacity);
+    w.value("cpus", p->cpus());
+    w.value("last_f_khz", p->last_f_khz());
+    w.value("samples", samples);
+    w.value("avg_f_khz", samples ? avg/samples : 0.0);
+    w.value("busy_avg_f_khz", busy_sum > 0.0 ? busy_avg/busy_sum : 0.0);
+    w.value("busy_pct", samples ?
+            (busy_sum*1e2)/(samples*cpufreq_stats::shm_seg::busy_scale) :
+            0.0);
+    w.value("transitions", p->transitions());
+    if (p->rapl() != shm_seg::no_rapl) {
+        w.value("rapl_pkg", p->rapl());
+        w.value("joule", p->joule());
+        w.value("last_power_w", p->last_power());
+    }
+    w.values("f_khz", f_khz, shm_seg::FREQ_ENTRIES);
+    w.values("entries", p->begin(), shm_seg::FREQ_ENTRIES);
+    w.values("busy_entries", p->busy_begin(), shm_seg::FREQ_ENTRIES);
+    w.end();
+}
+
+void
+topo_stats::data::to_writer(cpu_stats::writer& w)
+{
+    for (std::size_t i=0; i<_v.size(); ++i)
+        to_writer(w, _v[i]);
+}
+
+void
+topo_stats::data::
+to_writer(cpu_stats::writer& w, const cpu_stats::mark& m)
+{
+    for (std::size_t i=0; i<_v.size(); ++i) {
+        const shm_seg* p=_v[i];
+        std::string n=shm_seg::name(p->knd(), p->id());
+        const void* pm=m.find(n, sizeof(shm_seg));
+        if (pm==nullptr)
+            continue;
+        alignas(shm_seg) char b[sizeof(shm_seg)];
+        m.read_live(b, p, sizeof(shm_seg));
+        shm_seg* d=reinterpret_cast<shm_seg*>(b);
+        (*d) -= *static_cast<const shm_seg*>(pm);
+        to_writer(w, d);
+    }
+}
@@ -0,0 +1,107 @@
+//
+//  Copyright (C) 2020-2026  Axel Zeuner
+//
+//  This program is free software; you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation; either version 2 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program; if not, write to the Free Software
+//  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+//
+#include "topo_stats.h"
+#include "tools.h"
+#include <sstream>
+#include <iomanip>
+
+const char* const topo_stats::shm_seg::prefix="/cpu_stats_o_";
+
+const char*
+topo_stats::kind_name(kind k)
+{
+    static const char* const names[KINDS]={
+        "sys", "pkg", "die", "node", "type", "core"
+    };
+    return k < KINDS ? names[k] : "unknown";
+}
+
+std::string
+topo_stats::shm_seg::name(kind k, std::uint32_t id)
+{
+    std::ostringstream s;
+    s << prefix << kind_name(k) << '_'
+      << std::setw(5) << std::setfill('0') << id;
+    return s.str();
+}
+
+topo_stats::shm_seg::shm_seg(kind k, std::uint32_t id, const location& l,
+                             std::uint32_t cpus, std::uint32_t rapl)
+    : _kind(k),
+      _id(id),
+      _loc(l),
+      _cpus(cpus),
+      _rapl(rapl),
+      _last_f_khz(0.0),
+      _joule(0.0),
+      _last_power(0.0),
+      _transitions(0),
+      _entries{0},
+      _busy_entries{0}
+{
+}
+
+topo_stats::shm_seg::~shm_seg()
+{
+    std::string fn=name(_kind, _id);
+    tools::shm::unlink(fn);
+}
+
+topo_stats::shm_seg*
+topo_stats::shm_seg::create(kind k, std::uint32_t id, const location& l,
+                            std::uint32_t cpus, std::uint32_t rapl)
+{
+    std::string fn=name(k, id);
+    void* addr=tools::shm::create(fn, sizeof(shm_seg), 0644);
+    shm_seg* ret=new (addr) shm_seg(k, id, l, cpus, rapl);
+    return ret;
+}
+
+void
+topo_stats::shm_seg::close(shm_seg* p)
+{
+    p->~shm_seg();
+    tools::shm::unmap(p, sizeof(shm_seg));
+}
+
+const topo_stats::shm_seg*
+topo_stats::shm_seg::open(const std::string& n)
+{
+    void* addr=tools::shm::open_ro(n, sizeof(shm_seg));
+    const shm_seg* ret=reinterpret_cast<const shm_seg*>(addr);
+    return ret;
+}
+
+void
+topo_stats::shm_seg::close(const shm_seg* p)
+{
+    void* ap=const_cast<shm_seg*>(p);
+    tools::shm::unmap(ap, sizeof(shm_seg));
+}
+
+topo_stats::shm_seg&
+topo_stats::shm_seg::operator-=(const shm_seg& r)
+{
+    for (std::size_t i=0; i<FREQ_ENTRIES; ++i) {
+        _entries[i] -= r._entries[i];
+        _busy_entries[i] -= r._busy_entries[i];
+    }
+    _transitions -= r._transitions;
+    _joule -= r._joule;
+    return *this;
+}
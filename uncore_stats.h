@@ -0,0 +1,347 @@
+//
+//  Copyright (C) 2020-2026  Axel Zeuner
+//
+//  This program is free software; you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation; either version 2 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program; if not, write to the Free Software
+//  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+//
+#if !defined (__UNCORE_STATS_H__)
+#define __UNCORE_STATS_H__ 1
+
+#include <tools.h>
+#include <cstdint>
+#include <vector>
+#include <string>
+#include <iosfwd>
+
+namespace cpu_stats {
+    class mark;
+    class writer;
+    class selection;
+}
+
+// frequencies of the uncore or fabric clock domains
+namespace uncore_stats {
+
+    // a clock domain
+    struct domain {
+        // _cluster of the domains without fabric clusters
+        static
+        constexpr const std::uint32_t no_cluster=~std::uint32_t(0);
+        // description like intel uncore
+        std::string _name;
+        // package and die of the domain
+        std::uint32_t _pkg;
+        std::uint32_t _die;
+        // fabric cluster of the die or no_cluster
+        std::uint32_t _cluster;
+        // file with the current frequency in kHz
+        std::string _freq_file;
+        // limits in kHz
+        double _min_f_khz;
+        double _max_f_khz;
+    };
+
+    // source of clock domains, new sources like amd fabric clocks
+    // are added to sources
+    struct source {
+        const char* _name;
+        std::vector<domain> (*_discover)();
+    };
+
+    // intel_uncore_frequency driver
+    std::vector<domain>
+    intel_uncore();
+
+    // amd fabric clock, empty until a kernel interface exists
+    std::vector<domain>
+    amd_fabric();
+
+    // all sources
+    extern const source sources[];
+    extern const std::size_t source_count;
+
+    // shared memory segment between server and client, one per
+    // domain
+    class shm_seg {
+        shm_seg(std::uint32_t id, const domain& d);
+        ~shm_seg();
+        // frequency step of 100 MHz/XXX khz
+        static
+        constexpr const double freq_step=100000;
+        static
+        constexpr const double inv_freq_step=1.0/freq_step;
+        // maximum frequency = 7GHz for now
+        static
+        constexpr const double max_freq=7000000;
+    public:
+        enum {
+            FREQ_ENTRIES=uint32_t(max_freq/freq_step)+1
+        };
+    private:
+        // number of the domain
+        std::uint32_t _id;
+        // package, die and fabric cluster
+        std::uint32_t _pkg;
+        std::uint32_t _die;
+        std::uint32_t _cluster;
+        char _name[32];
+        // min frequency
+        double _min_f_khz;
+        // max frequency
+        double _max_f_khz;
+        // last measured frequency
+        double _last_f_khz;
+        // array with ticks/freq range, _entries[0] 0*freq_step,
+        // _entries[1] 1*freq_step, ..
+        std::uint32_t _entries[FREQ_ENTRIES];
+        // number of changes between frequency ranges
+        std::uint64_t _transitions;
+    public:
+        static
+        const char* const prefix;
+
+        static
+        std::string name(std::uint32_t id);
+
+        static
+        shm_seg*
+        create(std::uint32_t id, const domain& d);
+
+        static
+        void
+        close(shm_seg* p);
+
+        static
+        const shm_seg*
+        open(std::uint32_t id);
+
+        static
+        void
+        close(const shm_seg* p);
+
+        static
+        std::size_t
+        freq_to_idx(double f);
+
+        static
+        double
+        idx_to_freq(std::uint32_t f);
+
+        // subtract the entries of r, used for the differences
+        // to a mark
+        shm_seg& operator-=(const shm_seg& r);
+
+        const std::uint32_t& id() const;
+        const std::uint32_t& pkg() const;
+        const std::uint32_t& die() const;
+        const std::uint32_t& cluster() const;
+        const char* domain_name() const;
+        const double& min_f_khz() const;
+        const double& max_f_khz() const;
+        shm_seg& last_f_khz(const double& f);
+        const double& last_f_khz() const;
+        std::uint32_t* begin();
+        std::uint32_t* end();
+        const std::uint32_t* begin() const;
+        const std::uint32_t* end() const;
+        shm_seg& transitions(const std::uint64_t& n);
+        const std::uint64_t& transitions() const;
+    };
+
+    class data {
+        std::vector<const shm_seg*> _v;
+        struct priv_data {
+            tools::sys_fs::value_file _f;
+            // frequency range of the last sample, ~0 before the
+            // first one
+            std::size_t _last_idx;
+            // frequency read by sample()
+            std::uint64_t _s_f;
+            bool _s_ok;
+        };
+        std::vector<priv_data> _vp;
+        bool _create;
+
+        static
+        void
+        to_stream(std::ostream& s, const shm_seg* p, bool short_output);
+        void
+        close();
+        static
+        void
+        to_writer(cpu_stats::writer& w, const shm_seg* p);
+    public:
+        // the client opens the domains of the packages in sel or
+        // all if sel is nullptr
+        data(bool create, const cpu_stats::selection* sel=nullptr);
+        ~data();
+        data(const data&) = delete;
+        data&
+        operator=(const data& r) = delete;
+        // the segments sorted by package, die and cluster
+        const std::vector<const shm_seg*>&
+        segments() const;
+        // the names of the segments
+        std::vector<std::string>
+        names() const;
+        // read the frequencies of all domains, called before update
+        // outside of the update of the segments
+        void
+        sample();
+        // update _v from the last sample
+        void
+        update(std::uint32_t weight);
+        // dump the data
+        void
+        to_stream(std::ostream& s, bool short_output=false);
+        // dump the differences to the data saved in mark m
+        void
+        to_stream(std::ostream& s, const cpu_stats::mark& m,
+                  bool short_output=false);
+        // write the data to w
+        void
+        to_writer(cpu_stats::writer& w);
+        // write the differences to the data saved in mark m to w
+        void
+        to_writer(cpu_stats::writer& w, const cpu_stats::mark& m);
+    };
+}
+
+inline
+const std::uint32_t&
+uncore_stats::shm_seg::id()
+    const
+{
+    return _id;
+}
+
+inline
+const std::uint32_t&
+uncore_stats::shm_seg::pkg()
+    const
+{
+    return _pkg;
+}
+
+inline
+const std::uint32_t&
+uncore_stats::shm_seg::die()
+    const
+{
+    return _die;
+}
+
+inline
+const std::uint32_t&
+uncore_stats::shm_seg::cluster()
+    const
+{
+    return _cluster;
+}
+
+inline
+const char*
+uncore_stats::shm_seg::domain_name()
+    const
+{
+    return _name;
+}
+
+inline
+const double&
+uncore_stats::shm_seg::min_f_khz()
+    const
+{
+    return _min_f_khz;
+}
+
+inline
+const double&
+uncore_stats::shm_seg::max_f_khz()
+    const
+{
+    return _max_f_khz;
+}
+
+inline
+uncore_stats::shm_seg&
+uncore_stats::shm_seg::last_f_khz(const double& f)
+{
+    _last_f_khz=f;
+    return *this;
+}
+
+inline
+const double&
+uncore_stats::shm_seg::last_f_khz()
+    const
+{
+    return _last_f_khz;
+}
+
+inline
+std::uint32_t*
+uncore_stats::shm_seg::begin()
+{
+    return _entries;
+}
+
+inline
+std::uint32_t*
+uncore_stats::shm_seg::end()
+{
+    return _entries+FREQ_ENTRIES;
+}
+
+inline
+const std::uint32_t*
+uncore_stats::shm_seg::begin()
+    const
+{
+    return _entries;
+}
+
+inline
+const std::uint32_t*
+uncore_stats::shm_seg::end()
+    const
+{
+    return _entries+FREQ_ENTRIES;
+}
+
+inline
+uncore_stats::shm_seg&
+uncore_stats::shm_seg::transitions(const std::uint64_t& n)
+{
+    _transitions=n;
+    return *this;
+}
+
+inline
+const std::uint64_t&
+uncore_stats::shm_seg::transitions()
+    const
+{
+    return _transitions;
+}
+
+inline
+const std::vector<const uncore_stats::shm_seg*>&
+uncore_stats::data::segments()
+    const
+{
+    return _v;
+}
+
+#endif
@@ -0,0 +1,337 @@
+//
+//  Copyright (C) 2020-2026  Axel Zeuner
+//
+//  This program is free software; you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation; either version 2 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program; if not, write to the Free Software
+//  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+//
+#include "uncore_stats.h"
+#include "cpu-stats.h"
+#include <iostream>
+#include <iomanip>
+#include <cmath>
+#include <algorithm>
+#include <numeric>
+#include <cstring>
+#include <cstdlib>
+
+uncore_stats::data::data(bool create, const cpu_stats::selection* sel)
+    : _v(),
+      _vp(),
+      _create(create)
+{
+    try {
+        if (_create) {
+            std::vector<domain> vd;
+            for (std::size_t i=0; i<source_count; ++i) {
+                std::vector<domain> vi=sources[i]._discover();
+                vd.insert(vd.end(), vi.begin(), vi.end());
+            }
+            std::stable_sort(vd.begin(), vd.end(),
+                             [](const domain& a, const domain& b) {
+                                 if (a._pkg != b._pkg)
+                                     return a._pkg < b._pkg;
+                                 if (a._die != b._die)
+                                     return a._die < b._die;
+                                 return a._cluster < b._cluster;
+                             });
+            for (const auto& d : vd) {
+                tools::sys_fs::value_file vf(d._freq_file);
+                if (!vf.valid())
+                    continue;
+                std::uint32_t id=_v.size();
+                _v.push_back(shm_seg::create(id, d));
+                _vp.push_back(priv_data{std::move(vf), ~std::size_t(0),
+                                        0, false});
+            }
+        } else {
+            std::string pf(shm_seg::prefix);
+            for (const auto& n : cpu_stats::segments(pf)) {
+                std::uint32_t id=std::strtoul(n.c_str()+pf.size(),
+                                              nullptr, 10);
+                const shm_seg* p;
+                try {
+                    p=shm_seg::open(id);
+                }
+                catch (const std::runtime_error& e) {
+                    // listed in the index but not accessible, i.e. not
+                    // bound into a container
+                    continue;
+                }
+                // the package is only known from the segment
+                if (sel != nullptr && !sel->pkg(p->pkg())) {
+                    shm_seg::close(p);
+                    continue;
+                }
+                _v.push_back(p);
+            }
+        }
+    }
+    catch (const std::runtime_error& e) {
+        close();
+        throw;
+    }
+}
+
+void
+uncore_stats::data::close()
+{
+    if (_create==true) {
+        for (std::size_t i=0; i<_v.size(); ++i) {
+            shm_seg* p=const_cast<shm_seg*>(_v[i]);
+            shm_seg::close(p);
+        }
+    } else {
+        for (std::size_t i=0; i<_v.size(); ++i) {
+            shm_seg::close(_v[i]);
+        }
+    }
+    _v.clear();
+}
+
+uncore_stats::data::~data()
+{
+    close();
+}
+
+void
+uncore_stats::data::sample()
+{
+    if (_create == false)
+        return;
+    for (std::size_t i=0; i<_v.size(); ++i) {
+        priv_data& pd=_vp[i];
+        pd._s_ok=pd._f.read(pd._s_f);
+    }
+}
+
+void
+uncore_stats::data::update(std::uint32_t weight)
+{
+    if (_create == false)
+        return;
+    for (std::size_t i=0; i<_v.size(); ++i) {
+        shm_seg* p=const_cast<shm_seg*>(_v[i]);
+        priv_data& pd=_vp[i];
+        if (pd._s_ok==false)
+            continue;
+        pd._s_ok=false;
+        double cur_f=double(pd._s_f);
+        size_t idx=shm_seg::freq_to_idx(cur_f);
+        std::uint32_t* pi=p->begin() + idx;
+        (*pi)+=weight;
+        p->last_f_khz(cur_f);
+        if (pd._last_idx != ~std::size_t(0) && idx != pd._last_idx)
+            p->transitions(p->transitions()+1);
+        pd._last_idx=idx;
+    }
+}
+
+void
+uncore_stats::data::
+to_stream(std::ostream& s, const shm_seg* p, bool short_output)
+{
+    std::uint32_t vt[shm_seg::FREQ_ENTRIES];
+    double min_f=p->min_f_khz();
+    double max_f=p->max_f_khz();
+    double last_f=p->last_f_khz();
+    std::copy(p->begin(), p->end(), std::begin(vt));
+
+    // determine entries != 0
+    std::size_t cnt=0;
+    std::size_t vidx[shm_seg::FREQ_ENTRIES];
+    double vpct[shm_seg::FREQ_ENTRIES];
+    std::size_t idx_max=0;
+    std::uint32_t max_ti=0;
+    double sum_ti=0.0;
+    for (std::size_t i=0; i<shm_seg::FREQ_ENTRIES; ++i) {
+        std::uint32_t ti=vt[i];
+        if (vt[i]==0)
+            continue;
+        vidx[cnt]=i;
+        double dti=double(ti);
+        sum_ti += dti;
+        vpct[cnt]=dti;
+        if (ti > max_ti) {
+            idx_max = cnt;
+            max_ti = ti;
+        }
+        ++cnt;
+    }
+    // produce percents from the ticks in vpct
+    double sum_pct=0.0;
+    for (std::size_t i=0; i<cnt; ++i) {
+        double pcti=(vpct[i]*1e2)/sum_ti;
+        pcti=std::rint(1e2*pcti)*1e-2;
+        if (i != idx_max)
+            sum_pct += pcti;
+        vpct[i]=pcti;
+    }
+    if (cnt)
+        vpct[idx_max] = 100.0 - sum_pct;
+    double vspct[shm_seg::FREQ_ENTRIES];
+    std::partial_sum(std::begin(vpct), std::begin(vpct)+cnt,
+                     std::begin(vspct));
+    std::reverse(std::begin(vidx), std::begin(vidx)+cnt);
+    std::reverse(std::begin(vpct), std::begin(vpct)+cnt);
+    std::reverse(std::begin(vspct), std::begin(vspct)+cnt);
+
+    const std::uint32_t cols=3;
+    for (std::uint32_t i=0; i<cols; ++i)
+        s << "========================";
+    s << '\n';
+    s << std::fixed << std::setprecision(0);
+    s << p->domain_name() << " package " << p->pkg() << " die " << p->die();
+    if (p->cluster() != domain::no_cluster)
+        s << " cluster " << p->cluster();
+    s << ", f_min=" << min_f*1e-3
+      << ", f_max=" << max_f*1e-3
+      << ", samples=" << std::scientific << std::setprecision(22) << sum_ti
+      << std::fixed << '\n';
+    if (!short_output) {
+        for (std::uint32_t i=0; i<cols; ++i) {
+            if (i)
+                s << " | ";
+            s << "f/MHz       %   sum % ";
+        }
+        s << '\n';
+    }
+    std::uint32_t lines=(cnt+cols-1)/cols;
+    double sum=0.0, avg=0.0;
+    for (std::uint32_t j=0; j<lines; ++j) {
+        for (std::uint32_t i=0; i<cols; ++i) {
+            std::size_t k=j+lines*i;
+            if (k >= cnt)
+                continue;
+            std::size_t idx = vidx[k];
+            double fi=shm_seg::idx_to_freq(idx);
+            fi /= 1000;
+            double pcti=vpct[k];
+            double spcti=vspct[k];
+            if (!short_output) {
+                if (i)
+                    s << "  | ";
+                s << std::setw(5) << std::setprecision(0) << fi << ' '
+                << std::setw(7) << std::setprecision(2) << pcti << ' '
+                << std::setw(7) << std::setprecision(2) << spcti;
+            }
+            sum +=pcti;
+            avg +=pcti*fi;
+        }
+        if (!short_output)
+            s << '\n';
+    }
+    avg *= 1e-2;
+    s << "average frequency: ~" << std::setprecision(0) << avg << " MHz, "
+      << "last measured frequency: ~" << last_f*1e-3 << " MHz\n";
+    std::uint64_t trans=p->transitions();
+    double avg_run=sum_ti/double(trans+1);
+    s << "frequency transitions: " << trans
+      << ", average dwell: ~" << std::setprecision(1) << avg_run
+      << " samples\n";
+    if (cnt && std::fabs(sum-100) > 0.005) {
+        s << "invalid sum " << sum << std::endl;
+    }
+}
+
+std::vector<std::string>
+uncore_stats::data::names()
+    const
+{
+    std::vector<std::string> r;
+    for (const auto* p : _v)
+        r.push_back(shm_seg::name(p->id()));
+    return r;
+}
+
+void
+uncore_stats::data::to_stream(std::ostream& s, bool short_output)
+{
+    for (std::size_t i=0; i<_v.size(); ++i) {
+        to_stream(s, _v[i], short_output);
+    }
+}
+
+void
+uncore_stats::data::
+to_stream(std::ostream& s, const cpu_stats::mark& m, bool short_output)
+{
+    for (std::size_t i=0; i<_v.size(); ++i) {
+        const shm_seg* p=_v[i];
+        std::string n=shm_seg::name(p->id());
+        const void* pm=m.find(n, sizeof(shm_seg));
+        if (pm==nullptr)
+            continue;
+        alignas(shm_seg) char b[sizeof(shm_seg)];
+        m.read_live(b, p, sizeof(shm_seg));
+        shm_seg* d=reinterpret_cast<shm_seg*>(b);
+        (*d) -= *static_cast<const shm_seg*>(pm);
+        // nothing happened since the mark
+        if (std::all_of(d->begin(), d->end(),
+                        [](std::uint32_t v) { return v==0; }))
+            continue;
+        to_stream(s, d, short_output);
+    }
+}
+
+void
+uncore_stats::data::to_writer(cpu_stats::writer& w, const shm_seg* p)
+{
+    double f_khz[shm_seg::FREQ_ENTRIES];
+    std::uint64_t samples=0;
+    double avg=0.0;
+    for (std::size_t i=0; i<shm_seg::FREQ_ENTRIES; ++i) {
+        f_khz[i]=shm_seg::idx_to_freq(i);
+        samples += p->begin()[i];
+        avg += p->begin()[i]*f_khz[i];
+    }
+    w.begin("uncore", p->domain_name());
+    w.value("pkg", p->pkg());
+    w.value("die", p->die());
+    if (p->cluster() != domain::no_cluster)
+        w.value("cluster", p->cluster());
+    w.value("min_f_khz", p->min_f_khz());
+    w.value("max_f_khz", p->max_f_khz());
+    w.value("last_f_khz", p->last_f_khz());
+    w.value("samples", samples);
+    w.value("avg_f_khz", samples ? avg/samples : 0.0);
+    w.value("transitions", p->transitions());
+    w.values("f_khz", f_khz, shm_seg::FREQ_ENTRIES);
+    w.values("entries", p->begin(), shm_seg::FREQ_ENTRIES);
+    w.end();
+}
+
+void
+uncore_stats::data::to_writer(cpu_stats::writer& w)
+{
+    for (std::size_t i=0; i<_v.size(); ++i)
+        to_writer(w, _v[i]);
+}
+
+void
+uncore_stats::data::
+to_writer(cpu_stats::writer& w, const cpu_stats::mark& m)
+{
+    for (std::size_t i=0; i<_v.size(); ++i) {
+        const shm_seg* p=_v[i];
+        std::string n=shm_seg::name(p->id());
+        const void* pm=m.find(n, sizeof(shm_seg));
+        if (pm==nullptr)
+            continue;
+        alignas(shm_seg) char b[sizeof(shm_seg)];
+        m.read_live(b, p, sizeof(shm_seg));
+        shm_seg* d=reinterpret_cast<shm_seg*>(b);
+        (*d) -= *static_cast<const shm_seg*>(pm);
+        to_writer(w, d);
+    }
+}
@@ -0,0 +1,98 @@
+//
+//  Copyright (C) 2020-2026  Axel Zeuner
+//
+//  This program is free software; you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation; either version 2 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program; if not, write to the Free Software
+//  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+//
+#include "uncore_stats.h"
+#include <algorithm>
+#include <cstdio>
+#include <dirent.h>
+
+constexpr const std::uint32_t uncore_stats::domain::no_cluster;
+
+const uncore_stats::source uncore_stats::sources[]={
+    {"intel uncore", intel_uncore},
+    {"amd fabric", amd_fabric}
+};
+
+const std::size_t uncore_stats::source_count=
+    sizeof(sources)/sizeof(sources[0]);
+
+std::vector<uncore_stats::domain>
+uncore_stats::intel_uncore()
+{
+    std::vector<domain> r;
+    const std::string base="/sys/devices/system/cpu/intel_uncore_frequency/";
+    DIR* d=opendir(base.c_str());
+    if (d==nullptr)
+        return r;
+    std::vector<std::string> vn;
+    const struct dirent* e;
+    while ((e=readdir(d))!=nullptr) {
+        if (e->d_name[0] != '.')
+            vn.emplace_back(e->d_name);
+    }
+    closedir(d);
+    std::sort(vn.begin(), vn.end());
+    // the tpmi based driver provides the legacy package_XX_die_YY
+    // directories besides the uncoreNN directories, they cover the
+    // same hardware
+    bool tpmi=std::any_of(vn.begin(), vn.end(),
+                          [](const std::string& n) {
+                              return n.compare(0, 6, "uncore")==0;
+                          });
+    for (const auto& n : vn) {
+        std::string p=base + n + '/';
+        domain dm;
+        dm._name="intel uncore";
+        dm._freq_file=p + "current_freq_khz";
+        if (!tools::file::exists(dm._freq_file))
+            continue;
+        unsigned pkg, die;
+        if (std::sscanf(n.c_str(), "package_%u_die_%u", &pkg, &die)==2) {
+            // older kernels
+            if (tpmi)
+                continue;
+            dm._pkg=pkg;
+            dm._die=die;
+            dm._cluster=domain::no_cluster;
+        } else if (tools::file::exists(p + "package_id")) {
+            // uncoreNN directories of the tpmi based driver, a power
+            // domain may contain several fabric clusters
+            dm._pkg=tools::sys_fs::read<std::uint32_t>::from(p + "package_id");
+            dm._die=tools::sys_fs::read<std::uint32_t>::from(p + "domain_id");
+            std::string fc=p + "fabric_cluster_id";
+            dm._cluster=tools::file::exists(fc) ?
+                tools::sys_fs::read<std::uint32_t>::from(fc) :
+                domain::no_cluster;
+        } else {
+            continue;
+        }
+        dm._min_f_khz=
+            tools::sys_fs::read<double>::from(p + "initial_min_freq_khz");
+        dm._max_f_khz=
+            tools::sys_fs::read<double>::from(p + "initial_max_freq_khz");
+        r.push_back(dm);
+    }
+    return r;
+}
+
+std::vector<uncore_stats::domain>
+uncore_stats::amd_fabric()
+{
+    // the mainline kernel does not export the fabric clock of amd
+    // cpus yet
+    return std::vector<domain>();
+}
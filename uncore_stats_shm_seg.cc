@@ -0,0 +1,115 @@
+//
+//  Copyright (C) 2020-2026  Axel Zeuner
+//
+//  This program is free software; you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation; either version 2 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program; if not, write to the Free Software
+//  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+//
+#include "uncore_stats.h"
+#include "tools.h"
+#include <sstream>
+#include <iomanip>
+#include <cmath>
+#include <cstring>
+#include <algorithm>
+
+constexpr const double uncore_stats::shm_seg::freq_step;
+constexpr const double uncore_stats::shm_seg::inv_freq_step;
+constexpr const double uncore_stats::shm_seg::max_freq;
+
+const char* const uncore_stats::shm_seg::prefix="/cpu_stats_u_dom_";
+
+std::string
+uncore_stats::shm_seg::name(std::uint32_t id)
+{
+    std::ostringstream s;
+    s << prefix << std::setw(3) << std::setfill('0') << id;
+    return s.str();
+}
+
+uncore_stats::shm_seg::shm_seg(std::uint32_t id, const domain& d)
+    : _id(id),
+      _pkg(d._pkg),
+      _die(d._die),
+      _cluster(d._cluster),
+      _name{0},
+      _min_f_khz(d._min_f_khz),
+      _max_f_khz(d._max_f_khz),
+      _last_f_khz(0.0),
+      _entries{0},
+      _transitions(0)
+{
+    std::strncpy(_name, d._name.c_str(), sizeof(_name)-1);
+}
+
+uncore_stats::shm_seg::~shm_seg()
+{
+    std::string fn=name(_id);
+    tools::shm::unlink(fn);
+}
+
+uncore_stats::shm_seg*
+uncore_stats::shm_seg::create(std::uint32_t id, const domain& d)
+{
+    std::string fn=name(id);
+    void* addr=tools::shm::create(fn, sizeof(shm_seg), 0644);
+    shm_seg* ret=new (addr) shm_seg(id, d);
+    return ret;
+}
+
+void
+uncore_stats::shm_seg::close(shm_seg* p)
+{
+    p->~shm_seg();
+    tools::shm::unmap(p, sizeof(shm_seg));
+}
+
+const uncore_stats::shm_seg*
+uncore_stats::shm_seg::open(std::uint32_t id)
+{
+    std::string fn=name(id);
+    void* addr=tools::shm::open_ro(fn, sizeof(shm_seg));
+    const shm_seg* ret=reinterpret_cast<const shm_seg*>(addr);
+    return ret;
+}
+
+void
+uncore_stats::shm_seg::close(const shm_seg* p)
+{
+    void* ap=const_cast<shm_seg*>(p);
+    tools::shm::unmap(ap, sizeof(shm_seg));
+}
+
+std::size_t
+uncore_stats::shm_seg::freq_to_idx(double f)
+{
+    double f0=std::rint(f*inv_freq_step);
+    auto i=static_cast<std::size_t>(f0);
+    i = std::min(i, std::size_t(FREQ_ENTRIES)-1);
+    return i;
+}
+
+double
+uncore_stats::shm_seg::idx_to_freq(std::uint32_t i)
+{
+    return i * freq_step;
+}
+
+uncore_stats::shm_seg&
+uncore_stats::shm_seg::operator-=(const shm_seg& r)
+{
+    for (std::size_t i=0; i<FREQ_ENTRIES; ++i)
+        _entries[i] -= r._entries[i];
+    _transitions -= r._transitions;
+    return *this;
+}